@@ -23,6 +23,8 @@
 
 namespace sfz {
 
+class ArenaAllocator;
+
 // sfzCore Context struct
 // ------------------------------------------------------------------------------------------------
 
@@ -47,6 +49,12 @@ struct Context final {
 	/// The current logger used by sfzCore. See `sfz/logging/Logging.hpp` for the logging macros
 	/// use this logger.
 	LoggingInterface* logger = nullptr;
+
+	/// The number of bytes of virtual memory reserved for each thread's scratch arena, see
+	/// getScratchArena(). Physical memory is only committed when actually used. On platforms
+	/// without virtual memory support (Emscripten) this amount is allocated up front from the
+	/// default allocator instead, so it should be set to something smaller there.
+	uint64_t scratchArenaReserveBytes = uint64_t(64) * 1024 * 1024;
 };
 
 // Context getters/setters
@@ -78,6 +86,13 @@ inline LoggingInterface* getLogger() noexcept
 	return getContext()->logger;
 }
 
+/// Returns pointer to the calling thread's scratch arena. The arena is created the first time it
+/// is requested on a thread (with the size specified in the context) and is destroyed when the
+/// thread exits. It is intended for nested, stack-like temporary allocations, and should always
+/// be used through an ArenaScope (see sfz/memory/ArenaAllocator.hpp) so that memory is released
+/// when the temporary work is done. Pointers into it must never be shared with other threads.
+ArenaAllocator* getScratchArena() noexcept;
+
 // Standard context
 // ------------------------------------------------------------------------------------------------
 
@@ -0,0 +1,307 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#pragma once
+
+#include <cstdint>
+#include <mutex> // std::unique_lock
+#include <shared_mutex>
+#include <utility> // std::move, std::forward
+
+#include "sfz/containers/HashMap.hpp"
+
+namespace sfz {
+
+// ConcurrentHashMap
+// ------------------------------------------------------------------------------------------------
+
+/// A thread-safe HashMap which can be shared between multiple reader and writer threads.
+///
+/// The ConcurrentHashMap consists of a number of shards, each a normal HashMap protected by its
+/// own reader-writer lock (std::shared_mutex). The shard of a key is selected by the highest bits
+/// of its (Fibonacci mixed) hash, so operations on keys in different shards never contend with
+/// each other, and multiple readers of the same shard can proceed in parallel. Each shard is
+/// aligned to a cache line so that the locks of neighbouring shards are not falsely shared.
+///
+/// Pointers and references into a shard would be invalidated as soon as another thread inserts
+/// into (and rehashes) or removes from it, so the interface never exposes them. Values are
+/// instead returned by copy (getCopy()) or accessed through a callback which is invoked while the
+/// lock of the shard is held (get()). The callback must not access the ConcurrentHashMap itself,
+/// as that could deadlock.
+///
+/// size() and forEach() lock one shard at a time, so they don't give a consistent snapshot of
+/// the whole map if other threads are modifying it concurrently.
+///
+/// create() and destroy() are not thread-safe, they must not be called while other threads are
+/// accessing the map. All other methods are.
+///
+/// \param K the key type
+/// \param V the value type
+/// \param Descr the HashTableKeyDescriptor (by default sfz::HashTableKeyDescriptor)
+/// \param NUM_SHARDS_LOG2 the base 2 logarithm of the number of shards (by default 16 shards)
+template<typename K, typename V, typename Descr = HashTableKeyDescriptor<K>,
+	uint32_t NUM_SHARDS_LOG2 = 4>
+class ConcurrentHashMap final {
+public:
+	// Constants
+	// --------------------------------------------------------------------------------------------
+
+	static_assert(NUM_SHARDS_LOG2 >= 1 && NUM_SHARDS_LOG2 <= 10, "Unreasonable number of shards");
+	static constexpr uint32_t NUM_SHARDS = uint32_t(1) << NUM_SHARDS_LOG2;
+
+	// Typedefs
+	// --------------------------------------------------------------------------------------------
+
+	using MapT = HashMap<K, V, Descr>;
+	using KeyHash = typename MapT::KeyHash;
+	using KeyEqual = typename MapT::KeyEqual;
+	using AltK = typename MapT::AltK;
+	using AltKeyHash = typename MapT::AltKeyHash;
+	using AltKeyKeyEqual = typename MapT::AltKeyKeyEqual;
+
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	/// Creates an empty ConcurrentHashMap without setting an allocator or allocating any memory.
+	ConcurrentHashMap() noexcept = default;
+	ConcurrentHashMap(const ConcurrentHashMap&) = delete;
+	ConcurrentHashMap& operator= (const ConcurrentHashMap&) = delete;
+	ConcurrentHashMap(ConcurrentHashMap&&) = delete;
+	ConcurrentHashMap& operator= (ConcurrentHashMap&&) = delete;
+	~ConcurrentHashMap() noexcept = default;
+
+	/// Constructs a new ConcurrentHashMap using create()
+	explicit ConcurrentHashMap(
+		uint32_t suggestedCapacity, Allocator* allocator = getDefaultAllocator()) noexcept
+	{
+		this->create(suggestedCapacity, allocator);
+	}
+
+	// State methods
+	// --------------------------------------------------------------------------------------------
+
+	/// Creates all shards with the specified allocator. The suggested capacity is the total for
+	/// the whole map, it is divided evenly between the shards. Not thread-safe.
+	void create(uint32_t suggestedCapacity, Allocator* allocator = getDefaultAllocator()) noexcept
+	{
+		uint32_t shardCapacity = (suggestedCapacity + NUM_SHARDS - 1) / NUM_SHARDS;
+		for (Shard& shard : mShards) shard.map.create(shardCapacity, allocator);
+	}
+
+	/// Destroys all shards, see HashMap::destroy(). Not thread-safe.
+	void destroy() noexcept
+	{
+		for (Shard& shard : mShards) shard.map.destroy();
+	}
+
+	/// Removes all elements, one shard at a time. Does not deallocate any memory.
+	void clear() noexcept
+	{
+		for (Shard& shard : mShards) {
+			std::unique_lock<std::shared_mutex> lock(shard.mutex);
+			shard.map.clear();
+		}
+	}
+
+	// Getters
+	// --------------------------------------------------------------------------------------------
+
+	/// Returns the total number of elements in all shards. Only a snapshot, might be outdated
+	/// by the time it is returned if other threads are modifying the map.
+	uint32_t size() const noexcept
+	{
+		uint32_t total = 0;
+		for (const Shard& shard : mShards) {
+			std::shared_lock<std::shared_mutex> lock(shard.mutex);
+			total += shard.map.size();
+		}
+		return total;
+	}
+
+	/// Returns the allocator of the shards. Will return nullptr if no allocator is set.
+	Allocator* allocator() const noexcept { return mShards[0].map.allocator(); }
+
+	/// Copies the value associated with the given key to valueOut. Returns false (and leaves
+	/// valueOut untouched) if no such element exists. Only holds a shared lock, so it can run in
+	/// parallel with other readers of the same shard.
+	bool getCopy(const K& key, V& valueOut) const noexcept
+	{
+		return this->get(key, [&](const V& value) { valueOut = value; });
+	}
+	bool getCopy(const AltK& key, V& valueOut) const noexcept
+	{
+		return this->get(key, [&](const V& value) { valueOut = value; });
+	}
+
+	/// Invokes func (with a const reference to the value) if an element associated with the given
+	/// key exists, while the shared lock of its shard is held. Returns whether it was found. The
+	/// reference must not be retained after func returns.
+	template<typename Func>
+	bool get(const K& key, Func&& func) const noexcept
+	{
+		return this->getInternal<K, KeyEqual>(
+			key, uint64_t(KeyHash()(key)), std::forward<Func>(func));
+	}
+	template<typename Func>
+	bool get(const AltK& key, Func&& func) const noexcept
+	{
+		return this->getInternal<AltK, AltKeyKeyEqual>(
+			key, uint64_t(AltKeyHash()(key)), std::forward<Func>(func));
+	}
+
+	/// Invokes func with a const reference to every key and value, one shard at a time while its
+	/// shared lock is held.
+	template<typename Func>
+	void forEach(Func&& func) const noexcept
+	{
+		for (const Shard& shard : mShards) {
+			std::shared_lock<std::shared_mutex> lock(shard.mutex);
+			for (auto pair : shard.map) func(pair.key, pair.value);
+		}
+	}
+
+	// Public methods
+	// --------------------------------------------------------------------------------------------
+
+	/// Adds the specified key value pair, replacing the value if the key already exists. Holds
+	/// the exclusive lock of the key's shard, which might be rehashed.
+	void put(const K& key, const V& value) noexcept
+	{
+		this->putInternal<const K&, const V&, KeyEqual>(key, uint64_t(KeyHash()(key)), value);
+	}
+	void put(const K& key, V&& value) noexcept
+	{
+		this->putInternal<const K&, V, KeyEqual>(
+			key, uint64_t(KeyHash()(key)), std::move(value));
+	}
+	void put(K&& key, const V& value) noexcept
+	{
+		const uint64_t hash = uint64_t(KeyHash()(key));
+		this->putInternal<K, const V&, KeyEqual>(std::move(key), hash, value);
+	}
+	void put(K&& key, V&& value) noexcept
+	{
+		const uint64_t hash = uint64_t(KeyHash()(key));
+		this->putInternal<K, V, KeyEqual>(std::move(key), hash, std::move(value));
+	}
+	void put(const AltK& key, const V& value) noexcept
+	{
+		this->putInternal<const AltK&, const V&, AltKeyKeyEqual>(
+			key, uint64_t(AltKeyHash()(key)), value);
+	}
+	void put(const AltK& key, V&& value) noexcept
+	{
+		this->putInternal<const AltK&, V, AltKeyKeyEqual>(
+			key, uint64_t(AltKeyHash()(key)), std::move(value));
+	}
+
+	/// Constructs an element from the specified arguments if no element is associated with the
+	/// given key, otherwise leaves the existing one untouched (see HashMap::emplace()). Returns
+	/// whether an element was inserted. Since the check and the insertion happen under the same
+	/// lock this can be used to safely let exactly one of several racing threads insert a key.
+	template<typename... Args>
+	bool emplace(const K& key, Args&&... args) noexcept
+	{
+		const uint64_t hash = uint64_t(KeyHash()(key));
+		Shard& shard = this->shardOf(hash);
+		std::unique_lock<std::shared_mutex> lock(shard.mutex);
+		return shard.map.template emplaceInternal<const K&, KeyEqual>(
+			key, hash, std::forward<Args>(args)...).inserted;
+	}
+	template<typename... Args>
+	bool emplace(const AltK& key, Args&&... args) noexcept
+	{
+		const uint64_t hash = uint64_t(AltKeyHash()(key));
+		Shard& shard = this->shardOf(hash);
+		std::unique_lock<std::shared_mutex> lock(shard.mutex);
+		return shard.map.template emplaceInternal<const AltK&, AltKeyKeyEqual>(
+			key, hash, std::forward<Args>(args)...).inserted;
+	}
+
+	/// Attempts to remove the element associated with the given key. Returns false if no such
+	/// element exists. Holds the exclusive lock of the key's shard.
+	bool remove(const K& key) noexcept
+	{
+		return this->removeInternal<K, KeyEqual>(key, uint64_t(KeyHash()(key)));
+	}
+	bool remove(const AltK& key) noexcept
+	{
+		return this->removeInternal<AltK, AltKeyKeyEqual>(key, uint64_t(AltKeyHash()(key)));
+	}
+
+private:
+	// Private types
+	// --------------------------------------------------------------------------------------------
+
+	struct alignas(64) Shard final {
+		mutable std::shared_mutex mutex;
+		MapT map;
+	};
+
+	// Private methods
+	// --------------------------------------------------------------------------------------------
+
+	// Selects the shard using the highest bits of the Fibonacci mixed hash, the hash itself might
+	// have few significant high bits (e.g. std::hash of integers). The shard maps derive their
+	// control bytes from bits 25-31 of the same product. PowerOfTwoCapacityPolicy takes the slot
+	// index from bits 32 and up, so the shard bits only become part of it for shards with a
+	// capacity above 2^(32 - NUM_SHARDS_LOG2). PrimeCapacityPolicy uses hash modulo capacity.
+	static uint32_t shardIndex(uint64_t hash) noexcept
+	{
+		return uint32_t((hash * detail::HASH_TABLE_FIBONACCI_MULTIPLIER) >> (64 - NUM_SHARDS_LOG2));
+	}
+	Shard& shardOf(uint64_t hash) noexcept { return mShards[shardIndex(hash)]; }
+	const Shard& shardOf(uint64_t hash) const noexcept { return mShards[shardIndex(hash)]; }
+
+	// The internal methods pass the hash on to the shard map, so that each key is only hashed once
+
+	template<typename KT, typename Equal, typename Func>
+	bool getInternal(const KT& key, uint64_t hash, Func&& func) const noexcept
+	{
+		const Shard& shard = this->shardOf(hash);
+		std::shared_lock<std::shared_mutex> lock(shard.mutex);
+		const V* value = shard.map.template getInternal<KT, Equal>(key, hash);
+		if (value == nullptr) return false;
+		func(*value);
+		return true;
+	}
+
+	template<typename KT, typename VT, typename Equal>
+	void putInternal(KT&& key, uint64_t hash, VT&& value) noexcept
+	{
+		Shard& shard = this->shardOf(hash);
+		std::unique_lock<std::shared_mutex> lock(shard.mutex);
+		shard.map.template putInternal<KT, VT, Equal>(
+			std::forward<KT>(key), hash, std::forward<VT>(value));
+	}
+
+	template<typename KT, typename Equal>
+	bool removeInternal(const KT& key, uint64_t hash) noexcept
+	{
+		Shard& shard = this->shardOf(hash);
+		std::unique_lock<std::shared_mutex> lock(shard.mutex);
+		return shard.map.template removeInternal<KT, Equal>(key, hash);
+	}
+
+	// Private members
+	// --------------------------------------------------------------------------------------------
+
+	Shard mShards[NUM_SHARDS];
+};
+
+} // namespace sfz
@@ -20,6 +20,7 @@
 
 #include <cstdint>
 #include <new> // placement new
+#include <type_traits> // std::is_trivially_copyable, std::is_same
 #include <utility> // std::forward(), std::move(), std::swap()
 
 #include "sfz/Assert.hpp"
@@ -34,6 +35,7 @@ constexpr float DYNARRAY_GROW_RATE = 1.75;
 constexpr uint32_t DYNARRAY_DEFAULT_INITIAL_CAPACITY = 64;
 constexpr uint32_t DYNARRAY_MIN_CAPACITY = 2;
 constexpr uint32_t DYNARRAY_MAX_CAPACITY = uint32_t(UINT32_MAX / DYNARRAY_GROW_RATE) - 1;
+constexpr uint64_t DYNARRAY64_MAX_CAPACITY = uint64_t(1) << 48;
 
 // A class managing a dynamic array, somewhat like std::vector.
 //
@@ -47,9 +49,17 @@ constexpr uint32_t DYNARRAY_MAX_CAPACITY = uint32_t(UINT32_MAX / DYNARRAY_GROW_R
 // DynArray does not guarantee that a specific element will always occupy the same position in
 // memory. E.g., elements may be moved around when the array is modified. It is not safe to modify
 // the DynArray when iterating over it, as the iterators will not update on resize.
-template<typename T>
+//
+// Sizes, capacities and indices are stored as SizeT. The default uint32_t keeps the array compact
+// and is enough for almost all uses, DynArray64 (uint64_t) can hold more than 2^32 elements.
+template<typename T, typename SizeT = uint32_t>
 class DynArray final {
 public:
+	static_assert(std::is_same<SizeT, uint32_t>::value || std::is_same<SizeT, uint64_t>::value,
+		"DynArray only supports uint32_t and uint64_t sizes");
+	static constexpr SizeT MAX_CAPACITY = sizeof(SizeT) == sizeof(uint32_t) ?
+		SizeT(DYNARRAY_MAX_CAPACITY) : SizeT(DYNARRAY64_MAX_CAPACITY);
+
 	// Constructors & destructors
 	// --------------------------------------------------------------------------------------------
 
@@ -60,7 +70,7 @@ public:
 	DynArray& operator= (DynArray&& other) noexcept { this->swap(other); return *this; }
 	~DynArray() noexcept { this->destroy(); }
 
-	explicit DynArray(uint32_t capacity, Allocator* allocator, DbgInfo allocDbg) noexcept {
+	explicit DynArray(SizeT capacity, Allocator* allocator, DbgInfo allocDbg) noexcept {
 		this->init(capacity, allocator, allocDbg);
 	}
 
@@ -69,7 +79,7 @@ public:
 
 	// Initializes with specified parameters. Guaranteed to only set allocator and not allocate
 	// memory if a capacity of 0 is requested.
-	void init(uint32_t capacity, Allocator* allocator, DbgInfo allocDbg)
+	void init(SizeT capacity, Allocator* allocator, DbgInfo allocDbg)
 	{
 		this->destroy();
 		mAllocator = allocator;
@@ -92,13 +102,16 @@ public:
 	}
 
 	// Removes all elements without deallocating memory.
-	void clear() { for (uint32_t i = 0; i < mSize; i++) mData[i].~T(); mSize = 0; }
+	void clear() { for (SizeT i = 0; i < mSize; i++) mData[i].~T(); mSize = 0; }
 
 	// Destroys all elements, deallocates memory and removes allocator.
 	void destroy()
 	{
 		this->clear();
-		if (mData != nullptr) mAllocator->deallocate(mData);
+		if (mData != nullptr) {
+			mAllocator->deallocateSized(
+				mData, mCapacity * sizeof(T), alignof(T) < 32 ? 32 : alignof(T));
+		}
 		mCapacity = 0;
 		mData = nullptr;
 		mAllocator = nullptr;
@@ -106,24 +119,43 @@ public:
 
 	// Directly sets the size without touching or initializing any elements. Only safe if T is a
 	// trivial type and you know what you are doing, use at your own risk.
-	void hackSetSize(uint32_t size) { mSize = (size <= mCapacity) ? size : mCapacity; }
+	void hackSetSize(SizeT size) { mSize = (size <= mCapacity) ? size : mCapacity; }
 
 	// Sets the capacity, allocating memory and moving elements if necessary.
-	void setCapacity(uint32_t capacity, DbgInfo allocDbg = sfz_dbg("DynArray"))
+	void setCapacity(SizeT capacity, DbgInfo allocDbg = sfz_dbg("DynArray"))
 	{
 		if (mSize > capacity) capacity = mSize;
 		if (mCapacity == capacity) return;
 		if (capacity < DYNARRAY_MIN_CAPACITY) capacity = DYNARRAY_MIN_CAPACITY;
 		sfz_assert_hard(mAllocator != nullptr);
-		sfz_assert_hard(capacity < DYNARRAY_MAX_CAPACITY);
+		sfz_assert_hard(capacity < MAX_CAPACITY);
+
+		// Attempt to grow existing memory in place, which avoids moving any elements
+		if (mData != nullptr && capacity > mCapacity) {
+			if (mAllocator->tryExtendInPlace(mData, mCapacity * sizeof(T), capacity * sizeof(T))) {
+				mCapacity = capacity;
+				return;
+			}
+
+			// Trivially copyable elements can be moved by the allocator, which may be able to do
+			// it more efficiently (e.g. by remapping pages instead of copying).
+			if constexpr (std::is_trivially_copyable<T>::value) {
+				T* newAllocation = (T*)mAllocator->reallocate(allocDbg, mData, mCapacity * sizeof(T),
+					capacity * sizeof(T), alignof(T) < 32 ? 32 : alignof(T));
+				sfz_assert_hard(newAllocation != nullptr);
+				mData = newAllocation;
+				mCapacity = capacity;
+				return;
+			}
+		}
 
 		// Allocate memory and move/copy over elements from old memory
 		T* newAllocation = capacity == 0 ? nullptr : (T*)mAllocator->allocate(
 			allocDbg, capacity * sizeof(T), alignof(T) < 32 ? 32 : alignof(T));
-		for (uint32_t i = 0; i < mSize; i++) new(newAllocation + i) T(std::move(mData[i]));
+		for (SizeT i = 0; i < mSize; i++) new(newAllocation + i) T(std::move(mData[i]));
 		
 		// Destroy old memory and replace state with new memory and values
-		uint32_t sizeBackup = mSize;
+		SizeT sizeBackup = mSize;
 		Allocator* allocatorBackup = mAllocator;
 		this->destroy();
 		mSize = sizeBackup;
@@ -131,19 +163,19 @@ public:
 		mData = newAllocation;
 		mAllocator = allocatorBackup;
 	}
-	void ensureCapacity(uint32_t capacity) { if (mCapacity < capacity) setCapacity(capacity); }
+	void ensureCapacity(SizeT capacity) { if (mCapacity < capacity) setCapacity(capacity); }
 
 	// Getters
 	// --------------------------------------------------------------------------------------------
 
-	uint32_t size() const { return mSize; }
-	uint32_t capacity() const { return mCapacity; }
+	SizeT size() const { return mSize; }
+	SizeT capacity() const { return mCapacity; }
 	const T* data() const { return mData; }
 	T* data() { return mData; }
 	Allocator* allocator() const { return mAllocator; }
 
-	T& operator[] (uint32_t idx) { sfz_assert(idx < mSize); return mData[idx]; }
-	const T& operator[] (uint32_t idx) const { sfz_assert(idx < mSize); return mData[idx]; }
+	T& operator[] (SizeT idx) { sfz_assert(idx < mSize); return mData[idx]; }
+	const T& operator[] (SizeT idx) const { sfz_assert(idx < mSize); return mData[idx]; }
 
 	T& first() { sfz_assert(mSize > 0); return mData[0]; }
 	const T& first() const { sfz_assert(mSize > 0); return mData[0]; }
@@ -155,35 +187,35 @@ public:
 	// --------------------------------------------------------------------------------------------
 
 	// Copy element numCopies times to the back of this array. Increases capacity if needed.
-	void add(const T& value, uint32_t numCopies = 1) { addImpl<const T&>(value, numCopies); }
+	void add(const T& value, SizeT numCopies = 1) { addImpl<const T&>(value, numCopies); }
 	void add(T&& value) { addImpl<T>(std::move(value), 1); }
 
 	// Copy numElements elements to the back of this array. Increases capacity if needed.
-	void add(const T* ptr, uint32_t numElements)
+	void add(const T* ptr, SizeT numElements)
 	{
 		growIfNeeded(numElements);
-		for (uint32_t i = 0; i < numElements; i++) new (this->mData + mSize + i) T(ptr[i]);
+		for (SizeT i = 0; i < numElements; i++) new (this->mData + mSize + i) T(ptr[i]);
 		mSize += numElements;
 	}
 
 	// Insert elements into the array at the specified position. Increases capacity if needed.
-	void insert(uint32_t pos, const T& value) { insertImpl(pos, &value, 1); }
-	void insert(uint32_t pos, const T* ptr, uint32_t numElements) { insertImpl(pos, ptr, numElements); }
+	void insert(SizeT pos, const T& value) { insertImpl(pos, &value, 1); }
+	void insert(SizeT pos, const T* ptr, SizeT numElements) { insertImpl(pos, ptr, numElements); }
 
 	// Removes the last element. If the array is empty nothing happens.
 	void pop() { if (mSize == 0) return; mSize -= 1; mData[mSize].~T(); }
 
 	// Remove numElements elements starting at the specified position.
-	void remove(uint32_t pos, uint32_t numElements = 1)
+	void remove(SizeT pos, SizeT numElements = 1)
 	{
 		// Destroy elements
 		sfz_assert(pos < mSize);
 		if (numElements > (mSize - pos)) numElements = (mSize - pos);
-		for (uint32_t i = 0; i < numElements; i++) mData[pos + i].~T();
+		for (SizeT i = 0; i < numElements; i++) mData[pos + i].~T();
 
 		// Move the elements after the removed elements
-		uint32_t numElementsToMove = mSize - pos - numElements;
-		for (uint32_t i = 0; i < numElementsToMove; i++) {
+		SizeT numElementsToMove = mSize - pos - numElements;
+		for (SizeT i = 0; i < numElementsToMove; i++) {
 			new (mData + pos + i) T(std::move(mData[pos + i + numElements]));
 			mData[pos + i + numElements].~T();
 		}
@@ -192,7 +224,7 @@ public:
 
 	// Removes element at given position by swapping it with the last element in array.
 	// O(1) operation unlike remove(), but obviously does not maintain internal array order.
-	void removeQuickSwap(uint32_t pos) { sfz_assert(pos < mSize); std::swap(mData[pos], last()); remove(mSize - 1); }
+	void removeQuickSwap(SizeT pos) { sfz_assert(pos < mSize); std::swap(mData[pos], last()); remove(mSize - 1); }
 
 	// Searches for the first instance of the given element, nullptr if not found.
 	T* search(const T& ref) { return searchImpl(mData, [&](const T& e) { return e == ref; }); }
@@ -218,26 +250,27 @@ private:
 	// Private methods
 	// --------------------------------------------------------------------------------------------
 
-	void growIfNeeded(uint32_t elementsToAdd)
+	void growIfNeeded(SizeT elementsToAdd)
 	{
-		uint32_t newSize = mSize + elementsToAdd;
+		SizeT newSize = mSize + elementsToAdd;
 		if (newSize <= mCapacity) return;
-		uint32_t newCapacity = (mCapacity == 0) ? DYNARRAY_DEFAULT_INITIAL_CAPACITY :
-			uint32_t(mCapacity * DYNARRAY_GROW_RATE);
+		SizeT newCapacity = (mCapacity == 0) ? DYNARRAY_DEFAULT_INITIAL_CAPACITY :
+			SizeT(mCapacity * DYNARRAY_GROW_RATE);
+		if (newCapacity < newSize) newCapacity = newSize;
 		setCapacity(newCapacity);
 	}
 
 	template<typename ForwardT>
-	void addImpl(ForwardT&& value, uint32_t numCopies)
+	void addImpl(ForwardT&& value, SizeT numCopies)
 	{
 		// Perfect forwarding: const reference: ForwardT == const T&, rvalue: ForwardT == T
 		// std::forward<ForwardT>(value) will then return the correct version of value
 		this->growIfNeeded(numCopies);
-		for(uint32_t i = 0; i < numCopies; i++) new (mData + mSize + i) T(std::forward<ForwardT>(value));
+		for(SizeT i = 0; i < numCopies; i++) new (mData + mSize + i) T(std::forward<ForwardT>(value));
 		mSize += numCopies;
 	}
 
-	void insertImpl(uint32_t pos, const T* ptr, uint32_t numElements)
+	void insertImpl(SizeT pos, const T* ptr, SizeT numElements)
 	{
 		sfz_assert(pos <= mSize);
 		growIfNeeded(numElements);
@@ -245,31 +278,34 @@ private:
 		// Move elements
 		T* dstPtr = mData + pos + numElements;
 		T* srcPtr = mData + pos;
-		uint32_t numElementsToMove = (mSize - pos);
-		for (uint32_t i = numElementsToMove; i > 0; i--) {
-			uint32_t offs = i - 1;
+		SizeT numElementsToMove = (mSize - pos);
+		for (SizeT i = numElementsToMove; i > 0; i--) {
+			SizeT offs = i - 1;
 			new (dstPtr + offs) T(std::move(srcPtr[offs]));
 			srcPtr[offs].~T();
 		}
 
 		// Insert elements
-		for (uint32_t i = 0; i < numElements; ++i) new (this->mData + pos + i) T(ptr[i]);
+		for (SizeT i = 0; i < numElements; ++i) new (this->mData + pos + i) T(ptr[i]);
 		mSize += numElements;
 	}
 
 	template<typename F>
 	T* searchImpl(T* data, F func) const
 	{
-		for (uint32_t i = 0; i < mSize; ++i) if (func(data[i])) return &data[i];
+		for (SizeT i = 0; i < mSize; ++i) if (func(data[i])) return &data[i];
 		return nullptr;
 	}
 
 	// Private members
 	// --------------------------------------------------------------------------------------------
 
-	uint32_t mSize = 0, mCapacity = 0;
+	SizeT mSize = 0, mCapacity = 0;
 	T* mData = nullptr;
 	Allocator* mAllocator = nullptr;
 };
 
+template<typename T>
+using DynArray64 = DynArray<T, uint64_t>;
+
 } // namespace sfz
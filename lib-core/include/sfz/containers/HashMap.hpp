@@ -23,8 +23,10 @@
 #include <cstring>
 #include <functional>
 #include <new> // Placement new
+#include <type_traits>
 
 #include "sfz/Assert.hpp"
+#include "sfz/containers/HashTableGroup.hpp"
 #include "sfz/containers/HashTableKeyDescriptor.hpp"
 #include "sfz/Context.hpp"
 #include "sfz/memory/Allocator.hpp"
@@ -38,16 +40,45 @@ using std::uint64_t;
 // HashMap (interface)
 // ------------------------------------------------------------------------------------------------
 
+namespace detail {
+
+/// Value type of the HashMap used internally by HashSet, the HashMap does not allocate any memory
+/// for values when it is used.
+struct HashTableNoValue final { };
+
+} // namespace detail
+
+template<typename K, typename V, typename Descr, uint32_t NUM_SHARDS_LOG2>
+class ConcurrentHashMap;
+
 /// A HashMap with closed hashing (open adressing).
 ///
-/// Quadratic probing is used in the case of collisions, which can not guarantee that more than
-/// half the slots will be searched. For this reason the load factor is 49%, which should
-/// guarantee that this never poses a problem.
+/// Each slot has a control byte which is either empty, placeholder or holds 7 bits of the hash of
+/// the key stored in the slot. Probing is done in groups of 16 consecutive slots, whose control
+/// bytes are matched against the hash in parallel (using SSE2 if available). Keys are only
+/// compared for slots whose 7 hash bits match, so most lookups resolve with a single group match
+/// and a single key comparison. Probing continues with the next group until a group with an empty
+/// slot is found. Because of this the HashMap can be kept at a fairly high load factor (87.5%).
+///
+/// How the capacity is chosen and how hashes are mapped to slots is decided by the capacity policy
+/// of the HashTableKeyDescriptor. By default (PrimeCapacityPolicy) the capacity is always a prime
+/// number taken from an internal lookup table and hashes are mapped using modulo. With
+/// PowerOfTwoCapacityPolicy (e.g. by using PowerOfTwoKeyDescriptor) the capacity is a power of two
+/// and hashes are mapped using multiplicative (Fibonacci) hashing, which is faster. In the case
+/// of a rehash the capacity generally increases by (approximately) a factor of 2.
+///
+/// The HashTableKeyDescriptor may also enable CACHE_HASHES (e.g. by using CachedHashKeyDescriptor),
+/// in which case the full hash of each key is stored in a separate array. Rehashing then reuses
+/// the stored hashes instead of hashing all keys again, and probing compares the stored hashes
+/// before comparing keys. This is mostly useful for string keys.
 ///
-/// The capacity of the the HashMap is always a prime number, so when a certain capacity is
-/// suggested a prime bigger than the suggestion will simply be taken from an internal lookup
-/// table. In the case of a rehash the capacity generally increases by (approximately) a factor
-/// of 2.
+/// Rehashing normally rebuilds the whole table at once, which can take a long time for large
+/// HashMaps. Optionally incremental rehashing can be enabled (setIncrementalRehash()), in which
+/// case the old table is kept alive when the HashMap grows and its elements are migrated to the
+/// new table a few slots at a time by each mutating operation (put(), operator[], remove()).
+/// Lookups check both tables until the migration is complete. This bounds the worst case latency
+/// of an insertion. Note that elements migrated from the old table are moved, so pointers to
+/// elements may be invalidated by any mutating operation while a migration is in progress.
 ///
 /// Removal of elements is O(1), but will leave a placeholder on the previously occupied slot. The
 /// current number of placeholders can be queried by the placeholders() method. Both size and
@@ -69,29 +100,56 @@ using std::uint64_t;
 /// attempting to allocate memory (rehash(), put(), etc), then the default allocator will be
 /// retrieved (getDefaultAllocator()) and set.
 ///
+/// Sizes, capacities and slot indices are stored as SizeT. By default this is uint32_t, which is
+/// compact and enough for all but the largest HashMaps. HashMap64 uses uint64_t and can grow past
+/// 2^32 elements (up to the capacity policy's MAX_CAPACITY_64).
+///
 /// \param K the key type
 /// \param V the value type
 /// \param Descr the HashTableKeyDescriptor (by default sfz::HashTableKeyDescriptor)
-template<typename K, typename V, typename Descr = HashTableKeyDescriptor<K>>
+/// \param SizeT the type of sizes and indices, uint32_t (default) or uint64_t (see HashMap64)
+template<typename K, typename V, typename Descr = HashTableKeyDescriptor<K>,
+	typename SizeT = uint32_t>
 class HashMap {
 public:
+	static_assert(std::is_same<SizeT, uint32_t>::value || std::is_same<SizeT, uint64_t>::value,
+		"HashMap only supports uint32_t and uint64_t sizes");
+
 	// Constants
 	// --------------------------------------------------------------------------------------------
 
 	static constexpr uint32_t ALIGNMENT_EXP = 5;
 	static constexpr uint32_t ALIGNMENT = 1 << ALIGNMENT_EXP; // 2^5 = 32
-	static constexpr uint32_t MIN_CAPACITY = 67;
-	static constexpr uint32_t MAX_CAPACITY = 2147483659;
+	static constexpr uint32_t MIN_CAPACITY = detail::CapacityPolicyOf<Descr>::type::MIN_CAPACITY;
+	static constexpr SizeT MAX_CAPACITY = sizeof(SizeT) == sizeof(uint32_t) ?
+		SizeT(detail::CapacityPolicyOf<Descr>::type::MAX_CAPACITY) :
+		SizeT(detail::CapacityPolicyOf<Descr>::type::MAX_CAPACITY_64);
+
+	/// Whether the full hash of each key is stored next to it, see CACHE_HASHES in
+	/// HashTableKeyDescriptor. Selected by the descriptor, e.g. by using CachedHashKeyDescriptor.
+	static constexpr bool CACHE_HASHES = detail::CacheHashesOf<Descr>::value;
+
+	/// Whether values are stored. False if V is detail::HashTableNoValue (used by HashSet), in
+	/// which case no memory is allocated for values.
+	static constexpr bool HAS_VALUES = !std::is_same<V, detail::HashTableNoValue>::value;
 
 	/// This factor decides the maximum number of occupied slots (size + placeholders) this
 	/// HashMap may contain before it is rehashed by ensureProperlyHashed().
-	static constexpr float MAX_OCCUPIED_REHASH_FACTOR = 0.49f;
+	static constexpr float MAX_OCCUPIED_REHASH_FACTOR = 0.875f;
 
 	/// This factor decides the maximum size allowed to not increase the capacity when rehashing
-	/// in ensureProperlyHashed(). For example, size 20% and placeholders 30% would trigger a
-	/// rehash, but would not increase capacity. Size 40% and placeholders 10% would trigger a
+	/// in ensureProperlyHashed(). For example, size 50% and placeholders 40% would trigger a
+	/// rehash, but would not increase capacity. Size 70% and placeholders 20% would trigger a
 	/// rehash with capacity increase.
-	static constexpr float MAX_SIZE_KEEP_CAPACITY_FACTOR = 0.35f;
+	static constexpr float MAX_SIZE_KEEP_CAPACITY_FACTOR = 0.6f;
+
+	/// The number of keys hashed and prefetched ahead at a time by getBatch()
+	static constexpr uint32_t BATCH_CHUNK_SIZE = 16;
+
+	/// The number of slots in the old table which are migrated by each mutating operation when
+	/// incremental rehashing is in progress. Must be large enough that the migration is always
+	/// complete before the new table needs to be rehashed.
+	static constexpr uint32_t INCREMENTAL_REHASH_SLOTS_PER_STEP = 64;
 
 	// Typedefs
 	// --------------------------------------------------------------------------------------------
@@ -103,11 +161,13 @@ public:
 	using AltKeyHash = typename Descr::AltKeyHash;
 	using AltKeyKeyEqual = typename Descr::AltKeyKeyEqual;
 
+	using CapacityPolicy = typename detail::CapacityPolicyOf<Descr>::type;
+
 	// Constructors & destructors
 	// --------------------------------------------------------------------------------------------
 
 	/// Constructs a new HashMap using create()
-	explicit HashMap(uint32_t suggestedCapacity, Allocator* allocator = getDefaultAllocator()) noexcept;
+	explicit HashMap(SizeT suggestedCapacity, Allocator* allocator = getDefaultAllocator()) noexcept;
 
 	/// Creates an empty HashMap without setting an allocator or allocating any memory.
 	HashMap() noexcept = default;
@@ -132,7 +192,7 @@ public:
 
 	/// Calls destroy(), then constucts a new HashMap. Capacity will be larger than or equal to the
 	/// suggested capacity.
-	void create(uint32_t suggestedCapacity, Allocator* allocator = getDefaultAllocator()) noexcept;
+	void create(SizeT suggestedCapacity, Allocator* allocator = getDefaultAllocator()) noexcept;
 
 	/// Swaps the contents of two HashMaps, including the allocators.
 	void swap(HashMap& other) noexcept;
@@ -152,26 +212,43 @@ public:
 	/// in this HashMap and adds them to the new one. Finally this HashMap is replaced by the
 	/// new one. Obviously all pointers and references into the old HashMap are invalidated. If no
 	/// allocator is set then the default one will be retrieved and set.
-	void rehash(uint32_t suggestedCapacity) noexcept;
+	void rehash(SizeT suggestedCapacity) noexcept;
 
 	/// Checks if HashMap needs to be rehashed, and will do so if necessary. This method is
-	/// internally called by put() and operator[]. Will allocate capacity if this HashMap is
-	/// empty. Returns whether HashMap was rehashed.
+	/// internally called by put(), emplace() and operator[] before inserting a new element. Will
+	/// allocate capacity if this HashMap is empty. Returns whether HashMap was rehashed (or an
+	/// incremental rehash was started).
 	bool ensureProperlyHashed() noexcept;
 
+	/// Enables or disables incremental rehashing. Disabling it completes any migration in
+	/// progress. Preserved by swap(), copied by the copy constructors.
+	void setIncrementalRehash(bool enabled) noexcept;
+
+	/// Migrates all remaining elements of an incremental rehash in progress (if any) to the new
+	/// table and deallocates the old table.
+	void completeRehash() noexcept;
+
 	// Getters
 	// --------------------------------------------------------------------------------------------
 
 	/// Returns the size of this HashMap. This is the number of elements stored, not the current
 	/// capacity.
-	uint32_t size() const noexcept { return mSize; }
+	SizeT size() const noexcept { return mSize + (mOldMap != nullptr ? mOldMap->mSize : 0); }
 
-	/// Returns the capacity of this HashMap.
-	uint32_t capacity() const noexcept { return mCapacity; }
+	/// Returns the capacity of this HashMap. If an incremental rehash is in progress this is the
+	/// capacity of the new table.
+	SizeT capacity() const noexcept { return mCapacity; }
 
 	/// Returns the number of placeholder positions for removed elements. size + placeholders <=
-	/// capacity.
-	uint32_t placeholders() const noexcept { return mPlaceholders; }
+	/// capacity (not counting elements in the old table during an incremental rehash).
+	SizeT placeholders() const noexcept { return mPlaceholders; }
+
+	/// Returns whether incremental rehashing is enabled
+	bool incrementalRehash() const noexcept { return mIncrementalRehash; }
+
+	/// Returns whether an incremental rehash is in progress, i.e. whether there is an old table
+	/// whose elements are not yet migrated.
+	bool isRehashing() const noexcept { return mOldMap != nullptr; }
 
 	/// Returns the allocator of this HashMap. Will return nullptr if no allocator is set.
 	Allocator* allocator() const noexcept { return mAllocator; }
@@ -187,13 +264,32 @@ public:
 	V* get(const AltK& key) noexcept;
 	const V* get(const AltK& key) const noexcept;
 
+	/// Batched version of get(), writes a pointer to the element associated with each key (or
+	/// nullptr) to valuesOut. The keys are processed in chunks of BATCH_CHUNK_SIZE. For each
+	/// chunk all keys are first hashed and the cache lines containing their control bytes and
+	/// keys are prefetched, then the lookups are resolved in a second pass. This overlaps the
+	/// memory latency of the lookups, which can make a large difference for HashMaps that don't
+	/// fit in cache. Same guarantees as get(), will never rehash.
+	void getBatch(const K* keys, SizeT numKeys, V** valuesOut) noexcept;
+	void getBatch(const K* keys, SizeT numKeys, const V** valuesOut) const noexcept;
+	void getBatch(const AltK* keys, SizeT numKeys, V** valuesOut) noexcept;
+	void getBatch(const AltK* keys, SizeT numKeys, const V** valuesOut) const noexcept;
+
 	// Public methods
 	// --------------------------------------------------------------------------------------------
 
+	/// The return value of emplace(). Contains a reference to the element associated with the key
+	/// and whether it was inserted by the call (false if the key already existed).
+	struct InsertResult final {
+		V& value;
+		bool inserted;
+	};
+
 	/// Adds the specified key value pair to this HashMap. If a value is already associated with
 	/// the given key it will be replaced with the new value. Returns a reference to the element
 	/// set. As usual, the reference will be invalidated if the HashMap is rehashed, so be careful.
-	/// This method will always call ensureProperlyHashed(), which might trigger a rehash.
+	/// This method will call ensureProperlyHashed() if the key is not already in the HashMap,
+	/// which might trigger a rehash.
 	///
 	/// In particular the following scenario presents a dangerous trap:
 	/// V& ref1 = m.put(key1, value1);
@@ -209,19 +305,34 @@ public:
 	V& put(const AltK& key, const V& value) noexcept;
 	V& put(const AltK& key, V&& value) noexcept;
 
+	/// Returns a reference to the element associated with the given key. If no such element
+	/// exists it is constructed in place from the specified arguments, otherwise the arguments
+	/// are ignored and the existing element is left untouched (like try_emplace() in std). Only
+	/// probes the HashMap once, whether an element was inserted or not is returned along with
+	/// the reference. This is the preferred way to implement get-or-insert patterns (such as
+	/// counting), which would otherwise require both a get() and a put(). Guaranteed to not
+	/// rehash if the requested element already exists.
+	template<typename... Args>
+	InsertResult emplace(const K& key, Args&&... args) noexcept;
+	template<typename... Args>
+	InsertResult emplace(K&& key, Args&&... args) noexcept;
+	template<typename... Args>
+	InsertResult emplace(const AltK& key, Args&&... args) noexcept;
+
 	/// Access operator, will return a reference to the element associated with the given key. If
 	/// no such element exists it will be created with the default constructor. This method is
-	/// implemented by a call to get(), and then a call to put() if no element existed. In
-	/// practice this means that this function is guaranteed to not rehash if the requested
-	/// element already exists. This might be dangerous to rely on, so get() should be preferred
-	/// if rehashing needs to be avoided. As always, the reference will be invalidated if the
-	/// HashMap is rehashed.
+	/// implemented by a call to emplace() without arguments, so it is guaranteed to not rehash if
+	/// the requested element already exists. This might be dangerous to rely on, so get() should
+	/// be preferred if rehashing needs to be avoided. As always, the reference will be
+	/// invalidated if the HashMap is rehashed.
 	V& operator[] (const K& key) noexcept;
 	V& operator[] (K&& key) noexcept;
 	V& operator[] (const AltK& key) noexcept;
 
 	/// Attempts to remove the element associated with the given key. Returns false if this
-	/// HashMap contains no such element. Guaranteed to not rehash.
+	/// HashMap contains no such element. Never starts a rehash, but while an incremental rehash is
+	/// in progress (isRehashing()) it migrates elements from the old table like any other
+	/// mutating operation, which invalidates pointers to other elements.
 	bool remove(const K& key) noexcept;
 	bool remove(const AltK& key) noexcept;
 
@@ -241,7 +352,7 @@ public:
 	/// The normal non-const iterator for HashMap.
 	class Iterator final {
 	public:
-		Iterator(HashMap& hashMap, uint32_t index) noexcept : mHashMap(&hashMap), mIndex(index) { }
+		Iterator(HashMap& hashMap, SizeT index) noexcept : mHashMap(&hashMap), mIndex(index) { }
 		Iterator(const Iterator&) noexcept = default;
 		Iterator& operator= (const Iterator&) noexcept = default;
 
@@ -253,7 +364,7 @@ public:
 
 	private:
 		HashMap* mHashMap;
-		uint32_t mIndex;
+		SizeT mIndex;
 	};
 
 	/// The return value when dereferencing a const iterator. Contains references into the HashMap
@@ -269,7 +380,7 @@ public:
 	/// The const iterator for HashMap
 	class ConstIterator final {
 	public:
-		ConstIterator(const HashMap& hashMap, uint32_t index) noexcept : mHashMap(&hashMap), mIndex(index) {}
+		ConstIterator(const HashMap& hashMap, SizeT index) noexcept : mHashMap(&hashMap), mIndex(index) {}
 		ConstIterator(const ConstIterator&) noexcept = default;
 		ConstIterator& operator= (const ConstIterator&) noexcept = default;
 
@@ -281,7 +392,7 @@ public:
 
 	private:
 		const HashMap* mHashMap;
-		uint32_t mIndex;
+		SizeT mIndex;
 	};
 
 	// Iterator methods
@@ -296,21 +407,27 @@ public:
 	ConstIterator cend() const noexcept;
 
 private:
+	// ConcurrentHashMap hashes each key once to select a shard, then reuses the hash through the
+	// internal methods below.
+	template<typename, typename, typename, uint32_t>
+	friend class ConcurrentHashMap;
+
 	// Private constants
 	// --------------------------------------------------------------------------------------------
 
-	static constexpr uint8_t ELEMENT_INFO_EMPTY = 0;
-	static constexpr uint8_t ELEMENT_INFO_PLACEHOLDER = 1;
-	static constexpr uint8_t ELEMENT_INFO_OCCUPIED = 2;
+	static constexpr uint32_t GROUP_WIDTH = detail::HASH_TABLE_GROUP_WIDTH;
+	static constexpr uint8_t CTRL_EMPTY = detail::HASH_TABLE_CTRL_EMPTY;
+	static constexpr uint8_t CTRL_PLACEHOLDER = detail::HASH_TABLE_CTRL_PLACEHOLDER;
 
 	// Private methods
 	// --------------------------------------------------------------------------------------------
 
-	/// Returns a prime number larger than the suggested capacity
-	uint32_t findPrimeCapacity(uint32_t capacity) const noexcept;
+	/// Return the size of the memory allocation for the control byte array in bytes
+	uint64_t sizeOfControlArray() const noexcept;
 
-	/// Return the size of the memory allocation for the element info array in bytes
-	uint64_t sizeOfElementInfoArray() const noexcept;
+	/// Returns the size of the memory allocation for the hash array in bytes, 0 unless
+	/// CACHE_HASHES is enabled
+	uint64_t sizeOfHashArray() const noexcept;
 
 	/// Returns the size of the memory allocation for the key array in bytes
 	uint64_t sizeOfKeyArray() const noexcept;
@@ -321,8 +438,12 @@ private:
 	/// Returns the size of the allocated memory in bytes
 	uint64_t sizeOfAllocatedMemory() const noexcept;
 
-	/// Returns pointer to the info bits part of the allocated memory
-	uint8_t* elementInfoPtr() const noexcept;
+	/// Returns pointer to the control byte part of the allocated memory
+	uint8_t* controlPtr() const noexcept;
+
+	/// Returns pointer to the hash array part of the allocated memory, only valid if
+	/// CACHE_HASHES is enabled
+	uint64_t* hashesPtr() const noexcept;
 
 	/// Returns pointer to the key array part of the allocated memory
 	K* keysPtr() const noexcept;
@@ -330,45 +451,109 @@ private:
 	/// Returns pointer to the value array port fo the allocated memory
 	V* valuesPtr() const noexcept;
 
-	/// Returns the 2 bit element info about an element position in the HashMap
-	/// 0 = empty, 1 = removed, 2 = occupied, (3 is unused)
-	uint8_t elementInfo(uint32_t index) const noexcept;
+	/// Returns the value in a slot. If HAS_VALUES is false there is no value array and all slots
+	/// share a single (empty) dummy value.
+	V& valueAt(SizeT index) const noexcept;
+
+	/// Returns whether the slot at the specified index holds an element
+	bool isOccupied(SizeT index) const noexcept;
+
+	/// Returns the hash of the key in an occupied slot. Uses the stored hash if CACHE_HASHES is
+	/// enabled, otherwise the key is hashed.
+	uint64_t hashOfSlot(SizeT index) const noexcept;
+
+	/// Moves a key value pair into the first free slot in the probe sequence of its hash. The key
+	/// must not exist in this table and there must be a free slot. Used when rehashing.
+	void insertMovedUnique(uint64_t hash, K& key, V& value) noexcept;
+
+	/// Iterators index the slots of the current table followed by the slots of the old table
+	/// (during an incremental rehash). Returns the number of such slots.
+	SizeT numIterationSlots() const noexcept;
+
+	/// Returns the table (this or the old table) which an iteration index belongs to, the index
+	/// is converted to an index into that table.
+	HashMap* tableForIterationIndex(SizeT& index) const noexcept;
 
-	/// Sets the 2 bit element info with the selected value
-	void setElementInfo(uint32_t index, uint8_t value) noexcept;
+	/// Starts an incremental rehash to a table with the specified capacity
+	void startIncrementalRehash(SizeT newCapacity) noexcept;
 
-	/// Finds the index of an element associated with the specified key. Whether an element is
-	/// found or not is returned through the elementFound parameter. The first free slot found is
-	/// sent back through the firstFreeSlot parameter, if no free slot is found it will be set to
-	/// ~0. Whether the found free slot is a placeholder slot or not is sent back through the
-	/// isPlaceholder parameter.
+	/// Migrates up to INCREMENTAL_REHASH_SLOTS_PER_STEP slots from the old table
+	void incrementalRehashStep() noexcept;
+
+	/// Frees the old table, must not contain any elements
+	void destroyOldTable() noexcept;
+
+	/// Sets the control byte of a slot, also updates the mirrored copy if one of the first
+	/// GROUP_WIDTH slots
+	void setControl(SizeT index, uint8_t ctrl) noexcept;
+
+	/// Returns the index of the first slot to probe for the specified hash
+	SizeT probeStart(uint64_t hash) const noexcept;
+
+	/// Returns the index of the start of the next group to probe
+	SizeT probeNext(SizeT groupStart) const noexcept;
+
+	/// Finds the index of an element associated with the specified key, hash is the hash of the
+	/// key (using the hasher for its key type). Whether an element is found or not is returned
+	/// through the elementFound parameter. The first free slot found is sent back through the
+	/// firstFreeSlot parameter, if no free slot is found it will be set to ~0. Whether the found
+	/// free slot is a placeholder slot or not is sent back through the isPlaceholder parameter.
 	/// KT: The key type, either K or AltK
-	/// KeyHash: Hasher for KeyT
 	/// KeyEqual: Comparer for KeyT and K (I.e. KeyEqual for K and AltKeyKeyEqual for AltK)
-	template<typename KT, typename Hash, typename Equal>
-	uint32_t findElementIndex(const KT& key, bool& elementFound, uint32_t& firstFreeSlot,
-	                          bool& isPlaceholder) const noexcept;
+	template<typename KT, typename Equal>
+	SizeT findElementIndex(const KT& key, uint64_t hash, bool& elementFound,
+	                       SizeT& firstFreeSlot, bool& isPlaceholder) const noexcept;
 
-	/// Internal shared implementation of all get() methods
-	template<typename KT, typename Hash, typename Equal>
-	V* getInternal(const KT& key) const noexcept;
+	/// Finds the first free (empty or placeholder) slot in the probe sequence of the specified
+	/// hash, without comparing any keys. Returns ~0 if no free slot is found.
+	SizeT findFreeSlot(uint64_t hash, bool& isPlaceholder) const noexcept;
 
-	/// Internal shared implementation of all put() methods
-	template<typename KT, typename VT, typename Hash, typename Equal>
-	V& putInternal(KT&& key, VT&& value) noexcept;
+	/// Internal shared implementation of all get() methods, hash is the hash of the key
+	template<typename KT, typename Equal>
+	V* getInternal(const KT& key, uint64_t hash) const noexcept;
 
-	/// Internal shared implementation of all remove() methods
+	/// Internal shared implementation of all getBatch() methods
 	template<typename KT, typename Hash, typename Equal>
-	bool removeInternal(const KT& key) noexcept;
+	void getBatchInternal(const KT* keys, SizeT numKeys, V** valuesOut) const noexcept;
+
+	/// Internal shared implementation of all put() methods, hash is the hash of the key
+	template<typename KT, typename VT, typename Equal>
+	V& putInternal(KT&& key, uint64_t hash, VT&& value) noexcept;
+
+	/// Internal shared implementation of all emplace() methods and operator[], hash is the hash
+	/// of the key. The key is only probed for once, the free slot found is reused unless
+	/// inserting requires the table to be modified first (by a rehash or an incremental rehash
+	/// step).
+	template<typename KT, typename Equal, typename... Args>
+	InsertResult emplaceInternal(KT&& key, uint64_t hash, Args&&... args) noexcept;
+
+	/// Inserts an element which is known to not exist in the HashMap, firstFreeSlot and
+	/// isPlaceholder are the results of the probe for the key. Kept separate from
+	/// emplaceInternal() so that the common path where the key already exists stays small.
+	template<typename KT, typename... Args>
+	V& insertNew(KT&& key, uint64_t hash, SizeT firstFreeSlot, bool isPlaceholder,
+		Args&&... args) noexcept;
+
+	/// Internal shared implementation of all remove() methods, hash is the hash of the key
+	template<typename KT, typename Equal>
+	bool removeInternal(const KT& key, uint64_t hash) noexcept;
 
 	// Private members
 	// --------------------------------------------------------------------------------------------
 
-	uint32_t mSize = 0, mCapacity = 0, mPlaceholders = 0;
+	SizeT mSize = 0, mCapacity = 0, mPlaceholders = 0;
 	uint8_t* mDataPtr = nullptr;
 	Allocator* mAllocator = nullptr;
+
+	// Incremental rehash state, mOldMap is only allocated while a migration is in progress
+	HashMap* mOldMap = nullptr;
+	SizeT mMigrateIndex = 0;
+	bool mIncrementalRehash = false;
 };
 
+template<typename K, typename V, typename Descr = HashTableKeyDescriptor<K>>
+using HashMap64 = HashMap<K, V, Descr, uint64_t>;
+
 } // namespace sfz
 
 #include "sfz/containers/HashMap.inl"
@@ -28,20 +28,20 @@ namespace sfz {
 // HashMap (implementation): Constructors & destructors
 // ------------------------------------------------------------------------------------------------
 
-template<typename K, typename V, typename Descr>
-HashMap<K,V,Descr>::HashMap(uint32_t suggestedCapacity, Allocator* allocator) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+HashMap<K,V,Descr,SizeT>::HashMap(SizeT suggestedCapacity, Allocator* allocator) noexcept
 {
 	this->create(suggestedCapacity, allocator);
 }
 
-template<typename K, typename V, typename Descr>
-HashMap<K,V,Descr>::HashMap(const HashMap& other) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+HashMap<K,V,Descr,SizeT>::HashMap(const HashMap& other) noexcept
 {
 	*this = other;
 }
 
-template<typename K, typename V, typename Descr>
-HashMap<K,V,Descr>& HashMap<K,V,Descr>::operator= (const HashMap& other) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+HashMap<K,V,Descr,SizeT>& HashMap<K,V,Descr,SizeT>::operator= (const HashMap& other) noexcept
 {
 	// Don't copy to itself
 	if (this == &other) return *this;
@@ -49,6 +49,7 @@ HashMap<K,V,Descr>& HashMap<K,V,Descr>::operator= (const HashMap& other) noexcep
 	// Clear and rehash this HashMap
 	this->clear();
 	this->mAllocator = other.mAllocator;
+	this->mIncrementalRehash = other.mIncrementalRehash;
 	this->rehash(other.mCapacity);
 
 	// Add all elements from other HashMap
@@ -59,10 +60,11 @@ HashMap<K,V,Descr>& HashMap<K,V,Descr>::operator= (const HashMap& other) noexcep
 	return *this;
 }
 
-template<typename K, typename V, typename Descr>
-HashMap<K,V,Descr>::HashMap(const HashMap& other, Allocator* allocator) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+HashMap<K,V,Descr,SizeT>::HashMap(const HashMap& other, Allocator* allocator) noexcept
 {
 	HashMap tmp(other.capacity(), allocator);
+	tmp.mIncrementalRehash = other.mIncrementalRehash;
 
 	// Add all elements from other HashMap
 	for (ConstKeyValuePair pair : other) {
@@ -72,21 +74,21 @@ HashMap<K,V,Descr>::HashMap(const HashMap& other, Allocator* allocator) noexcept
 	*this = std::move(tmp);
 }
 
-template<typename K, typename V, typename Descr>
-HashMap<K,V,Descr>::HashMap(HashMap&& other) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+HashMap<K,V,Descr,SizeT>::HashMap(HashMap&& other) noexcept
 {
 	this->swap(other);
 }
 
-template<typename K, typename V, typename Descr>
-HashMap<K,V,Descr>& HashMap<K,V,Descr>::operator= (HashMap&& other) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+HashMap<K,V,Descr,SizeT>& HashMap<K,V,Descr,SizeT>::operator= (HashMap&& other) noexcept
 {
 	this->swap(other);
 	return *this;
 }
 
-template<typename K, typename V, typename Descr>
-HashMap<K,V,Descr>::~HashMap() noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+HashMap<K,V,Descr,SizeT>::~HashMap() noexcept
 {
 	this->destroy();
 }
@@ -94,39 +96,51 @@ HashMap<K,V,Descr>::~HashMap() noexcept
 // HashMap (implementation): State methods
 // ------------------------------------------------------------------------------------------------
 
-template<typename K, typename V, typename Descr>
-void HashMap<K,V,Descr>::create(uint32_t suggestedCapacity, Allocator* allocator) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+void HashMap<K,V,Descr,SizeT>::create(SizeT suggestedCapacity, Allocator* allocator) noexcept
 {
 	this->destroy();
 	mAllocator = allocator;
 	this->rehash(suggestedCapacity);
 }
 
-template<typename K, typename V, typename Descr>
-void HashMap<K,V,Descr>::swap(HashMap& other) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+void HashMap<K,V,Descr,SizeT>::swap(HashMap& other) noexcept
 {
-	uint32_t thisSize = this->mSize;
-	uint32_t thisCapacity = this->mCapacity;
-	uint32_t thisPlaceholders = this->mPlaceholders;
+	SizeT thisSize = this->mSize;
+	SizeT thisCapacity = this->mCapacity;
+	SizeT thisPlaceholders = this->mPlaceholders;
 	uint8_t* thisDataPtr = this->mDataPtr;
 	Allocator* thisAllocator = this->mAllocator;
+	HashMap* thisOldMap = this->mOldMap;
+	SizeT thisMigrateIndex = this->mMigrateIndex;
+	bool thisIncrementalRehash = this->mIncrementalRehash;
 
 	this->mSize = other.mSize;
 	this->mCapacity = other.mCapacity;
 	this->mPlaceholders = other.mPlaceholders;
 	this->mDataPtr = other.mDataPtr;
 	this->mAllocator = other.mAllocator;
+	this->mOldMap = other.mOldMap;
+	this->mMigrateIndex = other.mMigrateIndex;
+	this->mIncrementalRehash = other.mIncrementalRehash;
 
 	other.mSize = thisSize;
 	other.mCapacity = thisCapacity;
 	other.mPlaceholders = thisPlaceholders;
 	other.mDataPtr = thisDataPtr;
 	other.mAllocator = thisAllocator;
+	other.mOldMap = thisOldMap;
+	other.mMigrateIndex = thisMigrateIndex;
+	other.mIncrementalRehash = thisIncrementalRehash;
 }
 
-template<typename K, typename V, typename Descr>
-void HashMap<K,V,Descr>::destroy() noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+void HashMap<K,V,Descr,SizeT>::destroy() noexcept
 {
+	// Destroy old table if incremental rehash is in progress
+	if (mOldMap != nullptr) this->destroyOldTable();
+
 	if (mDataPtr == nullptr) {
 		mAllocator = nullptr;
 		return;
@@ -136,49 +150,54 @@ void HashMap<K,V,Descr>::destroy() noexcept
 	this->clear();
 
 	// Deallocate memory
-	mAllocator->deallocate(mDataPtr);
+	mAllocator->deallocateSized(mDataPtr, this->sizeOfAllocatedMemory(), ALIGNMENT);
 	mCapacity = 0;
 	mPlaceholders = 0;
 	mDataPtr = nullptr;
 	mAllocator = nullptr;
 }
 
-template<typename K, typename V, typename Descr>
-void HashMap<K,V,Descr>::clear() noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+void HashMap<K,V,Descr,SizeT>::clear() noexcept
 {
+	// Destroy old table if incremental rehash is in progress
+	if (mOldMap != nullptr) this->destroyOldTable();
+
 	if (mSize == 0) return;
 
 	// Call destructors for all active keys and values if they are not trivially destructible
 	if (!std::is_trivially_destructible<K>::value || !std::is_trivially_destructible<V>::value) {
 		K* keyPtr = keysPtr();
-		V* valuePtr = valuesPtr();
 		for (uint64_t i = 0; i < mCapacity; ++i) {
-			if (elementInfo((uint32_t)i) == ELEMENT_INFO_OCCUPIED) {
+			if (isOccupied(SizeT(i))) {
 				keyPtr[i].~K();
-				valuePtr[i].~V();
+				valueAt(SizeT(i)).~V();
 			}
 		}
 	}
 
-	// Clear all element info bits
-	std::memset(elementInfoPtr(), 0, sizeOfElementInfoArray());
+	// Set all control bytes to empty
+	std::memset(controlPtr(), CTRL_EMPTY, sizeOfControlArray());
 
 	// Set size to 0
 	mSize = 0;
 	mPlaceholders = 0;
 }
 
-template<typename K, typename V, typename Descr>
-void HashMap<K,V,Descr>::rehash(uint32_t suggestedCapacity) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+void HashMap<K,V,Descr,SizeT>::rehash(SizeT suggestedCapacity) noexcept
 {
+	// Finish incremental rehash in progress, if any
+	this->completeRehash();
+
 	// Can't decrease capacity with rehash()
 	if (suggestedCapacity < mCapacity) suggestedCapacity = mCapacity;
 
 	// Don't rehash if capacity already exists and there are no placeholders
 	if (suggestedCapacity == mCapacity && mPlaceholders == 0) return;
 
-	// Convert the suggested capacity to a larger (if possible) prime number
-	uint32_t newCapacity = findPrimeCapacity(suggestedCapacity);
+	// Convert the suggested capacity to a larger (if possible) valid capacity
+	SizeT newCapacity = CapacityPolicy::capacityFor(suggestedCapacity);
 
 	// Set default allocator if no allocator is set
 	if (mAllocator == nullptr) mAllocator = getDefaultAllocator();
@@ -190,20 +209,25 @@ void HashMap<K,V,Descr>::rehash(uint32_t suggestedCapacity) noexcept
 	tmp.mDataPtr =
 		(uint8_t*)mAllocator->allocate(sfz_dbg("HashMap"), tmp.sizeOfAllocatedMemory(), ALIGNMENT);
 	std::memset(tmp.mDataPtr, 0, tmp.sizeOfAllocatedMemory());
+	std::memset(tmp.controlPtr(), CTRL_EMPTY, tmp.sizeOfControlArray());
 
-	// Iterate over all pairs of objects in this HashMap and move them to the new one
+	// Move all elements in this HashMap to the new one. The keys are known to be unique, so
+	// only a free slot needs to be found for each of them.
 	if (this->mDataPtr != nullptr) {
-		for (KeyValuePair pair : *this) {
-			tmp.put(pair.key, std::move(pair.value));
+		K* const keys = keysPtr();
+		for (SizeT i = 0; i < mCapacity; i++) {
+			if (!isOccupied(i)) continue;
+			tmp.insertMovedUnique(hashOfSlot(i), keys[i], valueAt(i));
 		}
 	}
 
 	// Replace this HashMap with the new one
+	tmp.mIncrementalRehash = this->mIncrementalRehash;
 	this->swap(tmp);
 }
 
-template<typename K, typename V, typename Descr>
-bool HashMap<K,V,Descr>::ensureProperlyHashed() noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+bool HashMap<K,V,Descr,SizeT>::ensureProperlyHashed() noexcept
 {
 	// If HashMap is empty initialize with smallest size
 	if (mCapacity == 0) {
@@ -212,212 +236,303 @@ bool HashMap<K,V,Descr>::ensureProperlyHashed() noexcept
 	}
 
 	// Check if HashMap needs to be rehashed
-	uint32_t maxOccupied = uint32_t(MAX_OCCUPIED_REHASH_FACTOR * mCapacity);
+	SizeT maxOccupied = SizeT(MAX_OCCUPIED_REHASH_FACTOR * mCapacity);
 	if ((mSize + mPlaceholders) > maxOccupied) {
 
+		// Previous incremental rehash must be completed before starting a new one. Should never
+		// actually happen, as migration finishes long before the new table is filled.
+		this->completeRehash();
+
 		// Determine whether capacity needs to be increase or if is enough to remove placeholders
-		uint32_t maxSize = uint32_t(MAX_OCCUPIED_REHASH_FACTOR * mCapacity);
+		SizeT maxSize = SizeT(MAX_SIZE_KEEP_CAPACITY_FACTOR * mCapacity);
 		bool needCapacityIncrease = mSize > maxSize;
 
 		// Rehash
-		this->rehash(mCapacity + (needCapacityIncrease ? 1 : 0));
+		SizeT newCapacity = mCapacity + (needCapacityIncrease ? 1 : 0);
+		if (mIncrementalRehash) {
+			this->startIncrementalRehash(CapacityPolicy::capacityFor(newCapacity));
+		}
+		else {
+			this->rehash(newCapacity);
+		}
 		return true;
 	}
 
 	return false;
 }
 
+template<typename K, typename V, typename Descr, typename SizeT>
+void HashMap<K,V,Descr,SizeT>::setIncrementalRehash(bool enabled) noexcept
+{
+	mIncrementalRehash = enabled;
+	if (!enabled) this->completeRehash();
+}
+
+template<typename K, typename V, typename Descr, typename SizeT>
+void HashMap<K,V,Descr,SizeT>::completeRehash() noexcept
+{
+	while (mOldMap != nullptr) this->incrementalRehashStep();
+}
+
 // HashMap (implementation): Getters
 // ------------------------------------------------------------------------------------------------
 
-template<typename K, typename V, typename Descr>
-V* HashMap<K,V,Descr>::get(const K& key) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+V* HashMap<K,V,Descr,SizeT>::get(const K& key) noexcept
+{
+	return this->getInternal<K,KeyEqual>(key, uint64_t(KeyHash()(key)));
+}
+
+template<typename K, typename V, typename Descr, typename SizeT>
+const V* HashMap<K,V,Descr,SizeT>::get(const K& key) const noexcept
+{
+	return this->getInternal<K,KeyEqual>(key, uint64_t(KeyHash()(key)));
+}
+
+template<typename K, typename V, typename Descr, typename SizeT>
+V* HashMap<K,V,Descr,SizeT>::get(const AltK& key) noexcept
+{
+	return this->getInternal<AltK,AltKeyKeyEqual>(key, uint64_t(AltKeyHash()(key)));
+}
+
+template<typename K, typename V, typename Descr, typename SizeT>
+const V* HashMap<K,V,Descr,SizeT>::get(const AltK& key) const noexcept
+{
+	return this->getInternal<AltK,AltKeyKeyEqual>(key, uint64_t(AltKeyHash()(key)));
+}
+
+template<typename K, typename V, typename Descr, typename SizeT>
+void HashMap<K,V,Descr,SizeT>::getBatch(const K* keys, SizeT numKeys, V** valuesOut) noexcept
 {
-	return this->getInternal<K,KeyHash,KeyEqual>(key);
+	this->getBatchInternal<K,KeyHash,KeyEqual>(keys, numKeys, valuesOut);
 }
 
-template<typename K, typename V, typename Descr>
-const V* HashMap<K,V,Descr>::get(const K& key) const noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+void HashMap<K,V,Descr,SizeT>::getBatch(
+	const K* keys, SizeT numKeys, const V** valuesOut) const noexcept
 {
-	return this->getInternal<K,KeyHash,KeyEqual>(key);
+	this->getBatchInternal<K,KeyHash,KeyEqual>(keys, numKeys, const_cast<V**>(valuesOut));
 }
 
-template<typename K, typename V, typename Descr>
-V* HashMap<K,V,Descr>::get(const AltK& key) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+void HashMap<K,V,Descr,SizeT>::getBatch(const AltK* keys, SizeT numKeys, V** valuesOut) noexcept
 {
-	return this->getInternal<AltK,AltKeyHash,AltKeyKeyEqual>(key);
+	this->getBatchInternal<AltK,AltKeyHash,AltKeyKeyEqual>(keys, numKeys, valuesOut);
 }
 
-template<typename K, typename V, typename Descr>
-const V* HashMap<K,V,Descr>::get(const AltK& key) const noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+void HashMap<K,V,Descr,SizeT>::getBatch(
+	const AltK* keys, SizeT numKeys, const V** valuesOut) const noexcept
 {
-	return this->getInternal<AltK,AltKeyHash,AltKeyKeyEqual>(key);
+	this->getBatchInternal<AltK,AltKeyHash,AltKeyKeyEqual>(
+		keys, numKeys, const_cast<V**>(valuesOut));
 }
 
 // HashMap (implementation): Public methods
 // ------------------------------------------------------------------------------------------------
 
-template<typename K, typename V, typename Descr>
-V& HashMap<K,V,Descr>::put(const K& key, const V& value) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+V& HashMap<K,V,Descr,SizeT>::put(const K& key, const V& value) noexcept
+{
+	return this->putInternal<const K&, const V&, KeyEqual>(key, uint64_t(KeyHash()(key)), value);
+}
+
+template<typename K, typename V, typename Descr, typename SizeT>
+V& HashMap<K,V,Descr,SizeT>::put(const K& key, V&& value) noexcept
+{
+	return this->putInternal<const K&, V, KeyEqual>(
+		key, uint64_t(KeyHash()(key)), std::move(value));
+}
+
+template<typename K, typename V, typename Descr, typename SizeT>
+V& HashMap<K,V,Descr,SizeT>::put(K&& key, const V& value) noexcept
+{
+	const uint64_t hash = uint64_t(KeyHash()(key));
+	return this->putInternal<K, const V&, KeyEqual>(std::move(key), hash, value);
+}
+
+template<typename K, typename V, typename Descr, typename SizeT>
+V& HashMap<K,V,Descr,SizeT>::put(K&& key, V&& value) noexcept
 {
-	return this->putInternal<const K&, const V&, KeyHash, KeyEqual>(key, value);
+	const uint64_t hash = uint64_t(KeyHash()(key));
+	return this->putInternal<K, V, KeyEqual>(std::move(key), hash, std::move(value));
 }
 
-template<typename K, typename V, typename Descr>
-V& HashMap<K,V,Descr>::put(const K& key, V&& value) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+V& HashMap<K,V,Descr,SizeT>::put(const AltK& key, const V& value) noexcept
 {
-	return this->putInternal<const K&, V, KeyHash, KeyEqual>(key, std::move(value));
+	return this->putInternal<const AltK&, const V&, AltKeyKeyEqual>(
+		key, uint64_t(AltKeyHash()(key)), value);
 }
 
-template<typename K, typename V, typename Descr>
-V& HashMap<K,V,Descr>::put(K&& key, const V& value) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+V& HashMap<K,V,Descr,SizeT>::put(const AltK& key, V&& value) noexcept
 {
-	return this->putInternal<K, const V&, KeyHash, KeyEqual>(std::move(key), value);
+	return this->putInternal<const AltK&, V, AltKeyKeyEqual>(
+		key, uint64_t(AltKeyHash()(key)), std::move(value));
 }
 
-template<typename K, typename V, typename Descr>
-V& HashMap<K,V,Descr>::put(K&& key, V&& value) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+template<typename... Args>
+typename HashMap<K,V,Descr,SizeT>::InsertResult
+HashMap<K,V,Descr,SizeT>::emplace(const K& key, Args&&... args) noexcept
 {
-	return this->putInternal<K, V, KeyHash, KeyEqual>(std::move(key), std::move(value));
+	return this->emplaceInternal<const K&, KeyEqual>(
+		key, uint64_t(KeyHash()(key)), std::forward<Args>(args)...);
 }
 
-template<typename K, typename V, typename Descr>
-V& HashMap<K,V,Descr>::put(const AltK& key, const V& value) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+template<typename... Args>
+typename HashMap<K,V,Descr,SizeT>::InsertResult
+HashMap<K,V,Descr,SizeT>::emplace(K&& key, Args&&... args) noexcept
 {
-	return this->putInternal<const AltK&, const V&, AltKeyHash, AltKeyKeyEqual>(key, value);
+	const uint64_t hash = uint64_t(KeyHash()(key));
+	return this->emplaceInternal<K, KeyEqual>(std::move(key), hash, std::forward<Args>(args)...);
 }
 
-template<typename K, typename V, typename Descr>
-V& HashMap<K,V,Descr>::put(const AltK& key, V&& value) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+template<typename... Args>
+typename HashMap<K,V,Descr,SizeT>::InsertResult
+HashMap<K,V,Descr,SizeT>::emplace(const AltK& key, Args&&... args) noexcept
 {
-	return this->putInternal<const AltK&, V, AltKeyHash, AltKeyKeyEqual>(key, std::move(value));
+	return this->emplaceInternal<const AltK&, AltKeyKeyEqual>(
+		key, uint64_t(AltKeyHash()(key)), std::forward<Args>(args)...);
 }
 
-template<typename K, typename V, typename Descr>
-V& HashMap<K,V,Descr>::operator[] (const K& key) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+V& HashMap<K,V,Descr,SizeT>::operator[] (const K& key) noexcept
 {
-	V* ptr = this->get(key);
-	if (ptr != nullptr) return *ptr;
-	return this->put(key, V());
+	return this->emplaceInternal<const K&, KeyEqual>(key, uint64_t(KeyHash()(key))).value;
 }
 
-template<typename K, typename V, typename Descr>
-V& HashMap<K,V,Descr>::operator[] (K&& key) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+V& HashMap<K,V,Descr,SizeT>::operator[] (K&& key) noexcept
 {
-	V* ptr = this->get(key);
-	if (ptr != nullptr) return *ptr;
-	return this->put(std::move(key), V());
+	const uint64_t hash = uint64_t(KeyHash()(key));
+	return this->emplaceInternal<K, KeyEqual>(std::move(key), hash).value;
 }
 
-template<typename K, typename V, typename Descr>
-V& HashMap<K,V,Descr>::operator[] (const AltK& key) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+V& HashMap<K,V,Descr,SizeT>::operator[] (const AltK& key) noexcept
 {
-	V* ptr = this->get(key);
-	if (ptr != nullptr) return *ptr;
-	return this->put(key, V());
+	return this->emplaceInternal<const AltK&, AltKeyKeyEqual>(
+		key, uint64_t(AltKeyHash()(key))).value;
 }
 
-template<typename K, typename V, typename Descr>
-bool HashMap<K,V,Descr>::remove(const K& key) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+bool HashMap<K,V,Descr,SizeT>::remove(const K& key) noexcept
 {
-	return this->removeInternal<K,KeyHash,KeyEqual>(key);
+	return this->removeInternal<K,KeyEqual>(key, uint64_t(KeyHash()(key)));
 }
 
-template<typename K, typename V, typename Descr>
-bool HashMap<K,V,Descr>::remove(const AltK& key) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+bool HashMap<K,V,Descr,SizeT>::remove(const AltK& key) noexcept
 {
-	return this->removeInternal<AltK,AltKeyHash,AltKeyKeyEqual>(key);
+	return this->removeInternal<AltK,AltKeyKeyEqual>(
+		key, uint64_t(AltKeyHash()(key)));
 }
 
 // HashMap (implementation): Iterators
 // ------------------------------------------------------------------------------------------------
 
-template<typename K, typename V, typename Descr>
-typename HashMap<K,V,Descr>::Iterator& HashMap<K,V,Descr>::Iterator::operator++ () noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+typename HashMap<K,V,Descr,SizeT>::Iterator&
+HashMap<K,V,Descr,SizeT>::Iterator::operator++ () noexcept
 {
 	// Go through map until we find next occupied slot
-	for (uint32_t i = mIndex + 1; i < mHashMap->mCapacity; ++i) {
-		uint8_t info = mHashMap->elementInfo(i);
-		if (info == ELEMENT_INFO_OCCUPIED) {
+	const SizeT numSlots = mHashMap->numIterationSlots();
+	for (SizeT i = mIndex + 1; i < numSlots; ++i) {
+		SizeT tableIndex = i;
+		if (mHashMap->tableForIterationIndex(tableIndex)->isOccupied(tableIndex)) {
 			mIndex = i;
 			return *this;
 		}
 	}
 
 	// Did not find any more elements, set to end
-	mIndex = uint32_t(~0);
+	mIndex = SizeT(~0);
 	return *this;
 }
 
-template<typename K, typename V, typename Descr>
-typename HashMap<K,V,Descr>::Iterator HashMap<K,V,Descr>::Iterator::operator++ (int) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+typename HashMap<K,V,Descr,SizeT>::Iterator
+HashMap<K,V,Descr,SizeT>::Iterator::operator++ (int) noexcept
 {
 	auto copy = *this;
 	++(*this);
 	return copy;
 }
 
-template<typename K, typename V, typename Descr>
-typename HashMap<K,V,Descr>::KeyValuePair HashMap<K,V,Descr>::Iterator::operator* () noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+typename HashMap<K,V,Descr,SizeT>::KeyValuePair
+HashMap<K,V,Descr,SizeT>::Iterator::operator* () noexcept
 {
-	sfz_assert(mIndex != uint32_t(~0));
-	sfz_assert(mHashMap->elementInfo(mIndex) == ELEMENT_INFO_OCCUPIED);
-	return KeyValuePair(mHashMap->keysPtr()[mIndex], mHashMap->valuesPtr()[mIndex]);
+	sfz_assert(mIndex != SizeT(~0));
+	SizeT index = mIndex;
+	HashMap* table = mHashMap->tableForIterationIndex(index);
+	sfz_assert(table->isOccupied(index));
+	return KeyValuePair(table->keysPtr()[index], table->valueAt(index));
 }
 
-template<typename K, typename V, typename Descr>
-bool HashMap<K,V,Descr>::Iterator::operator== (const Iterator& other) const noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+bool HashMap<K,V,Descr,SizeT>::Iterator::operator== (const Iterator& other) const noexcept
 {
 	return (this->mHashMap == other.mHashMap) && (this->mIndex == other.mIndex);
 }
 
-template<typename K, typename V, typename Descr>
-bool HashMap<K,V,Descr>::Iterator::operator!= (const Iterator& other) const noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+bool HashMap<K,V,Descr,SizeT>::Iterator::operator!= (const Iterator& other) const noexcept
 {
 	return !(*this == other);
 }
 
-template<typename K, typename V, typename Descr>
-typename HashMap<K,V,Descr>::ConstIterator& HashMap<K,V,Descr>::ConstIterator::operator++ () noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+typename HashMap<K,V,Descr,SizeT>::ConstIterator&
+HashMap<K,V,Descr,SizeT>::ConstIterator::operator++ () noexcept
 {
 	// Go through map until we find next occupied slot
-	for (uint32_t i = mIndex + 1; i < mHashMap->mCapacity; ++i) {
-		uint8_t info = mHashMap->elementInfo(i);
-		if (info == ELEMENT_INFO_OCCUPIED) {
+	const SizeT numSlots = mHashMap->numIterationSlots();
+	for (SizeT i = mIndex + 1; i < numSlots; ++i) {
+		SizeT tableIndex = i;
+		if (mHashMap->tableForIterationIndex(tableIndex)->isOccupied(tableIndex)) {
 			mIndex = i;
 			return *this;
 		}
 	}
 
 	// Did not find any more elements, set to end
-	mIndex = uint32_t(~0);
+	mIndex = SizeT(~0);
 	return *this;
 }
 
-template<typename K, typename V, typename Descr>
-typename HashMap<K,V,Descr>::ConstIterator HashMap<K,V,Descr>::ConstIterator::operator++ (int) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+typename HashMap<K,V,Descr,SizeT>::ConstIterator
+HashMap<K,V,Descr,SizeT>::ConstIterator::operator++ (int) noexcept
 {
 	auto copy = *this;
 	++(*this);
 	return copy;
 }
 
-template<typename K, typename V, typename Descr>
-typename HashMap<K,V,Descr>::ConstKeyValuePair HashMap<K,V,Descr>::ConstIterator::operator* () noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+typename HashMap<K,V,Descr,SizeT>::ConstKeyValuePair
+HashMap<K,V,Descr,SizeT>::ConstIterator::operator* () noexcept
 {
-	sfz_assert(mIndex != uint32_t(~0));
-	sfz_assert(mHashMap->elementInfo(mIndex) == ELEMENT_INFO_OCCUPIED);
-	return ConstKeyValuePair(mHashMap->keysPtr()[mIndex], mHashMap->valuesPtr()[mIndex]);
+	sfz_assert(mIndex != SizeT(~0));
+	SizeT index = mIndex;
+	const HashMap* table = mHashMap->tableForIterationIndex(index);
+	sfz_assert(table->isOccupied(index));
+	return ConstKeyValuePair(table->keysPtr()[index], table->valueAt(index));
 }
 
-template<typename K, typename V, typename Descr>
-bool HashMap<K,V,Descr>::ConstIterator::operator== (const ConstIterator& other) const noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+bool HashMap<K,V,Descr,SizeT>::ConstIterator::operator== (const ConstIterator& other) const noexcept
 {
 	return (this->mHashMap == other.mHashMap) && (this->mIndex == other.mIndex);
 }
 
-template<typename K, typename V, typename Descr>
-bool HashMap<K,V,Descr>::ConstIterator::operator!= (const ConstIterator& other) const noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+bool HashMap<K,V,Descr,SizeT>::ConstIterator::operator!= (const ConstIterator& other) const noexcept
 {
 	return !(*this == other);
 }
@@ -425,111 +540,81 @@ bool HashMap<K,V,Descr>::ConstIterator::operator!= (const ConstIterator& other)
 // HashMap (implementation): Iterator methods
 // ------------------------------------------------------------------------------------------------
 
-template<typename K, typename V, typename Descr>
-typename HashMap<K,V,Descr>::Iterator HashMap<K,V,Descr>::begin() noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+typename HashMap<K,V,Descr,SizeT>::Iterator HashMap<K,V,Descr,SizeT>::begin() noexcept
 {
-	if (this->size() == 0) return Iterator(*this, uint32_t(~0));
+	if (this->size() == 0) return Iterator(*this, SizeT(~0));
 	Iterator it(*this, 0);
 	// Unless there happens to be an element in slot 0 we increment the iterator to find it
-	if (elementInfo(uint32_t(0)) != ELEMENT_INFO_OCCUPIED) {
+	if (!isOccupied(0)) {
 		++it;
 	}
 	return it;
 }
 
-template<typename K, typename V, typename Descr>
-typename HashMap<K,V,Descr>::ConstIterator HashMap<K,V,Descr>::begin() const noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+typename HashMap<K,V,Descr,SizeT>::ConstIterator HashMap<K,V,Descr,SizeT>::begin() const noexcept
 {
 	return cbegin();
 }
 
-template<typename K, typename V, typename Descr>
-typename HashMap<K,V,Descr>::ConstIterator HashMap<K,V,Descr>::cbegin() const noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+typename HashMap<K,V,Descr,SizeT>::ConstIterator HashMap<K,V,Descr,SizeT>::cbegin() const noexcept
 {
-	if (this->size() == 0) return ConstIterator(*this, uint32_t(~0));
+	if (this->size() == 0) return ConstIterator(*this, SizeT(~0));
 	ConstIterator it(*this, 0);
 	// Unless there happens to be an element in slot 0 we increment the iterator to find it
-	if (elementInfo(uint32_t(0)) != ELEMENT_INFO_OCCUPIED) {
+	if (!isOccupied(0)) {
 		++it;
 	}
 	return it;
 }
 
-template<typename K, typename V, typename Descr>
-typename HashMap<K,V,Descr>::Iterator HashMap<K,V,Descr>::end() noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+typename HashMap<K,V,Descr,SizeT>::Iterator HashMap<K,V,Descr,SizeT>::end() noexcept
 {
-	return Iterator(*this, uint32_t(~0));
+	return Iterator(*this, SizeT(~0));
 }
 
-template<typename K, typename V, typename Descr>
-typename HashMap<K,V,Descr>::ConstIterator HashMap<K,V,Descr>::end() const noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+typename HashMap<K,V,Descr,SizeT>::ConstIterator HashMap<K,V,Descr,SizeT>::end() const noexcept
 {
 	return cend();
 }
 
-template<typename K, typename V, typename Descr>
-typename HashMap<K,V,Descr>::ConstIterator HashMap<K,V,Descr>::cend() const noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+typename HashMap<K,V,Descr,SizeT>::ConstIterator HashMap<K,V,Descr,SizeT>::cend() const noexcept
 {
-	return ConstIterator(*this, uint32_t(~0));
+	return ConstIterator(*this, SizeT(~0));
 }
 
 // HashMap (implementation): Private methods
 // ------------------------------------------------------------------------------------------------
 
-template<typename K, typename V, typename Descr>
-uint32_t HashMap<K,V,Descr>::findPrimeCapacity(uint32_t capacity) const noexcept
-{
-	constexpr uint32_t PRIMES[] = {
-		67,
-		131,
-		257,
-		521,
-		1031,
-		2053,
-		4099,
-		8209,
-		16411,
-		32771,
-		65537,
-		131101,
-		262147,
-		524309,
-		1048583,
-		2097169,
-		4194319,
-		8388617,
-		16777259,
-		33554467,
-		67108879,
-		134217757,
-		268435459,
-		536870923,
-		1073741827,
-		2147483659
-	};
-
-	// Linear search is probably okay for an array this small
-	for (uint32_t i = 0; i < sizeof(PRIMES) / sizeof(uint32_t); ++i) {
-		if (PRIMES[i] >= capacity) return PRIMES[i];
-	}
+template<typename K, typename V, typename Descr, typename SizeT>
+uint64_t HashMap<K,V,Descr,SizeT>::sizeOfControlArray() const noexcept
+{
+	// 1 byte per slot, + GROUP_WIDTH mirrored bytes at the end
+	uint64_t ctrlMinRequiredSize = uint64_t(mCapacity) + GROUP_WIDTH;
 
-	// Found no prime, which means that the suggested capacity is too large.
-	return MAX_CAPACITY;
+	// Calculate how many alignment sized chunks is needed to store control bytes
+	uint64_t ctrlNumAlignmentSizedChunks = (ctrlMinRequiredSize >> ALIGNMENT_EXP) + 1;
+	return ctrlNumAlignmentSizedChunks << ALIGNMENT_EXP;
 }
 
-template<typename K, typename V, typename Descr>
-uint64_t HashMap<K,V,Descr>::sizeOfElementInfoArray() const noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+uint64_t HashMap<K,V,Descr,SizeT>::sizeOfHashArray() const noexcept
 {
-	// 2 bits per info element, + 1 since mCapacity always is odd.
-	uint64_t infoMinRequiredSize = (mCapacity >> 2) + 1;
+	if (!CACHE_HASHES) return 0;
 
-	// Calculate how many alignment sized chunks is needed to store element info
-	uint64_t infoNumAlignmentSizedChunks = (infoMinRequiredSize >> ALIGNMENT_EXP) + 1;
-	return infoNumAlignmentSizedChunks << ALIGNMENT_EXP;
+	// Calculate how many aligment sized chunks is needed to store hashes
+	uint64_t hashesMinRequiredSize = uint64_t(mCapacity) * sizeof(uint64_t);
+	uint64_t hashNumAlignmentSizedChunks = (hashesMinRequiredSize >> ALIGNMENT_EXP) + 1;
+	return hashNumAlignmentSizedChunks << ALIGNMENT_EXP;
 }
 
-template<typename K, typename V, typename Descr>
-uint64_t HashMap<K,V,Descr>::sizeOfKeyArray() const noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+uint64_t HashMap<K,V,Descr,SizeT>::sizeOfKeyArray() const noexcept
 {
 	// Calculate how many aligment sized chunks is needed to store keys
 	uint64_t keysMinRequiredSize = mCapacity * sizeof(K);
@@ -537,216 +622,439 @@ uint64_t HashMap<K,V,Descr>::sizeOfKeyArray() const noexcept
 	return keyNumAlignmentSizedChunks << ALIGNMENT_EXP;
 }
 
-template<typename K, typename V, typename Descr>
-uint64_t HashMap<K,V,Descr>::sizeOfValueArray() const noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+uint64_t HashMap<K,V,Descr,SizeT>::sizeOfValueArray() const noexcept
 {
+	if (!HAS_VALUES) return 0;
+
 	// Calculate how many alignment sized chunks is needed to store values
 	uint64_t valuesMinRequiredSize = mCapacity * sizeof(V);
 	uint64_t valuesNumAlignmentSizedChunks = (valuesMinRequiredSize >> ALIGNMENT_EXP) + 1;
 	return valuesNumAlignmentSizedChunks << ALIGNMENT_EXP;
 }
 
-template<typename K, typename V, typename Descr>
-uint64_t HashMap<K,V,Descr>::sizeOfAllocatedMemory() const noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+uint64_t HashMap<K,V,Descr,SizeT>::sizeOfAllocatedMemory() const noexcept
 {
-	return sizeOfElementInfoArray() + sizeOfKeyArray() + sizeOfValueArray();
+	return sizeOfControlArray() + sizeOfHashArray() + sizeOfKeyArray() + sizeOfValueArray();
 }
 
-template<typename K, typename V, typename Descr>
-uint8_t* HashMap<K,V,Descr>::elementInfoPtr() const noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+uint8_t* HashMap<K,V,Descr,SizeT>::controlPtr() const noexcept
 {
 	return mDataPtr;
 }
 
-template<typename K, typename V, typename Descr>
-K* HashMap<K,V,Descr>::keysPtr() const noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+uint64_t* HashMap<K,V,Descr,SizeT>::hashesPtr() const noexcept
 {
-	return reinterpret_cast<K*>(mDataPtr + sizeOfElementInfoArray());
+	return reinterpret_cast<uint64_t*>(mDataPtr + sizeOfControlArray());
 }
 
-template<typename K, typename V, typename Descr>
-V* HashMap<K,V,Descr>::valuesPtr() const noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+K* HashMap<K,V,Descr,SizeT>::keysPtr() const noexcept
 {
-	return reinterpret_cast<V*>(mDataPtr + sizeOfElementInfoArray() + sizeOfKeyArray());
+	return reinterpret_cast<K*>(mDataPtr + sizeOfControlArray() + sizeOfHashArray());
 }
 
-template<typename K, typename V, typename Descr>
-uint8_t HashMap<K,V,Descr>::elementInfo(uint32_t index) const noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+V* HashMap<K,V,Descr,SizeT>::valuesPtr() const noexcept
 {
-	uint32_t chunkIndex = index >> 2; // index / 4;
-	uint32_t chunkIndexModulo = index & 0x03; // index % 4
-	uint32_t chunkIndexModuloTimes2 = chunkIndexModulo << 1;
+	return reinterpret_cast<V*>(
+		mDataPtr + sizeOfControlArray() + sizeOfHashArray() + sizeOfKeyArray());
+}
 
-	uint8_t chunk = elementInfoPtr()[chunkIndex];
-	uint8_t info = static_cast<uint8_t>((chunk >> (chunkIndexModuloTimes2)) & 0x3);
+template<typename K, typename V, typename Descr, typename SizeT>
+V& HashMap<K,V,Descr,SizeT>::valueAt(SizeT index) const noexcept
+{
+	if constexpr (HAS_VALUES) {
+		return valuesPtr()[index];
+	}
+	else {
+		(void)index;
+		static V dummy;
+		return dummy;
+	}
+}
 
-	return info;
+template<typename K, typename V, typename Descr, typename SizeT>
+bool HashMap<K,V,Descr,SizeT>::isOccupied(SizeT index) const noexcept
+{
+	return detail::hashTableCtrlIsOccupied(controlPtr()[index]);
 }
 
-template<typename K, typename V, typename Descr>
-void HashMap<K,V,Descr>::setElementInfo(uint32_t index, uint8_t value) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+uint64_t HashMap<K,V,Descr,SizeT>::hashOfSlot(SizeT index) const noexcept
 {
-	uint32_t chunkIndex = index >> 2; // index / 4;
-	uint32_t chunkIndexModulo = index & 0x03; // index % 4
-	uint32_t chunkIndexModuloTimes2 = chunkIndexModulo << 1;
+	sfz_assert(isOccupied(index));
+	if constexpr (CACHE_HASHES) return hashesPtr()[index];
+	else return uint64_t(KeyHash()(keysPtr()[index]));
+}
 
-	uint8_t chunk = elementInfoPtr()[chunkIndex];
+template<typename K, typename V, typename Descr, typename SizeT>
+void HashMap<K,V,Descr,SizeT>::insertMovedUnique(uint64_t hash, K& key, V& value) noexcept
+{
+	bool isPlaceholder = false;
+	SizeT index = this->findFreeSlot(hash, isPlaceholder);
+	sfz_assert_hard(index != SizeT(~0));
 
-	// Remove previous info
-	chunk = chunk & (~(uint32_t(0x03) << chunkIndexModuloTimes2));
+	setControl(index, detail::hashTableCtrlFromHash(hash));
+	if constexpr (CACHE_HASHES) hashesPtr()[index] = hash;
+	new (keysPtr() + index) K(std::move(key));
+	if constexpr (HAS_VALUES) new (valuesPtr() + index) V(std::move(value));
+	mSize += 1;
+	if (isPlaceholder) mPlaceholders -= 1;
+}
 
-	// Insert new info
-	elementInfoPtr()[chunkIndex] =  uint8_t(chunk | (value << chunkIndexModuloTimes2));
+template<typename K, typename V, typename Descr, typename SizeT>
+SizeT HashMap<K,V,Descr,SizeT>::numIterationSlots() const noexcept
+{
+	return mCapacity + (mOldMap != nullptr ? mOldMap->mCapacity : 0);
 }
 
-template<typename K, typename V, typename Descr>
-template<typename KT, typename Hash, typename Equal>
-uint32_t HashMap<K,V,Descr>::findElementIndex(const KT& key, bool& elementFound,
-                                                        uint32_t& firstFreeSlot, bool& isPlaceholder) const noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+HashMap<K,V,Descr,SizeT>*
+HashMap<K,V,Descr,SizeT>::tableForIterationIndex(SizeT& index) const noexcept
 {
-	Hash keyHasher;
-	Equal keyComparer;
+	if (index < mCapacity) return const_cast<HashMap*>(this);
+	sfz_assert(mOldMap != nullptr);
+	index -= mCapacity;
+	return mOldMap;
+}
 
-	elementFound = false;
-	firstFreeSlot = uint32_t(~0);
-	isPlaceholder = false;
-	K* const keys = keysPtr();
+template<typename K, typename V, typename Descr, typename SizeT>
+void HashMap<K,V,Descr,SizeT>::startIncrementalRehash(SizeT newCapacity) noexcept
+{
+	sfz_assert(mOldMap == nullptr);
 
-	// Early exit if HashMap has no capacity
-	if (mCapacity == 0) return uint32_t(~0);
+	// Iteration indices cover both tables, fall back to a full rehash if they would not fit
+	if ((uint64_t(mCapacity) + uint64_t(newCapacity)) >= uint64_t(SizeT(~0))) {
+		this->rehash(newCapacity);
+		return;
+	}
 
-	// Hash the key and find the base index
-	const int64_t baseIndex = int64_t(keyHasher(key) % uint64_t(mCapacity));
+	// Move the current table to the old table
+	HashMap* old = mAllocator->newObject<HashMap>(sfz_dbg("HashMap"));
+	old->mSize = mSize;
+	old->mCapacity = mCapacity;
+	old->mPlaceholders = mPlaceholders;
+	old->mDataPtr = mDataPtr;
+	old->mAllocator = mAllocator;
+	mOldMap = old;
+	mMigrateIndex = 0;
+
+	// Allocate the new table, only the control bytes need to be initialized
+	mSize = 0;
+	mCapacity = newCapacity;
+	mPlaceholders = 0;
+	mDataPtr = (uint8_t*)mAllocator->allocate(
+		sfz_dbg("HashMap"), this->sizeOfAllocatedMemory(), ALIGNMENT);
+	std::memset(this->controlPtr(), CTRL_EMPTY, this->sizeOfControlArray());
+}
 
-	// Check if base index holds the element
-	uint8_t info = elementInfo(uint32_t(baseIndex));
-	if (info == ELEMENT_INFO_EMPTY) {
-		firstFreeSlot = uint32_t(baseIndex);
-		return uint32_t(~0);
-	}
-	else if (info == ELEMENT_INFO_PLACEHOLDER) {
-		firstFreeSlot = uint32_t(baseIndex);
-		isPlaceholder = true;
+template<typename K, typename V, typename Descr, typename SizeT>
+void HashMap<K,V,Descr,SizeT>::incrementalRehashStep() noexcept
+{
+	if (mOldMap == nullptr) return;
+	HashMap& old = *mOldMap;
+	K* const oldKeys = old.keysPtr();
+
+	SizeT end = mMigrateIndex + INCREMENTAL_REHASH_SLOTS_PER_STEP;
+	if (end > old.mCapacity) end = old.mCapacity;
+	for (SizeT i = mMigrateIndex; i < end; i++) {
+		if (!old.isOccupied(i)) continue;
+
+		// Keys are never stored in both tables, so we only need to find a free slot
+		this->insertMovedUnique(old.hashOfSlot(i), oldKeys[i], old.valueAt(i));
+
+		// Remove it from the old table
+		old.setControl(i, CTRL_PLACEHOLDER);
+		oldKeys[i].~K();
+		old.valueAt(i).~V();
+		old.mSize -= 1;
+		old.mPlaceholders += 1;
 	}
-	else if (info == ELEMENT_INFO_OCCUPIED) {
-		if (keyComparer(key, keys[baseIndex])) {
-			elementFound = true;
-			return uint32_t(baseIndex);
-		}
+	mMigrateIndex = end;
+
+	// Old table is no longer needed when all elements have been migrated or removed
+	if (mMigrateIndex >= old.mCapacity || old.mSize == 0) {
+		sfz_assert(old.mSize == 0);
+		this->destroyOldTable();
 	}
+}
 
-	// Search for the element using quadratic probing
-	const int64_t maxNumProbingAttempts = int64_t(mCapacity);
-	for (int64_t i = 1; i < maxNumProbingAttempts; ++i) {
-		const int64_t iSquared = i * i;
-
-		// Try (base + i²) index
-		int64_t index = (baseIndex + iSquared) % int64_t(mCapacity);
-		info = elementInfo(uint32_t(index));
-		if (info == ELEMENT_INFO_EMPTY) {
-			if (firstFreeSlot == uint32_t(~0)) firstFreeSlot = uint32_t(index);
-			break;
-		} else if (info == ELEMENT_INFO_PLACEHOLDER) {
-			if (firstFreeSlot == uint32_t(~0)) {
-				firstFreeSlot = uint32_t(index);
-				isPlaceholder = true;
-			}
-		} else if (info == ELEMENT_INFO_OCCUPIED) {
+template<typename K, typename V, typename Descr, typename SizeT>
+void HashMap<K,V,Descr,SizeT>::destroyOldTable() noexcept
+{
+	mOldMap->destroy();
+	mAllocator->deleteObject(mOldMap);
+	mOldMap = nullptr;
+	mMigrateIndex = 0;
+}
+
+template<typename K, typename V, typename Descr, typename SizeT>
+void HashMap<K,V,Descr,SizeT>::setControl(SizeT index, uint8_t ctrl) noexcept
+{
+	uint8_t* ctrlPtr = controlPtr();
+	ctrlPtr[index] = ctrl;
+	if (index < GROUP_WIDTH) ctrlPtr[mCapacity + index] = ctrl;
+}
+
+template<typename K, typename V, typename Descr, typename SizeT>
+SizeT HashMap<K,V,Descr,SizeT>::probeStart(uint64_t hash) const noexcept
+{
+	return CapacityPolicy::slotFromHash(hash, mCapacity);
+}
+
+template<typename K, typename V, typename Descr, typename SizeT>
+SizeT HashMap<K,V,Descr,SizeT>::probeNext(SizeT groupStart) const noexcept
+{
+	// Capacity is never smaller than GROUP_WIDTH
+	return CapacityPolicy::wrapIndex(groupStart + GROUP_WIDTH, mCapacity);
+}
+
+template<typename K, typename V, typename Descr, typename SizeT>
+template<typename KT, typename Equal>
+SizeT HashMap<K,V,Descr,SizeT>::findElementIndex(const KT& key, uint64_t hash,
+	bool& elementFound, SizeT& firstFreeSlot, bool& isPlaceholder) const noexcept
+{
+	Equal keyComparer;
+
+	elementFound = false;
+	firstFreeSlot = SizeT(~0);
+	isPlaceholder = false;
+	const uint8_t* const ctrlPtr = controlPtr();
+	const uint64_t* const hashes = hashesPtr();
+	K* const keys = keysPtr();
+
+	// Early exit if HashMap has no capacity
+	if (mCapacity == 0) return SizeT(~0);
+
+	// Find the first group to probe
+	const uint8_t ctrl = detail::hashTableCtrlFromHash(hash);
+	SizeT groupStart = probeStart(hash);
+
+	// Probe one group at a time. The probed groups are consecutive (wrapping around at the end),
+	// so the whole table has been searched after this many groups.
+	const SizeT maxNumProbedGroups = (mCapacity + GROUP_WIDTH - 1) / GROUP_WIDTH;
+	for (SizeT i = 0; i < maxNumProbedGroups; i++) {
+		const detail::HashTableGroup group(ctrlPtr + groupStart);
+
+		// Compare keys in all slots whose control byte match the hash
+		for (detail::GroupBitMask m = group.match(ctrl); m.any(); m.removeLowest()) {
+			SizeT index = CapacityPolicy::wrapIndex(groupStart + m.lowest(), mCapacity);
+			if (CACHE_HASHES && hashes[index] != hash) continue;
 			if (keyComparer(key, keys[index])) {
 				elementFound = true;
-				return uint32_t(index);
+				return index;
 			}
 		}
 
-		// Try (base - i²) index
-		index = (((baseIndex - iSquared) % int64_t(mCapacity)) + int64_t(mCapacity)) % int64_t(mCapacity);
-		info = elementInfo(uint32_t(index));
-		if (info == ELEMENT_INFO_EMPTY) {
-			if (firstFreeSlot == uint32_t(~0)) firstFreeSlot = uint32_t(index);
-			break;
-		} else if (info == ELEMENT_INFO_PLACEHOLDER) {
-			if (firstFreeSlot == uint32_t(~0)) {
-				firstFreeSlot = uint32_t(index);
-				isPlaceholder = true;
-			}
-		} else if (info == ELEMENT_INFO_OCCUPIED) {
-			if (keyComparer(key, keys[index])) {
-				elementFound = true;
-				return uint32_t(index);
+		// Store the first free slot found
+		if (firstFreeSlot == SizeT(~0)) {
+			detail::GroupBitMask freeMask = group.matchEmptyOrPlaceholder();
+			if (freeMask.any()) {
+				SizeT index = groupStart + freeMask.lowest();
+				index = CapacityPolicy::wrapIndex(index, mCapacity);
+				firstFreeSlot = index;
+				isPlaceholder = ctrlPtr[index] == CTRL_PLACEHOLDER;
 			}
 		}
+
+		// If the group has an empty slot the key can't be stored further along the probe sequence
+		if (group.matchEmpty().any()) break;
+
+		groupStart = probeNext(groupStart);
 	}
 
-	return uint32_t(~0);
+	return SizeT(~0);
 }
 
-template<typename K, typename V, typename Descr>
-template<typename KT, typename Hash, typename Equal>
-V* HashMap<K,V,Descr>::getInternal(const KT& key) const noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+SizeT HashMap<K,V,Descr,SizeT>::findFreeSlot(uint64_t hash, bool& isPlaceholder) const noexcept
+{
+	const uint8_t* const ctrlPtr = controlPtr();
+	SizeT groupStart = probeStart(hash);
+	const SizeT maxNumProbedGroups = (mCapacity + GROUP_WIDTH - 1) / GROUP_WIDTH;
+	for (SizeT i = 0; i < maxNumProbedGroups; i++) {
+		const detail::HashTableGroup group(ctrlPtr + groupStart);
+		detail::GroupBitMask freeMask = group.matchEmptyOrPlaceholder();
+		if (freeMask.any()) {
+			SizeT index = groupStart + freeMask.lowest();
+			index = CapacityPolicy::wrapIndex(index, mCapacity);
+			isPlaceholder = ctrlPtr[index] == CTRL_PLACEHOLDER;
+			return index;
+		}
+		groupStart = probeNext(groupStart);
+	}
+	return SizeT(~0);
+}
+
+template<typename K, typename V, typename Descr, typename SizeT>
+template<typename KT, typename Equal>
+V* HashMap<K,V,Descr,SizeT>::getInternal(const KT& key, uint64_t hash) const noexcept
 {
 	// Finds the index of the element
-	uint32_t firstFreeSlot = uint32_t(~0);
+	SizeT firstFreeSlot = SizeT(~0);
 	bool elementFound = false;
 	bool isPlaceholder = false;
-	uint32_t index = this->findElementIndex<KT,Hash,Equal>(key, elementFound, firstFreeSlot, isPlaceholder);
+	SizeT index =
+		this->findElementIndex<KT,Equal>(key, hash, elementFound, firstFreeSlot, isPlaceholder);
 
-	// Returns nullptr if map doesn't contain element
-	if (!elementFound) return nullptr;
+	// Check old table if not found and incremental rehash is in progress
+	if (!elementFound) {
+		if (mOldMap != nullptr) return mOldMap->getInternal<KT,Equal>(key, hash);
+		return nullptr;
+	}
 
 	// Returns pointer to element
-	return &(valuesPtr()[index]);
+	return &valueAt(index);
+}
+
+template<typename K, typename V, typename Descr, typename SizeT>
+template<typename KT, typename Hash, typename Equal>
+void HashMap<K,V,Descr,SizeT>::getBatchInternal(
+	const KT* keys, SizeT numKeys, V** valuesOut) const noexcept
+{
+	if (mSize == 0) {
+		for (SizeT i = 0; i < numKeys; i++) valuesOut[i] = nullptr;
+		if (mOldMap != nullptr) mOldMap->getBatchInternal<KT,Hash,Equal>(keys, numKeys, valuesOut);
+		return;
+	}
+
+	Hash keyHasher;
+	const uint8_t* const ctrlPtr = controlPtr();
+	const uint64_t* const hashesArr = hashesPtr();
+	K* const keysArr = keysPtr();
+
+	for (SizeT chunkStart = 0; chunkStart < numKeys; chunkStart += BATCH_CHUNK_SIZE) {
+		const SizeT numLeft = numKeys - chunkStart;
+		const SizeT chunkSize = numLeft < BATCH_CHUNK_SIZE ? numLeft : BATCH_CHUNK_SIZE;
+		const KT* chunkKeys = keys + chunkStart;
+
+		// Hash all keys and prefetch the start of their probe sequences
+		uint64_t hashes[BATCH_CHUNK_SIZE];
+		for (SizeT i = 0; i < chunkSize; i++) {
+			hashes[i] = uint64_t(keyHasher(chunkKeys[i]));
+			SizeT groupStart = probeStart(hashes[i]);
+			detail::hashTablePrefetch(ctrlPtr + groupStart);
+			if (CACHE_HASHES) detail::hashTablePrefetch(hashesArr + groupStart);
+			detail::hashTablePrefetch(keysArr + groupStart);
+		}
+
+		// Resolve the lookups, hopefully the memory they need has arrived by now
+		for (SizeT i = 0; i < chunkSize; i++) {
+			SizeT firstFreeSlot = SizeT(~0);
+			bool elementFound = false;
+			bool isPlaceholder = false;
+			SizeT index = this->findElementIndex<KT,Equal>(
+				chunkKeys[i], hashes[i], elementFound, firstFreeSlot, isPlaceholder);
+			valuesOut[chunkStart + i] = elementFound ? &valueAt(index) : nullptr;
+
+			// Keys not found might be in the old table if incremental rehash is in progress
+			if (!elementFound && mOldMap != nullptr) {
+				valuesOut[chunkStart + i] =
+					mOldMap->getInternal<KT,Equal>(chunkKeys[i], hashes[i]);
+			}
+		}
+	}
 }
 
-template<typename K, typename V, typename Descr>
-template<typename KT, typename VT, typename Hash, typename Equal>
-V& HashMap<K,V,Descr>::putInternal(KT&& key, VT&& value) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+template<typename KT, typename VT, typename Equal>
+V& HashMap<K,V,Descr,SizeT>::putInternal(KT&& key, uint64_t hash, VT&& value) noexcept
 {
 	// Utilizes perfect forwarding in order to determine if parameters are const references or rvalues.
 	// const reference: KT == const K&
 	// rvalue: KT == K
 	// std::forward<KT>(key) will then return the correct version of key
 
-	ensureProperlyHashed();
+	// Value is only used once, either to construct a new element or to replace an existing one
+	InsertResult res =
+		this->emplaceInternal<KT,Equal>(std::forward<KT>(key), hash, std::forward<VT>(value));
+	if (!res.inserted) res.value = std::forward<VT>(value);
+	return res.value;
+}
+
+template<typename K, typename V, typename Descr, typename SizeT>
+template<typename KT, typename Equal, typename... Args>
+typename HashMap<K,V,Descr,SizeT>::InsertResult
+HashMap<K,V,Descr,SizeT>::emplaceInternal(KT&& key, uint64_t hash, Args&&... args) noexcept
+{
+	// KT is a reference type if the key is passed by const reference
+	using KeyT = typename std::decay<KT>::type;
 
 	// Finds the index of the element
-	uint32_t firstFreeSlot = uint32_t(~0);
+	SizeT firstFreeSlot = SizeT(~0);
 	bool elementFound = false;
 	bool isPlaceholder = false;
-	uint32_t index = this->findElementIndex<KT,Hash,Equal>(key, elementFound, firstFreeSlot, isPlaceholder);
+	SizeT index =
+		this->findElementIndex<KeyT,Equal>(key, hash, elementFound, firstFreeSlot, isPlaceholder);
 
-	// If map contains key just replace value and return
-	if (elementFound) {
-		valuesPtr()[index] = std::forward<VT>(value);
-		return valuesPtr()[index];
+	// If map contains key just return it
+	if (elementFound) return { valueAt(index), false };
+
+	// If incremental rehash is in progress the key might be in the old table
+	if (mOldMap != nullptr) {
+		V* oldValue = mOldMap->getInternal<KeyT,Equal>(key, hash);
+		if (oldValue != nullptr) return { *oldValue, false };
 	}
 
-	// Otherwise insert info, key and value
-	setElementInfo(firstFreeSlot, ELEMENT_INFO_OCCUPIED);
+	// Insert new element
+	V& value = this->insertNew<KT>(
+		std::forward<KT>(key), hash, firstFreeSlot, isPlaceholder, std::forward<Args>(args)...);
+	return { value, true };
+}
+
+template<typename K, typename V, typename Descr, typename SizeT>
+template<typename KT, typename... Args>
+V& HashMap<K,V,Descr,SizeT>::insertNew(KT&& key, uint64_t hash, SizeT firstFreeSlot,
+	bool isPlaceholder, Args&&... args) noexcept
+{
+	// Make room for the new element. If this modified the table the free slot found is no longer
+	// valid and we need to probe again, the key is known to not exist so no keys are compared.
+	const SizeT sizeBefore = mSize;
+	const bool rehashed = ensureProperlyHashed();
+	incrementalRehashStep();
+	if (rehashed || mSize != sizeBefore) {
+		firstFreeSlot = this->findFreeSlot(hash, isPlaceholder);
+	}
+	sfz_assert(firstFreeSlot != SizeT(~0));
+
+	// Insert info, key and value
+	setControl(firstFreeSlot, detail::hashTableCtrlFromHash(hash));
+	if constexpr (CACHE_HASHES) hashesPtr()[firstFreeSlot] = hash;
 	new (keysPtr() + firstFreeSlot) K(std::forward<KT>(key));
-	new (valuesPtr() + firstFreeSlot) V(std::forward<VT>(value));
+	if constexpr (HAS_VALUES) new (valuesPtr() + firstFreeSlot) V(std::forward<Args>(args)...);
 
 	mSize += 1;
 	if (isPlaceholder) mPlaceholders -= 1;
-	return valuesPtr()[firstFreeSlot];
+	return valueAt(firstFreeSlot);
 }
 
-template<typename K, typename V, typename Descr>
-template<typename KT, typename Hash, typename Equal>
-bool HashMap<K,V,Descr>::removeInternal(const KT& key) noexcept
+template<typename K, typename V, typename Descr, typename SizeT>
+template<typename KT, typename Equal>
+bool HashMap<K,V,Descr,SizeT>::removeInternal(const KT& key, uint64_t hash) noexcept
 {
+	incrementalRehashStep();
+
 	// Finds the index of the element
-	uint32_t firstFreeSlot = uint32_t(~0);
+	SizeT firstFreeSlot = SizeT(~0);
 	bool elementFound = false;
 	bool isPlaceholder = false;
-	uint32_t index = this->findElementIndex<KT,Hash,Equal>(key, elementFound, firstFreeSlot, isPlaceholder);
+	SizeT index =
+		this->findElementIndex<KT,Equal>(key, hash, elementFound, firstFreeSlot, isPlaceholder);
 
-	// Returns nullptr if map doesn't contain element
-	if (!elementFound) return false;
+	// Check old table if not found and incremental rehash is in progress
+	if (!elementFound) {
+		if (mOldMap != nullptr) return mOldMap->removeInternal<KT,Equal>(key, hash);
+		return false;
+	}
 
 	// Remove element
-	setElementInfo(index, ELEMENT_INFO_PLACEHOLDER);
+	setControl(index, CTRL_PLACEHOLDER);
 	keysPtr()[index].~K();
-	valuesPtr()[index].~V();
+	valueAt(index).~V();
 
 	mSize -= 1;
 	mPlaceholders += 1;
@@ -0,0 +1,237 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#pragma once
+
+#include <cstdint>
+#include <utility> // std::move
+
+#include "sfz/containers/HashMap.hpp"
+
+namespace sfz {
+
+// HashSet
+// ------------------------------------------------------------------------------------------------
+
+/// A HashSet with closed hashing (open adressing).
+///
+/// HashSet is implemented on top of HashMap with a value type that is never stored, so it uses
+/// the same probing, capacity policies, alt key lookups and allocator handling as HashMap (read
+/// its documentation for the details). Only the control bytes and keys (and the hashes if the
+/// HashTableKeyDescriptor enables CACHE_HASHES) are allocated, there is no value array.
+///
+/// In addition to the usual operations (add(), contains(), remove()) the set operations union,
+/// intersection and difference are available, both in place (addAll(), retainAll(),
+/// removeAll()) and as functions returning a new set (setUnion(), setIntersection(),
+/// setDifference()). They iterate over the smaller of the two sets where possible and allocate
+/// all needed capacity upfront, so the result is never rehashed more than once.
+///
+/// \param K the key type
+/// \param Descr the HashTableKeyDescriptor (by default sfz::HashTableKeyDescriptor)
+/// \param SizeT the type of sizes and indices, uint32_t (default) or uint64_t
+template<typename K, typename Descr = HashTableKeyDescriptor<K>, typename SizeT = uint32_t>
+class HashSet final {
+public:
+	// Typedefs
+	// --------------------------------------------------------------------------------------------
+
+	using MapT = HashMap<K, detail::HashTableNoValue, Descr, SizeT>;
+	using AltK = typename MapT::AltK;
+
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	/// Creates an empty HashSet without setting an allocator or allocating any memory.
+	HashSet() noexcept = default;
+	HashSet(const HashSet&) noexcept = default;
+	HashSet& operator= (const HashSet&) noexcept = default;
+	HashSet(HashSet&&) noexcept = default;
+	HashSet& operator= (HashSet&&) noexcept = default;
+	~HashSet() noexcept = default;
+
+	/// Constructs a new HashSet using create()
+	explicit HashSet(SizeT suggestedCapacity, Allocator* allocator = getDefaultAllocator()) noexcept
+		: mMap(suggestedCapacity, allocator) { }
+
+	/// Copy constructor that change allocator. Copies content but uses the specific allocator for
+	/// the copy instead of the original one.
+	HashSet(const HashSet& other, Allocator* allocator) noexcept : mMap(other.mMap, allocator) { }
+
+	// State methods
+	// --------------------------------------------------------------------------------------------
+
+	/// See HashMap::create()
+	void create(SizeT suggestedCapacity, Allocator* allocator = getDefaultAllocator()) noexcept
+	{
+		mMap.create(suggestedCapacity, allocator);
+	}
+
+	void swap(HashSet& other) noexcept { mMap.swap(other.mMap); }
+	void destroy() noexcept { mMap.destroy(); }
+	void clear() noexcept { mMap.clear(); }
+	void rehash(SizeT suggestedCapacity) noexcept { mMap.rehash(suggestedCapacity); }
+	void setIncrementalRehash(bool enabled) noexcept { mMap.setIncrementalRehash(enabled); }
+	void completeRehash() noexcept { mMap.completeRehash(); }
+
+	// Getters
+	// --------------------------------------------------------------------------------------------
+
+	SizeT size() const noexcept { return mMap.size(); }
+	SizeT capacity() const noexcept { return mMap.capacity(); }
+	SizeT placeholders() const noexcept { return mMap.placeholders(); }
+	Allocator* allocator() const noexcept { return mMap.allocator(); }
+
+	/// Returns whether the given key is in this HashSet. Guaranteed to never rehash.
+	bool contains(const K& key) const noexcept { return mMap.get(key) != nullptr; }
+	bool contains(const AltK& key) const noexcept { return mMap.get(key) != nullptr; }
+
+	// Public methods
+	// --------------------------------------------------------------------------------------------
+
+	/// Adds the given key to this HashSet. Returns whether it was added, i.e. false if it already
+	/// was in the set. Might rehash if the key was not in the set.
+	bool add(const K& key) noexcept { return mMap.emplace(key).inserted; }
+	bool add(K&& key) noexcept { return mMap.emplace(std::move(key)).inserted; }
+	bool add(const AltK& key) noexcept { return mMap.emplace(key).inserted; }
+
+	/// Removes the given key from this HashSet. Returns false if it was not in the set. Never
+	/// starts a rehash, but migrates keys while an incremental rehash is in progress (see
+	/// HashMap::remove()).
+	bool remove(const K& key) noexcept { return mMap.remove(key); }
+	bool remove(const AltK& key) noexcept { return mMap.remove(key); }
+
+	// Set operations
+	// --------------------------------------------------------------------------------------------
+
+	/// Union, adds all keys in the other set to this set.
+	void addAll(const HashSet& other) noexcept
+	{
+		this->reserve(this->size() + other.size());
+		for (const K& key : other) mMap.emplace(key);
+	}
+
+	/// Intersection, removes all keys in this set which are not in the other set.
+	void retainAll(const HashSet& other) noexcept
+	{
+		// Elements must not be migrated by an incremental rehash while iterating
+		mMap.completeRehash();
+		for (auto pair : mMap) {
+			if (!other.contains(pair.key)) mMap.remove(pair.key);
+		}
+	}
+
+	/// Difference, removes all keys in the other set from this set.
+	void removeAll(const HashSet& other) noexcept
+	{
+		mMap.completeRehash();
+		if (other.size() < this->size()) {
+			for (const K& key : other) mMap.remove(key);
+		}
+		else {
+			for (auto pair : mMap) {
+				if (other.contains(pair.key)) mMap.remove(pair.key);
+			}
+		}
+	}
+
+	/// Returns a new set with all keys in either lhs or rhs. Uses the allocator of lhs.
+	static HashSet setUnion(const HashSet& lhs, const HashSet& rhs) noexcept
+	{
+		const bool lhsSmaller = lhs.size() < rhs.size();
+		const HashSet& larger = lhsSmaller ? rhs : lhs;
+		const HashSet& smaller = lhsSmaller ? lhs : rhs;
+		HashSet result(larger, allocatorOf(lhs));
+		result.addAll(smaller);
+		return result;
+	}
+
+	/// Returns a new set with all keys in both lhs and rhs. Uses the allocator of lhs.
+	static HashSet setIntersection(const HashSet& lhs, const HashSet& rhs) noexcept
+	{
+		const bool lhsSmaller = lhs.size() < rhs.size();
+		const HashSet& larger = lhsSmaller ? rhs : lhs;
+		const HashSet& smaller = lhsSmaller ? lhs : rhs;
+		HashSet result(0, allocatorOf(lhs));
+		result.reserve(smaller.size());
+		for (const K& key : smaller) {
+			if (larger.contains(key)) result.mMap.emplace(key);
+		}
+		return result;
+	}
+
+	/// Returns a new set with all keys in lhs which are not in rhs. Uses the allocator of lhs.
+	static HashSet setDifference(const HashSet& lhs, const HashSet& rhs) noexcept
+	{
+		HashSet result(0, allocatorOf(lhs));
+		result.reserve(lhs.size());
+		for (const K& key : lhs) {
+			if (!rhs.contains(key)) result.mMap.emplace(key);
+		}
+		return result;
+	}
+
+	// Iterators
+	// --------------------------------------------------------------------------------------------
+
+	/// Iterator over the keys in the set. The same rules as for HashMap iterators apply, i.e. the
+	/// HashSet must not be modified while iterating.
+	class ConstIterator final {
+	public:
+		ConstIterator(typename MapT::ConstIterator it) noexcept : mIt(it) { }
+		ConstIterator(const ConstIterator&) noexcept = default;
+		ConstIterator& operator= (const ConstIterator&) noexcept = default;
+		~ConstIterator() noexcept = default;
+
+		ConstIterator& operator++ () noexcept { ++mIt; return *this; } // Pre-increment
+		ConstIterator operator++ (int) noexcept { ConstIterator tmp = *this; ++mIt; return tmp; }
+		const K& operator* () noexcept { return (*mIt).key; }
+		bool operator== (const ConstIterator& other) const noexcept { return mIt == other.mIt; }
+		bool operator!= (const ConstIterator& other) const noexcept { return mIt != other.mIt; }
+
+	private:
+		typename MapT::ConstIterator mIt;
+	};
+
+	ConstIterator begin() const noexcept { return ConstIterator(mMap.cbegin()); }
+	ConstIterator cbegin() const noexcept { return ConstIterator(mMap.cbegin()); }
+	ConstIterator end() const noexcept { return ConstIterator(mMap.cend()); }
+	ConstIterator cend() const noexcept { return ConstIterator(mMap.cend()); }
+
+private:
+	// Private methods
+	// --------------------------------------------------------------------------------------------
+
+	/// Ensures that the specified number of keys can be stored without rehashing
+	void reserve(SizeT numKeys) noexcept
+	{
+		SizeT capacity = SizeT(numKeys / MapT::MAX_OCCUPIED_REHASH_FACTOR) + 1;
+		if (capacity > mMap.capacity()) mMap.rehash(capacity);
+	}
+
+	static Allocator* allocatorOf(const HashSet& set) noexcept
+	{
+		return set.allocator() != nullptr ? set.allocator() : getDefaultAllocator();
+	}
+
+	// Private members
+	// --------------------------------------------------------------------------------------------
+
+	MapT mMap;
+};
+
+} // namespace sfz
@@ -0,0 +1,163 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+#pragma once
+
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SFZ_HASH_TABLE_SSE2 1
+#include <emmintrin.h> // SSE2
+#else
+#define SFZ_HASH_TABLE_SSE2 0
+#endif
+
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+
+namespace sfz {
+
+namespace detail {
+
+// Control bytes
+// ------------------------------------------------------------------------------------------------
+
+// The hash tables in sfzCore store one control byte per slot. The control byte of an occupied
+// slot holds 7 bits of the key's hash (the high bit is 0), empty and placeholder (removed) slots
+// have the high bit set. This means that 16 slots can be checked for a matching key with a single
+// SIMD compare, and keys only need to be compared when the 7 bits match.
+//
+// The control array has GROUP_WIDTH extra bytes at the end which mirror the first GROUP_WIDTH
+// control bytes, so a group can be loaded from any slot without wrapping around.
+
+constexpr uint32_t HASH_TABLE_GROUP_WIDTH = 16;
+constexpr uint8_t HASH_TABLE_CTRL_EMPTY = 0x80;
+constexpr uint8_t HASH_TABLE_CTRL_PLACEHOLDER = 0xFE;
+
+/// Multiplicative (Fibonacci) hashing constant, 2^64 divided by the golden ratio
+constexpr uint64_t HASH_TABLE_FIBONACCI_MULTIPLIER = 0x9E3779B97F4A7C15ull;
+
+/// Returns the 7 hash bits stored in the control byte of an occupied slot. Taken from the middle
+/// of the mixed hash so they are not correlated with the slot index, even for weak hashes such as
+/// the identity hash of integers.
+inline uint8_t hashTableCtrlFromHash(uint64_t hash) noexcept
+{
+	return uint8_t(((hash * HASH_TABLE_FIBONACCI_MULTIPLIER) >> 25) & 0x7F);
+}
+
+inline bool hashTableCtrlIsOccupied(uint8_t ctrl) noexcept
+{
+	return (ctrl & 0x80) == 0;
+}
+
+/// Hints the CPU to start loading the cache line containing the specified address
+inline void hashTablePrefetch(const void* ptr) noexcept
+{
+#if SFZ_HASH_TABLE_SSE2
+	_mm_prefetch(reinterpret_cast<const char*>(ptr), _MM_HINT_T0);
+#elif defined(__GNUC__) || defined(__clang__)
+	__builtin_prefetch(ptr);
+#else
+	(void)ptr;
+#endif
+}
+
+// GroupBitMask
+// ------------------------------------------------------------------------------------------------
+
+/// Bit mask with one bit per slot in a group, used to iterate over matching slots
+struct GroupBitMask final {
+	uint32_t bits = 0;
+
+	bool any() const noexcept { return bits != 0; }
+
+	/// Returns the offset of the lowest matching slot in the group, mask must not be empty
+	uint32_t lowest() const noexcept
+	{
+#ifdef _WIN32
+		unsigned long index = 0;
+		_BitScanForward(&index, bits);
+		return uint32_t(index);
+#else
+		return uint32_t(__builtin_ctz(bits));
+#endif
+	}
+
+	void removeLowest() noexcept { bits &= (bits - 1); }
+};
+
+// HashTableGroup
+// ------------------------------------------------------------------------------------------------
+
+/// GROUP_WIDTH consecutive control bytes, matched in parallel using SSE2 if available
+struct HashTableGroup final {
+#if SFZ_HASH_TABLE_SSE2
+	__m128i ctrl;
+
+	explicit HashTableGroup(const uint8_t* ctrlPtr) noexcept
+	{
+		ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrlPtr));
+	}
+
+	/// Returns the slots whose control byte is exactly the specified value
+	GroupBitMask match(uint8_t value) const noexcept
+	{
+		__m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8(char(value)), ctrl);
+		return GroupBitMask{ uint32_t(_mm_movemask_epi8(cmp)) };
+	}
+
+	/// Returns the slots which are either empty or placeholders (i.e. not occupied)
+	GroupBitMask matchEmptyOrPlaceholder() const noexcept
+	{
+		return GroupBitMask{ uint32_t(_mm_movemask_epi8(ctrl)) };
+	}
+#else
+	uint8_t ctrl[HASH_TABLE_GROUP_WIDTH];
+
+	explicit HashTableGroup(const uint8_t* ctrlPtr) noexcept
+	{
+		for (uint32_t i = 0; i < HASH_TABLE_GROUP_WIDTH; i++) ctrl[i] = ctrlPtr[i];
+	}
+
+	GroupBitMask match(uint8_t value) const noexcept
+	{
+		uint32_t bits = 0;
+		for (uint32_t i = 0; i < HASH_TABLE_GROUP_WIDTH; i++) {
+			bits |= uint32_t(ctrl[i] == value) << i;
+		}
+		return GroupBitMask{ bits };
+	}
+
+	GroupBitMask matchEmptyOrPlaceholder() const noexcept
+	{
+		uint32_t bits = 0;
+		for (uint32_t i = 0; i < HASH_TABLE_GROUP_WIDTH; i++) {
+			bits |= uint32_t(ctrl[i] >> 7) << i;
+		}
+		return GroupBitMask{ bits };
+	}
+#endif
+
+	/// Returns the slots which are empty
+	GroupBitMask matchEmpty() const noexcept { return match(HASH_TABLE_CTRL_EMPTY); }
+};
+
+} // namespace detail
+
+} // namespace sfz
@@ -18,7 +18,9 @@
 
 #pragma once
 
+#include <cstdint>
 #include <functional> // std::hash, std::equal_to
+#include <type_traits> // std::void_t, std::integral_constant
 
 namespace sfz {
 
@@ -50,6 +52,136 @@ struct EqualTo2<T,T> final {
 	}
 };
 
+// Capacity policies
+// ------------------------------------------------------------------------------------------------
+
+/// Capacity policy where the capacity of a hash table is a prime number and hashes are mapped to
+/// slots with an integer modulo. Robust against weak hashes, but the modulo is a fairly expensive
+/// division. This is the default.
+///
+/// The functions are templated on the hash table's size type (uint32_t or uint64_t), tables with
+/// 64-bit indices may grow up to MAX_CAPACITY_64.
+struct PrimeCapacityPolicy final {
+	static constexpr uint32_t MIN_CAPACITY = 67;
+	static constexpr uint32_t MAX_CAPACITY = 2147483659;
+	static constexpr uint64_t MAX_CAPACITY_64 = 140737488355333;
+
+	/// Returns a prime number larger than or equal to the suggested capacity
+	template<typename SizeT>
+	static SizeT capacityFor(SizeT suggestedCapacity) noexcept
+	{
+		constexpr uint64_t PRIMES[] = {
+			67,
+			131,
+			257,
+			521,
+			1031,
+			2053,
+			4099,
+			8209,
+			16411,
+			32771,
+			65537,
+			131101,
+			262147,
+			524309,
+			1048583,
+			2097169,
+			4194319,
+			8388617,
+			16777259,
+			33554467,
+			67108879,
+			134217757,
+			268435459,
+			536870923,
+			1073741827,
+			2147483659,
+			4294967311,
+			8589934609,
+			17179869209,
+			34359738421,
+			68719476767,
+			137438953481,
+			274877906951,
+			549755813911,
+			1099511627791,
+			2199023255579,
+			4398046511119,
+			8796093022237,
+			17592186044423,
+			35184372088891,
+			70368744177679,
+			140737488355333
+		};
+		constexpr uint64_t MAX = sizeof(SizeT) == sizeof(uint32_t) ? MAX_CAPACITY : MAX_CAPACITY_64;
+
+		// Linear search is probably okay for an array this small
+		for (uint32_t i = 0; i < sizeof(PRIMES) / sizeof(uint64_t) && PRIMES[i] <= MAX; ++i) {
+			if (PRIMES[i] >= suggestedCapacity) return SizeT(PRIMES[i]);
+		}
+
+		// Found no prime, which means that the suggested capacity is too large.
+		return SizeT(MAX);
+	}
+
+	/// Maps a hash to a slot index
+	template<typename SizeT>
+	static SizeT slotFromHash(uint64_t hash, SizeT capacity) noexcept
+	{
+		return SizeT(hash % uint64_t(capacity));
+	}
+
+	/// Wraps an index in the range [0, 2 * capacity) to [0, capacity)
+	template<typename SizeT>
+	static SizeT wrapIndex(SizeT index, SizeT capacity) noexcept
+	{
+		return index >= capacity ? index - capacity : index;
+	}
+};
+
+/// Capacity policy where the capacity of a hash table is a power of two. Hashes are mapped to
+/// slots using multiplicative (Fibonacci) hashing, i.e. the hash is multiplied by 2^64 divided
+/// by the golden ratio and the high bits of the product are masked out. This is considerably
+/// cheaper than a modulo and also spreads out weak hashes (such as the identity hash of
+/// integers and StringIDs), wrapping indices is a single AND.
+///
+/// Like PrimeCapacityPolicy the functions are templated on the hash table's size type.
+struct PowerOfTwoCapacityPolicy final {
+	static constexpr uint32_t MIN_CAPACITY = 64;
+	static constexpr uint32_t MAX_CAPACITY = 2147483648;
+	static constexpr uint64_t MAX_CAPACITY_64 = uint64_t(1) << 47;
+
+	/// Returns a power of two larger than or equal to the suggested capacity
+	template<typename SizeT>
+	static SizeT capacityFor(SizeT suggestedCapacity) noexcept
+	{
+		constexpr SizeT MAX =
+			sizeof(SizeT) == sizeof(uint32_t) ? SizeT(MAX_CAPACITY) : SizeT(MAX_CAPACITY_64);
+		if (suggestedCapacity >= MAX) return MAX;
+		SizeT capacity = MIN_CAPACITY;
+		while (capacity < suggestedCapacity) capacity <<= 1;
+		return capacity;
+	}
+
+	/// Maps a hash to a slot index. The product is rotated by 32 bits so that its (strong) high
+	/// bits become the low bits of the index, only tables with more than 2^32 slots use any of
+	/// the weaker low bits.
+	template<typename SizeT>
+	static SizeT slotFromHash(uint64_t hash, SizeT capacity) noexcept
+	{
+		uint64_t product = hash * 0x9E3779B97F4A7C15ull;
+		return SizeT(((product >> 32) | (product << 32)) & uint64_t(capacity - 1));
+	}
+
+	/// Wraps an index in the range [0, 2 * capacity) to [0, capacity)
+	template<typename SizeT>
+	static SizeT wrapIndex(SizeT index, SizeT capacity) noexcept
+	{
+		return index & (capacity - 1);
+	}
+};
+
 // HashTableKeyDescriptor template
 // ------------------------------------------------------------------------------------------------
 
@@ -86,6 +218,17 @@ struct NO_ALT_KEY_TYPE final {
 /// construct a normal key with the alt key. I.e., the key type needs a Key(AltKey alt)
 /// constructor.
 ///
+/// Optionally the following typedef can be defined to select how the capacity of the hash table
+/// is chosen and how hashes are mapped to slots. If it is not defined PrimeCapacityPolicy is used.
+/// CapacityPolicy: PrimeCapacityPolicy or PowerOfTwoCapacityPolicy.
+///
+/// Optionally the following constant can be defined to make the hash table store the full hash of
+/// each key next to it. If it is not defined hashes are not stored.
+/// CACHE_HASHES: static constexpr bool, if true hashes are stored. This costs 8 bytes per slot,
+/// but the keys never need to be rehashed when the table grows and key comparisons (KeyEqual) are
+/// skipped for keys whose hashes differ. Worthwhile for keys which are expensive to hash or
+/// compare, such as strings.
+///
 /// The default implementation uses std::hash<K> and std::equal_to<K>. In other words, as long
 /// as std::hash is specialized and an equality (==) operator is defined the default
 /// HashTableKeyDescriptor should just work.
@@ -105,4 +248,58 @@ struct HashTableKeyDescriptor final {
 	using AltKeyKeyEqual = NO_ALT_KEY_TYPE; // If specialized for alt key: EqualTo2<AltKeyT,KeyT>
 };
 
+namespace detail {
+
+/// Retrieves Descr::CapacityPolicy, or PrimeCapacityPolicy if not defined
+template<typename Descr, typename = void>
+struct CapacityPolicyOf { using type = PrimeCapacityPolicy; };
+
+template<typename Descr>
+struct CapacityPolicyOf<Descr, std::void_t<typename Descr::CapacityPolicy>> {
+	using type = typename Descr::CapacityPolicy;
+};
+
+/// Retrieves Descr::CACHE_HASHES, or false if not defined
+template<typename Descr, typename = void>
+struct CacheHashesOf : std::false_type { };
+
+template<typename Descr>
+struct CacheHashesOf<Descr, std::void_t<decltype(Descr::CACHE_HASHES)>>
+	: std::integral_constant<bool, Descr::CACHE_HASHES> { };
+
+} // namespace detail
+
+/// Wraps a HashTableKeyDescriptor, selecting PowerOfTwoCapacityPolicy while keeping everything
+/// else. E.g. HashMap<StringID, V, PowerOfTwoKeyDescriptor<StringID>>.
+template<typename K, typename Descr = HashTableKeyDescriptor<K>>
+struct PowerOfTwoKeyDescriptor final {
+	using KeyT = typename Descr::KeyT;
+	using KeyHash = typename Descr::KeyHash;
+	using KeyEqual = typename Descr::KeyEqual;
+
+	using AltKeyT = typename Descr::AltKeyT;
+	using AltKeyHash = typename Descr::AltKeyHash;
+	using AltKeyKeyEqual = typename Descr::AltKeyKeyEqual;
+
+	using CapacityPolicy = PowerOfTwoCapacityPolicy;
+	static constexpr bool CACHE_HASHES = detail::CacheHashesOf<Descr>::value;
+};
+
+/// Wraps a HashTableKeyDescriptor, enabling CACHE_HASHES while keeping everything else. E.g.
+/// HashMap<DynString, V, CachedHashKeyDescriptor<DynString>>. Can be combined with
+/// PowerOfTwoKeyDescriptor by nesting them.
+template<typename K, typename Descr = HashTableKeyDescriptor<K>>
+struct CachedHashKeyDescriptor final {
+	using KeyT = typename Descr::KeyT;
+	using KeyHash = typename Descr::KeyHash;
+	using KeyEqual = typename Descr::KeyEqual;
+
+	using AltKeyT = typename Descr::AltKeyT;
+	using AltKeyHash = typename Descr::AltKeyHash;
+	using AltKeyKeyEqual = typename Descr::AltKeyKeyEqual;
+
+	using CapacityPolicy = typename detail::CapacityPolicyOf<Descr>::type;
+	static constexpr bool CACHE_HASHES = true;
+};
+
 } // namespace sfz
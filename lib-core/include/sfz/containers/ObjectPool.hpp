@@ -0,0 +1,253 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#pragma once
+
+#include <cstdint>
+#include <utility> // std::forward(), std::move(), std::swap()
+
+#include "sfz/Assert.hpp"
+#include "sfz/containers/DynArray.hpp"
+#include "sfz/memory/Allocator.hpp"
+
+namespace sfz {
+
+// PoolHandle
+// ------------------------------------------------------------------------------------------------
+
+// Handle to an object in an ObjectPool. The lower 32 bits is the index of the object's slot and
+// the upper 32 bits is the generation of the slot when the object was added. A handle with
+// generation 0 is never valid, so a default constructed handle can be used as a null handle.
+struct PoolHandle final {
+	uint64_t bits = 0;
+
+	PoolHandle() noexcept = default;
+	constexpr PoolHandle(uint32_t idx, uint32_t generation) noexcept :
+		bits((uint64_t(generation) << 32) | uint64_t(idx)) {}
+
+	constexpr uint32_t idx() const noexcept { return uint32_t(bits); }
+	constexpr uint32_t generation() const noexcept { return uint32_t(bits >> 32); }
+	constexpr bool isNull() const noexcept { return generation() == 0; }
+
+	constexpr bool operator== (PoolHandle other) const noexcept { return bits == other.bits; }
+	constexpr bool operator!= (PoolHandle other) const noexcept { return bits != other.bits; }
+};
+
+// ObjectPool
+// ------------------------------------------------------------------------------------------------
+
+// A pool of objects referenced by generational handles, also known as a slot map.
+//
+// The objects are stored densely in a DynArray and can be iterated over linearly, in no specific
+// order. Each object also owns a slot in a sparse table which maps from handle to the object's
+// current position in the dense array. add() returns a handle to the new object which stays valid
+// until the object is removed, even though the object itself may be moved around in memory when
+// the pool is modified.
+//
+// Lookup, add() and remove() are all O(1). An object is removed by moving the last object in the
+// dense array into its place. The generation of the removed object's slot is then incremented,
+// which invalidates all existing handles to the slot, before it is put on a free list to be reused
+// by later additions. A generation is 32 bits, so a stale handle will only be mistaken for a valid
+// one if its slot has been reused exactly 2^32 times.
+//
+// Pointers returned from get() are invalidated by add() and remove(), same as for DynArray.
+template<typename T>
+class ObjectPool final {
+public:
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	ObjectPool() noexcept = default;
+	ObjectPool(const ObjectPool&) noexcept = default;
+	ObjectPool& operator= (const ObjectPool&) noexcept = default;
+	ObjectPool(ObjectPool&& other) noexcept { this->swap(other); }
+	ObjectPool& operator= (ObjectPool&& other) noexcept { this->swap(other); return *this; }
+	~ObjectPool() noexcept { this->destroy(); }
+
+	explicit ObjectPool(uint32_t capacity, Allocator* allocator, DbgInfo allocDbg) noexcept
+	{
+		this->init(capacity, allocator, allocDbg);
+	}
+
+	// State methods
+	// --------------------------------------------------------------------------------------------
+
+	// Initializes with specified parameters. Guaranteed to only set allocator and not allocate
+	// memory if a capacity of 0 is requested.
+	void init(uint32_t capacity, Allocator* allocator, DbgInfo allocDbg) noexcept
+	{
+		this->destroy();
+		mObjects.init(capacity, allocator, allocDbg);
+		mDenseToSlot.init(capacity, allocator, allocDbg);
+		mSlots.init(capacity, allocator, allocDbg);
+	}
+
+	void swap(ObjectPool& other) noexcept
+	{
+		mObjects.swap(other.mObjects);
+		mDenseToSlot.swap(other.mDenseToSlot);
+		mSlots.swap(other.mSlots);
+		std::swap(mFreeSlotHead, other.mFreeSlotHead);
+	}
+
+	// Destroys all objects, deallocates memory and removes allocator.
+	void destroy() noexcept
+	{
+		mObjects.destroy();
+		mDenseToSlot.destroy();
+		mSlots.destroy();
+		mFreeSlotHead = NO_SLOT;
+	}
+
+	// Removes all objects without deallocating memory. All existing handles are invalidated.
+	void clear() noexcept
+	{
+		while (mObjects.size() > 0) this->remove(this->handleAt(mObjects.size() - 1));
+	}
+
+	// Getters
+	// --------------------------------------------------------------------------------------------
+
+	uint32_t size() const noexcept { return mObjects.size(); }
+	uint32_t capacity() const noexcept { return mObjects.capacity(); }
+	uint32_t numSlots() const noexcept { return mSlots.size(); }
+	Allocator* allocator() const noexcept { return mObjects.allocator(); }
+
+	// Returns the dense array of objects, only valid until the pool is modified.
+	T* data() noexcept { return mObjects.data(); }
+	const T* data() const noexcept { return mObjects.data(); }
+
+	// Returns whether the handle refers to an object currently in the pool.
+	bool isValid(PoolHandle handle) const noexcept
+	{
+		if (handle.idx() >= mSlots.size()) return false;
+		return mSlots[handle.idx()].generation == handle.generation();
+	}
+
+	// Returns pointer to the object the handle refers to, or nullptr if the handle is invalid.
+	T* get(PoolHandle handle) noexcept
+	{
+		if (!this->isValid(handle)) return nullptr;
+		return &mObjects[mSlots[handle.idx()].denseIdx];
+	}
+	const T* get(PoolHandle handle) const noexcept
+	{
+		if (!this->isValid(handle)) return nullptr;
+		return &mObjects[mSlots[handle.idx()].denseIdx];
+	}
+
+	// Returns the handle of the object at the specified position in the dense array.
+	PoolHandle handleAt(uint32_t denseIdx) const noexcept
+	{
+		const uint32_t slotIdx = mDenseToSlot[denseIdx];
+		return PoolHandle(slotIdx, mSlots[slotIdx].generation);
+	}
+
+	// Methods
+	// --------------------------------------------------------------------------------------------
+
+	// Adds an object to the pool and returns a handle to it. Increases capacity if needed.
+	PoolHandle add(const T& object) noexcept { return this->addImpl<const T&>(object); }
+	PoolHandle add(T&& object) noexcept { return this->addImpl<T>(std::move(object)); }
+
+	// Constructs an object in the pool and returns a handle to it.
+	template<typename... Args>
+	PoolHandle emplace(Args&&... args) noexcept
+	{
+		return this->add(T(std::forward<Args>(args)...));
+	}
+
+	// Removes the object the handle refers to. Returns false (and does nothing) if the handle is
+	// not valid.
+	bool remove(PoolHandle handle) noexcept
+	{
+		if (!this->isValid(handle)) return false;
+		const uint32_t slotIdx = handle.idx();
+		Slot& slot = mSlots[slotIdx];
+		const uint32_t denseIdx = slot.denseIdx;
+		const uint32_t lastIdx = mObjects.size() - 1;
+
+		// Move last object into place of removed object and update its slot
+		if (denseIdx != lastIdx) {
+			mObjects[denseIdx] = std::move(mObjects[lastIdx]);
+			mDenseToSlot[denseIdx] = mDenseToSlot[lastIdx];
+			mSlots[mDenseToSlot[denseIdx]].denseIdx = denseIdx;
+		}
+		mObjects.pop();
+		mDenseToSlot.pop();
+
+		// Invalidate handles to slot and put it on free list, generation 0 is reserved for null
+		slot.generation += 1;
+		if (slot.generation == 0) slot.generation = 1;
+		slot.denseIdx = mFreeSlotHead;
+		mFreeSlotHead = slotIdx;
+		return true;
+	}
+
+	// Iterator methods
+	// --------------------------------------------------------------------------------------------
+
+	T* begin() noexcept { return mObjects.begin(); }
+	const T* begin() const noexcept { return mObjects.begin(); }
+	const T* cbegin() const noexcept { return mObjects.cbegin(); }
+
+	T* end() noexcept { return mObjects.end(); }
+	const T* end() const noexcept { return mObjects.end(); }
+	const T* cend() const noexcept { return mObjects.cend(); }
+
+private:
+	// Private methods
+	// --------------------------------------------------------------------------------------------
+
+	template<typename ForwardT>
+	PoolHandle addImpl(ForwardT&& object) noexcept
+	{
+		// Reuse slot from free list if possible, otherwise create a new one
+		uint32_t slotIdx = mFreeSlotHead;
+		if (slotIdx != NO_SLOT) {
+			mFreeSlotHead = mSlots[slotIdx].denseIdx;
+		}
+		else {
+			slotIdx = mSlots.size();
+			mSlots.add(Slot{ 0, 1 });
+		}
+
+		Slot& slot = mSlots[slotIdx];
+		slot.denseIdx = mObjects.size();
+		mObjects.add(std::forward<ForwardT>(object));
+		mDenseToSlot.add(slotIdx);
+		return PoolHandle(slotIdx, slot.generation);
+	}
+
+	// Private members
+	// --------------------------------------------------------------------------------------------
+
+	static constexpr uint32_t NO_SLOT = ~uint32_t(0);
+
+	struct Slot final {
+		uint32_t denseIdx; // Index into dense array, or next free slot if on free list
+		uint32_t generation;
+	};
+
+	DynArray<T> mObjects;
+	DynArray<uint32_t> mDenseToSlot;
+	DynArray<Slot> mSlots;
+	uint32_t mFreeSlotHead = NO_SLOT;
+};
+
+} // namespace sfz
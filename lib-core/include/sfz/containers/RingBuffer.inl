@@ -79,7 +79,8 @@ void RingBuffer<T>::destroy() noexcept
 	this->clear();
 
 	// Deallocate memory and reset member variables
-	mAllocator->deallocate(mDataPtr);
+	mAllocator->deallocateSized(
+		mDataPtr, mCapacity * sizeof(T), sfzMax(32u, uint32_t(alignof(T))));
 	mAllocator = nullptr;
 	mDataPtr = nullptr;
 	mCapacity = 0;
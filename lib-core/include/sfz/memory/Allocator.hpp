@@ -19,7 +19,9 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring> // std::memcpy
 #include <new> // placement new
+#include <type_traits>
 #include <utility> // std::move, std::forward, std::swap
 
 namespace sfz {
@@ -71,6 +73,45 @@ public:
 	// instance is undefined behavior, and may result in catastrophic failure.
 	virtual void deallocate(void* pointer) noexcept = 0;
 
+	// Deallocates memory previously allocated with this instance, where size and alignment must be
+	// exactly what the memory was allocated (or last resized) with. Allocators can override this to
+	// avoid storing or looking up per-allocation metadata (e.g. the size class of a block). The
+	// default implementation simply calls deallocate().
+	virtual void deallocateSized(void* pointer, uint64_t size, uint64_t alignment = 32) noexcept
+	{
+		(void)size; (void)alignment;
+		this->deallocate(pointer);
+	}
+
+	// Attempts to resize an allocation in place, i.e. without moving it. The current size must be
+	// the size the memory was allocated (or last resized) with. Returns whether successful, if
+	// not the allocation is left untouched. The default implementation always fails.
+	virtual bool tryExtendInPlace(void* pointer, uint64_t currentSize, uint64_t newSize) noexcept
+	{
+		(void)pointer; (void)currentSize; (void)newSize;
+		return false;
+	}
+
+	// Resizes an allocation, moving it to a new location if necessary. The contents are preserved
+	// up to the smaller of the two sizes by (at most) a bitwise copy, so this may only be used for
+	// trivially copyable data. The alignment must be the same as the memory was allocated with.
+	// Returns the (possibly unchanged) pointer to the resized memory, or nullptr on failure in
+	// which case the original allocation remains valid.
+	//
+	// The default implementation first attempts tryExtendInPlace(), then falls back to allocating
+	// new memory, copying and deallocating the old memory.
+	virtual void* reallocate(DbgInfo dbg, void* pointer, uint64_t currentSize, uint64_t newSize,
+		uint64_t alignment = 32) noexcept
+	{
+		if (pointer == nullptr) return this->allocate(dbg, newSize, alignment);
+		if (this->tryExtendInPlace(pointer, currentSize, newSize)) return pointer;
+		void* newPointer = this->allocate(dbg, newSize, alignment);
+		if (newPointer == nullptr) return nullptr;
+		std::memcpy(newPointer, pointer, currentSize < newSize ? currentSize : newSize);
+		this->deallocateSized(pointer, currentSize, alignment);
+		return newPointer;
+	}
+
 	// Constructs a new object of type T, similar to operator new. Guarantees 32-byte alignment.
 	template<typename T, typename... Args>
 	T* newObject(DbgInfo dbg, Args&&... args) noexcept
@@ -83,13 +124,21 @@ public:
 		return new(memPtr) T(std::forward<Args>(args)...);
 	}
 
-	// Deletes an object created with this allocator, similar to operator delete.
+	// Deletes an object created with this allocator, similar to operator delete. Unless T is
+	// polymorphic, the object must have been created as a T (not a subclass of T).
 	template<typename T>
 	void deleteObject(T*& pointer) noexcept
 	{
 		if (pointer == nullptr) return;
 		pointer->~T(); // Call destructor, will terminate program if it throws exception.
-		this->deallocate(pointer);
+
+		// The size is only known if pointer can't point to a derived type
+		if constexpr (!std::is_polymorphic<T>::value || std::is_final<T>::value) {
+			this->deallocateSized(pointer, sizeof(T), alignof(T) < 32 ? 32 : alignof(T));
+		}
+		else {
+			this->deallocate(pointer);
+		}
 		pointer = nullptr; // Set callers pointer to nullptr, an attempt to avoid dangling pointers.
 	}
 };
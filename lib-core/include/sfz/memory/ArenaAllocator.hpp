@@ -35,6 +35,18 @@ namespace sfz {
 // "deallocate" all the memory for everything that has been allocated from it, and this is done by
 // just setting the offset back to 0 (the begininng of the memory chunk).
 //
+// Alternatively the arena can be initialized in virtual memory mode using initVirtual(). In this
+// mode a (potentially huge) range of virtual address space is reserved, but physical memory is only
+// committed in large steps as the offset grows. This means that there is no need to guess the
+// worst-case size up front, and that the resident memory tracks what is actually used. Memory
+// above a configurable watermark is decommitted (returned to the OS) when the arena is reset.
+//
+// In addition to resetting the entire arena it is also possible to save a checkpoint of its
+// current state and later roll back to it, releasing everything allocated after the checkpoint was
+// made. Checkpoints must be rolled back in stack (LIFO) order, typically using an ArenaScope. This
+// allows nested temporary work (e.g. a parse inside a frame) to release its scratch memory without
+// resetting the whole arena.
+//
 // The arena allocator is good for temporary allocations. An example would be to use it as a
 // "frame allocator". The arena is used for temporary allocations during a frame and then reset at
 // the end of it. Extremely fast temporary allocations, and no need to indvidually deallocate all of
@@ -57,18 +69,59 @@ public:
 	// --------------------------------------------------------------------------------------------
 
 	void init(void* memory, uint64_t memorySizeBytes) noexcept;
+
+	// Initializes the arena in virtual memory mode. Reserves reserveSizeBytes of address space
+	// and commits memory in commitStepBytes sized chunks when needed (both are rounded up to the
+	// page size). When the arena is reset all committed memory above decommitWatermarkBytes is
+	// decommitted, by default memory is never decommitted. If useHugePages is true the OS is asked
+	// to back the memory with transparent huge pages, in which case commitStepBytes should be a
+	// multiple of the huge page size (typically 2 MiB). Returns false on failure.
+	bool initVirtual(uint64_t reserveSizeBytes, uint64_t commitStepBytes = 2 * 1024 * 1024,
+		uint64_t decommitWatermarkBytes = UINT64_MAX, bool useHugePages = false) noexcept;
+
 	void destroy() noexcept;
 
 	// Resets this arena allocator, "deallocating" everything that has been allocated from it.
-	// This simply means moving the internal offset back to the beginning of the memory chunk.
+	// This simply means moving the internal offset back to the beginning of the memory chunk. In
+	// virtual memory mode committed memory above the decommit watermark is also decommitted.
 	void reset() noexcept;
 
+	// Checkpoints
+	// --------------------------------------------------------------------------------------------
+
+	// The saved state of an arena, see checkpoint() and rollback().
+	struct Checkpoint final {
+		uint64_t offsetBytes = 0;
+		uint64_t numPaddingBytes = 0;
+		uint64_t prevRollbackFloorBytes = 0;
+	};
+
+	// Returns a checkpoint of the current state of the arena. Allocations made before the
+	// checkpoint can no longer be resized in place (see tryExtendInPlace()) until it is rolled
+	// back to, as rolling back would otherwise free memory they still own.
+	Checkpoint checkpoint() noexcept
+	{
+		Checkpoint checkpoint = { mCurrentOffsetBytes, mNumPaddingBytes, mRollbackFloorBytes };
+		mRollbackFloorBytes = mCurrentOffsetBytes;
+		return checkpoint;
+	}
+
+	// Rolls back the arena to a previously made checkpoint, "deallocating" everything that has
+	// been allocated since. It is not valid to roll back to a checkpoint made after the one most
+	// recently rolled back to, or to one made before the last reset().
+	void rollback(Checkpoint checkpoint) noexcept;
+
 	// Methods
 	// --------------------------------------------------------------------------------------------
 
 	uint64_t capacity() const noexcept { return mMemorySizeBytes; }
 	uint64_t numBytesAllocated() const noexcept { return mCurrentOffsetBytes; }
 	uint64_t numPaddingBytes() const noexcept { return mNumPaddingBytes; }
+	bool isVirtual() const noexcept { return mIsVirtual; }
+
+	// Returns the number of bytes currently backed by physical memory. Always the same as
+	// capacity() unless in virtual memory mode.
+	uint64_t numBytesCommitted() const noexcept { return mCommittedBytes; }
 
 	// Implemented sfz::Allocator methods
 	// --------------------------------------------------------------------------------------------
@@ -76,13 +129,63 @@ public:
 	void* allocate(DbgInfo dbg, uint64_t size, uint64_t alignment = 32) noexcept override final;
 	void deallocate(void*) noexcept override final { /* no-op */ }
 
-	// Private members
+	// Only the most recent allocation can be resized in place, which is done by simply moving the
+	// offset. This makes growing an array which is the last thing allocated from the arena free.
+	// Allocations made before the most recent live checkpoint are never resized.
+	bool tryExtendInPlace(void* pointer, uint64_t currentSize, uint64_t newSize) noexcept override final;
+
+	// Private methods
 	// --------------------------------------------------------------------------------------------
 private:
+	// Ensures that memory up to the specified offset is committed, only has an effect in virtual
+	// memory mode. Returns false on failure.
+	bool ensureCommitted(uint64_t offsetBytes) noexcept;
+
+	// Private members
+	// --------------------------------------------------------------------------------------------
 	uint8_t* mMemory = nullptr;
 	uint64_t mMemorySizeBytes = 0;
 	uint64_t mCurrentOffsetBytes = 0;
 	uint64_t mNumPaddingBytes = 0;
+	uint64_t mRollbackFloorBytes = 0; // Offset of the most recent live checkpoint
+
+	// Virtual memory mode
+	bool mIsVirtual = false;
+	uint64_t mCommittedBytes = 0;
+	uint64_t mCommitStepBytes = 0;
+	uint64_t mDecommitWatermarkBytes = 0;
+};
+
+// ArenaScope class
+// ------------------------------------------------------------------------------------------------
+
+// RAII scope guard which makes a checkpoint of an arena when created and rolls back to it when
+// destroyed. Scopes can be nested, but must be destroyed in reverse order of creation (which is
+// what naturally happens if they live on the stack).
+//
+// Example:
+// {
+//     ArenaScope scope(getScratchArena());
+//     DynArray<int> tmp(1024, scope.arena(), sfz_dbg("tmp"));
+//     ...
+// } // Memory used by tmp is released here
+class ArenaScope final {
+public:
+	ArenaScope() = delete;
+	ArenaScope(const ArenaScope&) = delete;
+	ArenaScope& operator= (const ArenaScope&) = delete;
+	ArenaScope(ArenaScope&&) = delete;
+	ArenaScope& operator= (ArenaScope&&) = delete;
+
+	explicit ArenaScope(ArenaAllocator* arena) noexcept :
+		mArena(arena), mCheckpoint(arena->checkpoint()) {}
+	~ArenaScope() noexcept { mArena->rollback(mCheckpoint); }
+
+	ArenaAllocator* arena() const noexcept { return mArena; }
+
+private:
+	ArenaAllocator* mArena = nullptr;
+	ArenaAllocator::Checkpoint mCheckpoint;
 };
 
 } // namespace sfz
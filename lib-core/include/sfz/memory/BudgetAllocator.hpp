@@ -0,0 +1,166 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+#include <sfz/memory/Allocator.hpp>
+
+namespace sfz {
+
+// Budget report
+// ------------------------------------------------------------------------------------------------
+
+constexpr uint64_t BUDGET_UNLIMITED = ~uint64_t(0);
+
+// Statistics of one BudgetAllocator in a budget tree, see BudgetAllocator::report().
+struct BudgetReportEntry final {
+	const char* name = nullptr;
+	uint32_t depth = 0; // 0 for the root of the reported tree, 1 for its children, etc.
+	uint64_t budgetBytes = 0;
+	uint64_t currentBytes = 0; // Including all children
+	uint64_t peakBytes = 0; // Including all children
+	uint64_t numLiveAllocations = 0; // Only allocations made directly through this allocator
+	uint64_t numOverruns = 0;
+};
+
+// BudgetAllocator class
+// ------------------------------------------------------------------------------------------------
+
+class BudgetAllocator;
+
+// Called when an allocation would make a budget allocator exceed its budget. The budget allocator
+// passed is the one whose budget would be exceeded, which may be a parent of the one allocated
+// from. If the callback returns true the allocation is retried (e.g. after trimming caches), if
+// it returns false the allocation fails and nullptr is returned. To fail fast, simply assert or
+// terminate in the callback.
+using BudgetOverrunCallback =
+	bool(*)(BudgetAllocator* budget, uint64_t requestedBytes, void* userData);
+
+// Budget allocator
+//
+// Forwards allocations to a parent allocator while accounting and enforcing a byte budget, e.g.
+// per subsystem. Budget allocators can be nested into a tree (e.g. renderer -> textures), where
+// an allocation is accounted to the allocator it was made through and all of its ancestors. Only
+// the root of a tree forwards to a parent allocator, so nesting adds no extra allocation headers.
+//
+// The accounted size is the size requested by the user. Each allocation has a small header (16
+// bytes, or the alignment if larger) in front of it which stores its size, this header is not
+// accounted.
+//
+// Usage is tracked using atomics, so a budget allocator is thread-safe as long as its parent
+// allocator is. A budget may be exceeded momentarily by concurrent allocations while they are
+// being checked, but an allocation is never returned if it would put any budget above its limit.
+//
+// The allocators in a tree must be destroyed bottom up, i.e. children before their parents.
+class BudgetAllocator final : public Allocator {
+public:
+	// Number of times an allocation is retried if the overrun callback keeps returning true
+	static constexpr uint32_t MAX_OVERRUN_RETRIES = 8;
+
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	BudgetAllocator() noexcept = default;
+	BudgetAllocator(const BudgetAllocator&) = delete;
+	BudgetAllocator& operator= (const BudgetAllocator&) = delete;
+	BudgetAllocator(BudgetAllocator&&) = delete;
+	BudgetAllocator& operator= (BudgetAllocator&&) = delete;
+	~BudgetAllocator() noexcept { this->destroy(); }
+
+	// State methods
+	// --------------------------------------------------------------------------------------------
+
+	// Initializes the root of a budget tree, forwarding allocations to the specified allocator.
+	// The name must be a compile-time constant (same as DbgInfo::staticMsg).
+	void init(const char* name, uint64_t budgetBytes, Allocator* allocator) noexcept;
+
+	// Initializes a budget allocator as a child of another budget allocator.
+	void initChild(const char* name, uint64_t budgetBytes, BudgetAllocator* parent) noexcept;
+
+	// Destroys the budget allocator. All memory allocated through it must be deallocated and all
+	// its children destroyed first.
+	void destroy() noexcept;
+
+	// Methods
+	// --------------------------------------------------------------------------------------------
+
+	const char* name() const noexcept { return mName; }
+	BudgetAllocator* parentBudget() const noexcept { return mParent; }
+	Allocator* wrappedAllocator() const noexcept { return mAllocator; }
+
+	uint64_t budgetBytes() const noexcept { return mBudgetBytes.load(std::memory_order_relaxed); }
+	uint64_t currentBytes() const noexcept { return mCurrentBytes.load(std::memory_order_relaxed); }
+	uint64_t peakBytes() const noexcept { return mPeakBytes.load(std::memory_order_relaxed); }
+	uint64_t numOverruns() const noexcept { return mNumOverruns.load(std::memory_order_relaxed); }
+
+	// Changes the budget. Lowering it below the current usage does not affect existing
+	// allocations, but all new allocations fail (or trigger the callback) until usage is lowered.
+	void setBudget(uint64_t budgetBytes) noexcept;
+
+	// Sets the callback called when an allocation would exceed this allocator's budget. If no
+	// callback is set (default) such allocations simply fail. Not thread-safe, should be set
+	// before the allocator is used.
+	void setOverrunCallback(BudgetOverrunCallback callback, void* userData = nullptr) noexcept;
+
+	// Resets the peak usage of this allocator and all its children to their current usage.
+	void resetPeaks() noexcept;
+
+	// Writes a depth-first report of this allocator and all its descendants, parents before
+	// children. At most maxNumEntries are written, but the total number of allocators in the tree
+	// is returned, so a return value larger than maxNumEntries means the report was truncated.
+	uint32_t report(BudgetReportEntry* entriesOut, uint32_t maxNumEntries) const noexcept;
+
+	// Implemented sfz::Allocator methods
+	// --------------------------------------------------------------------------------------------
+
+	void* allocate(DbgInfo dbg, uint64_t size, uint64_t alignment = 32) noexcept override final;
+	void deallocate(void* pointer) noexcept override final;
+	bool tryExtendInPlace(void* pointer, uint64_t currentSize, uint64_t newSize) noexcept override final;
+
+	// Private members
+	// --------------------------------------------------------------------------------------------
+private:
+	BudgetAllocator* tryCharge(uint64_t bytes) noexcept;
+	void uncharge(uint64_t bytes, const BudgetAllocator* stop) noexcept;
+	bool chargeOrCallback(uint64_t bytes) noexcept;
+	uint32_t reportRecursive(BudgetReportEntry* entriesOut, uint32_t maxNumEntries,
+		uint32_t idx, uint32_t depth) const noexcept;
+
+	const char* mName = nullptr;
+	Allocator* mAllocator = nullptr; // The parent allocator of the root of the tree
+	BudgetAllocator* mParent = nullptr;
+
+	// Intrusive list of children, protected by mChildrenMutex
+	mutable std::mutex mChildrenMutex;
+	BudgetAllocator* mFirstChild = nullptr;
+	BudgetAllocator* mNextSibling = nullptr;
+
+	BudgetOverrunCallback mOverrunCallback = nullptr;
+	void* mOverrunUserData = nullptr;
+
+	alignas(64) std::atomic<uint64_t> mCurrentBytes{0};
+	std::atomic<uint64_t> mPeakBytes{0};
+	std::atomic<uint64_t> mBudgetBytes{0};
+	std::atomic<uint64_t> mNumLiveAllocations{0};
+	std::atomic<uint64_t> mNumOverruns{0};
+};
+
+} // namespace sfz
@@ -0,0 +1,96 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#pragma once
+
+#include <atomic>
+
+#include <sfz/memory/Allocator.hpp>
+
+namespace sfz {
+
+// ConcurrentArenaAllocator class
+// ------------------------------------------------------------------------------------------------
+
+// Thread-safe arena allocator
+//
+// Works in the same way as ArenaAllocator (see sfz/memory/ArenaAllocator.hpp), except that the
+// offset into the memory chunk is bumped atomically using compare-and-swap. This means that any
+// number of threads can allocate from the same arena at the same time without any locks, which
+// makes it suitable as a shared "frame allocator" for transient per-frame data produced by worker
+// threads.
+//
+// Only allocate() (and the statistics getters) are thread-safe. init(), destroy() and reset() must
+// not be called while other threads might be allocating, typically they are called once per frame
+// when all workers are synchronized.
+//
+// The statistics are updated using relaxed atomics. They are exact once all allocating threads
+// are synchronized, but may be slightly out of date if read while allocations are in flight.
+class ConcurrentArenaAllocator final : public Allocator {
+public:
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	ConcurrentArenaAllocator() noexcept = default;
+	ConcurrentArenaAllocator(const ConcurrentArenaAllocator&) = delete;
+	ConcurrentArenaAllocator& operator= (const ConcurrentArenaAllocator&) = delete;
+	ConcurrentArenaAllocator(ConcurrentArenaAllocator&&) = delete;
+	ConcurrentArenaAllocator& operator= (ConcurrentArenaAllocator&&) = delete;
+	~ConcurrentArenaAllocator() noexcept { this->destroy(); }
+
+	// State methods
+	// --------------------------------------------------------------------------------------------
+
+	void init(void* memory, uint64_t memorySizeBytes) noexcept;
+	void destroy() noexcept;
+
+	// Resets this arena allocator, "deallocating" everything that has been allocated from it.
+	// Not thread-safe, may not be called while other threads are allocating.
+	void reset() noexcept;
+
+	// Methods
+	// --------------------------------------------------------------------------------------------
+
+	uint64_t capacity() const noexcept { return mMemorySizeBytes; }
+	uint64_t numBytesAllocated() const noexcept
+	{
+		return mCurrentOffsetBytes.load(std::memory_order_relaxed);
+	}
+	uint64_t numPaddingBytes() const noexcept
+	{
+		return mNumPaddingBytes.load(std::memory_order_relaxed);
+	}
+
+	// Implemented sfz::Allocator methods
+	// --------------------------------------------------------------------------------------------
+
+	void* allocate(DbgInfo dbg, uint64_t size, uint64_t alignment = 32) noexcept override final;
+	void deallocate(void*) noexcept override final { /* no-op */ }
+
+	// Private members
+	// --------------------------------------------------------------------------------------------
+private:
+	uint8_t* mMemory = nullptr;
+	uint64_t mMemorySizeBytes = 0;
+
+	// Separate cache line from the read-only members above to avoid false sharing
+	alignas(64) std::atomic<uint64_t> mCurrentOffsetBytes{0};
+	std::atomic<uint64_t> mNumPaddingBytes{0};
+};
+
+} // namespace sfz
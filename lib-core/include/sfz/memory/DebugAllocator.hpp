@@ -47,12 +47,20 @@ struct DebugAllocatorImpl; // Pimpl pattern
 /// * Keeps track of all allocations made
 /// * Checks if an allocation is made with this allocator at deallocation
 /// * Checks if an allocation is already deallocated at deallocation
+/// * Checks that the size and alignment given to deallocateSized() matches the allocation
 /// * Checks if memory has been written out of bounds before and after allocation
 /// * Can be used to check if all memory has been properly deallocated by calling numAllocations()
 ///   and compare result with expected value (likely 0).
+/// * Thread-safe, can be shared between multiple threads
 ///
-/// All internal memory allocations is made with the standard C++ operator new and delete. A
-/// DebugAllocator should only be used when debugging, not in release code.
+/// Active allocations are tracked in a number of hash maps (shards) selected by pointer, each
+/// protected by its own mutex, so that threads rarely contend with each other. Deallocated
+/// allocations are kept in a bounded history ring per shard which is used to detect double frees,
+/// only the most recent deallocations are remembered. Neither allocation nor deallocation takes
+/// any lock other than the one of the pointer's shard.
+///
+/// All internal memory allocations is made with the standard allocator. A DebugAllocator should
+/// only be used when debugging, not in release code.
 class DebugAllocator final : public Allocator {
 public:
 	// Constructors & destructors
@@ -70,7 +78,11 @@ public:
 	/// start and end of each allocation. Specific values is written to this padding during
 	/// allocation, and at deallocation it is checked that it has not been overwritten. In other
 	/// words, a larger values means that more memory is checked for corruption.
-	DebugAllocator(const char* name, uint32_t alignmentIntegrityFactor = 4) noexcept;
+	/// historySize is the number of deallocated allocations remembered for double free detection.
+	/// Each shard has room for historySize deallocations, so that the most recent ones are always
+	/// remembered no matter which shards they belong to.
+	DebugAllocator(const char* name, uint32_t alignmentIntegrityFactor = 4,
+		uint32_t historySize = 4096) noexcept;
 	~DebugAllocator() noexcept override final;
 
 	// Overriden Allocator methods
@@ -78,6 +90,7 @@ public:
 
 	void* allocate(DbgInfo dbg, uint64_t size, uint64_t alignment) noexcept override final;
 	void deallocate(void* pointer) noexcept override final;
+	void deallocateSized(void* pointer, uint64_t size, uint64_t alignment) noexcept override final;
 
 	// Methods
 	// --------------------------------------------------------------------------------------------
@@ -85,18 +98,20 @@ public:
 	/// Returns the current number of active allocations
 	uint32_t numAllocations() const noexcept;
 
-	/// Returns the number of allocations that has been deallocated
+	/// Returns the number of allocations that has been deallocated (not limited by history size)
 	uint32_t numDeallocated() const noexcept;
 
 	/// Returns the total number of allocations made (both active and deallocated)
 	uint32_t numTotalAllocations() const noexcept;
 
-	/// Returns a list with all currently active allocations in this DebugAllocator. The list
-	/// itself is allocated by this DebugAllocator and needs to be deallocated when done.
+	/// Returns a list with all currently active allocations in this DebugAllocator (excluding the
+	/// list itself). The list itself is allocated by this DebugAllocator and needs to be
+	/// deallocated when done.
 	DebugAllocationInfo* allocations(uint32_t* numAllocations) noexcept;
 
-	/// Returns a list with all allocations that has been deallocated. The list itself is
-	/// allocated by this DebugAllocator and needs to be deallocated when done.
+	/// Returns a list with the most recently deallocated allocations (at most history size), in
+	/// order of deallocation. The list itself is allocated by this DebugAllocator and needs to be
+	/// deallocated when done.
 	DebugAllocationInfo* deallocatedAllocations(uint32_t* numAllocations) noexcept;
 
 private:
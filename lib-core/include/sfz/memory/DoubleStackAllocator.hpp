@@ -0,0 +1,155 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#pragma once
+
+#include <sfz/memory/Allocator.hpp>
+
+namespace sfz {
+
+// DoubleStackAllocator class
+// ------------------------------------------------------------------------------------------------
+
+class DoubleStackAllocator;
+
+// Allocator which allocates from the top end of a DoubleStackAllocator, see below.
+class DoubleStackTopAllocator final : public Allocator {
+public:
+	void* allocate(DbgInfo dbg, uint64_t size, uint64_t alignment = 32) noexcept override final;
+	void deallocate(void* pointer) noexcept override final;
+
+private:
+	friend class DoubleStackAllocator;
+	DoubleStackAllocator* mOwner = nullptr;
+};
+
+// Double-ended stack allocator
+//
+// The double-ended stack allocator is given a chunk of memory and allocates from both ends of it.
+// The bottom stack grows upwards from the start of the memory and the top stack grows downwards
+// from its end, the allocator is out of memory when they meet. A typical use is to allocate
+// long-lived (e.g. level) data from the bottom and short-lived temporaries (e.g. decode buffers)
+// from the top, so that the temporaries can be released without leaving holes in the long-lived
+// data.
+//
+// Allocating through the Allocator interface (allocate()) allocates from the bottom, use
+// topAllocator() to get an Allocator which allocates from the top.
+//
+// Each allocation has a 16 byte header, which makes it possible to deallocate individual
+// allocations in LIFO order. Deallocating something that is not the most recent allocation of its
+// end only marks it as freed, its memory is reclaimed once everything allocated after it on the
+// same end has been deallocated. Each end can also independently be rolled back to a marker,
+// which releases everything allocated on that end since the marker was made. Allocations made
+// before a marker can still be deallocated while it is live, but their memory is not reclaimed
+// until the marker has been rolled back to.
+class DoubleStackAllocator final : public Allocator {
+public:
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	DoubleStackAllocator() noexcept { mTopAllocator.mOwner = this; }
+	DoubleStackAllocator(const DoubleStackAllocator&) = delete;
+	DoubleStackAllocator& operator= (const DoubleStackAllocator&) = delete;
+	DoubleStackAllocator(DoubleStackAllocator&&) = delete;
+	DoubleStackAllocator& operator= (DoubleStackAllocator&&) = delete;
+	~DoubleStackAllocator() noexcept { this->destroy(); }
+
+	// State methods
+	// --------------------------------------------------------------------------------------------
+
+	// Initializes the allocator with a chunk of memory aligned to at least 16 bytes. The memory is
+	// not owned by the allocator.
+	void init(void* memory, uint64_t memorySizeBytes) noexcept;
+	void destroy() noexcept;
+
+	// Resets both ends, "deallocating" everything that has been allocated.
+	void reset() noexcept;
+
+	// Markers
+	// --------------------------------------------------------------------------------------------
+
+	// The saved state of one end of the allocator, see rollbackBottom() and rollbackTop().
+	struct Marker final {
+		uint64_t endOffset = 0;
+		uint64_t lastHeaderOffset = 0;
+		uint64_t prevFloor = 0;
+	};
+
+	// Making a marker sets the floor of its end to the current end offset. Until the marker is
+	// rolled back to, allocations made before it are never popped by deallocate() (they are only
+	// marked as freed) and can not be resized in place (see tryExtendInPlace()), as rolling back
+	// would otherwise move the end to memory which is in use or already released.
+	Marker bottomMarker() noexcept
+	{
+		Marker marker = { mBottomOffset, mBottomLastHeader, mBottomFloor };
+		mBottomFloor = mBottomOffset;
+		return marker;
+	}
+	Marker topMarker() noexcept
+	{
+		Marker marker = { mTopOffset, mTopLastHeader, mTopFloor };
+		mTopFloor = mTopOffset;
+		return marker;
+	}
+
+	// Rolls back an end to a marker made on the same end, releasing everything allocated on it
+	// since. Markers must be rolled back to in LIFO order.
+	void rollbackBottom(Marker marker) noexcept;
+	void rollbackTop(Marker marker) noexcept;
+
+	// Methods
+	// --------------------------------------------------------------------------------------------
+
+	uint64_t capacity() const noexcept { return mMemorySizeBytes; }
+	uint64_t numBytesBottom() const noexcept { return mBottomOffset; }
+	uint64_t numBytesTop() const noexcept { return mMemorySizeBytes - mTopOffset; }
+	uint64_t numBytesFree() const noexcept { return mTopOffset - mBottomOffset; }
+
+	void* allocateBottom(DbgInfo dbg, uint64_t size, uint64_t alignment = 32) noexcept;
+	void* allocateTop(DbgInfo dbg, uint64_t size, uint64_t alignment = 32) noexcept;
+
+	// Returns an Allocator which allocates from the top end. Memory from either end can be
+	// deallocated through either allocator.
+	Allocator* topAllocator() noexcept { return &mTopAllocator; }
+
+	// Implemented sfz::Allocator methods
+	// --------------------------------------------------------------------------------------------
+
+	// Allocates from the bottom end.
+	void* allocate(DbgInfo dbg, uint64_t size, uint64_t alignment = 32) noexcept override final;
+	void deallocate(void* pointer) noexcept override final;
+
+	// Only the most recent allocation of the bottom end can be resized in place, and only if it
+	// was made after the most recent live bottom marker.
+	bool tryExtendInPlace(void* pointer, uint64_t currentSize, uint64_t newSize) noexcept override final;
+
+	// Private members
+	// --------------------------------------------------------------------------------------------
+private:
+	uint8_t* mMemory = nullptr;
+	uint64_t mMemorySizeBytes = 0;
+	uint64_t mBottomOffset = 0; // End of bottom stack, i.e. first free byte
+	uint64_t mTopOffset = 0; // Start of top stack, i.e. one past last free byte
+	uint64_t mBottomLastHeader = 0; // Offset of header of most recent bottom allocation
+	uint64_t mTopLastHeader = 0; // Offset of header of most recent top allocation
+	uint64_t mBottomFloor = 0; // End offset of most recent live bottom marker
+	uint64_t mTopFloor = 0; // End offset of most recent live top marker
+	DoubleStackTopAllocator mTopAllocator;
+};
+
+} // namespace sfz
@@ -0,0 +1,136 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+#include <sfz/memory/Allocator.hpp>
+
+namespace sfz {
+
+// FrameRingAllocator class
+// ------------------------------------------------------------------------------------------------
+
+// Ring buffer allocator for per-frame data that must stay alive for a number of frames
+//
+// The allocator is given a chunk of memory which is used as a ring buffer. Allocations are bumped
+// from a monotonically increasing head offset and belong to the current frame. When an asynchronous
+// consumer (e.g. the GPU or a streaming thread) is done with frame f it calls retireFrame(f), the
+// memory of the oldest frames is then reclaimed and reused by later frames. Frames may be retired
+// out of order, but memory is only reclaimed in frame order, i.e. a frame's memory is reclaimed
+// once it and all frames before it have been retired.
+//
+// An allocation is never split across the end of the memory chunk, if it does not fit the rest of
+// the ring is skipped and the allocation is placed at the start of the chunk.
+//
+// allocate() is lock-free and may be called from any number of producer threads at the same time,
+// it returns nullptr if the requested memory is still used by unretired frames. retireFrame() may
+// be called concurrently with allocate(), typically from a consumer thread. beginFrame() must not
+// be called while other threads are allocating, and at most MAX_FRAMES_IN_FLIGHT frames may be in
+// flight (begun but not retired, including the current one) at the same time.
+//
+// deallocate() is a no-op, memory is reclaimed when frames are retired.
+class FrameRingAllocator final : public Allocator {
+public:
+	static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 16;
+
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	FrameRingAllocator() noexcept = default;
+	FrameRingAllocator(const FrameRingAllocator&) = delete;
+	FrameRingAllocator& operator= (const FrameRingAllocator&) = delete;
+	FrameRingAllocator(FrameRingAllocator&&) = delete;
+	FrameRingAllocator& operator= (FrameRingAllocator&&) = delete;
+	~FrameRingAllocator() noexcept { this->destroy(); }
+
+	// State methods
+	// --------------------------------------------------------------------------------------------
+
+	// Initializes the allocator with a chunk of memory aligned to at least 32 bytes. The memory is
+	// not owned by the allocator. The current frame is 0 after initialization.
+	void init(void* memory, uint64_t memorySizeBytes) noexcept;
+	void destroy() noexcept;
+
+	// Resets the allocator, retiring all frames and "deallocating" everything. Not thread-safe.
+	void reset() noexcept;
+
+	// Frame methods
+	// --------------------------------------------------------------------------------------------
+
+	// Begins a new frame and returns its index, subsequent allocations belong to this frame.
+	uint64_t beginFrame() noexcept;
+
+	// Retires a frame which is no longer the current frame, making its memory available for reuse
+	// once all earlier frames have been retired as well. Each frame may only be retired once.
+	void retireFrame(uint64_t frame) noexcept;
+
+	uint64_t currentFrame() const noexcept { return mCurrentFrame.load(std::memory_order_acquire); }
+	uint64_t oldestUnretiredFrame() const noexcept
+	{
+		return mOldestFrame.load(std::memory_order_acquire);
+	}
+	uint64_t numFramesInFlight() const noexcept
+	{
+		return currentFrame() - oldestUnretiredFrame() + 1;
+	}
+
+	// Methods
+	// --------------------------------------------------------------------------------------------
+
+	uint64_t capacity() const noexcept { return mMemorySizeBytes; }
+
+	// Number of bytes (including padding and skipped bytes at the end of the ring) used by frames
+	// that have not yet been reclaimed.
+	uint64_t numBytesInUse() const noexcept
+	{
+		return mHeadOffset.load(std::memory_order_relaxed) -
+			mTailOffset.load(std::memory_order_relaxed);
+	}
+
+	// Implemented sfz::Allocator methods
+	// --------------------------------------------------------------------------------------------
+
+	void* allocate(DbgInfo dbg, uint64_t size, uint64_t alignment = 32) noexcept override final;
+	void deallocate(void*) noexcept override final { /* no-op */ }
+
+	// Only the most recent allocation can be extended, and only if it does not need to wrap.
+	bool tryExtendInPlace(void* pointer, uint64_t currentSize, uint64_t newSize) noexcept override final;
+
+	// Private members
+	// --------------------------------------------------------------------------------------------
+private:
+	uint8_t* mMemory = nullptr;
+	uint64_t mMemorySizeBytes = 0;
+
+	// Head and tail are monotonically increasing logical offsets, the physical offset into the
+	// memory chunk is the logical offset modulo the size of the chunk.
+	alignas(64) std::atomic<uint64_t> mHeadOffset{0};
+	alignas(64) std::atomic<uint64_t> mTailOffset{0};
+	std::atomic<uint64_t> mCurrentFrame{0};
+	std::atomic<uint64_t> mOldestFrame{0};
+
+	// Start offset and retired flag of each frame in flight, indexed by frame % MAX_FRAMES_IN_FLIGHT
+	std::mutex mRetireMutex;
+	uint64_t mFrameStartOffsets[MAX_FRAMES_IN_FLIGHT] = {};
+	std::atomic<bool> mFrameRetired[MAX_FRAMES_IN_FLIGHT] = {};
+};
+
+} // namespace sfz
@@ -0,0 +1,114 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#pragma once
+
+#include <sfz/memory/Allocator.hpp>
+
+namespace sfz {
+
+// PoolAllocator class
+// ------------------------------------------------------------------------------------------------
+
+// Pool allocator
+//
+// The pool allocator is given (or allocates) a chunk of memory which it splits into a number of
+// fixed-size slots with a fixed alignment. Each allocation hands out exactly one slot, regardless
+// of the size requested, and each deallocation returns it. Free slots are linked together in an
+// intrusive free list (the "next" pointer is stored inside the free slot itself), which means
+// both allocation and deallocation are O(1) and that there is no per-allocation overhead.
+//
+// Slots that have never been used are not put on the free list when the allocator is initialized,
+// instead they are handed out in order once the free list is empty. This makes init() O(1) and
+// means that the number of slots ever touched is also the high-water mark of the pool.
+//
+// The pool allocator is good for objects of the same size which are created and destroyed often,
+// an example would be entities or particles. Attempting to allocate something larger than the
+// slot size (or with a larger alignment than the slot alignment) will fail and return nullptr.
+//
+// See more: https://en.wikipedia.org/wiki/Memory_pool
+class PoolAllocator final : public Allocator {
+public:
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	PoolAllocator() noexcept = default;
+	PoolAllocator(const PoolAllocator&) = delete;
+	PoolAllocator& operator= (const PoolAllocator&) = delete;
+	PoolAllocator(PoolAllocator&&) = delete;
+	PoolAllocator& operator= (PoolAllocator&&) = delete;
+	~PoolAllocator() noexcept { this->destroy(); }
+
+	// State methods
+	// --------------------------------------------------------------------------------------------
+
+	// Returns the number of bytes of memory required for a pool with the specified parameters.
+	static uint64_t memoryRequirementBytes(
+		uint64_t slotSize, uint32_t numSlots, uint64_t slotAlignment = 32) noexcept;
+
+	// Initializes the pool with a caller-supplied chunk of memory. The memory must be aligned to
+	// slotAlignment and must be at least memoryRequirementBytes() large. It is not owned by the
+	// pool, i.e. it is the responsibility of the caller to free it after the pool is destroyed.
+	void init(uint64_t slotSize, uint32_t numSlots, uint64_t slotAlignment,
+		void* memory, uint64_t memorySizeBytes) noexcept;
+
+	// Initializes the pool by allocating the required memory from the specified allocator. The
+	// memory is owned by the pool and returned to the allocator when destroy() is called.
+	void init(uint64_t slotSize, uint32_t numSlots, uint64_t slotAlignment,
+		Allocator* allocator, DbgInfo allocDbg) noexcept;
+
+	void destroy() noexcept;
+
+	// Resets this pool allocator, "deallocating" everything that has been allocated from it. This
+	// also resets the high-water mark.
+	void reset() noexcept;
+
+	// Methods
+	// --------------------------------------------------------------------------------------------
+
+	// The size of each slot, i.e. the requested slot size rounded up to the slot alignment.
+	uint64_t slotSize() const noexcept { return mSlotSize; }
+	uint64_t slotAlignment() const noexcept { return mSlotAlignment; }
+	uint32_t numSlots() const noexcept { return mNumSlots; }
+	uint32_t numSlotsInUse() const noexcept { return mNumSlotsInUse; }
+	uint32_t numSlotsHighWaterMark() const noexcept { return mNumSlotsTouched; }
+	uint64_t capacity() const noexcept { return mSlotSize * mNumSlots; }
+
+	// Returns whether the specified pointer points to a slot in this pool.
+	bool owns(const void* pointer) const noexcept;
+
+	// Implemented sfz::Allocator methods
+	// --------------------------------------------------------------------------------------------
+
+	void* allocate(DbgInfo dbg, uint64_t size, uint64_t alignment = 32) noexcept override final;
+	void deallocate(void* pointer) noexcept override final;
+
+	// Private members
+	// --------------------------------------------------------------------------------------------
+private:
+	uint8_t* mMemory = nullptr;
+	Allocator* mOwningAllocator = nullptr;
+	uint64_t mSlotSize = 0;
+	uint64_t mSlotAlignment = 0;
+	uint32_t mNumSlots = 0;
+	uint32_t mNumSlotsInUse = 0;
+	uint32_t mNumSlotsTouched = 0;
+	void* mFreeListHead = nullptr;
+};
+
+} // namespace sfz
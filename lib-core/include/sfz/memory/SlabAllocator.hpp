@@ -0,0 +1,143 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#pragma once
+
+#include <sfz/memory/Allocator.hpp>
+
+namespace sfz {
+
+// SlabAllocator class
+// ------------------------------------------------------------------------------------------------
+
+// Slab allocator for small objects
+//
+// Allocations of up to 512 bytes are rounded up to one of a number of size classes (powers of two
+// and intermediate sizes between them, starting at 8 bytes). Each size class allocates from its
+// own 4 KiB slabs, which are split into equally sized blocks without any per-allocation headers
+// or padding. Freed blocks are kept in a per-slab free list and slabs that become completely
+// empty are returned to a shared pool where they can be reused by any size class.
+//
+// Slabs are aligned to their size and blocks are placed at multiples of the class size within
+// them, so a block is aligned to the largest power of two dividing its class size. The smallest
+// size class which satisfies both the size and the requested alignment is used. This means that
+// to benefit from the small size classes the caller should pass the actual alignment required
+// (e.g. alignof(T)) instead of the default 32 bytes, which forces a 32 byte class.
+//
+// Slab memory is reserved up front as a range of virtual memory (committed in 64 KiB chunks as
+// needed) and slab metadata is stored in a separate side table, so the owning slab of a pointer
+// is found with a single subtraction and shift. On platforms without virtual memory support
+// (Emscripten) the entire slab memory is instead allocated up front from the parent allocator.
+// Larger allocations (or allocations with alignment above 512 bytes) are forwarded to the parent
+// allocator.
+//
+// The slab allocator is NOT thread-safe, it is intended to be used by a single thread (or
+// externally synchronized).
+class SlabAllocator final : public Allocator {
+public:
+	// Constants
+	// --------------------------------------------------------------------------------------------
+
+	static constexpr uint64_t SLAB_SIZE = 4096;
+	static constexpr uint32_t MAX_SMALL_SIZE = 512;
+	static constexpr uint32_t NUM_SIZE_CLASSES = 15;
+
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	SlabAllocator() noexcept = default;
+	SlabAllocator(const SlabAllocator&) = delete;
+	SlabAllocator& operator= (const SlabAllocator&) = delete;
+	SlabAllocator(SlabAllocator&&) = delete;
+	SlabAllocator& operator= (SlabAllocator&&) = delete;
+	~SlabAllocator() noexcept { this->destroy(); }
+
+	// State methods
+	// --------------------------------------------------------------------------------------------
+
+	// Initializes the slab allocator. Large allocations, the slab side table and (if virtual
+	// memory is not available) the slab memory itself is allocated from the parent allocator.
+	// maxSlabMemoryBytes is the max amount of memory used for slabs, rounded up to 64 KiB.
+	void init(Allocator* parentAllocator, uint64_t maxSlabMemoryBytes = 256 * 1024 * 1024) noexcept;
+
+	// Destroys the slab allocator, all memory allocated from it must be deallocated first.
+	void destroy() noexcept;
+
+	// Methods
+	// --------------------------------------------------------------------------------------------
+
+	Allocator* parentAllocator() const noexcept { return mParent; }
+	uint64_t slabMemoryCapacity() const noexcept { return uint64_t(mNumSlabs) * SLAB_SIZE; }
+
+	// Returns the block size of the size class an allocation with the specified size and
+	// alignment would use, or 0 if it would be forwarded to the parent allocator.
+	uint32_t sizeClassBlockSize(uint64_t size, uint64_t alignment) const noexcept;
+
+	// Number of slabs currently assigned to a size class, i.e. containing at least one block.
+	uint32_t numSlabsInUse() const noexcept { return mNumSlabsInUse; }
+
+	// Number of small allocations (served from slabs) currently allocated, and the number of
+	// bytes they occupy (i.e. their sizes rounded up to their size classes).
+	uint32_t numSmallAllocations() const noexcept { return mNumSmallAllocations; }
+	uint64_t numSmallBytesAllocated() const noexcept { return mNumSmallBytesAllocated; }
+
+	// Returns whether the specified pointer points into slab memory owned by this allocator.
+	bool ownsSlabMemory(const void* pointer) const noexcept;
+
+	// Implemented sfz::Allocator methods
+	// --------------------------------------------------------------------------------------------
+
+	void* allocate(DbgInfo dbg, uint64_t size, uint64_t alignment = 32) noexcept override final;
+	void deallocate(void* pointer) noexcept override final;
+	void deallocateSized(void* pointer, uint64_t size, uint64_t alignment = 32) noexcept override final;
+	bool tryExtendInPlace(void* pointer, uint64_t currentSize, uint64_t newSize) noexcept override final;
+
+	// Private members
+	// --------------------------------------------------------------------------------------------
+private:
+	struct SlabInfo final {
+		void* freeList;
+		uint32_t prevSlab;
+		uint32_t nextSlab;
+		uint16_t numUsed;
+		uint16_t numTouched;
+		uint8_t classIdx;
+	};
+
+	uint32_t findSizeClass(uint64_t size, uint64_t alignment) const noexcept;
+	uint32_t acquireSlab(uint32_t classIdx) noexcept;
+	void unlinkSlab(uint32_t slabIdx) noexcept;
+	void deallocateSmall(void* pointer) noexcept;
+
+	Allocator* mParent = nullptr;
+	uint8_t* mSlabMemory = nullptr;
+	bool mIsVirtual = false;
+	uint32_t mNumSlabs = 0;
+	uint32_t mNumSlabsTouched = 0;
+	uint32_t mNumSlabsCommitted = 0;
+	uint32_t mNumSlabsInUse = 0;
+	SlabInfo* mSlabInfos = nullptr;
+
+	uint32_t mPartialSlabs[NUM_SIZE_CLASSES] = {}; // Slabs with free blocks, per size class
+	uint32_t mFreeSlabs = 0; // Empty slabs, linked through nextSlab
+
+	uint32_t mNumSmallAllocations = 0;
+	uint64_t mNumSmallBytesAllocated = 0;
+};
+
+} // namespace sfz
@@ -22,6 +22,7 @@
 #include <cstddef> // nullptr_t
 #include <type_traits> // std::is_array
 
+#include "sfz/Assert.hpp"
 #include "sfz/Context.hpp"
 #include "sfz/memory/Allocator.hpp"
 
@@ -136,22 +137,56 @@ UniquePtr<T> makeUnique(Allocator* allocator, Args&&... args) noexcept;
 template<typename T, typename... Args>
 UniquePtr<T> makeUniqueDefault(Args&&... args) noexcept;
 
+// Reference counting policies
+// ------------------------------------------------------------------------------------------------
+
+/// Thread-safe reference counting using atomic operations. The default policy.
+struct AtomicRefCount final {
+	using CounterT = std::atomic<uint32_t>;
+	static void increment(CounterT& c) noexcept { c.fetch_add(1, std::memory_order_relaxed); }
+	static uint32_t decrement(CounterT& c) noexcept
+	{
+		return c.fetch_sub(1, std::memory_order_acq_rel) - 1;
+	}
+	static uint32_t load(const CounterT& c) noexcept { return c.load(std::memory_order_relaxed); }
+};
+
+/// Non-atomic reference counting, may only be used for objects which are never shared between
+/// threads. Avoids lock-prefixed instructions when references are copied and destroyed.
+struct NonAtomicRefCount final {
+	using CounterT = uint32_t;
+	static void increment(CounterT& c) noexcept { c += 1; }
+	static uint32_t decrement(CounterT& c) noexcept { c -= 1; return c; }
+	static uint32_t load(const CounterT& c) noexcept { return c; }
+};
+
 // SharedPtr (interface)
 // ------------------------------------------------------------------------------------------------
 
 namespace detail {
 
-/// Inner state of all SharedPtrs
+/// Inner state (control block) of all SharedPtrs
+template<typename Policy>
 struct SharedPtrState final {
 	Allocator* allocator = nullptr;
-	std::atomic<uint32_t> refCount{0};
+	void* object = nullptr; // The object as originally created, with its original type
+	void (*destroyFunc)(SharedPtrState* state) = nullptr; // Destroys both object and state
+	typename Policy::CounterT refCount{0};
 };
 
 }
 
 /// Simple replacement for std::shared_ptr using sfzCore allocators
 /// Unlike std::shared_ptr there is NO support for arrays, use sfz::DynArray for that.
-template<typename T>
+///
+/// makeShared() allocates the object and its state (reference counter etc) in a single allocation.
+/// Taking ownership of an existing object (through the constructor or from a UniquePtr) allocates
+/// a separate state.
+///
+/// The reference counting policy decides whether the reference counter is atomic (AtomicRefCount,
+/// default) or not (NonAtomicRefCount, see LocalSharedPtr). SharedPtrs with different policies
+/// can't be converted into each other.
+template<typename T, typename Policy = AtomicRefCount>
 class SharedPtr final {
 public:
 	static_assert(!std::is_array<T>::value, "SharedPtr does not accept array types");
@@ -172,7 +207,7 @@ public:
 
 	/// Casts a subclass to a base class.
 	template<typename T2>
-	SharedPtr(const SharedPtr<T2>& subclassPtr) noexcept;
+	SharedPtr(const SharedPtr<T2, Policy>& subclassPtr) noexcept;
 
 	/// Casts a subclasss UniquePtr to a base class SharedPtr
 	template<typename T2>
@@ -212,11 +247,11 @@ public:
 	/// Casts (static_cast) the pointer to another type. The original is preserved, increments
 	/// ref count by 1.
 	template<typename T2>
-	SharedPtr<T2> cast() const noexcept;
+	SharedPtr<T2, Policy> cast() const noexcept;
 
 	/// Sets the internal state of this SmartPointer. Should never be called. Exists for
 	/// implementation reasons.
-	void dangerousSetState(T* ptr, detail::SharedPtrState* state) noexcept;
+	void dangerousSetState(T* ptr, detail::SharedPtrState<Policy>* state) noexcept;
 
 	// Operators
 	// --------------------------------------------------------------------------------------------
@@ -232,22 +267,28 @@ private:
 	// --------------------------------------------------------------------------------------------
 
 	T* mPtr = nullptr;
-	detail::SharedPtrState* mState = nullptr;
+	detail::SharedPtrState<Policy>* mState = nullptr;
 };
 
+/// SharedPtr with non-atomic reference counting, for objects which are never shared between
+/// threads.
 template<typename T>
-bool operator== (const SharedPtr<T>& lhs, std::nullptr_t rhs) noexcept;
+using LocalSharedPtr = SharedPtr<T, NonAtomicRefCount>;
 
-template<typename T>
-bool operator== (std::nullptr_t lhs, const SharedPtr<T>& rhs) noexcept;
+template<typename T, typename Policy>
+bool operator== (const SharedPtr<T, Policy>& lhs, std::nullptr_t rhs) noexcept;
 
-template<typename T>
-bool operator!= (const SharedPtr<T>& lhs, std::nullptr_t rhs) noexcept;
+template<typename T, typename Policy>
+bool operator== (std::nullptr_t lhs, const SharedPtr<T, Policy>& rhs) noexcept;
 
-template<typename T>
-bool operator!= (std::nullptr_t lhs, const SharedPtr<T>& rhs) noexcept;
+template<typename T, typename Policy>
+bool operator!= (const SharedPtr<T, Policy>& lhs, std::nullptr_t rhs) noexcept;
+
+template<typename T, typename Policy>
+bool operator!= (std::nullptr_t lhs, const SharedPtr<T, Policy>& rhs) noexcept;
 
 /// Constructs a new object of type T with the specified allocator and returns it in a SharedPtr
+/// The object and the SharedPtr's state are allocated in a single allocation.
 /// Will exit the program through std::terminate() if constructor throws an exception
 /// \return nullptr if memory allocation failed
 template<typename T, typename... Args>
@@ -259,6 +300,123 @@ SharedPtr<T> makeShared(Allocator* allocator, Args&&... args) noexcept;
 template<typename T, typename... Args>
 SharedPtr<T> makeSharedDefault(Args&&... args) noexcept;
 
+/// Same as makeShared(), but returns a LocalSharedPtr with non-atomic reference counting
+template<typename T, typename... Args>
+LocalSharedPtr<T> makeLocalShared(Allocator* allocator, Args&&... args) noexcept;
+
+// RefCounted & IntrusivePtr (interface)
+// ------------------------------------------------------------------------------------------------
+
+namespace detail { struct RefCountedAccess; }
+
+/// Base class for intrusively reference counted objects, see IntrusivePtr.
+///
+/// The reference counter, allocator and a destroy function is stored in the object itself, which
+/// means that an IntrusivePtr is only a single pointer and that creating it requires no separate
+/// state. Objects must be created with makeIntrusive(). Copying an object does not copy its
+/// reference count.
+template<typename Policy = AtomicRefCount>
+class RefCounted {
+public:
+	using RefCountPolicy = Policy;
+
+	/// Returns the number of IntrusivePtrs currently referencing this object
+	uint32_t refCount() const noexcept { return Policy::load(mRefCount); }
+
+	/// Returns the allocator this object was created with
+	Allocator* refCountedAllocator() const noexcept { return mRefCountedAllocator; }
+
+protected:
+	RefCounted() noexcept = default;
+	RefCounted(const RefCounted&) noexcept { }
+	RefCounted& operator= (const RefCounted&) noexcept { return *this; }
+	~RefCounted() noexcept = default;
+
+private:
+	friend struct detail::RefCountedAccess;
+	mutable typename Policy::CounterT mRefCount{0};
+	Allocator* mRefCountedAllocator = nullptr;
+	void (*mRefCountedDestroyFunc)(RefCounted* object) = nullptr;
+};
+
+/// Smart pointer to an intrusively reference counted object, i.e. an object which inherits from
+/// RefCounted and is created using makeIntrusive(). Has the same size as a raw pointer.
+template<typename T>
+class IntrusivePtr final {
+public:
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	/// Creates an empty IntrusivePtr (holding nullptr)
+	IntrusivePtr() noexcept = default;
+
+	/// Creates an empty IntrusivePtr (holding nullptr)
+	IntrusivePtr(std::nullptr_t) noexcept { }
+
+	/// Creates a new reference to an object created with makeIntrusive(), increments the
+	/// reference counter. Can e.g. be used to create a new reference from the this pointer.
+	explicit IntrusivePtr(T* object) noexcept;
+
+	/// Casts a subclass to a base class.
+	template<typename T2>
+	IntrusivePtr(const IntrusivePtr<T2>& subclassPtr) noexcept;
+
+	/// Copy constructors. Copies an IntrusivePtr and increments the reference counter.
+	IntrusivePtr(const IntrusivePtr& other) noexcept;
+	IntrusivePtr& operator= (const IntrusivePtr& other) noexcept;
+
+	/// Move constructors. Swaps two pointers using swap().
+	IntrusivePtr(IntrusivePtr&& other) noexcept { this->swap(other); }
+	IntrusivePtr& operator= (IntrusivePtr&& other) noexcept { this->swap(other); return *this; }
+
+	/// Destroys this IntrusivePtr (not necessarily the object pointed at) with destroy().
+	~IntrusivePtr() noexcept { this->destroy(); }
+
+	// Public methods
+	// --------------------------------------------------------------------------------------------
+
+	/// Swaps the internal pointers of this and the other IntrusivePtr
+	void swap(IntrusivePtr& other) noexcept;
+
+	/// Decrements the reference counter and deletes the object if counter is 0. Will do nothing
+	/// if no object is held.
+	void destroy() noexcept;
+
+	/// Returns the internal pointer
+	T* get() const noexcept { return mPtr; }
+
+	/// Returns the number of references to the internal object (or 0 if no object is held)
+	size_t refCount() const noexcept { return mPtr == nullptr ? 0 : mPtr->refCount(); }
+
+	// Operators
+	// --------------------------------------------------------------------------------------------
+
+	T& operator* () const noexcept { return *mPtr; }
+	T* operator-> () const noexcept { return mPtr; }
+
+	bool operator== (const IntrusivePtr& other) const noexcept { return mPtr == other.mPtr; }
+	bool operator!= (const IntrusivePtr& other) const noexcept { return mPtr != other.mPtr; }
+	bool operator== (std::nullptr_t) const noexcept { return mPtr == nullptr; }
+	bool operator!= (std::nullptr_t) const noexcept { return mPtr != nullptr; }
+
+private:
+	// Private members
+	// --------------------------------------------------------------------------------------------
+
+	T* mPtr = nullptr;
+};
+
+/// Constructs a new intrusively reference counted object of type T (which must inherit from
+/// RefCounted) with the specified allocator and returns it in an IntrusivePtr.
+/// Will exit the program through std::terminate() if constructor throws an exception
+/// \return nullptr if memory allocation failed
+template<typename T, typename... Args>
+IntrusivePtr<T> makeIntrusive(Allocator* allocator, Args&&... args) noexcept;
+
+/// Same as makeIntrusive(), but with the default allocator
+template<typename T, typename... Args>
+IntrusivePtr<T> makeIntrusiveDefault(Args&&... args) noexcept;
+
 } // namespace sfz
 
 #include "sfz/memory/SmartPointers.inl"
@@ -75,7 +75,10 @@ template<typename T>
 void UniquePtr<T>::destroy() noexcept
 {
 	if (mPtr == nullptr) return;
-	mAllocator->deleteObject<T>(mPtr);
+
+	// Not deleteObject(), pointer may have been cast from a subclass so its size is not known
+	mPtr->~T();
+	mAllocator->deallocate(mPtr);
 	mPtr = nullptr;
 	mAllocator = nullptr;
 }
@@ -157,60 +160,125 @@ UniquePtr<T> makeUniqueDefault(Args&&... args) noexcept
 	return makeUnique<T>(getDefaultAllocator(), std::forward<Args>(args)...);
 }
 
+// SharedPtr (implementation): Control blocks
+// ------------------------------------------------------------------------------------------------
+
+namespace detail {
+
+// Object and state allocated together by makeShared()
+template<typename T, typename Policy>
+struct SharedPtrInlineBlock final {
+	SharedPtrState<Policy> state;
+	alignas(T) uint8_t object[sizeof(T)];
+};
+
+template<typename T, typename Policy>
+void destroySharedInline(SharedPtrState<Policy>* state) noexcept
+{
+	using Block = SharedPtrInlineBlock<T, Policy>;
+	Block* block = reinterpret_cast<Block*>(state);
+	Allocator* allocator = state->allocator;
+	static_cast<T*>(state->object)->~T();
+	state->~SharedPtrState<Policy>();
+	allocator->deallocateSized(block, sizeof(Block), alignof(Block) < 32 ? 32 : alignof(Block));
+}
+
+template<typename T, typename Policy>
+void destroySharedSeparate(SharedPtrState<Policy>* state) noexcept
+{
+	// Not deleteObject(), object may have been created as a subclass so its size is not known
+	T* object = static_cast<T*>(state->object);
+	Allocator* allocator = state->allocator;
+	object->~T();
+	allocator->deallocate(object);
+	allocator->deleteObject(state);
+}
+
+template<typename T, typename Policy>
+SharedPtrState<Policy>* createSharedSeparateState(T* object, Allocator* allocator) noexcept
+{
+	SharedPtrState<Policy>* state =
+		allocator->newObject<SharedPtrState<Policy>>(sfz_dbg("SharedPtrState"));
+	state->allocator = allocator;
+	state->object = object;
+	state->destroyFunc = &destroySharedSeparate<T, Policy>;
+	state->refCount = 1;
+	return state;
+}
+
+template<typename T, typename Policy, typename... Args>
+SharedPtr<T, Policy> makeSharedInline(Allocator* allocator, Args&&... args) noexcept
+{
+	using Block = SharedPtrInlineBlock<T, Policy>;
+	Block* block = static_cast<Block*>(allocator->allocate(
+		sfz_dbg("SharedPtr"), sizeof(Block), alignof(Block) < 32 ? 32 : alignof(Block)));
+	if (block == nullptr) return nullptr;
+
+	// Creates object (placement new), terminates program if constructor throws exception.
+	SharedPtrState<Policy>* state = new (&block->state) SharedPtrState<Policy>();
+	T* object = new (block->object) T(std::forward<Args>(args)...);
+	state->allocator = allocator;
+	state->object = object;
+	state->destroyFunc = &destroySharedInline<T, Policy>;
+	state->refCount = 1;
+
+	SharedPtr<T, Policy> tmp;
+	tmp.dangerousSetState(object, state);
+	return tmp;
+}
+
+} // namespace detail
+
 // SharedPtr (implementation): Constructors & destructors
 // ------------------------------------------------------------------------------------------------
 
-template<typename T>
-SharedPtr<T>::SharedPtr(T* object, Allocator* allocator) noexcept
+template<typename T, typename Policy>
+SharedPtr<T, Policy>::SharedPtr(T* object, Allocator* allocator) noexcept
 {
+	if (object == nullptr) return;
 	mPtr = object;
-	mState = allocator->newObject<detail::SharedPtrState>(sfz_dbg("SharedPtrStr"));
-	mState->allocator = allocator;
-	mState->refCount = 1;
+	mState = detail::createSharedSeparateState<T, Policy>(object, allocator);
 }
 
-template<typename T>
+template<typename T, typename Policy>
 template<typename T2>
-SharedPtr<T>::SharedPtr(const SharedPtr<T2>& subclassPtr) noexcept
+SharedPtr<T, Policy>::SharedPtr(const SharedPtr<T2, Policy>& subclassPtr) noexcept
 {
 	static_assert(std::is_base_of<T,T2>::value, "T2 is not a subclass of T");
 	*this = subclassPtr.template cast<T>();
 }
 
-template<typename T>
+template<typename T, typename Policy>
 template<typename T2>
-SharedPtr<T>::SharedPtr(UniquePtr<T2>&& subclassPtr) noexcept
+SharedPtr<T, Policy>::SharedPtr(UniquePtr<T2>&& subclassPtr) noexcept
 {
 	static_assert(std::is_base_of<T,T2>::value || std::is_same<T,T2>::value, "T2 is not a subclass of T");
 	if (subclassPtr == nullptr) return;
 
-	mState = subclassPtr.allocator()-> template newObject<detail::SharedPtrState>(sfz_dbg("SharedPtrState"));
-	mState->allocator = subclassPtr.allocator();
-	mState->refCount = 1;
-	mPtr = static_cast<T*>(subclassPtr.take());
+	Allocator* allocator = subclassPtr.allocator();
+	T2* object = subclassPtr.take();
+	mState = detail::createSharedSeparateState<T2, Policy>(object, allocator);
+	mPtr = static_cast<T*>(object);
 }
 
-template<typename T>
-SharedPtr<T>::SharedPtr(const SharedPtr& other) noexcept
+template<typename T, typename Policy>
+SharedPtr<T, Policy>::SharedPtr(const SharedPtr& other) noexcept
 {
 	*this = other;
 }
 
-template<typename T>
-SharedPtr<T>& SharedPtr<T>::operator= (const SharedPtr& other) noexcept
+template<typename T, typename Policy>
+SharedPtr<T, Policy>& SharedPtr<T, Policy>::operator= (const SharedPtr& other) noexcept
 {
 	// Don't copy to same SharedPointer
 	if (this == &other) return *this;
 
+	// Increment ref counter first, other might be the last reference to the object held by this
+	if (other != nullptr) Policy::increment(other.mState->refCount);
+
 	// Destroy whatevers currently in this pointer
 	this->destroy();
 
-	// If other is nullptr we are done
-	if (other == nullptr) return *this;
-
-	// Increment ref counter
-	other.mState->refCount += 1;
-
 	// Copy pointer and state
 	this->mPtr = other.mPtr;
 	this->mState = other.mState;
@@ -218,21 +286,21 @@ SharedPtr<T>& SharedPtr<T>::operator= (const SharedPtr& other) noexcept
 	return *this;
 }
 
-template<typename T>
-SharedPtr<T>::SharedPtr(SharedPtr&& other) noexcept
+template<typename T, typename Policy>
+SharedPtr<T, Policy>::SharedPtr(SharedPtr&& other) noexcept
 {
 	this->swap(other);
 }
 
-template<typename T>
-SharedPtr<T>& SharedPtr<T>::operator= (SharedPtr&& other) noexcept
+template<typename T, typename Policy>
+SharedPtr<T, Policy>& SharedPtr<T, Policy>::operator= (SharedPtr&& other) noexcept
 {
 	this->swap(other);
 	return *this;
 }
 
-template<typename T>
-SharedPtr<T>::~SharedPtr() noexcept
+template<typename T, typename Policy>
+SharedPtr<T, Policy>::~SharedPtr() noexcept
 {
 	this->destroy();
 }
@@ -240,62 +308,61 @@ SharedPtr<T>::~SharedPtr() noexcept
 // SharedPtr (implementation): Public methods
 // ------------------------------------------------------------------------------------------------
 
-template<typename T>
-void SharedPtr<T>::swap(SharedPtr& other) noexcept
+template<typename T, typename Policy>
+void SharedPtr<T, Policy>::swap(SharedPtr& other) noexcept
 {
 	T* thisPtr = this->mPtr;
 	this->mPtr = other.mPtr;
 	other.mPtr = thisPtr;
 
-	detail::SharedPtrState* thisState = this->mState;
+	detail::SharedPtrState<Policy>* thisState = this->mState;
 	this->mState = other.mState;
 	other.mState = thisState;
 }
 
-template<typename T>
-void SharedPtr<T>::destroy() noexcept
+template<typename T, typename Policy>
+void SharedPtr<T, Policy>::destroy() noexcept
 {
 	if (mPtr == nullptr) return;
-	uint32_t count = mState->refCount.fetch_sub(1) - 1;
-	if (count == 0) {
-		mState->allocator->deleteObject(mPtr);
-		mState->allocator->deleteObject(mState);
+	if (Policy::decrement(mState->refCount) == 0) {
+		mState->destroyFunc(mState);
 	}
 	mPtr = nullptr;
 	mState = nullptr;
 }
 
-template<typename T>
-Allocator* SharedPtr<T>::allocator() const noexcept
+template<typename T, typename Policy>
+Allocator* SharedPtr<T, Policy>::allocator() const noexcept
 {
 	if (mState == nullptr) return nullptr;
 	return mState->allocator;
 }
 
-template<typename T>
-size_t SharedPtr<T>::refCount() const noexcept
+template<typename T, typename Policy>
+size_t SharedPtr<T, Policy>::refCount() const noexcept
 {
 	if (mState == nullptr) return 0;
-	return mState->refCount;
+	return Policy::load(mState->refCount);
 }
 
-template<typename T>
+template<typename T, typename Policy>
 template<typename T2>
-SharedPtr<T2> SharedPtr<T>::cast() const noexcept
+SharedPtr<T2, Policy> SharedPtr<T, Policy>::cast() const noexcept
 {
 	if (*this == nullptr) return nullptr;
 
 	// Increment ref counter
-	mState->refCount += 1;;
+	Policy::increment(mState->refCount);
 
 	// Cast pointer
-	SharedPtr<T2> tmp;
+	SharedPtr<T2, Policy> tmp;
 	tmp.dangerousSetState(static_cast<T2*>(this->mPtr), this->mState);
 	return tmp;
 }
 
-template<typename T>
-void SharedPtr<T>::dangerousSetState(T* ptr, detail::SharedPtrState* state) noexcept
+template<typename T, typename Policy>
+void SharedPtr<T, Policy>::dangerousSetState(
+	T* ptr, detail::SharedPtrState<Policy>* state) noexcept
 {
 	this->mPtr = ptr;
 	this->mState = state;
@@ -304,14 +371,14 @@ void SharedPtr<T>::dangerousSetState(T* ptr, detail::SharedPtrState* state) noex
 // SharedPtr (implementation): Operators
 // ------------------------------------------------------------------------------------------------
 
-template<typename T>
-bool SharedPtr<T>::operator== (const SharedPtr& other) const noexcept
+template<typename T, typename Policy>
+bool SharedPtr<T, Policy>::operator== (const SharedPtr& other) const noexcept
 {
 	return this->mPtr == other.mPtr;
 }
 
-template<typename T>
-bool SharedPtr<T>::operator!= (const SharedPtr& other) const noexcept
+template<typename T, typename Policy>
+bool SharedPtr<T, Policy>::operator!= (const SharedPtr& other) const noexcept
 {
 	return !(*this == other);
 }
@@ -319,26 +386,26 @@ bool SharedPtr<T>::operator!= (const SharedPtr& other) const noexcept
 // SharedPtr (implementation): Free operators
 // ------------------------------------------------------------------------------------------------
 
-template<typename T>
-bool operator== (const SharedPtr<T>& lhs, std::nullptr_t) noexcept
+template<typename T, typename Policy>
+bool operator== (const SharedPtr<T, Policy>& lhs, std::nullptr_t) noexcept
 {
 	return lhs.get() == nullptr;
 }
 
-template<typename T>
-bool operator== (std::nullptr_t, const SharedPtr<T>& rhs) noexcept
+template<typename T, typename Policy>
+bool operator== (std::nullptr_t, const SharedPtr<T, Policy>& rhs) noexcept
 {
 	return rhs.get() == nullptr;
 }
 
-template<typename T>
-bool operator!= (const SharedPtr<T>& lhs, std::nullptr_t) noexcept
+template<typename T, typename Policy>
+bool operator!= (const SharedPtr<T, Policy>& lhs, std::nullptr_t) noexcept
 {
 	return lhs.get() != nullptr;
 }
 
-template<typename T>
-bool operator!= (std::nullptr_t, const SharedPtr<T>& rhs) noexcept
+template<typename T, typename Policy>
+bool operator!= (std::nullptr_t, const SharedPtr<T, Policy>& rhs) noexcept
 {
 	return rhs.get() != nullptr;
 }
@@ -349,8 +416,7 @@ bool operator!= (std::nullptr_t, const SharedPtr<T>& rhs) noexcept
 template<typename T, typename... Args>
 SharedPtr<T> makeShared(Allocator* allocator, Args&&... args) noexcept
 {
-	return SharedPtr<T>(
-		allocator->newObject<T>(sfz_dbg("SharedPtr"), std::forward<Args>(args)...), allocator);
+	return detail::makeSharedInline<T, AtomicRefCount>(allocator, std::forward<Args>(args)...);
 }
 
 template<typename T, typename... Args>
@@ -359,4 +425,130 @@ SharedPtr<T> makeSharedDefault(Args&&... args) noexcept
 	return makeShared<T>(getDefaultAllocator(), std::forward<Args>(args)...);
 }
 
+template<typename T, typename... Args>
+LocalSharedPtr<T> makeLocalShared(Allocator* allocator, Args&&... args) noexcept
+{
+	return detail::makeSharedInline<T, NonAtomicRefCount>(allocator, std::forward<Args>(args)...);
+}
+
+// RefCounted & IntrusivePtr (implementation)
+// ------------------------------------------------------------------------------------------------
+
+namespace detail {
+
+// Gives IntrusivePtr and makeIntrusive() access to the private members of RefCounted
+struct RefCountedAccess final {
+	template<typename Policy>
+	static typename Policy::CounterT& counter(const RefCounted<Policy>& object) noexcept
+	{
+		return object.mRefCount;
+	}
+
+	template<typename T>
+	static void destroy(RefCounted<typename T::RefCountPolicy>* base) noexcept
+	{
+		T* object = static_cast<T*>(base);
+		Allocator* allocator = object->mRefCountedAllocator;
+		allocator->deleteObject(object);
+	}
+
+	template<typename T>
+	static void init(T* object, Allocator* allocator) noexcept
+	{
+		using Policy = typename T::RefCountPolicy;
+		RefCounted<Policy>* base = object;
+		base->mRefCountedAllocator = allocator;
+		base->mRefCountedDestroyFunc = &RefCountedAccess::destroy<T>;
+		Policy::increment(base->mRefCount);
+	}
+
+	template<typename T>
+	static void addRef(T* object) noexcept
+	{
+		using Policy = typename T::RefCountPolicy;
+		const RefCounted<Policy>* base = object;
+		sfz_assert(base->mRefCountedDestroyFunc != nullptr); // Must be created with makeIntrusive()
+		Policy::increment(base->mRefCount);
+	}
+
+	template<typename T>
+	static void release(T* object) noexcept
+	{
+		using Policy = typename T::RefCountPolicy;
+		RefCounted<Policy>* base = object;
+		if (Policy::decrement(base->mRefCount) == 0) base->mRefCountedDestroyFunc(base);
+	}
+};
+
+} // namespace detail
+
+template<typename T>
+IntrusivePtr<T>::IntrusivePtr(T* object) noexcept
+{
+	if (object == nullptr) return;
+	detail::RefCountedAccess::addRef(object);
+	mPtr = object;
+}
+
+template<typename T>
+template<typename T2>
+IntrusivePtr<T>::IntrusivePtr(const IntrusivePtr<T2>& subclassPtr) noexcept
+{
+	static_assert(std::is_base_of<T,T2>::value, "T2 is not a subclass of T");
+	*this = IntrusivePtr<T>(static_cast<T*>(subclassPtr.get()));
+}
+
+template<typename T>
+IntrusivePtr<T>::IntrusivePtr(const IntrusivePtr& other) noexcept
+{
+	*this = other;
+}
+
+template<typename T>
+IntrusivePtr<T>& IntrusivePtr<T>::operator= (const IntrusivePtr& other) noexcept
+{
+	if (this == &other) return *this;
+	if (other.mPtr != nullptr) detail::RefCountedAccess::addRef(other.mPtr);
+	this->destroy();
+	mPtr = other.mPtr;
+	return *this;
+}
+
+template<typename T>
+void IntrusivePtr<T>::swap(IntrusivePtr& other) noexcept
+{
+	T* thisPtr = this->mPtr;
+	this->mPtr = other.mPtr;
+	other.mPtr = thisPtr;
+}
+
+template<typename T>
+void IntrusivePtr<T>::destroy() noexcept
+{
+	if (mPtr == nullptr) return;
+	detail::RefCountedAccess::release(mPtr);
+	mPtr = nullptr;
+}
+
+template<typename T, typename... Args>
+IntrusivePtr<T> makeIntrusive(Allocator* allocator, Args&&... args) noexcept
+{
+	static_assert(std::is_base_of<RefCounted<typename T::RefCountPolicy>, T>::value,
+		"T must inherit from RefCounted");
+	T* object = allocator->newObject<T>(sfz_dbg("IntrusivePtr"), std::forward<Args>(args)...);
+	if (object == nullptr) return nullptr;
+
+	// Initialized with ref count 1, which is adopted by the returned pointer
+	detail::RefCountedAccess::init(object, allocator);
+	IntrusivePtr<T> tmp(object);
+	detail::RefCountedAccess::release(object);
+	return tmp;
+}
+
+template<typename T, typename... Args>
+IntrusivePtr<T> makeIntrusiveDefault(Args&&... args) noexcept
+{
+	return makeIntrusive<T>(getDefaultAllocator(), std::forward<Args>(args)...);
+}
+
 } // namespace sfz
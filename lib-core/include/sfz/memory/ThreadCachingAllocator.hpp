@@ -0,0 +1,53 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#pragma once
+
+#include "sfz/memory/Allocator.hpp"
+
+namespace sfz {
+
+// ThreadCachingAllocator retrieval function
+// ------------------------------------------------------------------------------------------------
+
+/// Returns pointer to the thread-caching allocator, a general purpose allocator designed to scale
+/// with many threads allocating and deallocating at the same time.
+///
+/// Small allocations (up to 32 KiB) are rounded up to one of a number of size classes. Each thread
+/// keeps a cache of free blocks for every size class, so most allocations and deallocations never
+/// touch any shared state. When a thread's cache runs empty (or grows too large) blocks are moved
+/// in batches to/from a central pool protected by one mutex per size class. The central pool in
+/// turn carves blocks out of 64 KiB slabs committed from a large range of reserved virtual memory.
+/// Larger allocations (or allocations with alignment that no size class can satisfy) are
+/// forwarded to the standard allocator.
+///
+/// Memory freed to the thread-caching allocator is kept for reuse and never returned to the OS.
+/// Blocks may be deallocated on a different thread than they were allocated on. The caches of
+/// threads that exit are returned to the central pool. On platforms without virtual memory
+/// support (Emscripten) all allocations are forwarded to the standard allocator.
+///
+/// The allocator is a process-wide singleton that is never destroyed, so it can be used as the
+/// default allocator in the context:
+///
+/// static sfz::Context context;
+/// context.defaultAllocator = sfz::getThreadCachingAllocator();
+/// context.logger = sfz::getStandardLogger();
+/// sfz::setContext(&context);
+Allocator* getThreadCachingAllocator() noexcept;
+
+} // namespace sfz
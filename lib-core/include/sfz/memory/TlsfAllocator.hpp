@@ -0,0 +1,145 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#pragma once
+
+#include <sfz/memory/Allocator.hpp>
+
+namespace sfz {
+
+// TlsfAllocator class
+// ------------------------------------------------------------------------------------------------
+
+// Two-Level Segregated Fit (TLSF) allocator
+//
+// General purpose allocator for variable sized allocations from a single chunk of memory, with
+// O(1) allocation and deallocation. This makes it suitable for real-time code where the worst
+// case latency of the standard allocator is not acceptable, and for giving a subsystem a fixed
+// memory budget which it can allocate and free from arbitrarily.
+//
+// Free blocks are kept in segregated free lists indexed by two levels: the first level is the
+// power of two range of the block size and the second level linearly subdivides that range into
+// 32 sub ranges. Two levels of bitmaps keep track of which lists are non-empty, so a suitable
+// free block can be found with a couple of bit scans. Blocks are split on allocation and
+// immediately coalesced with their free physical neighbours on deallocation.
+//
+// Each allocation has a 16 byte header and sizes are rounded up to a multiple of 16 bytes.
+// Alignments up to 16 bytes are free, larger alignments are handled by searching for a larger
+// block and splitting off the leading gap as a new free block.
+//
+// See more: http://www.gii.upv.es/tlsf/
+class TlsfAllocator final : public Allocator {
+public:
+	// Constants
+	// --------------------------------------------------------------------------------------------
+
+	static constexpr uint32_t SL_INDEX_COUNT_LOG2 = 5;
+	static constexpr uint32_t SL_INDEX_COUNT = 1 << SL_INDEX_COUNT_LOG2;
+	static constexpr uint32_t ALIGN_SIZE_LOG2 = 4;
+	static constexpr uint32_t ALIGN_SIZE = 1 << ALIGN_SIZE_LOG2;
+	static constexpr uint32_t FL_INDEX_MAX = 40; // Supports up to 1 TiB of memory
+	static constexpr uint32_t FL_INDEX_SHIFT = SL_INDEX_COUNT_LOG2 + ALIGN_SIZE_LOG2;
+	static constexpr uint32_t FL_INDEX_COUNT = FL_INDEX_MAX - FL_INDEX_SHIFT + 1;
+	static constexpr uint64_t SMALL_BLOCK_SIZE = uint64_t(1) << FL_INDEX_SHIFT;
+
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	TlsfAllocator() noexcept = default;
+	TlsfAllocator(const TlsfAllocator&) = delete;
+	TlsfAllocator& operator= (const TlsfAllocator&) = delete;
+	TlsfAllocator(TlsfAllocator&&) = delete;
+	TlsfAllocator& operator= (TlsfAllocator&&) = delete;
+	~TlsfAllocator() noexcept { this->destroy(); }
+
+	// State methods
+	// --------------------------------------------------------------------------------------------
+
+	// Initializes the allocator with a caller-supplied chunk of memory, which must be aligned to
+	// 16 bytes. It is not owned by the allocator, i.e. it is the responsibility of the caller to
+	// free it after the allocator is destroyed.
+	void init(void* memory, uint64_t memorySizeBytes) noexcept;
+
+	// Initializes the allocator by allocating the memory from the specified allocator. The memory
+	// is owned by the allocator and returned to the allocator when destroy() is called.
+	void init(uint64_t memorySizeBytes, Allocator* allocator, DbgInfo allocDbg) noexcept;
+
+	void destroy() noexcept;
+
+	// Resets this allocator, "deallocating" everything that has been allocated from it.
+	void reset() noexcept;
+
+	// Methods
+	// --------------------------------------------------------------------------------------------
+
+	uint64_t capacity() const noexcept { return mMemorySizeBytes; }
+	uint32_t numAllocations() const noexcept { return mNumAllocations; }
+
+	// Number of bytes in allocated blocks (excluding headers), i.e. the requested sizes rounded
+	// up to a multiple of 16 bytes, plus any unsplittable leftovers.
+	uint64_t numBytesAllocated() const noexcept { return mNumBytesAllocated; }
+
+	// Number of bytes in free blocks (excluding headers).
+	uint64_t numBytesFree() const noexcept { return mNumBytesFree; }
+
+	// Size of the largest free block, i.e. an upper bound of the largest allocation (with 16 byte
+	// alignment) that can currently succeed. Only has to scan the free list with the largest
+	// blocks, but is not O(1).
+	uint64_t largestFreeBlockBytes() const noexcept;
+
+	// External fragmentation in the range [0, 1], calculated as 1 - (largest free block / free
+	// bytes). 0 means that all free memory is in a single contiguous block.
+	float fragmentation() const noexcept;
+
+	// Returns whether the specified pointer points into the memory managed by this allocator.
+	bool owns(const void* pointer) const noexcept;
+
+	// Implemented sfz::Allocator methods
+	// --------------------------------------------------------------------------------------------
+
+	void* allocate(DbgInfo dbg, uint64_t size, uint64_t alignment = 32) noexcept override final;
+	void deallocate(void* pointer) noexcept override final;
+
+	// Succeeds if the new size fits in the block, possibly after absorbing the next physical
+	// block if it is free.
+	bool tryExtendInPlace(void* pointer, uint64_t currentSize, uint64_t newSize) noexcept override final;
+
+	// Private members
+	// --------------------------------------------------------------------------------------------
+private:
+	struct BlockHeader;
+
+	void insertFreeBlock(BlockHeader* block) noexcept;
+	void removeFreeBlock(BlockHeader* block) noexcept;
+	BlockHeader* findFreeBlock(uint64_t size) noexcept;
+	void splitBlock(BlockHeader* block, uint64_t size) noexcept;
+
+	uint8_t* mMemory = nullptr;
+	uint64_t mMemorySizeBytes = 0;
+	Allocator* mOwningAllocator = nullptr;
+
+	uint32_t mNumAllocations = 0;
+	uint64_t mNumBytesAllocated = 0;
+	uint64_t mNumBytesFree = 0;
+
+	uint64_t mFlBitmap = 0;
+	uint32_t mSlBitmaps[FL_INDEX_COUNT] = {};
+	BlockHeader* mFreeLists[FL_INDEX_COUNT][SL_INDEX_COUNT] = {};
+};
+
+} // namespace sfz
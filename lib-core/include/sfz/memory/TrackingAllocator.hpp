@@ -0,0 +1,122 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#pragma once
+
+#include <sfz/memory/Allocator.hpp>
+
+namespace sfz {
+
+// TrackingTagStats
+// ------------------------------------------------------------------------------------------------
+
+constexpr uint32_t TRACKING_HISTOGRAM_NUM_BUCKETS = 32;
+
+// Statistics for all allocations made with the same tag, i.e. the same DbgInfo::staticMsg pointer.
+struct TrackingTagStats final {
+	const char* tag = nullptr;
+	uint64_t numAllocations = 0; // Total number of allocations made
+	uint64_t numLiveAllocations = 0; // Number of allocations not yet deallocated
+	uint64_t liveBytes = 0; // Number of bytes currently allocated (as requested by the user)
+	uint64_t peakLiveBytes = 0; // Max number of live bytes since creation or last resetPeaks()
+
+	// Histogram of allocation sizes. Bucket i contains the number of allocations with a size in
+	// the range [2^i, 2^(i+1)), except the first which also contains 0 sized allocations and the
+	// last which contains all larger allocations.
+	uint64_t sizeHistogram[TRACKING_HISTOGRAM_NUM_BUCKETS] = {};
+};
+
+// TrackingAllocator class
+// ------------------------------------------------------------------------------------------------
+
+struct TrackingTagEntry;
+
+// Tracking allocator
+//
+// Wraps another allocator and keeps statistics about the allocations made through it, aggregated
+// per tag. The tag of an allocation is the staticMsg of its DbgInfo, and since that must be a
+// compile-time constant the aggregation is keyed by the pointer itself, i.e. no string hashing or
+// comparisons are made. This is intended to be cheap enough to be left on in production builds,
+// e.g. to find which subsystems allocate the most.
+//
+// The tags are stored in a fixed size table which is lock-free, new tags are inserted using
+// compare-and-swap and all counters are relaxed atomics. So the tracking allocator is thread-safe
+// as long as the wrapped allocator is. If the table is full, allocations with new tags are
+// accounted to a shared overflow tag.
+//
+// Each allocation has a small header (16 bytes, or the alignment if larger) in front of it that
+// stores its size and tag, which is needed to update the statistics on deallocation.
+class TrackingAllocator final : public Allocator {
+public:
+	// Constructors & destructors
+	// --------------------------------------------------------------------------------------------
+
+	TrackingAllocator() noexcept = default;
+	TrackingAllocator(const TrackingAllocator&) = delete;
+	TrackingAllocator& operator= (const TrackingAllocator&) = delete;
+	TrackingAllocator(TrackingAllocator&&) = delete;
+	TrackingAllocator& operator= (TrackingAllocator&&) = delete;
+	~TrackingAllocator() noexcept { this->destroy(); }
+
+	// State methods
+	// --------------------------------------------------------------------------------------------
+
+	// Initializes the tracking allocator, wrapping the specified allocator. The tag table is
+	// allocated from the wrapped allocator and can hold at least maxNumTags different tags.
+	void init(Allocator* allocator, uint32_t maxNumTags = 256) noexcept;
+
+	// Destroys the tracking allocator. All memory allocated through it must be deallocated first.
+	void destroy() noexcept;
+
+	// Methods
+	// --------------------------------------------------------------------------------------------
+
+	Allocator* wrappedAllocator() const noexcept { return mAllocator; }
+
+	// Returns the number of different tags that have been used so far.
+	uint32_t numTags() const noexcept;
+
+	// Copies the statistics of up to maxNumStats tags into the specified array, returns the
+	// number of stats written. The counters of each tag are read individually while other threads
+	// may be allocating, so they are not guaranteed to be consistent with each other.
+	uint32_t snapshot(TrackingTagStats* statsOut, uint32_t maxNumStats) const noexcept;
+
+	// Returns the statistics of a specific tag, or false if it has never been used.
+	bool tagStats(const char* tag, TrackingTagStats& statsOut) const noexcept;
+
+	// Resets the peak live bytes of all tags to their current live bytes, e.g. once per frame.
+	void resetPeaks() noexcept;
+
+	// Implemented sfz::Allocator methods
+	// --------------------------------------------------------------------------------------------
+
+	void* allocate(DbgInfo dbg, uint64_t size, uint64_t alignment = 32) noexcept override final;
+	void deallocate(void* pointer) noexcept override final;
+	bool tryExtendInPlace(void* pointer, uint64_t currentSize, uint64_t newSize) noexcept override final;
+
+	// Private members
+	// --------------------------------------------------------------------------------------------
+private:
+	uint32_t findOrInsertTag(const char* tag) noexcept;
+
+	Allocator* mAllocator = nullptr;
+	TrackingTagEntry* mEntries = nullptr;
+	uint32_t mTableSize = 0; // Power of two, overflow entry is stored at index mTableSize
+};
+
+} // namespace sfz
@@ -0,0 +1,67 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#pragma once
+
+#include <cstdint>
+
+namespace sfz {
+
+using std::uint64_t;
+
+// Virtual memory functions
+// ------------------------------------------------------------------------------------------------
+
+// Thin cross-platform wrappers around the OS virtual memory functions (mmap/mprotect/madvise on
+// POSIX, VirtualAlloc/VirtualFree on Windows). Address space is first reserved, which does not
+// consume any physical memory, and then parts of it can be committed (made accessible) and
+// decommitted (returned to the OS) on demand.
+//
+// All pointers and sizes passed to these functions must be aligned to the page size. Reserving
+// virtual memory is not supported on Emscripten, where virtualMemoryReserve() returns nullptr.
+
+// Returns the page size of the system in bytes.
+uint64_t virtualMemoryPageSize() noexcept;
+
+// Reserves (but does not commit) the specified amount of virtual address space. The returned
+// memory may not be accessed before it is committed. Returns nullptr on failure.
+void* virtualMemoryReserve(uint64_t sizeBytes) noexcept;
+
+// Commits a range of previously reserved memory, making it readable and writable. The memory is
+// guaranteed to be zero the first time it is touched after being committed.
+bool virtualMemoryCommit(void* ptr, uint64_t sizeBytes) noexcept;
+
+// Decommits a range of committed memory, returning its physical pages to the OS. The range may
+// be committed again later.
+void virtualMemoryDecommit(void* ptr, uint64_t sizeBytes) noexcept;
+
+// Releases a reserved range of memory, pointer and size must be same as when reserved.
+void virtualMemoryRelease(void* ptr, uint64_t sizeBytes) noexcept;
+
+// Hints to the OS that the range should be backed by (transparent) huge pages if possible, which
+// reduces TLB misses for large linear allocations. This is only a hint and is a no-op on
+// platforms where it is not supported.
+void virtualMemoryAdviseHugePages(void* ptr, uint64_t sizeBytes) noexcept;
+
+// Rounds the specified size up to the nearest multiple of the specified power of two alignment.
+inline uint64_t roundUpAligned(uint64_t size, uint64_t alignment) noexcept
+{
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+} // namespace sfz
@@ -19,6 +19,7 @@
 #include "sfz/Context.hpp"
 
 #include "sfz/Assert.hpp"
+#include "sfz/memory/ArenaAllocator.hpp"
 #include "sfz/memory/StandardAllocator.hpp"
 #include "sfz/util/StandardLogger.hpp"
 
@@ -43,6 +44,39 @@ bool setContext(Context* context) noexcept
 	return true;
 }
 
+// Scratch arena
+// ------------------------------------------------------------------------------------------------
+
+struct ScratchArenaState final {
+	ArenaAllocator arena;
+	void* fallbackMemory = nullptr;
+	Allocator* fallbackAllocator = nullptr;
+
+	~ScratchArenaState() noexcept
+	{
+		arena.destroy();
+		if (fallbackMemory != nullptr) fallbackAllocator->deallocate(fallbackMemory);
+	}
+};
+
+ArenaAllocator* getScratchArena() noexcept
+{
+	thread_local ScratchArenaState state;
+	if (state.arena.capacity() == 0) {
+		const uint64_t reserveBytes = getContext()->scratchArenaReserveBytes;
+		if (!state.arena.initVirtual(reserveBytes, 256 * 1024)) {
+
+			// Virtual memory not supported, allocate scratch memory up front instead
+			state.fallbackAllocator = getDefaultAllocator();
+			state.fallbackMemory =
+				state.fallbackAllocator->allocate(sfz_dbg("ScratchArena"), reserveBytes, 32);
+			sfz_assert_hard(state.fallbackMemory != nullptr);
+			state.arena.init(state.fallbackMemory, reserveBytes);
+		}
+	}
+	return &state.arena;
+}
+
 // Standard context
 // ------------------------------------------------------------------------------------------------
 
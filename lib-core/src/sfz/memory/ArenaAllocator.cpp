@@ -21,6 +21,7 @@
 #include <sfz/Assert.hpp>
 #include <sfz/Logging.hpp>
 #include <sfz/memory/MemoryUtils.hpp>
+#include <sfz/memory/VirtualMemory.hpp>
 
 namespace sfz {
 
@@ -35,12 +36,44 @@ void ArenaAllocator::init(void* memory, uint64_t memorySizeBytes) noexcept
 	this->destroy();
 	mMemory = reinterpret_cast<uint8_t*>(memory);
 	mMemorySizeBytes = memorySizeBytes;
+	mCommittedBytes = memorySizeBytes;
+}
+
+bool ArenaAllocator::initVirtual(uint64_t reserveSizeBytes, uint64_t commitStepBytes,
+	uint64_t decommitWatermarkBytes, bool useHugePages) noexcept
+{
+	this->destroy();
+	const uint64_t pageSize = virtualMemoryPageSize();
+	reserveSizeBytes = roundUpAligned(reserveSizeBytes, pageSize);
+	commitStepBytes = roundUpAligned(commitStepBytes == 0 ? 1 : commitStepBytes, pageSize);
+
+	// Reserve address space
+	void* memory = virtualMemoryReserve(reserveSizeBytes);
+	if (memory == nullptr) {
+		SFZ_ERROR("ArenaAllocator", "Failed to reserve %llu bytes of virtual memory.",
+			reserveSizeBytes);
+		return false;
+	}
+	if (useHugePages) virtualMemoryAdviseHugePages(memory, reserveSizeBytes);
+
+	mMemory = reinterpret_cast<uint8_t*>(memory);
+	mMemorySizeBytes = reserveSizeBytes;
+	mIsVirtual = true;
+	mCommittedBytes = 0;
+	mCommitStepBytes = commitStepBytes;
+	mDecommitWatermarkBytes = decommitWatermarkBytes;
+	return true;
 }
 
 void ArenaAllocator::destroy() noexcept
 {
+	if (mIsVirtual) virtualMemoryRelease(mMemory, mMemorySizeBytes);
 	mMemory = nullptr;
 	mMemorySizeBytes = 0;
+	mIsVirtual = false;
+	mCommittedBytes = 0;
+	mCommitStepBytes = 0;
+	mDecommitWatermarkBytes = 0;
 	this->reset();
 }
 
@@ -48,6 +81,29 @@ void ArenaAllocator::reset() noexcept
 {
 	mCurrentOffsetBytes = 0;
 	mNumPaddingBytes = 0;
+	mRollbackFloorBytes = 0;
+
+	// Decommit memory above watermark
+	if (mIsVirtual && mCommittedBytes > mDecommitWatermarkBytes) {
+		uint64_t keepBytes = roundUpAligned(mDecommitWatermarkBytes, mCommitStepBytes);
+		if (keepBytes < mCommittedBytes) {
+			virtualMemoryDecommit(mMemory + keepBytes, mCommittedBytes - keepBytes);
+			mCommittedBytes = keepBytes;
+		}
+	}
+}
+
+// ArenaAllocator: Checkpoints
+// ------------------------------------------------------------------------------------------------
+
+void ArenaAllocator::rollback(Checkpoint checkpoint) noexcept
+{
+	sfz_assert(checkpoint.offsetBytes <= mCurrentOffsetBytes);
+	sfz_assert(checkpoint.numPaddingBytes <= mNumPaddingBytes);
+	sfz_assert(checkpoint.offsetBytes <= mRollbackFloorBytes);
+	mCurrentOffsetBytes = checkpoint.offsetBytes;
+	mNumPaddingBytes = checkpoint.numPaddingBytes;
+	mRollbackFloorBytes = checkpoint.prevRollbackFloorBytes;
 }
 
 // ArenaAllocator: Implemented sfz::Allocator methods
@@ -76,6 +132,9 @@ void* ArenaAllocator::allocate(DbgInfo dbg, uint64_t size, uint64_t alignment) n
 		return nullptr;
 	}
 
+	// Commit more memory if necessary (only possible in virtual memory mode)
+	if (!this->ensureCommitted(mCurrentOffsetBytes + size + padding)) return nullptr;
+
 	// Allocate memory from arena and return pointer
 	uint8_t* ptr = mMemory + mCurrentOffsetBytes + padding;
 	mCurrentOffsetBytes += padding + size;
@@ -83,4 +142,37 @@ void* ArenaAllocator::allocate(DbgInfo dbg, uint64_t size, uint64_t alignment) n
 	return ptr;
 }
 
+bool ArenaAllocator::tryExtendInPlace(void* pointer, uint64_t currentSize, uint64_t newSize) noexcept
+{
+	// Can only resize the most recent allocation, i.e. the one ending at the current offset
+	uint8_t* ptr = reinterpret_cast<uint8_t*>(pointer);
+	if (ptr == nullptr || (ptr + currentSize) != (mMemory + mCurrentOffsetBytes)) return false;
+	const uint64_t startOffset = uint64_t(ptr - mMemory);
+
+	// Allocations made before the most recent checkpoint would be partially freed by rolling back
+	if (startOffset < mRollbackFloorBytes) return false;
+	if ((startOffset + newSize) > mMemorySizeBytes) return false;
+	if (!this->ensureCommitted(startOffset + newSize)) return false;
+	mCurrentOffsetBytes = startOffset + newSize;
+	return true;
+}
+
+// ArenaAllocator: Private methods
+// ------------------------------------------------------------------------------------------------
+
+bool ArenaAllocator::ensureCommitted(uint64_t offsetBytes) noexcept
+{
+	if (offsetBytes <= mCommittedBytes) return true;
+	sfz_assert(mIsVirtual);
+	uint64_t newCommittedBytes = roundUpAligned(offsetBytes, mCommitStepBytes);
+	if (newCommittedBytes > mMemorySizeBytes) newCommittedBytes = mMemorySizeBytes;
+	if (!virtualMemoryCommit(mMemory + mCommittedBytes, newCommittedBytes - mCommittedBytes)) {
+		SFZ_WARNING("ArenaAllocator", "Failed to commit %llu bytes of virtual memory.",
+			newCommittedBytes - mCommittedBytes);
+		return false;
+	}
+	mCommittedBytes = newCommittedBytes;
+	return true;
+}
+
 } // namespace sfz
@@ -0,0 +1,267 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/memory/BudgetAllocator.hpp"
+
+#include "sfz/Assert.hpp"
+#include "sfz/Logging.hpp"
+#include "sfz/memory/MemoryUtils.hpp"
+
+namespace sfz {
+
+// Statics
+// ------------------------------------------------------------------------------------------------
+
+// Header stored directly before each allocation
+struct BudgetHeader final {
+	uint64_t size;
+	uint64_t offset; // Offset from start of allocated memory to user pointer
+};
+static_assert(sizeof(BudgetHeader) == 16, "BudgetHeader must be 16 bytes");
+
+static BudgetHeader* headerFromPointer(void* pointer) noexcept
+{
+	return reinterpret_cast<BudgetHeader*>(reinterpret_cast<uint8_t*>(pointer) - 16);
+}
+
+static void updatePeak(std::atomic<uint64_t>& peak, uint64_t value) noexcept
+{
+	uint64_t prevPeak = peak.load(std::memory_order_relaxed);
+	while (prevPeak < value && !peak.compare_exchange_weak(
+		prevPeak, value, std::memory_order_relaxed, std::memory_order_relaxed));
+}
+
+// BudgetAllocator: State methods
+// ------------------------------------------------------------------------------------------------
+
+void BudgetAllocator::init(const char* name, uint64_t budgetBytes, Allocator* allocator) noexcept
+{
+	sfz_assert(allocator != nullptr);
+	this->destroy();
+	mName = name;
+	mAllocator = allocator;
+	mBudgetBytes.store(budgetBytes, std::memory_order_relaxed);
+}
+
+void BudgetAllocator::initChild(
+	const char* name, uint64_t budgetBytes, BudgetAllocator* parent) noexcept
+{
+	sfz_assert(parent != nullptr);
+	sfz_assert(parent != this);
+	this->destroy();
+	mName = name;
+	mAllocator = parent->mAllocator;
+	mParent = parent;
+	mBudgetBytes.store(budgetBytes, std::memory_order_relaxed);
+
+	// Append last so that reports list children in creation order
+	std::lock_guard<std::mutex> lock(parent->mChildrenMutex);
+	BudgetAllocator** link = &parent->mFirstChild;
+	while (*link != nullptr) link = &(*link)->mNextSibling;
+	*link = this;
+}
+
+void BudgetAllocator::destroy() noexcept
+{
+	if (mAllocator == nullptr) return;
+	{
+		std::lock_guard<std::mutex> lock(mChildrenMutex);
+		sfz_assert(mFirstChild == nullptr);
+	}
+	sfz_assert(mNumLiveAllocations.load() == 0);
+
+	// Unlink from parent
+	if (mParent != nullptr) {
+		std::lock_guard<std::mutex> lock(mParent->mChildrenMutex);
+		BudgetAllocator** link = &mParent->mFirstChild;
+		while (*link != this) link = &(*link)->mNextSibling;
+		*link = mNextSibling;
+	}
+
+	mName = nullptr;
+	mAllocator = nullptr;
+	mParent = nullptr;
+	mNextSibling = nullptr;
+	mOverrunCallback = nullptr;
+	mOverrunUserData = nullptr;
+	mCurrentBytes.store(0, std::memory_order_relaxed);
+	mPeakBytes.store(0, std::memory_order_relaxed);
+	mBudgetBytes.store(0, std::memory_order_relaxed);
+	mNumOverruns.store(0, std::memory_order_relaxed);
+}
+
+// BudgetAllocator: Methods
+// ------------------------------------------------------------------------------------------------
+
+void BudgetAllocator::setBudget(uint64_t budgetBytes) noexcept
+{
+	mBudgetBytes.store(budgetBytes, std::memory_order_relaxed);
+}
+
+void BudgetAllocator::setOverrunCallback(BudgetOverrunCallback callback, void* userData) noexcept
+{
+	mOverrunCallback = callback;
+	mOverrunUserData = userData;
+}
+
+void BudgetAllocator::resetPeaks() noexcept
+{
+	mPeakBytes.store(mCurrentBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	std::lock_guard<std::mutex> lock(mChildrenMutex);
+	for (BudgetAllocator* child = mFirstChild; child != nullptr; child = child->mNextSibling) {
+		child->resetPeaks();
+	}
+}
+
+uint32_t BudgetAllocator::report(
+	BudgetReportEntry* entriesOut, uint32_t maxNumEntries) const noexcept
+{
+	return this->reportRecursive(entriesOut, maxNumEntries, 0, 0);
+}
+
+// BudgetAllocator: Implemented sfz::Allocator methods
+// ------------------------------------------------------------------------------------------------
+
+void* BudgetAllocator::allocate(DbgInfo dbg, uint64_t size, uint64_t alignment) noexcept
+{
+	sfz_assert(mAllocator != nullptr);
+	sfz_assert(isPowerOfTwo(alignment));
+	if (!this->chargeOrCallback(size)) return nullptr;
+
+	// Allocate memory with room for header in front
+	if (alignment < sizeof(BudgetHeader)) alignment = sizeof(BudgetHeader);
+	uint8_t* memory = reinterpret_cast<uint8_t*>(
+		mAllocator->allocate(dbg, size + alignment, alignment));
+	if (memory == nullptr) {
+		this->uncharge(size, nullptr);
+		return nullptr;
+	}
+	uint8_t* ptr = memory + alignment;
+	mNumLiveAllocations.fetch_add(1, std::memory_order_relaxed);
+
+	// Write header
+	BudgetHeader* header = headerFromPointer(ptr);
+	header->size = size;
+	header->offset = alignment;
+	return ptr;
+}
+
+void BudgetAllocator::deallocate(void* pointer) noexcept
+{
+	if (pointer == nullptr) return;
+	BudgetHeader* header = headerFromPointer(pointer);
+	const uint64_t size = header->size;
+	const uint64_t offset = header->offset;
+	mAllocator->deallocateSized(reinterpret_cast<uint8_t*>(pointer) - offset, size + offset, offset);
+	mNumLiveAllocations.fetch_sub(1, std::memory_order_relaxed);
+	this->uncharge(size, nullptr);
+}
+
+bool BudgetAllocator::tryExtendInPlace(
+	void* pointer, uint64_t currentSize, uint64_t newSize) noexcept
+{
+	if (pointer == nullptr) return false;
+	BudgetHeader* header = headerFromPointer(pointer);
+	sfz_assert(header->size == currentSize);
+	const uint64_t offset = header->offset;
+
+	// Growing is charged up front, but never triggers the overrun callback since the caller can
+	// always fall back to a regular allocation which does.
+	if (newSize > currentSize && this->tryCharge(newSize - currentSize) != nullptr) return false;
+	bool success = mAllocator->tryExtendInPlace(
+		reinterpret_cast<uint8_t*>(pointer) - offset, currentSize + offset, newSize + offset);
+	if (!success) {
+		if (newSize > currentSize) this->uncharge(newSize - currentSize, nullptr);
+		return false;
+	}
+	if (newSize < currentSize) this->uncharge(currentSize - newSize, nullptr);
+	header->size = newSize;
+	return true;
+}
+
+// BudgetAllocator: Private methods
+// ------------------------------------------------------------------------------------------------
+
+BudgetAllocator* BudgetAllocator::tryCharge(uint64_t bytes) noexcept
+{
+	for (BudgetAllocator* node = this; node != nullptr; node = node->mParent) {
+		uint64_t newBytes = node->mCurrentBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+		if (newBytes > node->mBudgetBytes.load(std::memory_order_relaxed)) {
+			node->mCurrentBytes.fetch_sub(bytes, std::memory_order_relaxed);
+			this->uncharge(bytes, node);
+			return node;
+		}
+	}
+
+	// Only update peaks once the whole chain has been charged successfully
+	for (BudgetAllocator* node = this; node != nullptr; node = node->mParent) {
+		updatePeak(node->mPeakBytes, node->mCurrentBytes.load(std::memory_order_relaxed));
+	}
+	return nullptr;
+}
+
+void BudgetAllocator::uncharge(uint64_t bytes, const BudgetAllocator* stop) noexcept
+{
+	for (BudgetAllocator* node = this; node != stop; node = node->mParent) {
+		node->mCurrentBytes.fetch_sub(bytes, std::memory_order_relaxed);
+	}
+}
+
+bool BudgetAllocator::chargeOrCallback(uint64_t bytes) noexcept
+{
+	for (uint32_t i = 0; i <= MAX_OVERRUN_RETRIES; i++) {
+		BudgetAllocator* overrun = this->tryCharge(bytes);
+		if (overrun == nullptr) return true;
+		overrun->mNumOverruns.fetch_add(1, std::memory_order_relaxed);
+		if (overrun->mOverrunCallback == nullptr ||
+			!overrun->mOverrunCallback(overrun, bytes, overrun->mOverrunUserData)) {
+			SFZ_WARNING("BudgetAllocator",
+				"Budget \"%s\" exceeded. Trying to allocate %llu bytes, %llu of %llu bytes used.",
+				overrun->mName, bytes, overrun->currentBytes(), overrun->budgetBytes());
+			return false;
+		}
+	}
+	SFZ_WARNING("BudgetAllocator",
+		"Budget exceeded. Trying to allocate %llu bytes, still over budget after %u retries.",
+		bytes, MAX_OVERRUN_RETRIES);
+	return false;
+}
+
+uint32_t BudgetAllocator::reportRecursive(BudgetReportEntry* entriesOut, uint32_t maxNumEntries,
+	uint32_t idx, uint32_t depth) const noexcept
+{
+	if (idx < maxNumEntries) {
+		BudgetReportEntry& entry = entriesOut[idx];
+		entry.name = mName;
+		entry.depth = depth;
+		entry.budgetBytes = this->budgetBytes();
+		entry.currentBytes = this->currentBytes();
+		entry.peakBytes = this->peakBytes();
+		entry.numLiveAllocations = mNumLiveAllocations.load(std::memory_order_relaxed);
+		entry.numOverruns = this->numOverruns();
+	}
+	idx += 1;
+
+	std::lock_guard<std::mutex> lock(mChildrenMutex);
+	for (const BudgetAllocator* child = mFirstChild; child != nullptr; child = child->mNextSibling) {
+		idx = child->reportRecursive(entriesOut, maxNumEntries, idx, depth + 1);
+	}
+	return idx;
+}
+
+} // namespace sfz
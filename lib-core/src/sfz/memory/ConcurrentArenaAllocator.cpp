@@ -0,0 +1,89 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/memory/ConcurrentArenaAllocator.hpp"
+
+#include <sfz/Assert.hpp>
+#include <sfz/Logging.hpp>
+#include <sfz/memory/MemoryUtils.hpp>
+
+namespace sfz {
+
+// ConcurrentArenaAllocator: State methods
+// ------------------------------------------------------------------------------------------------
+
+void ConcurrentArenaAllocator::init(void* memory, uint64_t memorySizeBytes) noexcept
+{
+	sfz_assert(memory != nullptr);
+	sfz_assert(isAligned(memory, 32));
+
+	this->destroy();
+	mMemory = reinterpret_cast<uint8_t*>(memory);
+	mMemorySizeBytes = memorySizeBytes;
+}
+
+void ConcurrentArenaAllocator::destroy() noexcept
+{
+	mMemory = nullptr;
+	mMemorySizeBytes = 0;
+	this->reset();
+}
+
+void ConcurrentArenaAllocator::reset() noexcept
+{
+	mCurrentOffsetBytes.store(0, std::memory_order_relaxed);
+	mNumPaddingBytes.store(0, std::memory_order_relaxed);
+}
+
+// ConcurrentArenaAllocator: Implemented sfz::Allocator methods
+// ------------------------------------------------------------------------------------------------
+
+void* ConcurrentArenaAllocator::allocate(DbgInfo dbg, uint64_t size, uint64_t alignment) noexcept
+{
+	(void)dbg;
+	sfz_assert(isPowerOfTwo(alignment));
+
+	// Attempt to bump the offset until successful. Relaxed ordering is enough since no data is
+	// published through the offset, each thread just needs to get its own unique range.
+	uint64_t offset = mCurrentOffsetBytes.load(std::memory_order_relaxed);
+	uint64_t padding = 0;
+	uint64_t newOffset = 0;
+	do {
+		// Calculate padding needed for the offset we are trying to claim
+		uint64_t alignmentOffset = uint64_t(mMemory + offset) & (alignment - 1);
+		padding = (alignmentOffset == 0) ? 0 : (alignment - alignmentOffset);
+		newOffset = offset + padding + size;
+
+		// Check if there is enough space left
+		if (newOffset > mMemorySizeBytes) {
+			SFZ_WARNING("ConcurrentArenaAllocator",
+				"Out of memory. Trying to allocate %llu bytes, currently %llu of %llu bytes allocated.",
+				size + padding, offset, mMemorySizeBytes);
+			return nullptr;
+		}
+	} while (!mCurrentOffsetBytes.compare_exchange_weak(
+		offset, newOffset, std::memory_order_relaxed, std::memory_order_relaxed));
+
+	// Allocation successful, update statistics and return pointer
+	mNumPaddingBytes.fetch_add(padding, std::memory_order_relaxed);
+	uint8_t* ptr = mMemory + offset + padding;
+	sfz_assert(isAligned(ptr, alignment));
+	return ptr;
+}
+
+} // namespace sfz
@@ -18,10 +18,10 @@
 
 #include "sfz/memory/DebugAllocator.hpp"
 
+#include <atomic>
 #include <cstring>
+#include <mutex>
 #include <new>
-#include <unordered_map>
-#include <vector>
 
 #ifdef _WIN32
 #include <malloc.h>
@@ -31,31 +31,91 @@
 
 #include "sfz/Assert.hpp"
 #include "sfz/Logging.hpp"
+#include "sfz/containers/HashMap.hpp"
+#include "sfz/memory/StandardAllocator.hpp"
 
 namespace sfz {
 
 // DebugAllocatorImpl class
 // ------------------------------------------------------------------------------------------------
 
+static constexpr uint32_t NUM_SHARDS = 16;
+
+struct DebugHistoryEntry final {
+	DebugAllocationInfo info;
+	uint64_t seq; // Global deallocation order
+};
+
+struct alignas(64) DebugAllocatorShard final {
+	std::mutex mutex;
+	HashMap<void*, DebugAllocationInfo> allocations;
+
+	// Ring buffer with the most recently deallocated allocations of this shard. A pointer always
+	// maps to the same shard, so double frees are detected without any global lock.
+	DebugHistoryEntry* history = nullptr;
+	uint64_t historyNumPushed = 0;
+
+	// Searches history for the most recent deallocation of the specified pointer, must hold lock
+	const DebugAllocationInfo* findInHistory(void* pointer, uint32_t capacity) const noexcept
+	{
+		uint64_t numInHistory = historyNumPushed < capacity ? historyNumPushed : capacity;
+		for (uint64_t i = 0; i < numInHistory; i++) {
+			const DebugHistoryEntry& entry = history[(historyNumPushed - 1 - i) % capacity];
+			if (entry.info.pointer == pointer) return &entry.info;
+		}
+		return nullptr;
+	}
+};
+
 struct DebugAllocatorImpl final {
 	char allocatorName[128];
 	uint32_t alignmentIntegrityFactor;
-	std::unordered_map<void*, DebugAllocationInfo> allocations;
-	std::unordered_map<void*, DebugAllocationInfo> history;
+	std::atomic<uint32_t> numAllocations{0};
+	std::atomic<uint32_t> numDeallocated{0};
+
+	// Each shard remembers up to historyCapacity deallocations, so that the historyCapacity most
+	// recent ones overall are always available regardless of how they are spread over the shards.
+	// Sequence numbers are claimed while holding the lock of the shard the entry is written to.
+	uint32_t historyCapacity = 0;
+	std::atomic<uint64_t> historySeq{0};
+
+	DebugAllocatorShard shards[NUM_SHARDS];
+
+	DebugAllocatorShard& shard(void* pointer) noexcept
+	{
+		// Fibonacci hash of pointer, lowest bits are typically 0 due to alignment
+		uint64_t hash = uint64_t(uintptr_t(pointer)) * 11400714819323198485ull;
+		return shards[hash >> 60];
+	}
 };
 
+static_assert(NUM_SHARDS == 16, "Shard selection uses top 4 bits of hash");
+
 // DebugAllocator: Constructors & destructors
 // ------------------------------------------------------------------------------------------------
 
-DebugAllocator::DebugAllocator(const char* name, uint32_t alignmentIntegrityFactor) noexcept
+DebugAllocator::DebugAllocator(
+	const char* name, uint32_t alignmentIntegrityFactor, uint32_t historySize) noexcept
 {
 	mImpl = new (std::nothrow) DebugAllocatorImpl();
 	std::strncpy(mImpl->allocatorName, name, sizeof(mImpl->allocatorName));
 	mImpl->alignmentIntegrityFactor = alignmentIntegrityFactor * 2;
+
+	Allocator* allocator = getStandardAllocator();
+	if (historySize == 0) historySize = 1;
+	mImpl->historyCapacity = historySize;
+	for (DebugAllocatorShard& shard : mImpl->shards) {
+		shard.allocations.create(64, allocator);
+		shard.history = (DebugHistoryEntry*)allocator->allocate(
+			sfz_dbg("DebugAllocator"), sizeof(DebugHistoryEntry) * historySize, 32);
+	}
 }
 
 DebugAllocator::~DebugAllocator() noexcept
 {
+	for (DebugAllocatorShard& shard : mImpl->shards) {
+		getStandardAllocator()->deallocate(shard.history);
+	}
 	delete mImpl;
 }
 
@@ -92,35 +152,71 @@ void* DebugAllocator::allocate(DbgInfo dbg, uint64_t size, uint64_t alignment) n
 	tmpInfo.pointer = visiblePtr;
 	tmpInfo.size = size;
 	tmpInfo.alignment = alignment;
-	mImpl->allocations[visiblePtr] = tmpInfo;
+	DebugAllocatorShard& shard = mImpl->shard(visiblePtr);
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		shard.allocations.put(visiblePtr, tmpInfo);
+	}
+	mImpl->numAllocations.fetch_add(1, std::memory_order_relaxed);
 
 	return visiblePtr;
 }
 
-void DebugAllocator::deallocate(void* pointer) noexcept
+void DebugAllocator::deallocateSized(void* pointer, uint64_t size, uint64_t alignment) noexcept
 {
 	if (pointer == nullptr) return;
 
-	// Check if pointer is deallocatable by this allocator
-	auto currItr = mImpl->allocations.find(pointer);
-	if (currItr == mImpl->allocations.end()) {
-
-		// Check if pointer has previously been allocated with this allocator
-		auto histItr = mImpl->history.find(pointer);
-		if (histItr == mImpl->history.end()) {
-			SFZ_ERROR_AND_EXIT("sfzCore", "Pointer %p not allocated by %s.",
-				pointer, mImpl->allocatorName);
-		} else {
+	// Check that size and alignment matches allocation, unknown pointers are handled in deallocate()
+	DebugAllocatorShard& shard = mImpl->shard(pointer);
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		const DebugAllocationInfo* info = shard.allocations.get(pointer);
+		if (info != nullptr && (info->size != size || info->alignment != alignment)) {
 			SFZ_ERROR_AND_EXIT("sfzCore",
-				"Allocation %s, pointer = %p has already been deallocated by %s.",
-				histItr->second.name, pointer, mImpl->allocatorName);
+				"Allocation %s, pointer = %p (size %llu, alignment %llu) deallocated with "
+				"size %llu and alignment %llu by %s.",
+				info->name, pointer, info->size, info->alignment, size, alignment,
+				mImpl->allocatorName);
 		}
 	}
+	this->deallocate(pointer);
+}
+
+void DebugAllocator::deallocate(void* pointer) noexcept
+{
+	if (pointer == nullptr) return;
+
+	// Check if pointer is deallocatable by this allocator, if so remove it from active allocations
+	// and add it to the history of its shard
+	DebugAllocationInfo info;
+	DebugAllocatorShard& shard = mImpl->shard(pointer);
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		DebugAllocationInfo* infoPtr = shard.allocations.get(pointer);
+		if (infoPtr == nullptr) {
+
+			// Check if pointer has recently been deallocated by this allocator
+			const DebugAllocationInfo* histInfo =
+				shard.findInHistory(pointer, mImpl->historyCapacity);
+			if (histInfo == nullptr) {
+				SFZ_ERROR_AND_EXIT("sfzCore", "Pointer %p not allocated by %s.",
+					pointer, mImpl->allocatorName);
+			} else {
+				SFZ_ERROR_AND_EXIT("sfzCore",
+					"Allocation %s, pointer = %p has already been deallocated by %s.",
+					histInfo->name, pointer, mImpl->allocatorName);
+			}
+		}
+		info = *infoPtr;
+		shard.allocations.remove(pointer);
 
-	// Retrieve allocation info, remove it from current list and add to history
-	DebugAllocationInfo info = currItr->second;
-	mImpl->allocations.erase(pointer);
-	mImpl->history[pointer] = info;
+		DebugHistoryEntry& entry = shard.history[shard.historyNumPushed % mImpl->historyCapacity];
+		entry.info = info;
+		entry.seq = mImpl->historySeq.fetch_add(1, std::memory_order_relaxed);
+		shard.historyNumPushed += 1;
+	}
+	mImpl->numAllocations.fetch_sub(1, std::memory_order_relaxed);
+	mImpl->numDeallocated.fetch_add(1, std::memory_order_relaxed);
 
 	// Calculate actual pointers
 	uint32_t halfIntegrityFactor = mImpl->alignmentIntegrityFactor / 2;
@@ -158,12 +254,12 @@ void DebugAllocator::deallocate(void* pointer) noexcept
 
 uint32_t DebugAllocator::numAllocations() const noexcept
 {
-	return uint32_t(mImpl->allocations.size());
+	return mImpl->numAllocations.load(std::memory_order_relaxed);
 }
 
 uint32_t DebugAllocator::numDeallocated() const noexcept
 {
-	return uint32_t(mImpl->history.size());
+	return mImpl->numDeallocated.load(std::memory_order_relaxed);
 }
 
 uint32_t DebugAllocator::numTotalAllocations() const noexcept
@@ -173,27 +269,61 @@ uint32_t DebugAllocator::numTotalAllocations() const noexcept
 
 DebugAllocationInfo* DebugAllocator::allocations(uint32_t* numAllocations) noexcept
 {
-	*numAllocations = this->numAllocations();
-	DebugAllocationInfo* ptr = (DebugAllocationInfo*)this->allocate(
-		sfz_dbg(""), sizeof(DebugAllocationInfo) * (*numAllocations), 32);
-	uint32_t i = 0;
-	for (auto& pair : mImpl->allocations) {
-		ptr[i] = pair.second;
-		i++;
+	while (true) {
+		// Allocate list (with some margin for concurrent allocations) before locking shards, as
+		// allocating the list itself requires locking a shard.
+		uint32_t capacity = this->numAllocations() + 16;
+		DebugAllocationInfo* ptr = (DebugAllocationInfo*)this->allocate(
+			sfz_dbg("DebugAllocator"), sizeof(DebugAllocationInfo) * capacity, 32);
+
+		// Lock all shards (always in same order) and copy allocations if they fit
+		for (DebugAllocatorShard& shard : mImpl->shards) shard.mutex.lock();
+		uint32_t count = 0;
+		for (DebugAllocatorShard& shard : mImpl->shards) count += shard.allocations.size();
+		count -= 1; // The list itself is not included
+		bool fits = count <= capacity;
+		if (fits) {
+			uint32_t i = 0;
+			for (DebugAllocatorShard& shard : mImpl->shards) {
+				for (auto pair : shard.allocations) {
+					if (pair.key == ptr) continue;
+					ptr[i] = pair.value;
+					i++;
+				}
+			}
+		}
+		for (DebugAllocatorShard& shard : mImpl->shards) shard.mutex.unlock();
+
+		if (fits) {
+			*numAllocations = count;
+			return ptr;
+		}
+		this->deallocate(ptr);
 	}
-	return ptr;
 }
 
 DebugAllocationInfo* DebugAllocator::deallocatedAllocations(uint32_t* numAllocations) noexcept
 {
-	*numAllocations = this->numDeallocated();
+	// Allocate list before locking shards, as allocating the list itself requires locking a shard
+	uint32_t capacity = mImpl->historyCapacity;
 	DebugAllocationInfo* ptr = (DebugAllocationInfo*)this->allocate(
-		sfz_dbg(""), sizeof(DebugAllocationInfo) * (*numAllocations), 32);
-	uint32_t i = 0;
-	for (auto& pair : mImpl->history) {
-		ptr[i] = pair.second;
-		i++;
+		sfz_dbg("DebugAllocator"), sizeof(DebugAllocationInfo) * capacity, 32);
+
+	// With all shards locked every claimed sequence number has been written, and the most recent
+	// entries are all still present as no shard holds more than capacity of them.
+	for (DebugAllocatorShard& shard : mImpl->shards) shard.mutex.lock();
+	uint64_t numPushed = mImpl->historySeq.load(std::memory_order_relaxed);
+	uint32_t count = uint32_t(numPushed < capacity ? numPushed : capacity);
+	uint64_t firstSeq = numPushed - count;
+	for (const DebugAllocatorShard& shard : mImpl->shards) {
+		uint64_t numInShard = shard.historyNumPushed < capacity ? shard.historyNumPushed : capacity;
+		for (uint64_t i = 0; i < numInShard; i++) {
+			const DebugHistoryEntry& entry = shard.history[i];
+			if (entry.seq >= firstSeq) ptr[entry.seq - firstSeq] = entry.info;
+		}
 	}
+	for (DebugAllocatorShard& shard : mImpl->shards) shard.mutex.unlock();
+	*numAllocations = count;
 	return ptr;
 }
 
@@ -0,0 +1,247 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/memory/DoubleStackAllocator.hpp"
+
+#include <sfz/Assert.hpp>
+#include <sfz/Logging.hpp>
+#include <sfz/memory/MemoryUtils.hpp>
+
+namespace sfz {
+
+// Statics
+// ------------------------------------------------------------------------------------------------
+
+static constexpr uint64_t NO_HEADER = ~uint64_t(0) >> 1;
+static constexpr uint64_t FREED_BIT = uint64_t(1) << 63;
+static constexpr uint64_t MIN_ALIGNMENT = 8;
+
+// Header placed directly before each allocation
+struct DoubleStackHeader final {
+	uint64_t prevEndOffset; // End offset before this allocation was made
+	uint64_t prevHeaderAndFlag; // Offset of previous header on same end, and freed flag
+};
+static_assert(sizeof(DoubleStackHeader) == 16, "DoubleStackHeader must be 16 bytes");
+
+static uint64_t alignUpAddress(uint8_t* base, uint64_t offset, uint64_t alignment) noexcept
+{
+	uint64_t address = uint64_t(base + offset);
+	return ((address + alignment - 1) & ~(alignment - 1)) - uint64_t(base);
+}
+
+static uint64_t alignDownAddress(uint8_t* base, uint64_t offset, uint64_t alignment) noexcept
+{
+	uint64_t address = uint64_t(base + offset);
+	return (address & ~(alignment - 1)) - uint64_t(base);
+}
+
+// Returns whether an allocation was made after the most recent marker (the floor) of its end
+static bool isAboveFloor(uint64_t headerOffset, uint64_t floor, bool isBottom) noexcept
+{
+	return isBottom ? headerOffset >= floor : headerOffset < floor;
+}
+
+// Pops allocations from an end as long as the most recent one is marked as freed and was made
+// after the most recent marker of the end
+static void popFreedAllocations(uint8_t* memory, uint64_t& endOffset, uint64_t& lastHeader,
+	uint64_t floor, bool isBottom) noexcept
+{
+	while (lastHeader != NO_HEADER && isAboveFloor(lastHeader, floor, isBottom)) {
+		DoubleStackHeader* header = reinterpret_cast<DoubleStackHeader*>(memory + lastHeader);
+		if ((header->prevHeaderAndFlag & FREED_BIT) == 0) break;
+		endOffset = header->prevEndOffset;
+		lastHeader = header->prevHeaderAndFlag & ~FREED_BIT;
+	}
+}
+
+// DoubleStackAllocator: State methods
+// ------------------------------------------------------------------------------------------------
+
+void DoubleStackAllocator::init(void* memory, uint64_t memorySizeBytes) noexcept
+{
+	sfz_assert(memory != nullptr);
+	sfz_assert(isAligned(memory, 16));
+
+	this->destroy();
+	mMemory = reinterpret_cast<uint8_t*>(memory);
+	mMemorySizeBytes = memorySizeBytes;
+	this->reset();
+}
+
+void DoubleStackAllocator::destroy() noexcept
+{
+	mMemory = nullptr;
+	mMemorySizeBytes = 0;
+	this->reset();
+}
+
+void DoubleStackAllocator::reset() noexcept
+{
+	mBottomOffset = 0;
+	mTopOffset = mMemorySizeBytes;
+	mBottomLastHeader = NO_HEADER;
+	mTopLastHeader = NO_HEADER;
+	mBottomFloor = 0;
+	mTopFloor = mMemorySizeBytes;
+}
+
+// DoubleStackAllocator: Markers
+// ------------------------------------------------------------------------------------------------
+
+void DoubleStackAllocator::rollbackBottom(Marker marker) noexcept
+{
+	sfz_assert(marker.endOffset <= mBottomOffset);
+	sfz_assert(marker.endOffset <= mBottomFloor);
+	mBottomOffset = marker.endOffset;
+	mBottomLastHeader = marker.lastHeaderOffset;
+	mBottomFloor = marker.prevFloor;
+
+	// Allocations made before the marker might have been deallocated while it was live
+	popFreedAllocations(mMemory, mBottomOffset, mBottomLastHeader, mBottomFloor, true);
+}
+
+void DoubleStackAllocator::rollbackTop(Marker marker) noexcept
+{
+	sfz_assert(marker.endOffset >= mTopOffset);
+	sfz_assert(marker.endOffset >= mTopFloor);
+	mTopOffset = marker.endOffset;
+	mTopLastHeader = marker.lastHeaderOffset;
+	mTopFloor = marker.prevFloor;
+	popFreedAllocations(mMemory, mTopOffset, mTopLastHeader, mTopFloor, false);
+}
+
+// DoubleStackAllocator: Methods
+// ------------------------------------------------------------------------------------------------
+
+void* DoubleStackAllocator::allocateBottom(DbgInfo dbg, uint64_t size, uint64_t alignment) noexcept
+{
+	(void)dbg;
+	sfz_assert(isPowerOfTwo(alignment));
+	if (alignment < MIN_ALIGNMENT) alignment = MIN_ALIGNMENT;
+
+	// Place header directly before the aligned allocation
+	uint64_t userOffset = alignUpAddress(mMemory, mBottomOffset + sizeof(DoubleStackHeader), alignment);
+	uint64_t headerOffset = userOffset - sizeof(DoubleStackHeader);
+	if (userOffset > mTopOffset || size > (mTopOffset - userOffset)) {
+		SFZ_WARNING("DoubleStackAllocator",
+			"Out of memory. Trying to allocate %llu bytes from bottom, %llu of %llu bytes free.",
+			size, numBytesFree(), mMemorySizeBytes);
+		return nullptr;
+	}
+
+	DoubleStackHeader* header = reinterpret_cast<DoubleStackHeader*>(mMemory + headerOffset);
+	header->prevEndOffset = mBottomOffset;
+	header->prevHeaderAndFlag = mBottomLastHeader;
+	mBottomOffset = userOffset + size;
+	mBottomLastHeader = headerOffset;
+	return mMemory + userOffset;
+}
+
+void* DoubleStackAllocator::allocateTop(DbgInfo dbg, uint64_t size, uint64_t alignment) noexcept
+{
+	(void)dbg;
+	sfz_assert(isPowerOfTwo(alignment));
+	if (alignment < MIN_ALIGNMENT) alignment = MIN_ALIGNMENT;
+
+	// Place allocation as high as possible, with the header directly before it
+	const uint64_t required = size + sizeof(DoubleStackHeader);
+	uint64_t headerOffset = 0;
+	uint64_t userOffset = 0;
+	bool fits = required <= (mTopOffset - mBottomOffset);
+	if (fits) {
+		userOffset = alignDownAddress(mMemory, mTopOffset - size, alignment);
+		fits = userOffset >= (mBottomOffset + sizeof(DoubleStackHeader));
+		headerOffset = userOffset - sizeof(DoubleStackHeader);
+	}
+	if (!fits) {
+		SFZ_WARNING("DoubleStackAllocator",
+			"Out of memory. Trying to allocate %llu bytes from top, %llu of %llu bytes free.",
+			size, numBytesFree(), mMemorySizeBytes);
+		return nullptr;
+	}
+
+	DoubleStackHeader* header = reinterpret_cast<DoubleStackHeader*>(mMemory + headerOffset);
+	header->prevEndOffset = mTopOffset;
+	header->prevHeaderAndFlag = mTopLastHeader;
+	mTopOffset = headerOffset;
+	mTopLastHeader = headerOffset;
+	return mMemory + userOffset;
+}
+
+// DoubleStackAllocator: Implemented sfz::Allocator methods
+// ------------------------------------------------------------------------------------------------
+
+void* DoubleStackAllocator::allocate(DbgInfo dbg, uint64_t size, uint64_t alignment) noexcept
+{
+	return this->allocateBottom(dbg, size, alignment);
+}
+
+void DoubleStackAllocator::deallocate(void* pointer) noexcept
+{
+	if (pointer == nullptr) return;
+	uint8_t* ptr = reinterpret_cast<uint8_t*>(pointer);
+	sfz_assert(mMemory < ptr && ptr <= (mMemory + mMemorySizeBytes));
+	const uint64_t headerOffset = uint64_t(ptr - mMemory) - sizeof(DoubleStackHeader);
+	DoubleStackHeader* header = reinterpret_cast<DoubleStackHeader*>(mMemory + headerOffset);
+
+	// Determine which end the allocation belongs to
+	const bool isBottom = headerOffset < mBottomOffset;
+	sfz_assert(isBottom || headerOffset >= mTopOffset);
+	uint64_t& endOffset = isBottom ? mBottomOffset : mTopOffset;
+	uint64_t& lastHeader = isBottom ? mBottomLastHeader : mTopLastHeader;
+	const uint64_t floor = isBottom ? mBottomFloor : mTopFloor;
+
+	// Mark as freed, then pop if most recent allocation. Allocations made before the most recent
+	// marker are not popped until it has been rolled back to.
+	header->prevHeaderAndFlag |= FREED_BIT;
+	if (headerOffset == lastHeader) {
+		popFreedAllocations(mMemory, endOffset, lastHeader, floor, isBottom);
+	}
+}
+
+bool DoubleStackAllocator::tryExtendInPlace(
+	void* pointer, uint64_t currentSize, uint64_t newSize) noexcept
+{
+	uint8_t* ptr = reinterpret_cast<uint8_t*>(pointer);
+	if (ptr == nullptr || mBottomLastHeader == NO_HEADER) return false;
+	if ((mMemory + mBottomLastHeader + sizeof(DoubleStackHeader)) != ptr) return false;
+	sfz_assert((ptr + currentSize) == (mMemory + mBottomOffset));
+	(void)currentSize;
+	const uint64_t userOffset = uint64_t(ptr - mMemory);
+
+	// Allocations made before the most recent marker would be partially freed by rolling back
+	if (userOffset < mBottomFloor) return false;
+	if (newSize > (mTopOffset - userOffset)) return false;
+	mBottomOffset = userOffset + newSize;
+	return true;
+}
+
+// DoubleStackTopAllocator: Implemented sfz::Allocator methods
+// ------------------------------------------------------------------------------------------------
+
+void* DoubleStackTopAllocator::allocate(DbgInfo dbg, uint64_t size, uint64_t alignment) noexcept
+{
+	return mOwner->allocateTop(dbg, size, alignment);
+}
+
+void DoubleStackTopAllocator::deallocate(void* pointer) noexcept
+{
+	mOwner->deallocate(pointer);
+}
+
+} // namespace sfz
@@ -0,0 +1,159 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/memory/FrameRingAllocator.hpp"
+
+#include <sfz/Assert.hpp>
+#include <sfz/Logging.hpp>
+#include <sfz/memory/MemoryUtils.hpp>
+
+namespace sfz {
+
+// FrameRingAllocator: State methods
+// ------------------------------------------------------------------------------------------------
+
+void FrameRingAllocator::init(void* memory, uint64_t memorySizeBytes) noexcept
+{
+	sfz_assert(memory != nullptr);
+	sfz_assert(isAligned(memory, 32));
+
+	this->destroy();
+	mMemory = reinterpret_cast<uint8_t*>(memory);
+	mMemorySizeBytes = memorySizeBytes;
+}
+
+void FrameRingAllocator::destroy() noexcept
+{
+	mMemory = nullptr;
+	mMemorySizeBytes = 0;
+	this->reset();
+}
+
+void FrameRingAllocator::reset() noexcept
+{
+	std::lock_guard<std::mutex> lock(mRetireMutex);
+	mHeadOffset.store(0, std::memory_order_relaxed);
+	mTailOffset.store(0, std::memory_order_relaxed);
+	mCurrentFrame.store(0, std::memory_order_relaxed);
+	mOldestFrame.store(0, std::memory_order_relaxed);
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		mFrameStartOffsets[i] = 0;
+		mFrameRetired[i].store(false, std::memory_order_relaxed);
+	}
+}
+
+// FrameRingAllocator: Frame methods
+// ------------------------------------------------------------------------------------------------
+
+uint64_t FrameRingAllocator::beginFrame() noexcept
+{
+	const uint64_t frame = mCurrentFrame.load(std::memory_order_relaxed) + 1;
+	const uint64_t oldest = mOldestFrame.load(std::memory_order_acquire);
+	sfz_assert_hard((frame - oldest) < MAX_FRAMES_IN_FLIGHT);
+
+	// The slot was last used by a frame that has been retired and reclaimed, so the consumer will
+	// not read it until the new frame index is published below.
+	const uint32_t slot = uint32_t(frame % MAX_FRAMES_IN_FLIGHT);
+	mFrameStartOffsets[slot] = mHeadOffset.load(std::memory_order_relaxed);
+	mFrameRetired[slot].store(false, std::memory_order_relaxed);
+	mCurrentFrame.store(frame, std::memory_order_release);
+	return frame;
+}
+
+void FrameRingAllocator::retireFrame(uint64_t frame) noexcept
+{
+	std::lock_guard<std::mutex> lock(mRetireMutex);
+	const uint64_t current = mCurrentFrame.load(std::memory_order_acquire);
+	uint64_t oldest = mOldestFrame.load(std::memory_order_relaxed);
+	sfz_assert(oldest <= frame && frame < current);
+	if (frame < oldest || current <= frame) return;
+	sfz_assert(!mFrameRetired[frame % MAX_FRAMES_IN_FLIGHT].load(std::memory_order_relaxed));
+	mFrameRetired[frame % MAX_FRAMES_IN_FLIGHT].store(true, std::memory_order_relaxed);
+
+	// Reclaim all consecutive retired frames starting with the oldest one
+	while (oldest < current &&
+		mFrameRetired[oldest % MAX_FRAMES_IN_FLIGHT].load(std::memory_order_relaxed)) {
+		oldest += 1;
+	}
+
+	// Release so that the consumer's reads of the reclaimed memory happen before producers reuse it
+	mTailOffset.store(mFrameStartOffsets[oldest % MAX_FRAMES_IN_FLIGHT], std::memory_order_release);
+	mOldestFrame.store(oldest, std::memory_order_release);
+}
+
+// FrameRingAllocator: Implemented sfz::Allocator methods
+// ------------------------------------------------------------------------------------------------
+
+void* FrameRingAllocator::allocate(DbgInfo dbg, uint64_t size, uint64_t alignment) noexcept
+{
+	(void)dbg;
+	sfz_assert(isPowerOfTwo(alignment));
+
+	uint64_t head = mHeadOffset.load(std::memory_order_relaxed);
+	uint64_t newHead = 0;
+	uint64_t physicalOffset = 0;
+	do {
+		// Align, and skip to the start of the ring if the allocation does not fit before its end
+		physicalOffset = head % mMemorySizeBytes;
+		uint64_t alignedOffset = uint64_t(mMemory + physicalOffset);
+		alignedOffset = ((alignedOffset + alignment - 1) & ~(alignment - 1)) - uint64_t(mMemory);
+		if ((alignedOffset + size) > mMemorySizeBytes) {
+			alignedOffset = uint64_t(mMemory);
+			alignedOffset = ((alignedOffset + alignment - 1) & ~(alignment - 1)) - uint64_t(mMemory);
+			newHead = head + (mMemorySizeBytes - physicalOffset) + alignedOffset + size;
+		}
+		else {
+			newHead = head + (alignedOffset - physicalOffset) + size;
+		}
+		physicalOffset = alignedOffset;
+
+		// Acquire so that the consumer is done with the reclaimed memory before it is handed out
+		const uint64_t tail = mTailOffset.load(std::memory_order_acquire);
+		if ((newHead - tail) > mMemorySizeBytes) {
+			SFZ_WARNING("FrameRingAllocator",
+				"Out of memory. Trying to allocate %llu bytes, %llu of %llu bytes in use by %llu frames.",
+				size, head - tail, mMemorySizeBytes, numFramesInFlight());
+			return nullptr;
+		}
+	} while (!mHeadOffset.compare_exchange_weak(
+		head, newHead, std::memory_order_relaxed, std::memory_order_relaxed));
+
+	uint8_t* ptr = mMemory + physicalOffset;
+	sfz_assert(isAligned(ptr, alignment));
+	return ptr;
+}
+
+bool FrameRingAllocator::tryExtendInPlace(
+	void* pointer, uint64_t currentSize, uint64_t newSize) noexcept
+{
+	if (pointer == nullptr || newSize < currentSize) return false;
+	const uint64_t endOffset = uint64_t(reinterpret_cast<uint8_t*>(pointer) - mMemory) + currentSize;
+	uint64_t head = mHeadOffset.load(std::memory_order_relaxed);
+	const uint64_t physicalHead = head % mMemorySizeBytes;
+
+	// Must be the most recent allocation (i.e. end exactly at the head) and not need to wrap
+	if (endOffset != physicalHead) return false;
+	const uint64_t extraBytes = newSize - currentSize;
+	if ((endOffset + extraBytes) > mMemorySizeBytes) return false;
+	const uint64_t tail = mTailOffset.load(std::memory_order_acquire);
+	if ((head + extraBytes - tail) > mMemorySizeBytes) return false;
+	return mHeadOffset.compare_exchange_strong(
+		head, head + extraBytes, std::memory_order_relaxed, std::memory_order_relaxed);
+}
+
+} // namespace sfz
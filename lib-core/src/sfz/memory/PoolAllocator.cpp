@@ -0,0 +1,154 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/memory/PoolAllocator.hpp"
+
+#include <sfz/Assert.hpp>
+#include <sfz/Logging.hpp>
+#include <sfz/memory/MemoryUtils.hpp>
+
+namespace sfz {
+
+// Statics
+// ------------------------------------------------------------------------------------------------
+
+static uint64_t calcSlotStride(uint64_t slotSize, uint64_t slotAlignment) noexcept
+{
+	// Each free slot must be able to hold the "next" pointer of the free list
+	if (slotSize < sizeof(void*)) slotSize = sizeof(void*);
+
+	// Round up to a multiple of the alignment, so that every slot is properly aligned
+	return (slotSize + slotAlignment - 1) & ~(slotAlignment - 1);
+}
+
+// PoolAllocator: State methods
+// ------------------------------------------------------------------------------------------------
+
+uint64_t PoolAllocator::memoryRequirementBytes(
+	uint64_t slotSize, uint32_t numSlots, uint64_t slotAlignment) noexcept
+{
+	sfz_assert(isPowerOfTwo(slotAlignment));
+	return calcSlotStride(slotSize, slotAlignment) * numSlots;
+}
+
+void PoolAllocator::init(uint64_t slotSize, uint32_t numSlots, uint64_t slotAlignment,
+	void* memory, uint64_t memorySizeBytes) noexcept
+{
+	sfz_assert(memory != nullptr);
+	sfz_assert(isPowerOfTwo(slotAlignment));
+	sfz_assert(isAligned(memory, slotAlignment));
+	sfz_assert(memoryRequirementBytes(slotSize, numSlots, slotAlignment) <= memorySizeBytes);
+	(void)memorySizeBytes;
+
+	this->destroy();
+	mMemory = reinterpret_cast<uint8_t*>(memory);
+	mSlotSize = calcSlotStride(slotSize, slotAlignment);
+	mSlotAlignment = slotAlignment;
+	mNumSlots = numSlots;
+}
+
+void PoolAllocator::init(uint64_t slotSize, uint32_t numSlots, uint64_t slotAlignment,
+	Allocator* allocator, DbgInfo allocDbg) noexcept
+{
+	sfz_assert(allocator != nullptr);
+	uint64_t memorySizeBytes = memoryRequirementBytes(slotSize, numSlots, slotAlignment);
+	void* memory = allocator->allocate(allocDbg, memorySizeBytes, slotAlignment);
+	sfz_assert_hard(memory != nullptr);
+
+	this->init(slotSize, numSlots, slotAlignment, memory, memorySizeBytes);
+	mOwningAllocator = allocator;
+}
+
+void PoolAllocator::destroy() noexcept
+{
+	if (mOwningAllocator != nullptr) mOwningAllocator->deallocate(mMemory);
+	mMemory = nullptr;
+	mOwningAllocator = nullptr;
+	mSlotSize = 0;
+	mSlotAlignment = 0;
+	mNumSlots = 0;
+	this->reset();
+}
+
+void PoolAllocator::reset() noexcept
+{
+	mNumSlotsInUse = 0;
+	mNumSlotsTouched = 0;
+	mFreeListHead = nullptr;
+}
+
+// PoolAllocator: Methods
+// ------------------------------------------------------------------------------------------------
+
+bool PoolAllocator::owns(const void* pointer) const noexcept
+{
+	const uint8_t* ptr = reinterpret_cast<const uint8_t*>(pointer);
+	return mMemory <= ptr && ptr < (mMemory + mSlotSize * mNumSlots);
+}
+
+// PoolAllocator: Implemented sfz::Allocator methods
+// ------------------------------------------------------------------------------------------------
+
+void* PoolAllocator::allocate(DbgInfo dbg, uint64_t size, uint64_t alignment) noexcept
+{
+	(void)dbg;
+	sfz_assert(isPowerOfTwo(alignment));
+
+	// Check if the requested allocation fits in a slot
+	if (size > mSlotSize || alignment > mSlotAlignment) {
+		SFZ_WARNING("PoolAllocator",
+			"Invalid allocation. Trying to allocate %llu bytes with %llu alignment, slots are %llu bytes with %llu alignment.",
+			size, alignment, mSlotSize, mSlotAlignment);
+		return nullptr;
+	}
+
+	// Pop a slot from the free list if possible
+	if (mFreeListHead != nullptr) {
+		void* ptr = mFreeListHead;
+		mFreeListHead = *reinterpret_cast<void**>(ptr);
+		mNumSlotsInUse += 1;
+		return ptr;
+	}
+
+	// Otherwise take the next untouched slot, if there are any left
+	if (mNumSlotsTouched >= mNumSlots) {
+		SFZ_WARNING("PoolAllocator",
+			"Out of memory. Trying to allocate %llu bytes, all %u slots are in use.",
+			size, mNumSlots);
+		return nullptr;
+	}
+	void* ptr = mMemory + mSlotSize * mNumSlotsTouched;
+	mNumSlotsTouched += 1;
+	mNumSlotsInUse += 1;
+	return ptr;
+}
+
+void PoolAllocator::deallocate(void* pointer) noexcept
+{
+	if (pointer == nullptr) return;
+	sfz_assert(owns(pointer));
+	sfz_assert(((reinterpret_cast<uint8_t*>(pointer) - mMemory) % mSlotSize) == 0);
+	sfz_assert(mNumSlotsInUse > 0);
+
+	// Push slot to the front of the free list
+	*reinterpret_cast<void**>(pointer) = mFreeListHead;
+	mFreeListHead = pointer;
+	mNumSlotsInUse -= 1;
+}
+
+} // namespace sfz
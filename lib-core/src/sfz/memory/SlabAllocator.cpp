@@ -0,0 +1,287 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/memory/SlabAllocator.hpp"
+
+#include <sfz/Assert.hpp>
+#include <sfz/Logging.hpp>
+#include <sfz/memory/MemoryUtils.hpp>
+#include <sfz/memory/VirtualMemory.hpp>
+
+namespace sfz {
+
+// Statics
+// ------------------------------------------------------------------------------------------------
+
+static constexpr uint32_t NO_SLAB = ~uint32_t(0);
+static constexpr uint64_t COMMIT_STEP_BYTES = 64 * 1024;
+static constexpr uint32_t SLABS_PER_COMMIT_STEP = uint32_t(COMMIT_STEP_BYTES / SlabAllocator::SLAB_SIZE);
+
+static constexpr uint32_t SIZE_CLASSES[SlabAllocator::NUM_SIZE_CLASSES] = {
+	8, 16, 24, 32, 48, 64, 80, 96, 128, 160, 192, 256, 320, 384, 512
+};
+
+// SlabAllocator: State methods
+// ------------------------------------------------------------------------------------------------
+
+void SlabAllocator::init(Allocator* parentAllocator, uint64_t maxSlabMemoryBytes) noexcept
+{
+	static_assert(SIZE_CLASSES[NUM_SIZE_CLASSES - 1] == MAX_SMALL_SIZE, "Invalid size classes");
+	sfz_assert(parentAllocator != nullptr);
+	this->destroy();
+	mParent = parentAllocator;
+
+	maxSlabMemoryBytes = roundUpAligned(maxSlabMemoryBytes, COMMIT_STEP_BYTES);
+	sfz_assert_hard((maxSlabMemoryBytes / SLAB_SIZE) < NO_SLAB);
+	mNumSlabs = uint32_t(maxSlabMemoryBytes / SLAB_SIZE);
+
+	// Reserve slab memory, slabs must be aligned to their size
+	mSlabMemory = reinterpret_cast<uint8_t*>(virtualMemoryReserve(maxSlabMemoryBytes));
+	mIsVirtual = mSlabMemory != nullptr;
+	if (!mIsVirtual) {
+		mSlabMemory = reinterpret_cast<uint8_t*>(
+			mParent->allocate(sfz_dbg("SlabAllocator"), maxSlabMemoryBytes, SLAB_SIZE));
+		sfz_assert_hard(mSlabMemory != nullptr);
+		mNumSlabsCommitted = mNumSlabs;
+	}
+	sfz_assert(isAligned(mSlabMemory, SLAB_SIZE));
+
+	// Allocate side table, entries are initialized when their slab is first used
+	mSlabInfos = reinterpret_cast<SlabInfo*>(mParent->allocate(
+		sfz_dbg("SlabAllocator"), sizeof(SlabInfo) * mNumSlabs, alignof(SlabInfo)));
+	sfz_assert_hard(mSlabInfos != nullptr);
+
+	for (uint32_t& head : mPartialSlabs) head = NO_SLAB;
+	mFreeSlabs = NO_SLAB;
+}
+
+void SlabAllocator::destroy() noexcept
+{
+	if (mParent != nullptr) {
+		sfz_assert(mNumSmallAllocations == 0);
+		if (mIsVirtual) virtualMemoryRelease(mSlabMemory, uint64_t(mNumSlabs) * SLAB_SIZE);
+		else mParent->deallocate(mSlabMemory);
+		mParent->deallocate(mSlabInfos);
+	}
+	mParent = nullptr;
+	mSlabMemory = nullptr;
+	mIsVirtual = false;
+	mNumSlabs = 0;
+	mNumSlabsTouched = 0;
+	mNumSlabsCommitted = 0;
+	mNumSlabsInUse = 0;
+	mSlabInfos = nullptr;
+	for (uint32_t& head : mPartialSlabs) head = NO_SLAB;
+	mFreeSlabs = NO_SLAB;
+	mNumSmallAllocations = 0;
+	mNumSmallBytesAllocated = 0;
+}
+
+// SlabAllocator: Methods
+// ------------------------------------------------------------------------------------------------
+
+uint32_t SlabAllocator::sizeClassBlockSize(uint64_t size, uint64_t alignment) const noexcept
+{
+	uint32_t classIdx = this->findSizeClass(size, alignment);
+	return classIdx < NUM_SIZE_CLASSES ? SIZE_CLASSES[classIdx] : 0;
+}
+
+bool SlabAllocator::ownsSlabMemory(const void* pointer) const noexcept
+{
+	const uint8_t* ptr = reinterpret_cast<const uint8_t*>(pointer);
+	return mSlabMemory <= ptr && ptr < (mSlabMemory + uint64_t(mNumSlabs) * SLAB_SIZE);
+}
+
+// SlabAllocator: Implemented sfz::Allocator methods
+// ------------------------------------------------------------------------------------------------
+
+void* SlabAllocator::allocate(DbgInfo dbg, uint64_t size, uint64_t alignment) noexcept
+{
+	sfz_assert(mParent != nullptr);
+	sfz_assert(isPowerOfTwo(alignment));
+
+	const uint32_t classIdx = this->findSizeClass(size, alignment);
+	if (classIdx >= NUM_SIZE_CLASSES) return mParent->allocate(dbg, size, alignment);
+	const uint32_t blockSize = SIZE_CLASSES[classIdx];
+
+	// Get slab with free blocks
+	uint32_t slabIdx = mPartialSlabs[classIdx];
+	if (slabIdx == NO_SLAB) {
+		slabIdx = this->acquireSlab(classIdx);
+		if (slabIdx == NO_SLAB) return nullptr;
+	}
+	SlabInfo& slab = mSlabInfos[slabIdx];
+	uint8_t* slabMemory = mSlabMemory + uint64_t(slabIdx) * SLAB_SIZE;
+
+	// Pop block from free list, or take a never used block if free list is empty
+	void* block = nullptr;
+	if (slab.freeList != nullptr) {
+		block = slab.freeList;
+		slab.freeList = *reinterpret_cast<void**>(block);
+	}
+	else {
+		block = slabMemory + uint64_t(slab.numTouched) * blockSize;
+		slab.numTouched += 1;
+	}
+	slab.numUsed += 1;
+
+	// Remove slab from partial list if full
+	if (slab.numUsed == (SLAB_SIZE / blockSize)) this->unlinkSlab(slabIdx);
+
+	mNumSmallAllocations += 1;
+	mNumSmallBytesAllocated += blockSize;
+	sfz_assert(isAligned(block, alignment));
+	return block;
+}
+
+void SlabAllocator::deallocate(void* pointer) noexcept
+{
+	if (pointer == nullptr) return;
+	if (!this->ownsSlabMemory(pointer)) {
+		mParent->deallocate(pointer);
+		return;
+	}
+	this->deallocateSmall(pointer);
+}
+
+void SlabAllocator::deallocateSized(void* pointer, uint64_t size, uint64_t alignment) noexcept
+{
+	if (pointer == nullptr) return;
+
+	// Same size class as allocate() chose, so large allocations can be forwarded without checking
+	// ownership, and the parent gets the size as well.
+	if (this->findSizeClass(size, alignment) >= NUM_SIZE_CLASSES) {
+		mParent->deallocateSized(pointer, size, alignment);
+		return;
+	}
+	sfz_assert(this->ownsSlabMemory(pointer));
+	this->deallocateSmall(pointer);
+}
+
+bool SlabAllocator::tryExtendInPlace(void* pointer, uint64_t currentSize, uint64_t newSize) noexcept
+{
+	// Never shrinks, since the smaller size could belong to another size class, which would break
+	// deallocateSized().
+	if (pointer == nullptr || !this->ownsSlabMemory(pointer)) return false;
+	if (newSize < currentSize) return false;
+	const uint32_t slabIdx = uint32_t(uint64_t(reinterpret_cast<uint8_t*>(pointer) - mSlabMemory) / SLAB_SIZE);
+	return newSize <= SIZE_CLASSES[mSlabInfos[slabIdx].classIdx];
+}
+
+// SlabAllocator: Private methods
+// ------------------------------------------------------------------------------------------------
+
+void SlabAllocator::deallocateSmall(void* pointer) noexcept
+{
+	const uint32_t slabIdx = uint32_t(uint64_t(reinterpret_cast<uint8_t*>(pointer) - mSlabMemory) / SLAB_SIZE);
+	SlabInfo& slab = mSlabInfos[slabIdx];
+	const uint32_t classIdx = slab.classIdx;
+	const uint32_t blockSize = SIZE_CLASSES[classIdx];
+	sfz_assert(slab.numUsed > 0);
+	sfz_assert(((reinterpret_cast<uint8_t*>(pointer) - mSlabMemory) % SLAB_SIZE) % blockSize == 0);
+
+	// Push block to free list of slab
+	const bool wasFull = slab.numUsed == (SLAB_SIZE / blockSize);
+	*reinterpret_cast<void**>(pointer) = slab.freeList;
+	slab.freeList = pointer;
+	slab.numUsed -= 1;
+	mNumSmallAllocations -= 1;
+	mNumSmallBytesAllocated -= blockSize;
+
+	if (slab.numUsed == 0) {
+		// Slab is empty, return it to shared pool of free slabs
+		if (!wasFull) this->unlinkSlab(slabIdx);
+		slab.nextSlab = mFreeSlabs;
+		mFreeSlabs = slabIdx;
+		mNumSlabsInUse -= 1;
+	}
+	else if (wasFull) {
+		// Slab has free blocks again, add it to partial list of its size class
+		slab.prevSlab = NO_SLAB;
+		slab.nextSlab = mPartialSlabs[classIdx];
+		if (slab.nextSlab != NO_SLAB) mSlabInfos[slab.nextSlab].prevSlab = slabIdx;
+		mPartialSlabs[classIdx] = slabIdx;
+	}
+}
+
+uint32_t SlabAllocator::findSizeClass(uint64_t size, uint64_t alignment) const noexcept
+{
+	if (size > MAX_SMALL_SIZE || alignment > MAX_SMALL_SIZE) return NUM_SIZE_CLASSES;
+
+	// Smallest class that fits size and whose size is a multiple of the alignment
+	uint32_t classIdx = 0;
+	while (classIdx < NUM_SIZE_CLASSES &&
+		(SIZE_CLASSES[classIdx] < size || (SIZE_CLASSES[classIdx] & (alignment - 1)) != 0)) {
+		classIdx++;
+	}
+	return classIdx;
+}
+
+uint32_t SlabAllocator::acquireSlab(uint32_t classIdx) noexcept
+{
+	// Reuse empty slab if available, otherwise take a new one
+	uint32_t slabIdx = mFreeSlabs;
+	if (slabIdx != NO_SLAB) {
+		mFreeSlabs = mSlabInfos[slabIdx].nextSlab;
+	}
+	else {
+		if (mNumSlabsTouched >= mNumSlabs) {
+			SFZ_WARNING("SlabAllocator", "Out of slab memory, all %u slabs are in use.", mNumSlabs);
+			return NO_SLAB;
+		}
+
+		// Commit more memory if necessary
+		if (mNumSlabsTouched >= mNumSlabsCommitted) {
+			sfz_assert(mIsVirtual);
+			if (!virtualMemoryCommit(
+				mSlabMemory + uint64_t(mNumSlabsCommitted) * SLAB_SIZE, COMMIT_STEP_BYTES)) {
+				SFZ_WARNING("SlabAllocator", "Failed to commit %llu bytes of virtual memory.",
+					COMMIT_STEP_BYTES);
+				return NO_SLAB;
+			}
+			mNumSlabsCommitted += SLABS_PER_COMMIT_STEP;
+		}
+		slabIdx = mNumSlabsTouched;
+		mNumSlabsTouched += 1;
+	}
+
+	// Initialize slab for size class and add it to partial list
+	SlabInfo& slab = mSlabInfos[slabIdx];
+	slab.freeList = nullptr;
+	slab.numUsed = 0;
+	slab.numTouched = 0;
+	slab.classIdx = uint8_t(classIdx);
+	slab.prevSlab = NO_SLAB;
+	slab.nextSlab = mPartialSlabs[classIdx];
+	if (slab.nextSlab != NO_SLAB) mSlabInfos[slab.nextSlab].prevSlab = slabIdx;
+	mPartialSlabs[classIdx] = slabIdx;
+	mNumSlabsInUse += 1;
+	return slabIdx;
+}
+
+void SlabAllocator::unlinkSlab(uint32_t slabIdx) noexcept
+{
+	SlabInfo& slab = mSlabInfos[slabIdx];
+	if (slab.prevSlab != NO_SLAB) mSlabInfos[slab.prevSlab].nextSlab = slab.nextSlab;
+	else mPartialSlabs[slab.classIdx] = slab.nextSlab;
+	if (slab.nextSlab != NO_SLAB) mSlabInfos[slab.nextSlab].prevSlab = slab.prevSlab;
+	slab.prevSlab = NO_SLAB;
+	slab.nextSlab = NO_SLAB;
+}
+
+} // namespace sfz
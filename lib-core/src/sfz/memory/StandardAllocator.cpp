@@ -19,13 +19,18 @@
 #include "sfz/memory/StandardAllocator.hpp"
 
 #include <cinttypes>
+#include <cstddef>
 
 #include "sfz/Assert.hpp"
 #include "sfz/memory/MemoryUtils.hpp"
 
 #ifdef _WIN32
 #include <malloc.h>
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#include <stdlib.h>
 #else
+#include <malloc.h>
 #include <stdlib.h>
 #endif
 
@@ -44,6 +49,8 @@ public:
 #ifdef _WIN32
 		return _aligned_malloc(size, alignment);
 #else
+		// posix_memalign() requires alignment to be at least the size of a pointer
+		if (alignment < sizeof(void*)) alignment = sizeof(void*);
 		void* ptr = nullptr;
 		posix_memalign(&ptr, alignment, size);
 		return ptr;
@@ -57,6 +64,40 @@ public:
 		_aligned_free(pointer);
 #else
 		free(pointer);
+#endif
+	}
+
+	bool tryExtendInPlace(void* pointer, uint64_t currentSize, uint64_t newSize) noexcept override final
+	{
+		(void)currentSize;
+		if (pointer == nullptr) return false;
+
+		// malloc() typically rounds up sizes, succeed if the new size fits in the actual block
+#if defined(__GLIBC__)
+		return newSize <= malloc_usable_size(pointer);
+#elif defined(__APPLE__)
+		return newSize <= malloc_size(pointer);
+#else
+		(void)newSize;
+		return false;
+#endif
+	}
+
+	void* reallocate(DbgInfo dbg, void* pointer, uint64_t currentSize, uint64_t newSize,
+		uint64_t alignment) noexcept override final
+	{
+		sfz_assert(isPowerOfTwo(alignment));
+#ifdef _WIN32
+		(void)dbg; (void)currentSize;
+		return _aligned_realloc(pointer, newSize, alignment);
+#else
+		// realloc() only guarantees the fundamental alignment, so larger alignments must use the
+		// generic allocate, copy and deallocate path.
+		if (alignment <= alignof(std::max_align_t)) {
+			if (this->tryExtendInPlace(pointer, currentSize, newSize)) return pointer;
+			return realloc(pointer, newSize);
+		}
+		return Allocator::reallocate(dbg, pointer, currentSize, newSize, alignment);
 #endif
 	}
 };
@@ -0,0 +1,421 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/memory/ThreadCachingAllocator.hpp"
+
+#include <atomic>
+#include <mutex>
+
+#include "sfz/Assert.hpp"
+#include "sfz/Logging.hpp"
+#include "sfz/memory/MemoryUtils.hpp"
+#include "sfz/memory/StandardAllocator.hpp"
+#include "sfz/memory/VirtualMemory.hpp"
+
+namespace sfz {
+
+// Constants
+// ------------------------------------------------------------------------------------------------
+
+// Size of each slab, all blocks in a slab belong to the same size class. Slabs are aligned to
+// their size, so the slab (and thus size class) of a block can be found from its address.
+static constexpr uint64_t SLAB_SIZE = 64 * 1024;
+
+// Amount of virtual address space reserved for slabs
+static constexpr uint64_t REGION_SIZE = sizeof(void*) == 8 ?
+	(uint64_t(32) * 1024 * 1024 * 1024) : (uint64_t(512) * 1024 * 1024);
+static constexpr uint64_t NUM_SLABS = REGION_SIZE / SLAB_SIZE;
+
+// Number of slabs at the beginning of the region used for the slab -> size class side table
+static constexpr uint64_t NUM_SIDE_TABLE_SLABS = (NUM_SLABS + SLAB_SIZE - 1) / SLAB_SIZE;
+
+static constexpr uint32_t MAX_SMALL_SIZE = 32 * 1024;
+static constexpr uint32_t NUM_SIZE_CLASSES = 40;
+
+// Targeted number of bytes moved in each batch between thread caches and the central pool
+static constexpr uint32_t BATCH_TARGET_BYTES = 32 * 1024;
+static constexpr uint32_t MIN_BATCH_SIZE = 2;
+static constexpr uint32_t MAX_BATCH_SIZE = 64;
+
+// Free list helpers
+// ------------------------------------------------------------------------------------------------
+
+// Free blocks are linked together through their first pointer. Batches in the central pool are
+// in addition linked together through the second pointer of their first block, which is why the
+// smallest size class must be able to hold two pointers.
+
+static void*& nextBlock(void* block) noexcept { return reinterpret_cast<void**>(block)[0]; }
+static void*& nextBatch(void* block) noexcept { return reinterpret_cast<void**>(block)[1]; }
+
+// Thread cache
+// ------------------------------------------------------------------------------------------------
+
+struct ThreadCacheList final {
+	void* head;
+	uint32_t count;
+};
+
+// Trivially destructible so that it remains accessible even after the flusher below has been
+// destroyed, e.g. if another thread local object deallocates memory in its destructor.
+struct ThreadCache final {
+	ThreadCacheList lists[NUM_SIZE_CLASSES];
+	bool initialized;
+	bool destroyed;
+};
+
+static thread_local ThreadCache tlsCache = {};
+
+struct ThreadCacheFlusher final {
+	bool registered = false;
+	~ThreadCacheFlusher() noexcept;
+};
+
+static thread_local ThreadCacheFlusher tlsFlusher;
+
+// ThreadCachingAllocator class
+// ------------------------------------------------------------------------------------------------
+
+class ThreadCachingAllocator final : public Allocator {
+public:
+	ThreadCachingAllocator() noexcept
+	{
+		static_assert(MAX_SMALL_SIZE <= SLAB_SIZE, "Largest size class must fit in a slab");
+
+		// Size classes, 16 byte steps up to 128 bytes, then 4 steps per power of two
+		uint32_t idx = 0;
+		for (uint32_t size = 16; size <= 128; size += 16) mSizes[idx++] = size;
+		for (uint32_t base = 128; base < MAX_SMALL_SIZE; base *= 2) {
+			for (uint32_t i = 1; i <= 4; i++) mSizes[idx++] = base + i * (base / 4);
+		}
+		sfz_assert_hard(idx == NUM_SIZE_CLASSES);
+		sfz_assert_hard(mSizes[NUM_SIZE_CLASSES - 1] == MAX_SMALL_SIZE);
+
+		// Batch sizes and size -> smallest size class lookup table
+		uint32_t classIdx = 0;
+		for (uint32_t i = 0; i < NUM_SIZE_CLASSES; i++) {
+			uint32_t batchSize = BATCH_TARGET_BYTES / mSizes[i];
+			mBatchSizes[i] = batchSize < MIN_BATCH_SIZE ? MIN_BATCH_SIZE :
+				(batchSize > MAX_BATCH_SIZE ? MAX_BATCH_SIZE : batchSize);
+		}
+		for (uint32_t i = 0; i <= MAX_SMALL_SIZE / 16; i++) {
+			while (mSizes[classIdx] < i * 16) classIdx++;
+			mSizeToClass[i] = uint8_t(classIdx);
+		}
+
+		// Reserve region, with an extra slab so that it can be aligned to the slab size
+		const uint64_t reserveSize = REGION_SIZE + SLAB_SIZE;
+		void* reserved = virtualMemoryReserve(reserveSize);
+		if (reserved == nullptr) {
+			SFZ_WARNING("ThreadCachingAllocator",
+				"Could not reserve virtual memory, all allocations will use standard allocator.");
+			return;
+		}
+		uint8_t* region = reinterpret_cast<uint8_t*>(
+			roundUpAligned(reinterpret_cast<uint64_t>(reserved), SLAB_SIZE));
+
+		// Commit memory for the side table
+		if (!virtualMemoryCommit(region, NUM_SIDE_TABLE_SLABS * SLAB_SIZE)) {
+			SFZ_WARNING("ThreadCachingAllocator",
+				"Could not commit virtual memory, all allocations will use standard allocator.");
+			virtualMemoryRelease(reserved, reserveSize);
+			return;
+		}
+
+		mRegion = region;
+		mRegionEnd = region + REGION_SIZE;
+		mSlabSizeClass = region;
+		mNextSlabIdx.store(NUM_SIDE_TABLE_SLABS, std::memory_order_relaxed);
+	}
+
+	ThreadCachingAllocator(const ThreadCachingAllocator&) = delete;
+	ThreadCachingAllocator& operator= (const ThreadCachingAllocator&) = delete;
+
+	// Implemented sfz::Allocator methods
+	// --------------------------------------------------------------------------------------------
+
+	void* allocate(DbgInfo dbg, uint64_t size, uint64_t alignment) noexcept override final
+	{
+		sfz_assert(isPowerOfTwo(alignment));
+		const uint32_t classIdx = this->findSizeClass(size, alignment);
+		if (classIdx == NUM_SIZE_CLASSES) {
+			return getStandardAllocator()->allocate(dbg, size, alignment);
+		}
+
+		// Pop block from thread cache, refill it from central pool if empty
+		ThreadCache& cache = getThreadCache();
+		ThreadCacheList& list = cache.lists[classIdx];
+		if (list.head == nullptr) {
+			void* head = nullptr;
+			uint32_t count = this->fetchBlocks(classIdx, head);
+			if (count == 0) return nullptr;
+
+			// If thread cache is already destroyed, return all but one block to the central pool
+			if (cache.destroyed) {
+				void* block = head;
+				if (count > 1) this->releaseBlocks(classIdx, nextBlock(block), count - 1);
+				return block;
+			}
+
+			list.head = head;
+			list.count = count;
+		}
+		void* block = list.head;
+		list.head = nextBlock(block);
+		list.count -= 1;
+		return block;
+	}
+
+	void deallocate(void* pointer) noexcept override final
+	{
+		if (pointer == nullptr) return;
+		uint8_t* ptr = reinterpret_cast<uint8_t*>(pointer);
+		if (ptr < mRegion || mRegionEnd <= ptr) {
+			getStandardAllocator()->deallocate(pointer);
+			return;
+		}
+
+		const uint64_t slabIdx = uint64_t(ptr - mRegion) / SLAB_SIZE;
+		this->deallocateBlock(mSlabSizeClass[slabIdx], pointer);
+	}
+
+	void deallocateSized(void* pointer, uint64_t size, uint64_t alignment) noexcept override final
+	{
+		if (pointer == nullptr) return;
+
+		// The size class is the same as allocate() chose, so no need to look it up
+		const uint32_t classIdx = this->findSizeClass(size, alignment);
+		if (classIdx == NUM_SIZE_CLASSES) {
+			getStandardAllocator()->deallocateSized(pointer, size, alignment);
+			return;
+		}
+		sfz_assert(mSlabSizeClass[
+			uint64_t(reinterpret_cast<uint8_t*>(pointer) - mRegion) / SLAB_SIZE] == classIdx);
+		this->deallocateBlock(classIdx, pointer);
+	}
+
+	bool tryExtendInPlace(void* pointer, uint64_t currentSize, uint64_t newSize) noexcept override final
+	{
+		// Succeeds if the new size still fits in the block's size class. Never shrinks, since the
+		// smaller size could belong to another size class, which would break deallocateSized().
+		uint8_t* ptr = reinterpret_cast<uint8_t*>(pointer);
+		if (ptr == nullptr || ptr < mRegion || mRegionEnd <= ptr) return false;
+		if (newSize < currentSize) return false;
+		const uint64_t slabIdx = uint64_t(ptr - mRegion) / SLAB_SIZE;
+		return newSize <= mSizes[mSlabSizeClass[slabIdx]];
+	}
+
+	// Thread cache methods
+	// --------------------------------------------------------------------------------------------
+
+	// Returns all blocks in the calling thread's cache to the central pool, called on thread exit
+	void flushThreadCache() noexcept
+	{
+		for (uint32_t i = 0; i < NUM_SIZE_CLASSES; i++) {
+			ThreadCacheList& list = tlsCache.lists[i];
+			if (list.head != nullptr) this->releaseBlocks(i, list.head, list.count);
+			list.head = nullptr;
+			list.count = 0;
+		}
+		tlsCache.destroyed = true;
+	}
+
+private:
+	// Private methods
+	// --------------------------------------------------------------------------------------------
+
+	// Finds smallest size class that fits the size and whose blocks are aligned to the requested
+	// alignment, which is the case if the class size is a multiple of it. Returns
+	// NUM_SIZE_CLASSES if the allocation should be forwarded to the standard allocator.
+	uint32_t findSizeClass(uint64_t size, uint64_t alignment) const noexcept
+	{
+		if (mRegion == nullptr || size > MAX_SMALL_SIZE) return NUM_SIZE_CLASSES;
+		uint32_t classIdx = mSizeToClass[(size + 15) / 16];
+		while (classIdx < NUM_SIZE_CLASSES && (mSizes[classIdx] & (alignment - 1)) != 0) {
+			classIdx++;
+		}
+		return classIdx;
+	}
+
+	// Returns a block to the calling thread's cache, or to the central pool if the cache is full
+	void deallocateBlock(uint32_t classIdx, void* pointer) noexcept
+	{
+		sfz_assert(classIdx < NUM_SIZE_CLASSES);
+		const uint64_t offset = uint64_t(reinterpret_cast<uint8_t*>(pointer) - mRegion);
+		sfz_assert((offset % SLAB_SIZE) % mSizes[classIdx] == 0);
+		(void)offset;
+
+		ThreadCache& cache = getThreadCache();
+		if (cache.destroyed) {
+			nextBlock(pointer) = nullptr;
+			this->releaseBlocks(classIdx, pointer, 1);
+			return;
+		}
+
+		// Push block to thread cache
+		ThreadCacheList& list = cache.lists[classIdx];
+		nextBlock(pointer) = list.head;
+		list.head = pointer;
+		list.count += 1;
+
+		// If thread cache has grown too large, return a batch to the central pool
+		const uint32_t batchSize = mBatchSizes[classIdx];
+		if (list.count >= 2 * batchSize) {
+			void* batch = list.head;
+			void* last = batch;
+			for (uint32_t i = 1; i < batchSize; i++) last = nextBlock(last);
+			list.head = nextBlock(last);
+			list.count -= batchSize;
+			nextBlock(last) = nullptr;
+
+			CentralFreeList& central = mCentral[classIdx];
+			std::lock_guard<std::mutex> lock(central.mutex);
+			nextBatch(batch) = central.batches;
+			central.batches = batch;
+		}
+	}
+
+	ThreadCache& getThreadCache() noexcept
+	{
+		if (!tlsCache.initialized) {
+			tlsCache.initialized = true;
+			tlsFlusher.registered = true; // Constructs flusher, registering it for thread exit
+		}
+		return tlsCache;
+	}
+
+	// Fetches a list of up to batch size blocks from the central pool, returns number of blocks
+	// fetched or 0 on failure.
+	uint32_t fetchBlocks(uint32_t classIdx, void*& headOut) noexcept
+	{
+		const uint32_t batchSize = mBatchSizes[classIdx];
+		const uint32_t blockSize = mSizes[classIdx];
+		CentralFreeList& central = mCentral[classIdx];
+		std::lock_guard<std::mutex> lock(central.mutex);
+
+		// Take full batch if available
+		if (central.batches != nullptr) {
+			headOut = central.batches;
+			central.batches = nextBatch(headOut);
+			return batchSize;
+		}
+
+		// Take loose blocks if available
+		if (central.loose != nullptr) {
+			headOut = central.loose;
+			void* last = headOut;
+			uint32_t count = 1;
+			while (count < batchSize && nextBlock(last) != nullptr) {
+				last = nextBlock(last);
+				count += 1;
+			}
+			central.loose = nextBlock(last);
+			nextBlock(last) = nullptr;
+			return count;
+		}
+
+		// Carve new blocks from slab, get a new slab if current one is exhausted
+		if (uint64_t(central.carveEnd - central.carveNext) < blockSize) {
+			uint8_t* slab = this->allocateSlab(classIdx);
+			if (slab == nullptr) return 0;
+			central.carveNext = slab;
+			central.carveEnd = slab + (SLAB_SIZE / blockSize) * blockSize;
+		}
+		uint32_t count = 0;
+		void* prev = nullptr;
+		while (count < batchSize && central.carveNext < central.carveEnd) {
+			void* block = central.carveNext;
+			central.carveNext += blockSize;
+			if (prev == nullptr) headOut = block;
+			else nextBlock(prev) = block;
+			prev = block;
+			count += 1;
+		}
+		nextBlock(prev) = nullptr;
+		return count;
+	}
+
+	// Returns a nullptr terminated list of blocks to the loose list of the central pool.
+	void releaseBlocks(uint32_t classIdx, void* head, uint32_t count) noexcept
+	{
+		void* last = head;
+		for (uint32_t i = 1; i < count; i++) last = nextBlock(last);
+		sfz_assert(nextBlock(last) == nullptr);
+
+		CentralFreeList& central = mCentral[classIdx];
+		std::lock_guard<std::mutex> lock(central.mutex);
+		nextBlock(last) = central.loose;
+		central.loose = head;
+	}
+
+	uint8_t* allocateSlab(uint32_t classIdx) noexcept
+	{
+		const uint64_t slabIdx = mNextSlabIdx.fetch_add(1, std::memory_order_relaxed);
+		if (slabIdx >= NUM_SLABS) {
+			SFZ_WARNING("ThreadCachingAllocator", "Out of reserved virtual memory.");
+			return nullptr;
+		}
+		uint8_t* slab = mRegion + slabIdx * SLAB_SIZE;
+		if (!virtualMemoryCommit(slab, SLAB_SIZE)) {
+			SFZ_WARNING("ThreadCachingAllocator", "Failed to commit memory for slab.");
+			return nullptr;
+		}
+		mSlabSizeClass[slabIdx] = uint8_t(classIdx);
+		return slab;
+	}
+
+	// Private members
+	// --------------------------------------------------------------------------------------------
+
+	struct alignas(64) CentralFreeList final {
+		std::mutex mutex;
+		void* batches = nullptr; // Full batches, linked through nextBatch() of first block
+		void* loose = nullptr; // Individual blocks, e.g. from caches of exited threads
+		uint8_t* carveNext = nullptr;
+		uint8_t* carveEnd = nullptr;
+	};
+
+	uint32_t mSizes[NUM_SIZE_CLASSES] = {};
+	uint32_t mBatchSizes[NUM_SIZE_CLASSES] = {};
+	uint8_t mSizeToClass[MAX_SMALL_SIZE / 16 + 1] = {};
+
+	uint8_t* mRegion = nullptr;
+	uint8_t* mRegionEnd = nullptr;
+	uint8_t* mSlabSizeClass = nullptr;
+	std::atomic<uint64_t> mNextSlabIdx{0};
+
+	CentralFreeList mCentral[NUM_SIZE_CLASSES];
+};
+
+// ThreadCachingAllocator retrieval function
+// ------------------------------------------------------------------------------------------------
+
+Allocator* getThreadCachingAllocator() noexcept
+{
+	// Intentionally never destroyed, memory allocated from it may still be in use by other static
+	// objects and threads during shutdown.
+	alignas(ThreadCachingAllocator) static uint8_t storage[sizeof(ThreadCachingAllocator)];
+	static ThreadCachingAllocator* allocator = new (storage) ThreadCachingAllocator();
+	return allocator;
+}
+
+ThreadCacheFlusher::~ThreadCacheFlusher() noexcept
+{
+	static_cast<ThreadCachingAllocator*>(getThreadCachingAllocator())->flushThreadCache();
+}
+
+} // namespace sfz
@@ -0,0 +1,404 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/memory/TlsfAllocator.hpp"
+
+#include <cstddef>
+
+#include <sfz/Assert.hpp>
+#include <sfz/Logging.hpp>
+#include <sfz/memory/MemoryUtils.hpp>
+
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+
+namespace sfz {
+
+// Block header
+// ------------------------------------------------------------------------------------------------
+
+static constexpr uint64_t FREE_BIT = 1;
+static constexpr uint64_t HEADER_SIZE = 16;
+static constexpr uint64_t MIN_BLOCK_SIZE = 16; // Must be able to hold the free list pointers
+
+// Header placed directly before each block's memory. The physical blocks form a doubly linked
+// list through prevPhysical and the size, the free list pointers are only used for free blocks
+// and are stored in the block's memory (after the header).
+struct TlsfAllocator::BlockHeader final {
+	BlockHeader* prevPhysical;
+	uint64_t sizeAndFlags;
+	BlockHeader* nextFree;
+	BlockHeader* prevFree;
+
+	uint64_t size() const noexcept { return sizeAndFlags & ~FREE_BIT; }
+	void setSize(uint64_t size) noexcept { sizeAndFlags = size | (sizeAndFlags & FREE_BIT); }
+	bool isFree() const noexcept { return (sizeAndFlags & FREE_BIT) != 0; }
+	void setFree(bool free) noexcept { sizeAndFlags = free ? (sizeAndFlags | FREE_BIT) : size(); }
+
+	uint8_t* memory() noexcept { return reinterpret_cast<uint8_t*>(this) + HEADER_SIZE; }
+	BlockHeader* nextPhysical() noexcept
+	{
+		return reinterpret_cast<BlockHeader*>(memory() + size());
+	}
+	static BlockHeader* fromMemory(void* ptr) noexcept
+	{
+		return reinterpret_cast<BlockHeader*>(reinterpret_cast<uint8_t*>(ptr) - HEADER_SIZE);
+	}
+};
+
+// Statics
+// ------------------------------------------------------------------------------------------------
+
+// Index of the lowest set bit, value must not be 0
+static uint32_t findFirstSet(uint64_t value) noexcept
+{
+	sfz_assert(value != 0);
+#ifdef _WIN32
+	unsigned long index = 0;
+	_BitScanForward64(&index, value);
+	return uint32_t(index);
+#else
+	return uint32_t(__builtin_ctzll(value));
+#endif
+}
+
+// Index of the highest set bit, value must not be 0
+static uint32_t findLastSet(uint64_t value) noexcept
+{
+	sfz_assert(value != 0);
+#ifdef _WIN32
+	unsigned long index = 0;
+	_BitScanReverse64(&index, value);
+	return uint32_t(index);
+#else
+	return uint32_t(63 - __builtin_clzll(value));
+#endif
+}
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) noexcept
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Calculates the first and second level indices of the free list a block of the specified size
+// belongs to.
+static void mappingInsert(uint64_t size, uint32_t& fl, uint32_t& sl) noexcept
+{
+	if (size < TlsfAllocator::SMALL_BLOCK_SIZE) {
+		fl = 0;
+		sl = uint32_t(size / (TlsfAllocator::SMALL_BLOCK_SIZE / TlsfAllocator::SL_INDEX_COUNT));
+	}
+	else {
+		uint32_t bit = findLastSet(size);
+		sl = uint32_t(size >> (bit - TlsfAllocator::SL_INDEX_COUNT_LOG2)) ^
+			TlsfAllocator::SL_INDEX_COUNT;
+		fl = bit - (TlsfAllocator::FL_INDEX_SHIFT - 1);
+	}
+}
+
+// Same as mappingInsert(), but rounds the size up to the next list so that every block in the
+// found list is guaranteed to be large enough.
+static void mappingSearch(uint64_t size, uint32_t& fl, uint32_t& sl) noexcept
+{
+	if (size >= TlsfAllocator::SMALL_BLOCK_SIZE) {
+		size += (uint64_t(1) << (findLastSet(size) - TlsfAllocator::SL_INDEX_COUNT_LOG2)) - 1;
+	}
+	mappingInsert(size, fl, sl);
+}
+
+// TlsfAllocator: State methods
+// ------------------------------------------------------------------------------------------------
+
+void TlsfAllocator::init(void* memory, uint64_t memorySizeBytes) noexcept
+{
+	sfz_assert(memory != nullptr);
+	sfz_assert(isAligned(memory, ALIGN_SIZE));
+	sfz_assert(memorySizeBytes >= (2 * HEADER_SIZE + MIN_BLOCK_SIZE));
+	sfz_assert(memorySizeBytes < (uint64_t(1) << FL_INDEX_MAX));
+
+	this->destroy();
+	mMemory = reinterpret_cast<uint8_t*>(memory);
+	mMemorySizeBytes = memorySizeBytes;
+	this->reset();
+}
+
+void TlsfAllocator::init(uint64_t memorySizeBytes, Allocator* allocator, DbgInfo allocDbg) noexcept
+{
+	sfz_assert(allocator != nullptr);
+	void* memory = allocator->allocate(allocDbg, memorySizeBytes, 32);
+	sfz_assert_hard(memory != nullptr);
+
+	this->init(memory, memorySizeBytes);
+	mOwningAllocator = allocator;
+}
+
+void TlsfAllocator::destroy() noexcept
+{
+	if (mOwningAllocator != nullptr) mOwningAllocator->deallocate(mMemory);
+	mMemory = nullptr;
+	mMemorySizeBytes = 0;
+	mOwningAllocator = nullptr;
+	this->reset();
+}
+
+void TlsfAllocator::reset() noexcept
+{
+	static_assert(offsetof(BlockHeader, nextFree) == HEADER_SIZE, "Invalid block header size");
+
+	mNumAllocations = 0;
+	mNumBytesAllocated = 0;
+	mNumBytesFree = 0;
+	mFlBitmap = 0;
+	for (uint32_t fl = 0; fl < FL_INDEX_COUNT; fl++) {
+		mSlBitmaps[fl] = 0;
+		for (uint32_t sl = 0; sl < SL_INDEX_COUNT; sl++) mFreeLists[fl][sl] = nullptr;
+	}
+	if (mMemory == nullptr) return;
+
+	// Create one large free block covering all memory, followed by a zero-sized sentinel block
+	// which is never free and thus never coalesced with.
+	uint64_t usableSize = mMemorySizeBytes & ~uint64_t(ALIGN_SIZE - 1);
+	BlockHeader* block = reinterpret_cast<BlockHeader*>(mMemory);
+	block->prevPhysical = nullptr;
+	block->sizeAndFlags = usableSize - 2 * HEADER_SIZE;
+	BlockHeader* sentinel = block->nextPhysical();
+	sentinel->prevPhysical = block;
+	sentinel->sizeAndFlags = 0;
+	this->insertFreeBlock(block);
+}
+
+// TlsfAllocator: Methods
+// ------------------------------------------------------------------------------------------------
+
+uint64_t TlsfAllocator::largestFreeBlockBytes() const noexcept
+{
+	if (mFlBitmap == 0) return 0;
+	uint32_t fl = findLastSet(mFlBitmap);
+	uint32_t sl = findLastSet(mSlBitmaps[fl]);
+	uint64_t largest = 0;
+	for (const BlockHeader* block = mFreeLists[fl][sl]; block != nullptr; block = block->nextFree) {
+		if (block->size() > largest) largest = block->size();
+	}
+	return largest;
+}
+
+float TlsfAllocator::fragmentation() const noexcept
+{
+	if (mNumBytesFree == 0) return 0.0f;
+	return 1.0f - float(double(largestFreeBlockBytes()) / double(mNumBytesFree));
+}
+
+bool TlsfAllocator::owns(const void* pointer) const noexcept
+{
+	const uint8_t* ptr = reinterpret_cast<const uint8_t*>(pointer);
+	return mMemory <= ptr && ptr < (mMemory + mMemorySizeBytes);
+}
+
+// TlsfAllocator: Implemented sfz::Allocator methods
+// ------------------------------------------------------------------------------------------------
+
+void* TlsfAllocator::allocate(DbgInfo dbg, uint64_t size, uint64_t alignment) noexcept
+{
+	(void)dbg;
+	sfz_assert(isPowerOfTwo(alignment));
+	if (mMemory == nullptr) return nullptr;
+
+	// Round up size, and if alignment is larger than what blocks are naturally aligned to, search
+	// for a block large enough to fit both the allocation and a leading free block.
+	size = alignUp(size < MIN_BLOCK_SIZE ? MIN_BLOCK_SIZE : size, ALIGN_SIZE);
+	const bool overAligned = alignment > ALIGN_SIZE;
+	const uint64_t searchSize = overAligned ? (size + alignment + HEADER_SIZE + MIN_BLOCK_SIZE) : size;
+
+	BlockHeader* block = this->findFreeBlock(searchSize);
+	if (block == nullptr) {
+		SFZ_WARNING("TlsfAllocator",
+			"Out of memory. Trying to allocate %llu bytes (alignment %llu), %llu of %llu bytes free.",
+			size, alignment, mNumBytesFree, mMemorySizeBytes);
+		return nullptr;
+	}
+	this->removeFreeBlock(block);
+
+	// Split off leading gap as a free block, the gap must be large enough to form a block
+	if (overAligned) {
+		uint64_t memory = uint64_t(block->memory());
+		uint64_t aligned = alignUp(memory, alignment);
+		if (aligned != memory && (aligned - memory) < (HEADER_SIZE + MIN_BLOCK_SIZE)) {
+			aligned = alignUp(memory + HEADER_SIZE + MIN_BLOCK_SIZE, alignment);
+		}
+		uint64_t gap = aligned - memory;
+		if (gap != 0) {
+			BlockHeader* alignedBlock = BlockHeader::fromMemory(reinterpret_cast<void*>(aligned));
+			alignedBlock->prevPhysical = block;
+			alignedBlock->sizeAndFlags = block->size() - gap;
+			alignedBlock->nextPhysical()->prevPhysical = alignedBlock;
+			block->setSize(gap - HEADER_SIZE);
+			this->insertFreeBlock(block);
+			block = alignedBlock;
+		}
+	}
+
+	// Split off trailing memory as a free block if large enough
+	this->splitBlock(block, size);
+	block->setFree(false);
+
+	mNumAllocations += 1;
+	mNumBytesAllocated += block->size();
+	sfz_assert(isAligned(block->memory(), alignment));
+	return block->memory();
+}
+
+void TlsfAllocator::deallocate(void* pointer) noexcept
+{
+	if (pointer == nullptr) return;
+	sfz_assert(owns(pointer));
+	BlockHeader* block = BlockHeader::fromMemory(pointer);
+	sfz_assert(!block->isFree());
+
+	mNumAllocations -= 1;
+	mNumBytesAllocated -= block->size();
+
+	// Coalesce with previous physical block if free
+	BlockHeader* prev = block->prevPhysical;
+	if (prev != nullptr && prev->isFree()) {
+		this->removeFreeBlock(prev);
+		prev->setSize(prev->size() + HEADER_SIZE + block->size());
+		block = prev;
+		block->nextPhysical()->prevPhysical = block;
+	}
+
+	// Coalesce with next physical block if free
+	BlockHeader* next = block->nextPhysical();
+	if (next->isFree()) {
+		this->removeFreeBlock(next);
+		block->setSize(block->size() + HEADER_SIZE + next->size());
+		block->nextPhysical()->prevPhysical = block;
+	}
+
+	this->insertFreeBlock(block);
+}
+
+bool TlsfAllocator::tryExtendInPlace(void* pointer, uint64_t currentSize, uint64_t newSize) noexcept
+{
+	(void)currentSize;
+	if (pointer == nullptr) return false;
+	sfz_assert(owns(pointer));
+	BlockHeader* block = BlockHeader::fromMemory(pointer);
+	sfz_assert(!block->isFree());
+	newSize = alignUp(newSize < MIN_BLOCK_SIZE ? MIN_BLOCK_SIZE : newSize, ALIGN_SIZE);
+
+	// Absorb next physical block if it is free and the current block is not large enough
+	if (newSize > block->size()) {
+		BlockHeader* next = block->nextPhysical();
+		if (!next->isFree() || (block->size() + HEADER_SIZE + next->size()) < newSize) return false;
+		this->removeFreeBlock(next);
+		mNumBytesAllocated += HEADER_SIZE + next->size();
+		block->setSize(block->size() + HEADER_SIZE + next->size());
+		block->nextPhysical()->prevPhysical = block;
+	}
+
+	// Return any excess memory at the end as a free block, coalescing it with the next block
+	uint64_t sizeBefore = block->size();
+	this->splitBlock(block, newSize);
+	mNumBytesAllocated -= sizeBefore - block->size();
+	if (sizeBefore != block->size()) {
+		BlockHeader* remainder = block->nextPhysical();
+		BlockHeader* next = remainder->nextPhysical();
+		if (next->isFree()) {
+			this->removeFreeBlock(remainder);
+			this->removeFreeBlock(next);
+			remainder->setSize(remainder->size() + HEADER_SIZE + next->size());
+			remainder->nextPhysical()->prevPhysical = remainder;
+			this->insertFreeBlock(remainder);
+		}
+	}
+	return true;
+}
+
+// TlsfAllocator: Private methods
+// ------------------------------------------------------------------------------------------------
+
+void TlsfAllocator::insertFreeBlock(BlockHeader* block) noexcept
+{
+	uint32_t fl = 0, sl = 0;
+	mappingInsert(block->size(), fl, sl);
+
+	BlockHeader* head = mFreeLists[fl][sl];
+	block->nextFree = head;
+	block->prevFree = nullptr;
+	if (head != nullptr) head->prevFree = block;
+	mFreeLists[fl][sl] = block;
+
+	mFlBitmap |= uint64_t(1) << fl;
+	mSlBitmaps[fl] |= uint32_t(1) << sl;
+
+	block->setFree(true);
+	mNumBytesFree += block->size();
+}
+
+void TlsfAllocator::removeFreeBlock(BlockHeader* block) noexcept
+{
+	uint32_t fl = 0, sl = 0;
+	mappingInsert(block->size(), fl, sl);
+
+	if (block->prevFree != nullptr) block->prevFree->nextFree = block->nextFree;
+	if (block->nextFree != nullptr) block->nextFree->prevFree = block->prevFree;
+	if (mFreeLists[fl][sl] == block) {
+		mFreeLists[fl][sl] = block->nextFree;
+		if (block->nextFree == nullptr) {
+			mSlBitmaps[fl] &= ~(uint32_t(1) << sl);
+			if (mSlBitmaps[fl] == 0) mFlBitmap &= ~(uint64_t(1) << fl);
+		}
+	}
+
+	block->setFree(false);
+	mNumBytesFree -= block->size();
+}
+
+TlsfAllocator::BlockHeader* TlsfAllocator::findFreeBlock(uint64_t size) noexcept
+{
+	uint32_t fl = 0, sl = 0;
+	mappingSearch(size, fl, sl);
+	if (fl >= FL_INDEX_COUNT) return nullptr;
+
+	// Search for non-empty list in same first level, otherwise in next non-empty first level
+	uint32_t slMap = mSlBitmaps[fl] & (~uint32_t(0) << sl);
+	if (slMap == 0) {
+		uint64_t flMap = mFlBitmap & (~uint64_t(0) << (fl + 1));
+		if (flMap == 0) return nullptr;
+		fl = findFirstSet(flMap);
+		slMap = mSlBitmaps[fl];
+	}
+	sl = findFirstSet(slMap);
+	return mFreeLists[fl][sl];
+}
+
+void TlsfAllocator::splitBlock(BlockHeader* block, uint64_t size) noexcept
+{
+	sfz_assert(block->size() >= size);
+	if (block->size() < (size + HEADER_SIZE + MIN_BLOCK_SIZE)) return;
+
+	BlockHeader* remainder = reinterpret_cast<BlockHeader*>(block->memory() + size);
+	remainder->prevPhysical = block;
+	remainder->sizeAndFlags = block->size() - size - HEADER_SIZE;
+	remainder->nextPhysical()->prevPhysical = remainder;
+	block->setSize(size);
+	this->insertFreeBlock(remainder);
+}
+
+} // namespace sfz
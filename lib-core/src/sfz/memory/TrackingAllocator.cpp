@@ -0,0 +1,268 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/memory/TrackingAllocator.hpp"
+
+#include <atomic>
+
+#include "sfz/Assert.hpp"
+#include "sfz/memory/MemoryUtils.hpp"
+
+namespace sfz {
+
+// TrackingTagEntry
+// ------------------------------------------------------------------------------------------------
+
+static const char* OVERFLOW_TAG = "<TrackingAllocator overflow>";
+
+struct alignas(64) TrackingTagEntry final {
+	std::atomic<const char*> tag{nullptr};
+	std::atomic<uint64_t> numAllocations{0};
+	std::atomic<uint64_t> numLiveAllocations{0};
+	std::atomic<uint64_t> liveBytes{0};
+	std::atomic<uint64_t> peakLiveBytes{0};
+	std::atomic<uint64_t> sizeHistogram[TRACKING_HISTOGRAM_NUM_BUCKETS];
+
+	TrackingTagEntry() noexcept
+	{
+		for (std::atomic<uint64_t>& bucket : sizeHistogram) bucket.store(0);
+	}
+
+	void copyTo(TrackingTagStats& stats) const noexcept
+	{
+		stats.tag = tag.load(std::memory_order_acquire);
+		stats.numAllocations = numAllocations.load(std::memory_order_relaxed);
+		stats.numLiveAllocations = numLiveAllocations.load(std::memory_order_relaxed);
+		stats.liveBytes = liveBytes.load(std::memory_order_relaxed);
+		stats.peakLiveBytes = peakLiveBytes.load(std::memory_order_relaxed);
+		for (uint32_t i = 0; i < TRACKING_HISTOGRAM_NUM_BUCKETS; i++) {
+			stats.sizeHistogram[i] = sizeHistogram[i].load(std::memory_order_relaxed);
+		}
+	}
+};
+
+// Header stored directly before each allocation
+struct TrackingHeader final {
+	uint64_t size;
+	uint32_t tagIdx;
+	uint32_t offset; // Offset from start of actual allocation to user pointer
+};
+static_assert(sizeof(TrackingHeader) == 16, "TrackingHeader must be 16 bytes");
+
+// Statics
+// ------------------------------------------------------------------------------------------------
+
+static uint32_t histogramBucket(uint64_t size) noexcept
+{
+	uint32_t bucket = 0;
+	while (size > 1 && bucket < (TRACKING_HISTOGRAM_NUM_BUCKETS - 1)) {
+		size >>= 1;
+		bucket += 1;
+	}
+	return bucket;
+}
+
+static TrackingHeader* headerFromPointer(void* pointer) noexcept
+{
+	return reinterpret_cast<TrackingHeader*>(reinterpret_cast<uint8_t*>(pointer) - 16);
+}
+
+static void addLiveBytes(TrackingTagEntry& entry, uint64_t bytes) noexcept
+{
+	uint64_t live = entry.liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	uint64_t peak = entry.peakLiveBytes.load(std::memory_order_relaxed);
+	while (live > peak && !entry.peakLiveBytes.compare_exchange_weak(
+		peak, live, std::memory_order_relaxed, std::memory_order_relaxed));
+}
+
+// TrackingAllocator: State methods
+// ------------------------------------------------------------------------------------------------
+
+void TrackingAllocator::init(Allocator* allocator, uint32_t maxNumTags) noexcept
+{
+	sfz_assert(allocator != nullptr);
+	this->destroy();
+
+	// Round up table size to power of two, and make room for the overflow entry at the end
+	uint32_t tableSize = 16;
+	while (tableSize < maxNumTags) tableSize *= 2;
+	TrackingTagEntry* entries = reinterpret_cast<TrackingTagEntry*>(allocator->allocate(
+		sfz_dbg("TrackingAllocator"), sizeof(TrackingTagEntry) * (tableSize + 1),
+		alignof(TrackingTagEntry)));
+	sfz_assert_hard(entries != nullptr);
+	for (uint32_t i = 0; i <= tableSize; i++) new (entries + i) TrackingTagEntry();
+	entries[tableSize].tag.store(OVERFLOW_TAG, std::memory_order_relaxed);
+
+	mAllocator = allocator;
+	mEntries = entries;
+	mTableSize = tableSize;
+}
+
+void TrackingAllocator::destroy() noexcept
+{
+	if (mEntries != nullptr) {
+		for (uint32_t i = 0; i <= mTableSize; i++) mEntries[i].~TrackingTagEntry();
+		mAllocator->deallocate(mEntries);
+	}
+	mAllocator = nullptr;
+	mEntries = nullptr;
+	mTableSize = 0;
+}
+
+// TrackingAllocator: Methods
+// ------------------------------------------------------------------------------------------------
+
+uint32_t TrackingAllocator::numTags() const noexcept
+{
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < mTableSize; i++) {
+		if (mEntries[i].tag.load(std::memory_order_relaxed) != nullptr) count += 1;
+	}
+	if (mEntries != nullptr &&
+		mEntries[mTableSize].numAllocations.load(std::memory_order_relaxed) != 0) count += 1;
+	return count;
+}
+
+uint32_t TrackingAllocator::snapshot(TrackingTagStats* statsOut, uint32_t maxNumStats) const noexcept
+{
+	if (mEntries == nullptr) return 0;
+	uint32_t numWritten = 0;
+	for (uint32_t i = 0; i <= mTableSize && numWritten < maxNumStats; i++) {
+		const TrackingTagEntry& entry = mEntries[i];
+		if (entry.tag.load(std::memory_order_acquire) == nullptr) continue;
+		if (entry.numAllocations.load(std::memory_order_relaxed) == 0) continue;
+		entry.copyTo(statsOut[numWritten]);
+		numWritten += 1;
+	}
+	return numWritten;
+}
+
+bool TrackingAllocator::tagStats(const char* tag, TrackingTagStats& statsOut) const noexcept
+{
+	if (mEntries == nullptr) return false;
+	if (tag == nullptr) tag = "";
+	for (uint32_t i = 0; i <= mTableSize; i++) {
+		const TrackingTagEntry& entry = mEntries[i];
+		if (entry.tag.load(std::memory_order_acquire) == tag) {
+			entry.copyTo(statsOut);
+			return true;
+		}
+	}
+	return false;
+}
+
+void TrackingAllocator::resetPeaks() noexcept
+{
+	for (uint32_t i = 0; mEntries != nullptr && i <= mTableSize; i++) {
+		TrackingTagEntry& entry = mEntries[i];
+		entry.peakLiveBytes.store(
+			entry.liveBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+}
+
+// TrackingAllocator: Implemented sfz::Allocator methods
+// ------------------------------------------------------------------------------------------------
+
+void* TrackingAllocator::allocate(DbgInfo dbg, uint64_t size, uint64_t alignment) noexcept
+{
+	sfz_assert(mAllocator != nullptr);
+	sfz_assert(isPowerOfTwo(alignment));
+
+	// Allocate memory with room for header in front
+	if (alignment < sizeof(TrackingHeader)) alignment = sizeof(TrackingHeader);
+	uint8_t* memory = reinterpret_cast<uint8_t*>(
+		mAllocator->allocate(dbg, size + alignment, alignment));
+	if (memory == nullptr) return nullptr;
+	uint8_t* ptr = memory + alignment;
+
+	// Update statistics
+	uint32_t tagIdx = this->findOrInsertTag(dbg.staticMsg);
+	TrackingTagEntry& entry = mEntries[tagIdx];
+	entry.numAllocations.fetch_add(1, std::memory_order_relaxed);
+	entry.numLiveAllocations.fetch_add(1, std::memory_order_relaxed);
+	entry.sizeHistogram[histogramBucket(size)].fetch_add(1, std::memory_order_relaxed);
+	addLiveBytes(entry, size);
+
+	// Write header
+	TrackingHeader* header = headerFromPointer(ptr);
+	header->size = size;
+	header->tagIdx = tagIdx;
+	header->offset = uint32_t(alignment);
+	return ptr;
+}
+
+void TrackingAllocator::deallocate(void* pointer) noexcept
+{
+	if (pointer == nullptr) return;
+	TrackingHeader* header = headerFromPointer(pointer);
+	sfz_assert(header->tagIdx <= mTableSize);
+
+	TrackingTagEntry& entry = mEntries[header->tagIdx];
+	entry.numLiveAllocations.fetch_sub(1, std::memory_order_relaxed);
+	entry.liveBytes.fetch_sub(header->size, std::memory_order_relaxed);
+
+	const uint64_t offset = header->offset;
+	mAllocator->deallocateSized(
+		reinterpret_cast<uint8_t*>(pointer) - offset, header->size + offset, offset);
+}
+
+bool TrackingAllocator::tryExtendInPlace(
+	void* pointer, uint64_t currentSize, uint64_t newSize) noexcept
+{
+	if (pointer == nullptr) return false;
+	TrackingHeader* header = headerFromPointer(pointer);
+	sfz_assert(header->size == currentSize);
+	const uint64_t offset = header->offset;
+	bool success = mAllocator->tryExtendInPlace(
+		reinterpret_cast<uint8_t*>(pointer) - offset, currentSize + offset, newSize + offset);
+	if (!success) return false;
+
+	TrackingTagEntry& entry = mEntries[header->tagIdx];
+	if (newSize > currentSize) addLiveBytes(entry, newSize - currentSize);
+	else entry.liveBytes.fetch_sub(currentSize - newSize, std::memory_order_relaxed);
+	header->size = newSize;
+	return true;
+}
+
+// TrackingAllocator: Private methods
+// ------------------------------------------------------------------------------------------------
+
+uint32_t TrackingAllocator::findOrInsertTag(const char* tag) noexcept
+{
+	if (tag == nullptr) tag = "";
+
+	// Fibonacci hash of pointer, then linear probing. Tags are never removed, so an empty slot
+	// means the tag is not in the table and can be claimed with a compare-and-swap.
+	const uint64_t hash = (uint64_t(uintptr_t(tag)) * 11400714819323198485ull) >> 32;
+	const uint32_t mask = mTableSize - 1;
+	for (uint32_t i = 0; i < mTableSize; i++) {
+		const uint32_t idx = (uint32_t(hash) + i) & mask;
+		const char* existing = mEntries[idx].tag.load(std::memory_order_acquire);
+		if (existing == tag) return idx;
+		if (existing == nullptr) {
+			if (mEntries[idx].tag.compare_exchange_strong(
+				existing, tag, std::memory_order_acq_rel, std::memory_order_acquire)) {
+				return idx;
+			}
+			if (existing == tag) return idx;
+		}
+	}
+	return mTableSize; // Table full, use overflow entry
+}
+
+} // namespace sfz
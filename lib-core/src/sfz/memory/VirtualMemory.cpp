@@ -0,0 +1,117 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/memory/VirtualMemory.hpp"
+
+#include "sfz/Assert.hpp"
+#include "sfz/memory/MemoryUtils.hpp"
+
+#include "sfz/PushWarnings.hpp"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "sfz/PopWarnings.hpp"
+
+namespace sfz {
+
+// Virtual memory functions
+// ------------------------------------------------------------------------------------------------
+
+uint64_t virtualMemoryPageSize() noexcept
+{
+#if defined(_WIN32)
+	static const uint64_t pageSize = []() {
+		SYSTEM_INFO info = {};
+		GetSystemInfo(&info);
+		return uint64_t(info.dwPageSize);
+	}();
+#else
+	static const uint64_t pageSize = uint64_t(sysconf(_SC_PAGESIZE));
+#endif
+	return pageSize;
+}
+
+void* virtualMemoryReserve(uint64_t sizeBytes) noexcept
+{
+	sfz_assert((sizeBytes % virtualMemoryPageSize()) == 0);
+#if defined(_WIN32)
+	return VirtualAlloc(nullptr, sizeBytes, MEM_RESERVE, PAGE_NOACCESS);
+#elif defined(__EMSCRIPTEN__)
+	(void)sizeBytes;
+	return nullptr;
+#else
+	void* ptr = mmap(nullptr, sizeBytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (ptr == MAP_FAILED) return nullptr;
+	return ptr;
+#endif
+}
+
+bool virtualMemoryCommit(void* ptr, uint64_t sizeBytes) noexcept
+{
+	sfz_assert(isAligned(ptr, virtualMemoryPageSize()));
+	sfz_assert((sizeBytes % virtualMemoryPageSize()) == 0);
+#if defined(_WIN32)
+	return VirtualAlloc(ptr, sizeBytes, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+	return mprotect(ptr, sizeBytes, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+void virtualMemoryDecommit(void* ptr, uint64_t sizeBytes) noexcept
+{
+	sfz_assert(isAligned(ptr, virtualMemoryPageSize()));
+	sfz_assert((sizeBytes % virtualMemoryPageSize()) == 0);
+	if (sizeBytes == 0) return;
+#if defined(_WIN32)
+	VirtualFree(ptr, sizeBytes, MEM_DECOMMIT);
+#else
+	madvise(ptr, sizeBytes, MADV_DONTNEED);
+	mprotect(ptr, sizeBytes, PROT_NONE);
+#endif
+}
+
+void virtualMemoryRelease(void* ptr, uint64_t sizeBytes) noexcept
+{
+	if (ptr == nullptr) return;
+#if defined(_WIN32)
+	(void)sizeBytes;
+	VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+	munmap(ptr, sizeBytes);
+#endif
+}
+
+void virtualMemoryAdviseHugePages(void* ptr, uint64_t sizeBytes) noexcept
+{
+#if defined(MADV_HUGEPAGE)
+	madvise(ptr, sizeBytes, MADV_HUGEPAGE);
+#else
+	(void)ptr;
+	(void)sizeBytes;
+#endif
+}
+
+} // namespace sfz
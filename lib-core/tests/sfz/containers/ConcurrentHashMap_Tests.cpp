@@ -0,0 +1,298 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/PushWarnings.hpp"
+#include "catch2/catch.hpp"
+#include "sfz/PopWarnings.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include "sfz/Logging.hpp"
+#include "sfz/containers/ConcurrentHashMap.hpp"
+#include "sfz/containers/HashMap.hpp"
+#include "sfz/strings/DynString.hpp"
+#include "sfz/strings/StringHashers.hpp"
+
+using namespace sfz;
+
+TEST_CASE("ConcurrentHashMap: Single thread", "[sfz::ConcurrentHashMap]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	ConcurrentHashMap<uint32_t, uint32_t> map(1000);
+	REQUIRE(map.size() == 0);
+	REQUIRE(map.allocator() == getDefaultAllocator());
+
+	for (uint32_t i = 0; i < 1000; i++) map.put(i, i * 3);
+	REQUIRE(map.size() == 1000);
+
+	uint32_t value = 0;
+	REQUIRE(map.getCopy(7, value));
+	REQUIRE(value == 21);
+	REQUIRE(!map.getCopy(1000, value));
+	REQUIRE(value == 21);
+
+	bool called = false;
+	REQUIRE(map.get(10, [&](const uint32_t& v) { called = true; value = v; }));
+	REQUIRE(called);
+	REQUIRE(value == 30);
+	called = false;
+	REQUIRE(!map.get(1001, [&](const uint32_t&) { called = true; }));
+	REQUIRE(!called);
+
+	map.put(7, 1);
+	REQUIRE(map.getCopy(7, value));
+	REQUIRE(value == 1);
+	REQUIRE(map.size() == 1000);
+
+	REQUIRE(!map.emplace(7, 2u));
+	REQUIRE(map.getCopy(7, value));
+	REQUIRE(value == 1);
+	REQUIRE(map.emplace(2000, 2u));
+	REQUIRE(map.getCopy(2000, value));
+	REQUIRE(value == 2);
+
+	for (uint32_t i = 0; i < 1000; i += 2) REQUIRE(map.remove(i));
+	REQUIRE(!map.remove(0));
+	REQUIRE(map.size() == 501);
+
+	// forEach() should visit every element exactly once
+	uint64_t keySum = 0, valueSum = 0;
+	map.forEach([&](const uint32_t& k, const uint32_t& v) {
+		keySum += k;
+		valueSum += v;
+	});
+	uint64_t expectedKeySum = 2000, expectedValueSum = 2;
+	for (uint32_t i = 1; i < 1000; i += 2) {
+		expectedKeySum += i;
+		expectedValueSum += (i == 7) ? 1 : i * 3;
+	}
+	REQUIRE(keySum == expectedKeySum);
+	REQUIRE(valueSum == expectedValueSum);
+
+	map.clear();
+	REQUIRE(map.size() == 0);
+	REQUIRE(!map.getCopy(1, value));
+	map.destroy();
+	REQUIRE(map.allocator() == nullptr);
+}
+
+TEST_CASE("ConcurrentHashMap: Alt keys", "[sfz::ConcurrentHashMap]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	ConcurrentHashMap<DynString, uint32_t> map(64);
+	map.put("foo", 1);
+	map.put(DynString("bar"), 2);
+	REQUIRE(!map.emplace("foo", 3u));
+	REQUIRE(map.emplace("baz", 3u));
+	REQUIRE(map.size() == 3);
+
+	uint32_t value = 0;
+	REQUIRE(map.getCopy("foo", value));
+	REQUIRE(value == 1);
+	REQUIRE(map.getCopy(DynString("bar"), value));
+	REQUIRE(value == 2);
+	REQUIRE(map.get("baz", [&](const uint32_t& v) { value = v; }));
+	REQUIRE(value == 3);
+	REQUIRE(map.remove("foo"));
+	REQUIRE(!map.getCopy("foo", value));
+	REQUIRE(map.size() == 2);
+}
+
+struct ConcurrentCountingDescr final {
+	static std::atomic<uint32_t> numHashes;
+
+	struct Hash final {
+		size_t operator() (uint32_t key) const noexcept
+		{
+			numHashes++;
+			return size_t(key);
+		}
+	};
+
+	using KeyT = uint32_t;
+	using KeyHash = Hash;
+	using KeyEqual = std::equal_to<uint32_t>;
+
+	using AltKeyT = NO_ALT_KEY_TYPE;
+	using AltKeyHash = NO_ALT_KEY_TYPE;
+	using AltKeyKeyEqual = NO_ALT_KEY_TYPE;
+};
+
+std::atomic<uint32_t> ConcurrentCountingDescr::numHashes{0};
+
+TEST_CASE("ConcurrentHashMap: Keys are hashed once", "[sfz::ConcurrentHashMap]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	// The hash used to select the shard is passed on to the shard map. Capacity is reserved
+	// upfront, rehashing would hash the keys again.
+	ConcurrentHashMap<uint32_t, uint32_t, ConcurrentCountingDescr> map(4000);
+	ConcurrentCountingDescr::numHashes = 0;
+	for (uint32_t i = 0; i < 100; i++) map.put(i, i);
+	REQUIRE(ConcurrentCountingDescr::numHashes == 100);
+	for (uint32_t i = 0; i < 100; i++) map.emplace(i, 0u);
+	REQUIRE(ConcurrentCountingDescr::numHashes == 200);
+	uint32_t value = 0;
+	for (uint32_t i = 0; i < 100; i++) REQUIRE(map.getCopy(i, value));
+	REQUIRE(ConcurrentCountingDescr::numHashes == 300);
+	for (uint32_t i = 0; i < 100; i++) REQUIRE(map.remove(i));
+	REQUIRE(ConcurrentCountingDescr::numHashes == 400);
+	REQUIRE(map.size() == 0);
+}
+
+TEST_CASE("ConcurrentHashMap: Multithreaded stress test", "[sfz::ConcurrentHashMap]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	constexpr uint32_t NUM_THREADS = 8;
+	constexpr uint32_t NUM_KEYS_PER_THREAD = 20000;
+	ConcurrentHashMap<uint32_t, uint32_t> map(64);
+
+	// Each thread inserts its own keys (without reserving capacity, so shards are rehashed
+	// concurrently with readers), reads back its own and other threads' keys, then removes half
+	// of its keys. Values are always key * 2, so a reader can verify anything it finds.
+	std::atomic<uint32_t> numErrors{0};
+	std::thread threads[NUM_THREADS];
+	for (uint32_t i = 0; i < NUM_THREADS; i++) {
+		threads[i] = std::thread([&, i]() {
+			const uint32_t first = i * NUM_KEYS_PER_THREAD;
+			for (uint32_t j = 0; j < NUM_KEYS_PER_THREAD; j++) {
+				uint32_t key = first + j;
+				map.put(key, key * 2);
+
+				uint32_t value = 0;
+				if (!map.getCopy(key, value) || value != key * 2) numErrors++;
+				uint32_t otherKey = (key * 7919) % (NUM_THREADS * NUM_KEYS_PER_THREAD);
+				if (map.getCopy(otherKey, value) && value != otherKey * 2) numErrors++;
+			}
+			for (uint32_t j = 0; j < NUM_KEYS_PER_THREAD; j += 2) {
+				if (!map.remove(first + j)) numErrors++;
+			}
+		});
+	}
+	for (std::thread& thread : threads) thread.join();
+
+	REQUIRE(numErrors == 0);
+	REQUIRE(map.size() == NUM_THREADS * NUM_KEYS_PER_THREAD / 2);
+	bool allCorrect = true;
+	for (uint32_t key = 0; key < NUM_THREADS * NUM_KEYS_PER_THREAD; key++) {
+		uint32_t value = 0;
+		bool found = map.getCopy(key, value);
+		allCorrect = allCorrect && (found == ((key % 2) == 1));
+		allCorrect = allCorrect && (!found || value == key * 2);
+	}
+	REQUIRE(allCorrect);
+}
+
+TEST_CASE("ConcurrentHashMap: Racing emplace()", "[sfz::ConcurrentHashMap]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	// All threads attempt to insert the same keys, exactly one insertion per key should succeed
+	constexpr uint32_t NUM_THREADS = 8;
+	constexpr uint32_t NUM_KEYS = 10000;
+	ConcurrentHashMap<uint32_t, uint32_t> map;
+	map.create(0);
+
+	std::atomic<uint32_t> numInserted{0};
+	std::thread threads[NUM_THREADS];
+	for (uint32_t i = 0; i < NUM_THREADS; i++) {
+		threads[i] = std::thread([&, i]() {
+			for (uint32_t key = 0; key < NUM_KEYS; key++) {
+				if (map.emplace(key, i)) numInserted++;
+			}
+		});
+	}
+	for (std::thread& thread : threads) thread.join();
+
+	REQUIRE(numInserted == NUM_KEYS);
+	REQUIRE(map.size() == NUM_KEYS);
+}
+
+TEST_CASE("ConcurrentHashMap: Scaling benchmark", "[sfz::ConcurrentHashMap][.benchmark]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	// Compares against a single HashMap protected by one mutex. The workload is 90% lookups and
+	// 10% insertions over a fixed key range, a fixed total number of operations is divided
+	// evenly between the threads.
+	constexpr uint32_t NUM_KEYS = 1 << 16;
+	constexpr uint32_t NUM_OPS = 1 << 24;
+
+	struct LockedMap final {
+		std::mutex mutex;
+		HashMap<uint32_t, uint32_t> map;
+		bool getCopy(uint32_t key, uint32_t& valueOut)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			const uint32_t* value = map.get(key);
+			if (value == nullptr) return false;
+			valueOut = *value;
+			return true;
+		}
+		void put(uint32_t key, uint32_t value)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			map.put(key, value);
+		}
+	};
+
+	auto runBenchmark = [&](auto& map, uint32_t numThreads) {
+		std::thread threads[32];
+		std::atomic<uint32_t> numFound{0};
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < numThreads; i++) {
+			threads[i] = std::thread([&, i]() {
+				uint64_t rng = 0x9E3779B97F4A7C15ull * (i + 1);
+				uint32_t found = 0;
+				for (uint32_t j = 0; j < NUM_OPS / numThreads; j++) {
+					rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+					uint32_t key = uint32_t(rng >> 32) % NUM_KEYS;
+					uint32_t value = 0;
+					if ((rng & 0xFF) < 26) map.put(key, key);
+					else if (map.getCopy(key, value)) found += 1;
+				}
+				numFound += found;
+			});
+		}
+		for (uint32_t i = 0; i < numThreads; i++) threads[i].join();
+		auto after = std::chrono::high_resolution_clock::now();
+		REQUIRE(numFound > 0);
+		return std::chrono::duration<double, std::milli>(after - before).count();
+	};
+
+	for (uint32_t numThreads = 1; numThreads <= 32; numThreads *= 2) {
+		LockedMap lockedMap;
+		lockedMap.map.create(NUM_KEYS * 2);
+		ConcurrentHashMap<uint32_t, uint32_t> concurrentMap(NUM_KEYS * 2);
+		for (uint32_t key = 0; key < NUM_KEYS; key += 2) {
+			lockedMap.put(key, key);
+			concurrentMap.put(key, key);
+		}
+		double lockedMs = runBenchmark(lockedMap, numThreads);
+		double concurrentMs = runBenchmark(concurrentMap, numThreads);
+		SFZ_INFO("ConcurrentHashMap Benchmark",
+			"%u threads, %u ops: HashMap + mutex %.2f ms, ConcurrentHashMap %.2f ms",
+			numThreads, NUM_OPS, lockedMs, concurrentMs);
+	}
+}
@@ -471,3 +471,54 @@ TEST_CASE("Allocator bug", "[sfz::DynArray]")
 	}
 	REQUIRE(debugAlloc.numAllocations() == 0);
 }
+
+TEST_CASE("Adding more elements than growth rate", "[sfz::DynArray]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	uint32_t values[300];
+	for (uint32_t i = 0; i < 300; i++) values[i] = i;
+
+	DynArray<uint32_t> arr(0, getDefaultAllocator(), sfz_dbg(""));
+	arr.add(values, 300);
+	REQUIRE(arr.size() == 300);
+	REQUIRE(arr.capacity() >= 300);
+	for (uint32_t i = 0; i < 300; i++) REQUIRE(arr[i] == i);
+
+	arr.add(7u, 1000);
+	REQUIRE(arr.size() == 1300);
+	REQUIRE(arr.capacity() >= 1300);
+	REQUIRE(arr.last() == 7);
+}
+
+TEST_CASE("DynArray64", "[sfz::DynArray]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	static_assert(sizeof(DynArray64<uint32_t>) > sizeof(DynArray<uint32_t>), "");
+	static_assert(DynArray<uint32_t>::MAX_CAPACITY == DYNARRAY_MAX_CAPACITY, "");
+	static_assert(DynArray64<uint32_t>::MAX_CAPACITY == DYNARRAY64_MAX_CAPACITY, "");
+
+	DebugAllocator debugAlloc("DebugAlloc", 4u);
+	{
+		DynArray64<uint64_t> arr(0, &debugAlloc, sfz_dbg(""));
+		REQUIRE(arr.capacity() == 0);
+		for (uint64_t i = 0; i < 1000; i++) arr.add(i * 2);
+		uint64_t size = arr.size();
+		REQUIRE(size == 1000);
+		for (uint64_t i = 0; i < 1000; i++) REQUIRE(arr[i] == i * 2);
+
+		arr.insert(1, uint64_t(5));
+		REQUIRE(arr[1] == 5);
+		REQUIRE(arr[2] == 2);
+		arr.remove(0, 2);
+		REQUIRE(arr.size() == 999);
+		REQUIRE(arr.first() == 2);
+		REQUIRE(*arr.find([](uint64_t v) { return v == 100; }) == 100);
+
+		DynArray64<uint64_t> copy = arr;
+		REQUIRE(copy.size() == 999);
+		REQUIRE(copy.last() == 1998);
+	}
+	REQUIRE(debugAlloc.numAllocations() == 0);
+}
@@ -20,11 +20,16 @@
 #include "catch2/catch.hpp"
 #include "sfz/PopWarnings.hpp"
 
+#include <chrono>
+
+#include "sfz/Logging.hpp"
+#include "sfz/containers/DynArray.hpp"
 #include "sfz/containers/HashMap.hpp"
 #include "sfz/memory/DebugAllocator.hpp"
 #include "sfz/strings/DynString.hpp"
 #include "sfz/strings/StackString.hpp"
 #include "sfz/strings/StringHashers.hpp"
+#include "sfz/strings/StringID.hpp"
 
 using namespace sfz;
 
@@ -637,3 +642,855 @@ TEST_CASE("Perfect forwarding in put()", "[sfz::HashMap]")
 		REQUIRE(ptr->moved);
 	}
 }
+
+struct LastSlotHash {
+	size_t operator() (const int&)
+	{
+		return size_t(HashMap<int,int>::MIN_CAPACITY - 1);
+	}
+};
+
+struct LastSlotHashDescriptor final {
+	using KeyT = int;
+	using KeyHash = LastSlotHash;
+	using KeyEqual = std::equal_to<int>;
+
+	using AltKeyT = NO_ALT_KEY_TYPE;
+	using AltKeyHash = NO_ALT_KEY_TYPE;
+	using AltKeyKeyEqual = NO_ALT_KEY_TYPE;
+};
+
+// Value type which counts the number of times it has been constructed from arguments
+struct EmplaceTestValue {
+	static int numConstructed;
+	int a = 0;
+	float b = 0.0f;
+
+	EmplaceTestValue(int a, float b) : a(a), b(b) { numConstructed += 1; }
+	EmplaceTestValue(const EmplaceTestValue&) = delete;
+	EmplaceTestValue& operator= (const EmplaceTestValue&) = delete;
+	EmplaceTestValue(EmplaceTestValue&& other) noexcept : a(other.a), b(other.b) { }
+	EmplaceTestValue& operator= (EmplaceTestValue&&) = default;
+};
+int EmplaceTestValue::numConstructed = 0;
+
+TEST_CASE("HashMap: emplace()", "[sfz::HashMap]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	SECTION("Constructs in place only if key is missing") {
+		EmplaceTestValue::numConstructed = 0;
+		HashMap<int, EmplaceTestValue> m;
+
+		auto res = m.emplace(1, 2, 3.0f);
+		REQUIRE(res.inserted);
+		REQUIRE(res.value.a == 2);
+		REQUIRE(res.value.b == 3.0f);
+		REQUIRE(EmplaceTestValue::numConstructed == 1);
+		REQUIRE(m.size() == 1);
+
+		auto res2 = m.emplace(1, 4, 5.0f);
+		REQUIRE(!res2.inserted);
+		REQUIRE(&res2.value == m.get(1));
+		REQUIRE(res2.value.a == 2);
+		REQUIRE(EmplaceTestValue::numConstructed == 1);
+		REQUIRE(m.size() == 1);
+
+		for (int i = 0; i < 1000; i++) m.emplace(i, i, float(i));
+		REQUIRE(m.size() == 1000);
+		REQUIRE(EmplaceTestValue::numConstructed == 1000);
+		REQUIRE(m.get(1)->a == 2);
+		for (int i = 2; i < 1000; i++) REQUIRE(m.get(i)->a == i);
+	}
+	SECTION("Counting") {
+		HashMap<uint32_t, uint32_t> counts;
+		for (uint32_t i = 0; i < 10000; i++) {
+			auto res = counts.emplace(i % 97, 0u);
+			REQUIRE(res.inserted == (i < 97));
+			res.value += 1;
+		}
+		REQUIRE(counts.size() == 97);
+		for (uint32_t i = 0; i < 97; i++) {
+			REQUIRE(*counts.get(i) == (10000 / 97 + (i < (10000 % 97) ? 1 : 0)));
+		}
+	}
+	SECTION("Does not rehash if key exists") {
+		// Fill HashMap until the next insertion would trigger a rehash
+		HashMap<int, int> m(1);
+		const uint32_t capacity = m.capacity();
+		const int numKeys = int(capacity * HashMap<int, int>::MAX_OCCUPIED_REHASH_FACTOR) + 1;
+		for (int i = 0; i < numKeys; i++) m.put(i, i);
+		REQUIRE(m.capacity() == capacity);
+
+		for (int i = 0; i < numKeys; i++) {
+			auto res = m.emplace(i, -1);
+			REQUIRE(!res.inserted);
+			REQUIRE(res.value == i);
+			REQUIRE(m[i] == i);
+		}
+		REQUIRE(m.capacity() == capacity);
+
+		REQUIRE(m.emplace(numKeys, -1).inserted);
+		REQUIRE(m.capacity() > capacity);
+		for (int i = 0; i < numKeys; i++) REQUIRE(*m.get(i) == i);
+		REQUIRE(*m.get(numKeys) == -1);
+	}
+	SECTION("Perfect forwarding of key") {
+		HashMap<MoveTestStruct, int> m;
+		MoveTestStruct k = 2;
+		m.emplace(k, 3);
+		REQUIRE(!k.moved);
+		MoveTestStruct k2 = 4;
+		REQUIRE(m.emplace(std::move(k2), 5).inserted);
+		REQUIRE(k2.moved);
+		MoveTestStruct k3 = 2;
+		REQUIRE(!m.emplace(std::move(k3), 6).inserted);
+		REQUIRE(!k3.moved);
+		REQUIRE(*m.get(2) == 3);
+		REQUIRE(*m.get(4) == 5);
+	}
+	SECTION("Alt keys") {
+		HashMap<DynString, uint32_t> m;
+		REQUIRE(m.emplace("foo", 1u).inserted);
+		REQUIRE(!m.emplace("foo", 2u).inserted);
+		REQUIRE(m.emplace(DynString("bar"), 3u).inserted);
+		REQUIRE(*m.get("foo") == 1);
+		REQUIRE(*m.get("bar") == 3);
+		m["baz"] += 4;
+		m["baz"] += 4;
+		REQUIRE(*m.get("baz") == 8);
+	}
+	SECTION("Incremental rehash") {
+		HashMap<uint32_t, uint32_t> m;
+		m.setIncrementalRehash(true);
+		bool wasRehashing = false;
+		for (uint32_t round = 0; round < 3; round++) {
+			for (uint32_t i = 0; i < 5000; i++) {
+				auto res = m.emplace(i, 0u);
+				REQUIRE(res.inserted == (round == 0));
+				res.value += i;
+				wasRehashing = wasRehashing || m.isRehashing();
+			}
+		}
+		REQUIRE(wasRehashing);
+		REQUIRE(m.size() == 5000);
+		for (uint32_t i = 0; i < 5000; i++) REQUIRE(*m.get(i) == i * 3);
+	}
+}
+
+TEST_CASE("HashMap: Probing wraps around end of table", "[sfz::HashMap]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	HashMap<int,int,LastSlotHashDescriptor> m(1);
+	REQUIRE(m.capacity() == HashMap<int,int>::MIN_CAPACITY);
+
+	// All keys start probing at the last slot, so all but the first end up in the slots at the
+	// start of the table (found through the mirrored control bytes)
+	for (int i = 0; i < 40; i++) m.put(i, i * 2);
+	REQUIRE(m.capacity() == HashMap<int,int>::MIN_CAPACITY);
+	REQUIRE(m.size() == 40);
+	for (int i = 0; i < 40; i++) {
+		REQUIRE(m.get(i) != nullptr);
+		REQUIRE(*m.get(i) == i * 2);
+	}
+	REQUIRE(m.get(40) == nullptr);
+
+	// Remove elements in the wrapped around part and reinsert them
+	for (int i = 1; i < 20; i += 2) REQUIRE(m.remove(i));
+	REQUIRE(m.placeholders() == 10);
+	for (int i = 0; i < 40; i++) REQUIRE((m.get(i) != nullptr) == ((i % 2) == 0 || i >= 20));
+	for (int i = 1; i < 20; i += 2) m.put(i, i * 3);
+	REQUIRE(m.placeholders() == 0);
+	for (int i = 1; i < 20; i += 2) REQUIRE(*m.get(i) == i * 3);
+
+	uint32_t numPairs = 0;
+	for (auto pair : m) {
+		numPairs += 1;
+		REQUIRE(pair.value == pair.key * ((pair.key % 2) != 0 && pair.key < 20 ? 3 : 2));
+	}
+	REQUIRE(numPairs == 40);
+}
+
+template<typename Descr, typename SizeT = uint32_t>
+static void testRandomInsertionsAndRemovals()
+{
+	constexpr uint32_t NUM_KEYS = 4096;
+	bool reference[NUM_KEYS] = {};
+	uint32_t referenceSize = 0;
+
+	HashMap<uint32_t, uint32_t, Descr, SizeT> m;
+	uint32_t rng = 0x9E3779B9u;
+	for (uint32_t i = 0; i < 100000; i++) {
+		rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+		uint32_t key = rng % NUM_KEYS;
+		if ((rng >> 16) % 3 != 0) {
+			m.put(key, key * 7);
+			if (!reference[key]) referenceSize += 1;
+			reference[key] = true;
+		}
+		else {
+			REQUIRE(m.remove(key) == reference[key]);
+			if (reference[key]) referenceSize -= 1;
+			reference[key] = false;
+		}
+		REQUIRE(m.size() == referenceSize);
+		REQUIRE((m.size() + m.placeholders()) <= m.capacity());
+	}
+
+	for (uint32_t key = 0; key < NUM_KEYS; key++) {
+		const uint32_t* value = m.get(key);
+		REQUIRE((value != nullptr) == reference[key]);
+		if (value != nullptr) REQUIRE(*value == key * 7);
+	}
+	uint32_t numPairs = 0;
+	for (auto pair : m) {
+		REQUIRE(reference[pair.key]);
+		numPairs += 1;
+	}
+	REQUIRE(numPairs == referenceSize);
+}
+
+TEST_CASE("HashMap: Random insertions and removals", "[sfz::HashMap]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	SECTION("Prime capacity") {
+		testRandomInsertionsAndRemovals<HashTableKeyDescriptor<uint32_t>>();
+	}
+	SECTION("Power of two capacity") {
+		testRandomInsertionsAndRemovals<PowerOfTwoKeyDescriptor<uint32_t>>();
+	}
+	SECTION("Prime capacity, 64-bit sizes") {
+		testRandomInsertionsAndRemovals<HashTableKeyDescriptor<uint32_t>, uint64_t>();
+	}
+	SECTION("Power of two capacity, 64-bit sizes") {
+		testRandomInsertionsAndRemovals<PowerOfTwoKeyDescriptor<uint32_t>, uint64_t>();
+	}
+	SECTION("Cached hashes") {
+		testRandomInsertionsAndRemovals<CachedHashKeyDescriptor<uint32_t>>();
+	}
+	SECTION("Cached hashes, power of two capacity") {
+		testRandomInsertionsAndRemovals<
+			CachedHashKeyDescriptor<uint32_t, PowerOfTwoKeyDescriptor<uint32_t>>>();
+	}
+}
+
+TEST_CASE("HashMap: Power of two capacity", "[sfz::HashMap]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	SECTION("Capacity") {
+		HashMap<int, int, PowerOfTwoKeyDescriptor<int>> m;
+		REQUIRE(m.capacity() == 0);
+		m.rehash(1);
+		REQUIRE(m.capacity() == 64);
+		m.rehash(65);
+		REQUIRE(m.capacity() == 128);
+		for (int i = 0; i < 1000; i++) m.put(i, -i);
+		REQUIRE(m.capacity() == 2048);
+		REQUIRE((m.capacity() & (m.capacity() - 1)) == 0);
+		for (int i = 0; i < 1000; i++) REQUIRE(*m.get(i) == -i);
+	}
+	SECTION("StringID keys with identity hash") {
+		HashMap<StringID, uint32_t, PowerOfTwoKeyDescriptor<StringID>> m;
+		// Keys that would all map to the same slot if the hash was only masked
+		for (uint32_t i = 0; i < 1000; i++) m.put(StringID(uint64_t(i + 1) << 20), i);
+		REQUIRE(m.size() == 1000);
+		for (uint32_t i = 0; i < 1000; i++) REQUIRE(*m.get(StringID(uint64_t(i + 1) << 20)) == i);
+		REQUIRE(m.get(StringID(1)) == nullptr);
+	}
+	SECTION("DynString keys with alt key") {
+		HashMap<DynString, uint32_t, PowerOfTwoKeyDescriptor<DynString>> m;
+		for (uint32_t i = 0; i < 100; i++) {
+			DynString tmp("", 20);
+			tmp.printf("str%u", i);
+			m.put(tmp, i);
+		}
+		REQUIRE(m.size() == 100);
+		REQUIRE(m.get("str0") != nullptr);
+		REQUIRE(*m.get("str42") == 42);
+		REQUIRE(m.remove("str42"));
+		REQUIRE(m.get("str42") == nullptr);
+		m["str42"] = 43;
+		REQUIRE(*m.get(DynString("str42")) == 43);
+	}
+}
+
+TEST_CASE("HashMap: 64-bit sizes", "[sfz::HashMap]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	SECTION("Capacity policies") {
+		REQUIRE(PrimeCapacityPolicy::capacityFor<uint32_t>(1) == 67);
+		REQUIRE(PrimeCapacityPolicy::capacityFor<uint64_t>(1) == 67);
+		REQUIRE(PrimeCapacityPolicy::capacityFor<uint32_t>(UINT32_MAX) == 2147483659u);
+		REQUIRE(PrimeCapacityPolicy::capacityFor<uint64_t>(uint64_t(1) << 32) == 4294967311ull);
+		REQUIRE(PrimeCapacityPolicy::capacityFor<uint64_t>(UINT64_MAX) ==
+			PrimeCapacityPolicy::MAX_CAPACITY_64);
+
+		REQUIRE(PowerOfTwoCapacityPolicy::capacityFor<uint32_t>(UINT32_MAX) == 2147483648u);
+		REQUIRE(PowerOfTwoCapacityPolicy::capacityFor<uint64_t>(5000000000ull) ==
+			(uint64_t(1) << 33));
+		REQUIRE(PowerOfTwoCapacityPolicy::capacityFor<uint64_t>(UINT64_MAX) ==
+			PowerOfTwoCapacityPolicy::MAX_CAPACITY_64);
+
+		// Tables with more than 2^32 slots use all bits of the index
+		const uint64_t bigCapacity = uint64_t(1) << 40;
+		bool highBitSet = false;
+		for (uint64_t i = 0; i < 64; i++) {
+			uint64_t slot = PowerOfTwoCapacityPolicy::slotFromHash<uint64_t>(i, bigCapacity);
+			REQUIRE(slot < bigCapacity);
+			if (slot >= (uint64_t(1) << 32)) highBitSet = true;
+		}
+		REQUIRE(highBitSet);
+	}
+	SECTION("HashMap64") {
+		static_assert(sizeof(HashMap64<int, int>) > sizeof(HashMap<int, int>), "");
+		static_assert(
+			HashMap64<int, int>::MAX_CAPACITY == PrimeCapacityPolicy::MAX_CAPACITY_64, "");
+		static_assert(HashMap<int, int>::MAX_CAPACITY == PrimeCapacityPolicy::MAX_CAPACITY, "");
+
+		HashMap64<int, int> m;
+		for (int i = 0; i < 1000; i++) m.put(i, i * 3);
+		uint64_t size = m.size();
+		REQUIRE(size == 1000);
+		for (int i = 0; i < 1000; i += 2) REQUIRE(m.remove(i));
+		REQUIRE(m.size() == 500);
+		REQUIRE(m.placeholders() == 500);
+		for (int i = 0; i < 1000; i++) REQUIRE((m.get(i) != nullptr) == ((i % 2) != 0));
+		uint64_t numPairs = 0;
+		for (auto pair : m) {
+			REQUIRE(pair.value == pair.key * 3);
+			numPairs += 1;
+		}
+		REQUIRE(numPairs == 500);
+
+		HashMap64<DynString, int, PowerOfTwoKeyDescriptor<DynString>> strMap;
+		strMap.setIncrementalRehash(true);
+		for (int i = 0; i < 500; i++) {
+			DynString tmp("", 20);
+			tmp.printf("str%i", i);
+			strMap.put(tmp, i);
+		}
+		REQUIRE(strMap.size() == 500);
+		REQUIRE(*strMap.get("str123") == 123);
+		strMap.completeRehash();
+		REQUIRE((strMap.capacity() & (strMap.capacity() - 1)) == 0);
+		REQUIRE(*strMap.get("str499") == 499);
+	}
+}
+
+// Key descriptor for DynString which counts the number of hashes and key comparisons performed
+template<bool CacheHashes>
+struct CountingStringDescr final {
+	static uint32_t numHashes;
+	static uint32_t numCompares;
+
+	struct Hash final {
+		size_t operator() (const DynString& str) const noexcept
+		{
+			numHashes += 1;
+			return std::hash<DynString>()(str);
+		}
+	};
+	struct Equal final {
+		bool operator() (const DynString& lhs, const DynString& rhs) const noexcept
+		{
+			numCompares += 1;
+			return lhs == rhs;
+		}
+	};
+
+	using KeyT = DynString;
+	using KeyHash = Hash;
+	using KeyEqual = Equal;
+
+	using AltKeyT = NO_ALT_KEY_TYPE;
+	using AltKeyHash = NO_ALT_KEY_TYPE;
+	using AltKeyKeyEqual = NO_ALT_KEY_TYPE;
+
+	static constexpr bool CACHE_HASHES = CacheHashes;
+};
+template<bool CacheHashes> uint32_t CountingStringDescr<CacheHashes>::numHashes = 0;
+template<bool CacheHashes> uint32_t CountingStringDescr<CacheHashes>::numCompares = 0;
+
+TEST_CASE("HashMap: Cached hashes", "[sfz::HashMap]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	static_assert(!HashMap<DynString, int>::CACHE_HASHES, "");
+	static_assert(HashMap<DynString, int, CachedHashKeyDescriptor<DynString>>::CACHE_HASHES, "");
+	static_assert(HashMap<DynString, int, CachedHashKeyDescriptor<DynString,
+		PowerOfTwoKeyDescriptor<DynString>>>::CACHE_HASHES, "");
+	static_assert(HashMap<DynString, int, PowerOfTwoKeyDescriptor<DynString,
+		CachedHashKeyDescriptor<DynString>>>::CACHE_HASHES, "");
+
+	constexpr uint32_t NUM_KEYS = 5000;
+	DynArray<DynString> keys(NUM_KEYS, getDefaultAllocator(), sfz_dbg(""));
+	for (uint32_t i = 0; i < NUM_KEYS; i++) {
+		DynString tmp("", 20);
+		tmp.printf("key%u", i);
+		keys.add(std::move(tmp));
+	}
+	DynString missingKey("missing");
+
+	SECTION("Without cached hashes") {
+		using Descr = CountingStringDescr<false>;
+		Descr::numHashes = 0;
+		Descr::numCompares = 0;
+		HashMap<DynString, uint32_t, Descr> m;
+		for (uint32_t i = 0; i < NUM_KEYS; i++) m.put(keys[i], i);
+
+		// Keys are hashed again on rehash
+		REQUIRE(Descr::numHashes > NUM_KEYS);
+	}
+	SECTION("With cached hashes") {
+		using Descr = CountingStringDescr<true>;
+		Descr::numHashes = 0;
+		Descr::numCompares = 0;
+		HashMap<DynString, uint32_t, Descr> m;
+		for (uint32_t i = 0; i < NUM_KEYS; i++) m.put(keys[i], i);
+		REQUIRE(m.size() == NUM_KEYS);
+
+		// Each key is only hashed once, rehashes reuse the stored hashes. Keys are only compared
+		// when their hashes are equal, which never happens for new keys.
+		REQUIRE(Descr::numHashes == NUM_KEYS);
+		REQUIRE(Descr::numCompares == 0);
+
+		Descr::numHashes = 0;
+		for (uint32_t i = 0; i < NUM_KEYS; i++) REQUIRE(*m.get(keys[i]) == i);
+		REQUIRE(m.get(missingKey) == nullptr);
+		REQUIRE(Descr::numHashes == (NUM_KEYS + 1));
+		REQUIRE(Descr::numCompares == NUM_KEYS);
+
+		// Removing and rehashing
+		for (uint32_t i = 0; i < NUM_KEYS; i += 2) REQUIRE(m.remove(keys[i]));
+		Descr::numHashes = 0;
+		m.rehash(m.capacity() * 2);
+		REQUIRE(Descr::numHashes == 0);
+		for (uint32_t i = 0; i < NUM_KEYS; i++) {
+			const uint32_t* value = m.get(keys[i]);
+			REQUIRE((value != nullptr) == ((i % 2) != 0));
+			if (value != nullptr) REQUIRE(*value == i);
+		}
+
+		// Copies
+		HashMap<DynString, uint32_t, Descr> copy = m;
+		REQUIRE(copy.size() == (NUM_KEYS / 2));
+		for (uint32_t i = 1; i < NUM_KEYS; i += 2) REQUIRE(*copy.get(keys[i]) == i);
+	}
+	SECTION("Incremental rehash with cached hashes") {
+		using Descr = CountingStringDescr<true>;
+		Descr::numHashes = 0;
+		HashMap<DynString, uint32_t, Descr> m;
+		m.setIncrementalRehash(true);
+		for (uint32_t i = 0; i < NUM_KEYS; i++) m.put(keys[i], i);
+		m.completeRehash();
+		REQUIRE(Descr::numHashes == NUM_KEYS);
+		for (uint32_t i = 0; i < NUM_KEYS; i++) REQUIRE(*m.get(keys[i]) == i);
+	}
+	SECTION("Alt keys with cached hashes") {
+		HashMap<DynString, uint32_t, CachedHashKeyDescriptor<DynString>> m;
+		for (uint32_t i = 0; i < NUM_KEYS; i++) m.put(keys[i], i);
+		for (uint32_t i = 0; i < NUM_KEYS; i++) REQUIRE(*m.get(keys[i].str()) == i);
+		REQUIRE(m.get("missing") == nullptr);
+		REQUIRE(m.remove("key42"));
+		REQUIRE(m.get("key42") == nullptr);
+		m["key42"] = 43;
+		REQUIRE(*m.get(keys[42]) == 43);
+	}
+}
+
+// Returns the best time (in ms) out of a few runs of inserting all keys and then looking them up
+template<typename K, typename Descr>
+static double benchmarkHashMap(const DynArray<K>& keys, uint32_t numLookupRounds) noexcept
+{
+	double bestMs = 1e30;
+	for (uint32_t run = 0; run < 3; run++) {
+		auto before = std::chrono::high_resolution_clock::now();
+		HashMap<K, uint32_t, Descr> m;
+		for (uint32_t i = 0; i < keys.size(); i++) m.put(keys[i], i);
+		uint64_t sum = 0;
+		for (uint32_t round = 0; round < numLookupRounds; round++) {
+			for (uint32_t i = 0; i < keys.size(); i++) sum += *m.get(keys[i]);
+		}
+		auto after = std::chrono::high_resolution_clock::now();
+		uint64_t expectedSum = uint64_t(keys.size()) * (keys.size() - 1) / 2;
+		REQUIRE(sum == uint64_t(numLookupRounds) * expectedSum);
+		double ms = std::chrono::duration<double, std::milli>(after - before).count();
+		if (ms < bestMs) bestMs = ms;
+	}
+	return bestMs;
+}
+
+TEST_CASE("HashMap: Capacity policy benchmark", "[sfz::HashMap][.benchmark]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	constexpr uint32_t NUM_KEYS = 1 << 20;
+	constexpr uint32_t NUM_STRING_KEYS = 1 << 18;
+	constexpr uint32_t NUM_LOOKUP_ROUNDS = 4;
+
+	DynArray<uint32_t> intKeys(NUM_KEYS, getDefaultAllocator(), sfz_dbg(""));
+	DynArray<StringID> idKeys(NUM_KEYS, getDefaultAllocator(), sfz_dbg(""));
+	DynArray<DynString> stringKeys(NUM_STRING_KEYS, getDefaultAllocator(), sfz_dbg(""));
+	for (uint32_t i = 0; i < NUM_KEYS; i++) {
+		// Bijective scramble of i, so keys are unique but not a regular stride
+		uint32_t key = i * 0x9E3779B1u;
+		intKeys.add(key ^ (key >> 15));
+		DynString tmp("", 24);
+		tmp.printf("asset/key_%u", i);
+		idKeys.add(StringID(sfz::hash(tmp)));
+		if (i < NUM_STRING_KEYS) stringKeys.add(std::move(tmp));
+	}
+
+	double intPrime = benchmarkHashMap<uint32_t, HashTableKeyDescriptor<uint32_t>>(
+		intKeys, NUM_LOOKUP_ROUNDS);
+	double intPow2 = benchmarkHashMap<uint32_t, PowerOfTwoKeyDescriptor<uint32_t>>(
+		intKeys, NUM_LOOKUP_ROUNDS);
+	SFZ_INFO("HashMap Benchmark", "uint32_t keys (%u): prime %.2f ms, power of two %.2f ms",
+		NUM_KEYS, intPrime, intPow2);
+
+	double idPrime = benchmarkHashMap<StringID, HashTableKeyDescriptor<StringID>>(
+		idKeys, NUM_LOOKUP_ROUNDS);
+	double idPow2 = benchmarkHashMap<StringID, PowerOfTwoKeyDescriptor<StringID>>(
+		idKeys, NUM_LOOKUP_ROUNDS);
+	SFZ_INFO("HashMap Benchmark", "StringID keys (%u): prime %.2f ms, power of two %.2f ms",
+		NUM_KEYS, idPrime, idPow2);
+
+	double stringPrime = benchmarkHashMap<DynString, HashTableKeyDescriptor<DynString>>(
+		stringKeys, NUM_LOOKUP_ROUNDS);
+	double stringPow2 = benchmarkHashMap<DynString, PowerOfTwoKeyDescriptor<DynString>>(
+		stringKeys, NUM_LOOKUP_ROUNDS);
+	SFZ_INFO("HashMap Benchmark", "DynString keys (%u): prime %.2f ms, power of two %.2f ms",
+		NUM_STRING_KEYS, stringPrime, stringPow2);
+}
+
+TEST_CASE("HashMap: getBatch()", "[sfz::HashMap]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	SECTION("Integer keys") {
+		HashMap<uint32_t, uint32_t> m;
+		uint32_t* empty[3] = { nullptr, nullptr, nullptr };
+		const uint32_t emptyKeys[3] = { 1, 2, 3 };
+		m.getBatch(emptyKeys, 3, empty);
+		REQUIRE((empty[0] == nullptr && empty[1] == nullptr && empty[2] == nullptr));
+
+		for (uint32_t i = 0; i < 1000; i += 2) m.put(i, i * 3);
+
+		// More keys than a single chunk, and not a multiple of the chunk size
+		constexpr uint32_t NUM_KEYS = 100;
+		uint32_t keys[NUM_KEYS];
+		for (uint32_t i = 0; i < NUM_KEYS; i++) keys[i] = i * 7;
+		uint32_t* values[NUM_KEYS];
+		m.getBatch(keys, NUM_KEYS, values);
+		for (uint32_t i = 0; i < NUM_KEYS; i++) {
+			REQUIRE(values[i] == m.get(keys[i]));
+			if ((keys[i] % 2) == 0) REQUIRE(*values[i] == keys[i] * 3);
+			else REQUIRE(values[i] == nullptr);
+		}
+
+		const HashMap<uint32_t, uint32_t>& constRef = m;
+		const uint32_t* constValues[NUM_KEYS];
+		constRef.getBatch(keys, NUM_KEYS, constValues);
+		for (uint32_t i = 0; i < NUM_KEYS; i++) REQUIRE(constValues[i] == values[i]);
+	}
+	SECTION("Alt keys") {
+		HashMap<DynString, uint32_t> m;
+		m.put(DynString("foo"), 1);
+		m.put(DynString("bar"), 2);
+		const char* keys[3] = { "bar", "car", "foo" };
+		uint32_t* values[3];
+		m.getBatch(keys, 3, values);
+		REQUIRE(*values[0] == 2);
+		REQUIRE(values[1] == nullptr);
+		REQUIRE(*values[2] == 1);
+
+		const HashMap<DynString, uint32_t>& constRef = m;
+		const uint32_t* constValues[3];
+		constRef.getBatch(keys, 3, constValues);
+		REQUIRE(constValues[0] == values[0]);
+		REQUIRE(constValues[2] == values[2]);
+	}
+}
+
+TEST_CASE("HashMap: getBatch() benchmark", "[sfz::HashMap][.benchmark]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	// Table with 4M uint64_t keys and values, much larger than L2
+	constexpr uint32_t NUM_KEYS = 1 << 22;
+	constexpr uint32_t NUM_LOOKUPS = 1 << 22;
+	constexpr uint32_t BATCH_SIZE = 256;
+
+	HashMap<uint64_t, uint64_t, PowerOfTwoKeyDescriptor<uint64_t>> m;
+	for (uint32_t i = 0; i < NUM_KEYS; i++) m.put(uint64_t(i) * 0x9E3779B97F4A7C15ull, i);
+
+	DynArray<uint64_t> lookupKeys(NUM_LOOKUPS, getDefaultAllocator(), sfz_dbg(""));
+	uint32_t rng = 0x9E3779B9u;
+	for (uint32_t i = 0; i < NUM_LOOKUPS; i++) {
+		rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+		lookupKeys.add(uint64_t(rng % NUM_KEYS) * 0x9E3779B97F4A7C15ull);
+	}
+
+	auto before = std::chrono::high_resolution_clock::now();
+	uint64_t sumSingle = 0;
+	for (uint32_t i = 0; i < NUM_LOOKUPS; i++) sumSingle += *m.get(lookupKeys[i]);
+	auto middle = std::chrono::high_resolution_clock::now();
+	uint64_t sumBatch = 0;
+	uint64_t* values[BATCH_SIZE];
+	for (uint32_t i = 0; i < NUM_LOOKUPS; i += BATCH_SIZE) {
+		m.getBatch(lookupKeys.data() + i, BATCH_SIZE, values);
+		for (uint32_t j = 0; j < BATCH_SIZE; j++) sumBatch += *values[j];
+	}
+	auto after = std::chrono::high_resolution_clock::now();
+	REQUIRE(sumSingle == sumBatch);
+
+	SFZ_INFO("HashMap Benchmark", "%u lookups in %u elements: get() %.2f ms, getBatch() %.2f ms",
+		NUM_LOOKUPS, NUM_KEYS,
+		std::chrono::duration<double, std::milli>(middle - before).count(),
+		std::chrono::duration<double, std::milli>(after - middle).count());
+}
+
+TEST_CASE("HashMap: Incremental rehash", "[sfz::HashMap]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	DebugAllocator allocator("debug");
+	{
+		HashMap<uint32_t, DynString> m(0, &allocator);
+		m.setIncrementalRehash(true);
+		REQUIRE(m.incrementalRehash());
+
+		// Insert elements until a rehash is started
+		uint32_t numInserted = 0;
+		uint32_t oldCapacity = 0;
+		while (!m.isRehashing()) {
+			oldCapacity = m.capacity();
+			m.put(numInserted, DynString("value", 0, &allocator));
+			numInserted += 1;
+		}
+		REQUIRE(m.capacity() > oldCapacity);
+		REQUIRE(m.size() == numInserted);
+
+		// All elements are available while rehashing
+		for (uint32_t i = 0; i < numInserted; i++) REQUIRE(m.get(i) != nullptr);
+		uint32_t numPairs = 0;
+		for (auto pair : m) {
+			REQUIRE(pair.key < numInserted);
+			numPairs += 1;
+		}
+		REQUIRE(numPairs == numInserted);
+		uint32_t keys[3] = { 0, numInserted - 1, numInserted };
+		DynString* values[3];
+		m.getBatch(keys, 3, values);
+		REQUIRE(values[0] != nullptr);
+		REQUIRE(values[1] != nullptr);
+		REQUIRE(values[2] == nullptr);
+
+		// Overwrite and remove elements which may still be in the old table
+		m.put(numInserted - 1, DynString("overwritten", 0, &allocator));
+		REQUIRE(*m.get(numInserted - 1) == "overwritten");
+		const uint32_t removedKey = numInserted - 2;
+		REQUIRE(m.remove(removedKey));
+		REQUIRE(!m.remove(removedKey));
+		REQUIRE(m.size() == numInserted - 1);
+
+		// Copying during rehash copies all elements
+		{
+			HashMap<uint32_t, DynString> copy = m;
+			REQUIRE(copy.size() == m.size());
+			REQUIRE(*copy.get(numInserted - 1) == "overwritten");
+			REQUIRE(copy.get(removedKey) == nullptr);
+		}
+
+		// Each mutating operation migrates some elements, eventually rehashing is complete
+		uint32_t numOps = 0;
+		while (m.isRehashing()) {
+			m.put(numInserted, DynString("value", 0, &allocator));
+			numInserted += 1;
+			numOps += 1;
+		}
+		constexpr uint32_t SLOTS_PER_STEP =
+			HashMap<uint32_t, DynString>::INCREMENTAL_REHASH_SLOTS_PER_STEP;
+		REQUIRE(numOps <= (oldCapacity / SLOTS_PER_STEP));
+		REQUIRE(m.size() == numInserted - 1);
+		for (uint32_t i = 0; i < numInserted; i++) {
+			REQUIRE((m.get(i) != nullptr) == (i != removedKey));
+		}
+
+		// Clear and destroy in the middle of a rehash
+		while (!m.isRehashing()) {
+			m.put(numInserted, DynString("value", 0, &allocator));
+			numInserted += 1;
+		}
+		m.clear();
+		REQUIRE(!m.isRehashing());
+		REQUIRE(m.size() == 0);
+		REQUIRE(m.get(0) == nullptr);
+		for (uint32_t i = 0; !m.isRehashing(); i++) m.put(i, DynString("value", 0, &allocator));
+		REQUIRE(m.size() > 0);
+		m.destroy();
+		REQUIRE(!m.isRehashing());
+	}
+	REQUIRE(allocator.numAllocations() == 0);
+}
+
+TEST_CASE("HashMap: Incremental rehash random operations", "[sfz::HashMap]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	constexpr uint32_t NUM_KEYS = 8192;
+	bool reference[NUM_KEYS] = {};
+	uint32_t referenceSize = 0;
+
+	HashMap<uint32_t, uint32_t> m;
+	m.setIncrementalRehash(true);
+	uint32_t numRehashesStarted = 0;
+	uint32_t rng = 0x9E3779B9u;
+	for (uint32_t i = 0; i < 200000; i++) {
+		rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+		uint32_t key = rng % NUM_KEYS;
+		bool wasRehashing = m.isRehashing();
+		if ((rng >> 16) % 4 != 0) {
+			m.put(key, key * 7);
+			if (!reference[key]) referenceSize += 1;
+			reference[key] = true;
+		}
+		else {
+			REQUIRE(m.remove(key) == reference[key]);
+			if (reference[key]) referenceSize -= 1;
+			reference[key] = false;
+		}
+		if (!wasRehashing && m.isRehashing()) numRehashesStarted += 1;
+		REQUIRE(m.size() == referenceSize);
+		if ((i % 1024) == 0) {
+			for (uint32_t k = 0; k < NUM_KEYS; k++) {
+				const uint32_t* value = m.get(k);
+				REQUIRE((value != nullptr) == reference[k]);
+				if (value != nullptr) REQUIRE(*value == k * 7);
+			}
+		}
+	}
+	REQUIRE(numRehashesStarted > 0);
+
+	m.setIncrementalRehash(false);
+	REQUIRE(!m.isRehashing());
+	uint32_t numPairs = 0;
+	for (auto pair : m) {
+		REQUIRE(reference[pair.key]);
+		REQUIRE(pair.value == pair.key * 7);
+		numPairs += 1;
+	}
+	REQUIRE(numPairs == referenceSize);
+}
+
+TEST_CASE("HashMap: Incremental rehash benchmark", "[sfz::HashMap][.benchmark]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	constexpr uint32_t NUM_KEYS = 1 << 22;
+
+	auto runBenchmark = [](bool incremental, double& totalMsOut, double& worstMsOut) {
+		HashMap<uint64_t, uint64_t> m;
+		m.setIncrementalRehash(incremental);
+		totalMsOut = 0.0;
+		worstMsOut = 0.0;
+		for (uint32_t i = 0; i < NUM_KEYS; i++) {
+			auto before = std::chrono::high_resolution_clock::now();
+			m.put(uint64_t(i) * 0x9E3779B97F4A7C15ull, i);
+			auto after = std::chrono::high_resolution_clock::now();
+			double ms = std::chrono::duration<double, std::milli>(after - before).count();
+			totalMsOut += ms;
+			if (ms > worstMsOut) worstMsOut = ms;
+		}
+	};
+
+	double fullTotalMs = 0.0, fullWorstMs = 0.0;
+	runBenchmark(false, fullTotalMs, fullWorstMs);
+	double incrTotalMs = 0.0, incrWorstMs = 0.0;
+	runBenchmark(true, incrTotalMs, incrWorstMs);
+	SFZ_INFO("HashMap Benchmark",
+		"%u insertions: full rehash %.2f ms (worst put() %.3f ms), incremental rehash %.2f ms "
+		"(worst put() %.3f ms)", NUM_KEYS, fullTotalMs, fullWorstMs, incrTotalMs, incrWorstMs);
+}
+
+TEST_CASE("HashMap: emplace() benchmark", "[sfz::HashMap][.benchmark]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	// Roughly half of the samples are new keys, which get() + put() probes for twice
+	constexpr uint32_t NUM_SAMPLES = 1 << 22;
+	constexpr uint32_t NUM_DISTINCT_KEYS = 1 << 21;
+
+	DynArray<uint64_t> samples(NUM_SAMPLES, getDefaultAllocator(), sfz_dbg(""));
+	uint64_t rng = 0x9E3779B97F4A7C15ull;
+	for (uint32_t i = 0; i < NUM_SAMPLES; i++) {
+		rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+		samples.add((rng % NUM_DISTINCT_KEYS) * 0x9E3779B97F4A7C15ull);
+	}
+
+	// Counts the number of occurences of each sample, returns the best time out of a few runs
+	auto runBenchmark = [&](auto countFunc) {
+		double bestMs = 1e30;
+		for (uint32_t run = 0; run < 3; run++) {
+			HashMap<uint64_t, uint32_t> counts;
+			auto before = std::chrono::high_resolution_clock::now();
+			for (uint64_t sample : samples) countFunc(counts, sample);
+			auto after = std::chrono::high_resolution_clock::now();
+			REQUIRE(counts.size() <= NUM_DISTINCT_KEYS);
+			double ms = std::chrono::duration<double, std::milli>(after - before).count();
+			if (ms < bestMs) bestMs = ms;
+		}
+		return bestMs;
+	};
+
+	double getPutMs = runBenchmark([](HashMap<uint64_t, uint32_t>& counts, uint64_t sample) {
+		uint32_t* count = counts.get(sample);
+		if (count != nullptr) *count += 1;
+		else counts.put(sample, 1);
+	});
+	double emplaceMs = runBenchmark([](HashMap<uint64_t, uint32_t>& counts, uint64_t sample) {
+		counts.emplace(sample, 0u).value += 1;
+	});
+	SFZ_INFO("HashMap Benchmark", "Counting %u samples: get() + put() %.2f ms, emplace() %.2f ms",
+		NUM_SAMPLES, getPutMs, emplaceMs);
+}
+
+TEST_CASE("HashMap: Cached hashes benchmark", "[sfz::HashMap][.benchmark]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	constexpr uint32_t NUM_KEYS = 1 << 20;
+	DynArray<DynString> keys(NUM_KEYS, getDefaultAllocator(), sfz_dbg(""));
+	for (uint32_t i = 0; i < NUM_KEYS; i++) {
+		DynString tmp("", 64);
+		tmp.printf("assets/textures/environment/material_%08u_albedo.png", i);
+		keys.add(std::move(tmp));
+	}
+
+	// Returns the time of inserting all keys (including rehashes) and of looking them all up
+	auto runBenchmark = [&](auto& m, double& insertMsOut, double& lookupMsOut) {
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < NUM_KEYS; i++) m.put(keys[i], i);
+		auto middle = std::chrono::high_resolution_clock::now();
+		uint64_t sum = 0;
+		for (uint32_t i = 0; i < NUM_KEYS; i++) sum += *m.get(keys[i].str());
+		auto after = std::chrono::high_resolution_clock::now();
+		REQUIRE(sum == uint64_t(NUM_KEYS) * (NUM_KEYS - 1) / 2);
+		insertMsOut = std::chrono::duration<double, std::milli>(middle - before).count();
+		lookupMsOut = std::chrono::duration<double, std::milli>(after - middle).count();
+	};
+
+	HashMap<DynString, uint32_t> normal;
+	double normalInsertMs = 0.0, normalLookupMs = 0.0;
+	runBenchmark(normal, normalInsertMs, normalLookupMs);
+	HashMap<DynString, uint32_t, CachedHashKeyDescriptor<DynString>> cached;
+	double cachedInsertMs = 0.0, cachedLookupMs = 0.0;
+	runBenchmark(cached, cachedInsertMs, cachedLookupMs);
+	SFZ_INFO("HashMap Benchmark",
+		"%u string keys: insert %.2f ms, lookup %.2f ms. With cached hashes: insert %.2f ms, "
+		"lookup %.2f ms", NUM_KEYS, normalInsertMs, normalLookupMs, cachedInsertMs, cachedLookupMs);
+}
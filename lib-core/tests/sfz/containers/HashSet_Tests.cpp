@@ -0,0 +1,227 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/PushWarnings.hpp"
+#include "catch2/catch.hpp"
+#include "sfz/PopWarnings.hpp"
+
+#include <chrono>
+
+#include "sfz/Logging.hpp"
+#include "sfz/containers/DynArray.hpp"
+#include "sfz/containers/HashMap.hpp"
+#include "sfz/containers/HashSet.hpp"
+#include "sfz/memory/DebugAllocator.hpp"
+#include "sfz/strings/DynString.hpp"
+#include "sfz/strings/StringHashers.hpp"
+
+using namespace sfz;
+
+TEST_CASE("HashSet: No value storage", "[sfz::HashSet]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	static_assert(!HashSet<uint64_t>::MapT::HAS_VALUES, "");
+	static_assert(HashMap<uint64_t, uint8_t>::HAS_VALUES, "");
+
+	// Returns the number of bytes currently allocated by a DebugAllocator
+	auto bytesAllocated = [](DebugAllocator& alloc) {
+		uint32_t numAllocations = 0;
+		DebugAllocationInfo* infos = alloc.allocations(&numAllocations);
+		uint64_t bytes = 0;
+		for (uint32_t i = 0; i < numAllocations; i++) bytes += infos[i].size;
+		alloc.deallocate(infos);
+		return bytes;
+	};
+
+	DebugAllocator setAlloc("SetAlloc", 4u);
+	DebugAllocator mapAlloc("MapAlloc", 4u);
+	{
+		HashSet<uint64_t> set(0, &setAlloc);
+		HashMap<uint64_t, uint8_t> map(0, &mapAlloc);
+		for (uint64_t i = 0; i < 1000; i++) {
+			REQUIRE(set.add(i));
+			map.put(i, 1);
+		}
+		REQUIRE(set.capacity() == map.capacity());
+
+		// The set should only allocate control bytes and keys
+		uint64_t setBytes = bytesAllocated(setAlloc);
+		uint64_t mapBytes = bytesAllocated(mapAlloc);
+		REQUIRE(setBytes < mapBytes);
+		REQUIRE(setBytes < (set.capacity() * (sizeof(uint64_t) + 1) + 128));
+	}
+	REQUIRE(setAlloc.numAllocations() == 0);
+	REQUIRE(mapAlloc.numAllocations() == 0);
+}
+
+TEST_CASE("HashSet: Adding, checking and removing keys", "[sfz::HashSet]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	HashSet<int> set;
+	REQUIRE(set.size() == 0);
+	REQUIRE(set.capacity() == 0);
+	REQUIRE(set.allocator() == nullptr);
+	REQUIRE(!set.contains(0));
+	REQUIRE(!set.remove(0));
+
+	for (int i = 0; i < 500; i++) REQUIRE(set.add(i * 3));
+	for (int i = 0; i < 500; i++) REQUIRE(!set.add(i * 3));
+	REQUIRE(set.size() == 500);
+	REQUIRE(set.allocator() == getDefaultAllocator());
+	for (int i = 0; i < 1500; i++) REQUIRE(set.contains(i) == ((i % 3) == 0));
+
+	for (int i = 0; i < 500; i += 2) REQUIRE(set.remove(i * 3));
+	REQUIRE(set.size() == 250);
+	REQUIRE(set.placeholders() == 250);
+	for (int i = 0; i < 500; i++) REQUIRE(set.contains(i * 3) == ((i % 2) != 0));
+
+	int numKeys = 0;
+	for (int key : set) {
+		REQUIRE((key % 6) == 3);
+		numKeys += 1;
+	}
+	REQUIRE(numKeys == 250);
+
+	HashSet<int> moved = std::move(set);
+	REQUIRE(moved.size() == 250);
+	REQUIRE(set.size() == 0);
+	moved.clear();
+	REQUIRE(moved.size() == 0);
+	REQUIRE(moved.begin() == moved.end());
+}
+
+TEST_CASE("HashSet: Alt keys", "[sfz::HashSet]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	HashSet<DynString> set;
+	REQUIRE(set.add("foo"));
+	REQUIRE(!set.add(DynString("foo")));
+	REQUIRE(set.add(DynString("bar")));
+	REQUIRE(set.contains("foo"));
+	REQUIRE(set.contains(DynString("bar")));
+	REQUIRE(!set.contains("baz"));
+	REQUIRE(set.remove("foo"));
+	REQUIRE(!set.contains("foo"));
+	REQUIRE(set.size() == 1);
+}
+
+TEST_CASE("HashSet: Set operations", "[sfz::HashSet]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	// a = multiples of 2 in [0, 1000), b = multiples of 3 in [0, 1000)
+	HashSet<uint32_t> a, b;
+	for (uint32_t i = 0; i < 1000; i += 2) a.add(i);
+	for (uint32_t i = 0; i < 1000; i += 3) b.add(i);
+
+	auto checkSet = [](const HashSet<uint32_t>& set, auto shouldContain) {
+		uint32_t expectedSize = 0;
+		for (uint32_t i = 0; i < 1000; i++) {
+			REQUIRE(set.contains(i) == shouldContain(i));
+			if (shouldContain(i)) expectedSize += 1;
+		}
+		REQUIRE(set.size() == expectedSize);
+	};
+	auto inUnion = [](uint32_t i) { return (i % 2) == 0 || (i % 3) == 0; };
+	auto inIntersection = [](uint32_t i) { return (i % 6) == 0; };
+	auto inAMinusB = [](uint32_t i) { return (i % 2) == 0 && (i % 3) != 0; };
+	auto inBMinusA = [](uint32_t i) { return (i % 3) == 0 && (i % 2) != 0; };
+
+	SECTION("Returning new sets") {
+		checkSet(HashSet<uint32_t>::setUnion(a, b), inUnion);
+		checkSet(HashSet<uint32_t>::setUnion(b, a), inUnion);
+		checkSet(HashSet<uint32_t>::setIntersection(a, b), inIntersection);
+		checkSet(HashSet<uint32_t>::setIntersection(b, a), inIntersection);
+		checkSet(HashSet<uint32_t>::setDifference(a, b), inAMinusB);
+		checkSet(HashSet<uint32_t>::setDifference(b, a), inBMinusA);
+
+		// Inputs are not modified
+		REQUIRE(a.size() == 500);
+		REQUIRE(b.size() == 334);
+
+		HashSet<uint32_t> empty;
+		REQUIRE(HashSet<uint32_t>::setUnion(a, empty).size() == 500);
+		REQUIRE(HashSet<uint32_t>::setIntersection(empty, a).size() == 0);
+		REQUIRE(HashSet<uint32_t>::setDifference(a, empty).size() == 500);
+		REQUIRE(HashSet<uint32_t>::setDifference(empty, a).size() == 0);
+	}
+	SECTION("addAll()") {
+		a.addAll(b);
+		checkSet(a, inUnion);
+		b.addAll(HashSet<uint32_t>());
+		REQUIRE(b.size() == 334);
+	}
+	SECTION("retainAll()") {
+		a.retainAll(b);
+		checkSet(a, inIntersection);
+		b.retainAll(HashSet<uint32_t>());
+		REQUIRE(b.size() == 0);
+	}
+	SECTION("removeAll()") {
+		HashSet<uint32_t> aCopy = a;
+		a.removeAll(b);
+		checkSet(a, inAMinusB);
+		b.removeAll(aCopy);
+		checkSet(b, inBMinusA);
+	}
+	SECTION("During incremental rehash") {
+		HashSet<uint32_t> c;
+		c.setIncrementalRehash(true);
+		for (uint32_t i = 0; i < 1000; i += 2) c.add(i);
+		c.retainAll(b);
+		checkSet(c, inIntersection);
+	}
+}
+
+TEST_CASE("HashSet: Benchmark", "[sfz::HashSet][.benchmark]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	constexpr uint32_t NUM_KEYS = 1 << 22;
+	constexpr uint32_t NUM_LOOKUPS = 1 << 24;
+	DynArray<uint64_t> lookups(NUM_LOOKUPS, getDefaultAllocator(), sfz_dbg(""));
+	uint64_t rng = 0x9E3779B97F4A7C15ull;
+	for (uint32_t i = 0; i < NUM_LOOKUPS; i++) {
+		rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+		lookups.add(rng % (NUM_KEYS * 2));
+	}
+
+	// Returns the time of looking up all keys, about half of them are in the set
+	auto runBenchmark = [&](auto containsFunc) {
+		auto before = std::chrono::high_resolution_clock::now();
+		uint32_t numFound = 0;
+		for (uint64_t key : lookups) numFound += containsFunc(key) ? 1 : 0;
+		auto after = std::chrono::high_resolution_clock::now();
+		REQUIRE(numFound > 0);
+		return std::chrono::duration<double, std::milli>(after - before).count();
+	};
+
+	HashMap<uint64_t, bool> map;
+	HashSet<uint64_t> set;
+	for (uint64_t i = 0; i < NUM_KEYS; i++) {
+		map.put(i * 2, true);
+		set.add(i * 2);
+	}
+	double mapMs = runBenchmark([&](uint64_t key) { return map.get(key) != nullptr; });
+	double setMs = runBenchmark([&](uint64_t key) { return set.contains(key); });
+	SFZ_INFO("HashSet Benchmark", "%u lookups: HashMap<K, bool> %.2f ms, HashSet<K> %.2f ms",
+		NUM_LOOKUPS, mapMs, setMs);
+}
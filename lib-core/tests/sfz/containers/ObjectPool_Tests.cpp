@@ -0,0 +1,157 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/PushWarnings.hpp"
+#include "catch2/catch.hpp"
+#include "sfz/PopWarnings.hpp"
+
+#include "sfz/Context.hpp"
+#include "sfz/containers/ObjectPool.hpp"
+#include "sfz/memory/DebugAllocator.hpp"
+#include "sfz/memory/SmartPointers.hpp"
+
+using namespace sfz;
+
+TEST_CASE("ObjectPool: Handles", "[sfz::ObjectPool]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	PoolHandle nullHandle;
+	REQUIRE(nullHandle.isNull());
+	PoolHandle handle(3, 7);
+	REQUIRE(handle.idx() == 3);
+	REQUIRE(handle.generation() == 7);
+	REQUIRE(!handle.isNull());
+	REQUIRE(handle == PoolHandle(3, 7));
+	REQUIRE(handle != PoolHandle(3, 8));
+
+	ObjectPool<uint32_t> pool;
+	REQUIRE(pool.size() == 0);
+	REQUIRE(pool.capacity() == 0);
+	REQUIRE(pool.allocator() == nullptr);
+	REQUIRE(!pool.isValid(nullHandle));
+	REQUIRE(pool.get(nullHandle) == nullptr);
+}
+
+TEST_CASE("ObjectPool: Add, get and remove", "[sfz::ObjectPool]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	ObjectPool<uint32_t> pool(0, getDefaultAllocator(), sfz_dbg(""));
+	REQUIRE(pool.allocator() == getDefaultAllocator());
+
+	PoolHandle h0 = pool.add(0u);
+	PoolHandle h1 = pool.add(1u);
+	PoolHandle h2 = pool.emplace(2u);
+	REQUIRE(pool.size() == 3);
+	REQUIRE(pool.numSlots() == 3);
+	REQUIRE(*pool.get(h0) == 0);
+	REQUIRE(*pool.get(h1) == 1);
+	REQUIRE(*pool.get(h2) == 2);
+
+	// Removing swaps last object into place, handles stay valid
+	REQUIRE(pool.remove(h0));
+	REQUIRE(!pool.isValid(h0));
+	REQUIRE(pool.get(h0) == nullptr);
+	REQUIRE(!pool.remove(h0));
+	REQUIRE(pool.size() == 2);
+	REQUIRE(pool.data()[0] == 2);
+	REQUIRE(pool.data()[1] == 1);
+	REQUIRE(*pool.get(h1) == 1);
+	REQUIRE(*pool.get(h2) == 2);
+	REQUIRE(pool.handleAt(0) == h2);
+	REQUIRE(pool.handleAt(1) == h1);
+
+	// Slot is reused with a new generation, old handle stays invalid
+	PoolHandle h3 = pool.add(3u);
+	REQUIRE(h3.idx() == h0.idx());
+	REQUIRE(h3.generation() == h0.generation() + 1);
+	REQUIRE(pool.numSlots() == 3);
+	REQUIRE(!pool.isValid(h0));
+	REQUIRE(*pool.get(h3) == 3);
+
+	// Handle from outside the slot table
+	REQUIRE(!pool.isValid(PoolHandle(100, 1)));
+
+	// Iteration over dense array
+	uint32_t sum = 0;
+	for (uint32_t val : pool) sum += val;
+	REQUIRE(sum == 6);
+
+	pool.clear();
+	REQUIRE(pool.size() == 0);
+	REQUIRE(!pool.isValid(h1));
+	REQUIRE(!pool.isValid(h2));
+	REQUIRE(!pool.isValid(h3));
+}
+
+TEST_CASE("ObjectPool: Many objects", "[sfz::ObjectPool]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	ObjectPool<uint64_t> pool(16, getDefaultAllocator(), sfz_dbg(""));
+	DynArray<PoolHandle> handles(0, getDefaultAllocator(), sfz_dbg(""));
+	DynArray<uint64_t> values(0, getDefaultAllocator(), sfz_dbg(""));
+
+	uint32_t rng = 1337;
+	bool allCorrect = true;
+	for (uint64_t i = 0; i < 20000; i++) {
+		rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+		if (handles.size() > 0 && (rng % 3) == 0) {
+			uint32_t idx = (rng >> 8) % handles.size();
+			allCorrect = allCorrect && pool.remove(handles[idx]);
+			allCorrect = allCorrect && !pool.isValid(handles[idx]);
+			handles.removeQuickSwap(idx);
+			values.removeQuickSwap(idx);
+		}
+		else {
+			handles.add(pool.add(i));
+			values.add(i);
+		}
+	}
+	REQUIRE(allCorrect);
+	REQUIRE(pool.size() == handles.size());
+	for (uint32_t i = 0; i < handles.size(); i++) {
+		REQUIRE(*pool.get(handles[i]) == values[i]);
+	}
+	for (uint32_t i = 0; i < pool.size(); i++) {
+		REQUIRE(*pool.get(pool.handleAt(i)) == pool.data()[i]);
+	}
+}
+
+TEST_CASE("ObjectPool: Move only objects", "[sfz::ObjectPool]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	DebugAllocator allocator("ObjectPool Test Allocator");
+	{
+		ObjectPool<UniquePtr<uint32_t>> pool(0, &allocator, sfz_dbg(""));
+		PoolHandle h0 = pool.emplace(allocator.newObject<uint32_t>(sfz_dbg(""), 0u), &allocator);
+		PoolHandle h1 = pool.emplace(allocator.newObject<uint32_t>(sfz_dbg(""), 1u), &allocator);
+		REQUIRE(**pool.get(h0) == 0);
+		REQUIRE(**pool.get(h1) == 1);
+		pool.remove(h0);
+		REQUIRE(**pool.get(h1) == 1);
+
+		ObjectPool<UniquePtr<uint32_t>> moved = std::move(pool);
+		REQUIRE(pool.size() == 0);
+		REQUIRE(moved.size() == 1);
+		REQUIRE(**moved.get(h1) == 1);
+	}
+	REQUIRE(allocator.numAllocations() == 0);
+}
@@ -74,3 +74,30 @@ TEST_CASE("Basic new and delete tests", "[sfz::StandardAllocator]")
 	getDefaultAllocator()->deleteObject(ptr);
 	REQUIRE(flag == 2);
 }
+
+TEST_CASE("Reallocate", "[sfz::StandardAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+	Allocator* allocator = getDefaultAllocator();
+
+	const uint64_t alignments[] = { 8, 16, 32, 64, 4096 };
+	for (uint64_t alignment : alignments) {
+		uint8_t* ptr = (uint8_t*)allocator->reallocate(sfz_dbg(""), nullptr, 0, 100, alignment);
+		REQUIRE(ptr != nullptr);
+		REQUIRE(isAligned(ptr, alignment));
+		for (uint32_t i = 0; i < 100; i++) ptr[i] = uint8_t(i);
+
+		uint64_t size = 100;
+		for (uint32_t i = 0; i < 10; i++) {
+			uint64_t newSize = size * 3;
+			ptr = (uint8_t*)allocator->reallocate(sfz_dbg(""), ptr, size, newSize, alignment);
+			REQUIRE(ptr != nullptr);
+			REQUIRE(isAligned(ptr, alignment));
+			size = newSize;
+		}
+		bool correct = true;
+		for (uint32_t i = 0; i < 100; i++) correct = correct && ptr[i] == uint8_t(i);
+		REQUIRE(correct);
+		allocator->deallocate(ptr);
+	}
+}
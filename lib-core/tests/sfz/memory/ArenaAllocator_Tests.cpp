@@ -20,8 +20,11 @@
 #include "catch2/catch.hpp"
 #include "sfz/PopWarnings.hpp"
 
+#include <thread>
+
 #include "sfz/Context.hpp"
 #include "sfz/Logging.hpp"
+#include "sfz/containers/DynArray.hpp"
 #include "sfz/memory/ArenaAllocator.hpp"
 #include "sfz/memory/MemoryUtils.hpp"
 
@@ -86,3 +89,227 @@ TEST_CASE("ArenaAllocator: Stack based memory", "[sfz::ArenaAllocator]")
 	REQUIRE(arena.numPaddingBytes() == 4);
 	REQUIRE(largeAligned == (uint32_t*)&memoryHeap[8]);
 }
+
+#ifndef __EMSCRIPTEN__
+TEST_CASE("ArenaAllocator: Virtual memory", "[sfz::ArenaAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	// Reserve 64 GiB of address space, commit in 1 MiB steps, keep 2 MiB committed on reset
+	constexpr uint64_t MiB = 1024 * 1024;
+	constexpr uint64_t RESERVE_SIZE = uint64_t(64) * 1024 * MiB;
+	ArenaAllocator arena;
+	REQUIRE(arena.initVirtual(RESERVE_SIZE, MiB, 2 * MiB));
+	REQUIRE(arena.isVirtual());
+	REQUIRE(arena.capacity() == RESERVE_SIZE);
+	REQUIRE(arena.numBytesAllocated() == 0);
+	REQUIRE(arena.numBytesCommitted() == 0);
+
+	// Allocations commit memory in steps
+	uint8_t* first = (uint8_t*)arena.allocate(sfz_dbg(""), 16);
+	REQUIRE(first != nullptr);
+	REQUIRE(isAligned(first, 32));
+	REQUIRE(arena.numBytesCommitted() == MiB);
+	first[0] = 1;
+	first[15] = 2;
+
+	uint8_t* second = (uint8_t*)arena.allocate(sfz_dbg(""), 3 * MiB);
+	REQUIRE(second != nullptr);
+	REQUIRE(second == first + 32);
+	REQUIRE(arena.numBytesAllocated() == 32 + 3 * MiB);
+	REQUIRE(arena.numPaddingBytes() == 16);
+	REQUIRE(arena.numBytesCommitted() == 4 * MiB);
+	for (uint64_t i = 0; i < 3 * MiB; i += 4096) second[i] = uint8_t(i);
+	second[3 * MiB - 1] = 3;
+	REQUIRE(first[0] == 1);
+	REQUIRE(first[15] == 2);
+
+	// Reset decommits memory above the watermark
+	arena.reset();
+	REQUIRE(arena.numBytesAllocated() == 0);
+	REQUIRE(arena.numPaddingBytes() == 0);
+	REQUIRE(arena.numBytesCommitted() == 2 * MiB);
+
+	// Memory can be reused after reset
+	uint8_t* third = (uint8_t*)arena.allocate(sfz_dbg(""), 5 * MiB, 64);
+	REQUIRE(third == first);
+	REQUIRE(arena.numBytesCommitted() == 5 * MiB);
+	third[5 * MiB - 1] = 4;
+
+	arena.destroy();
+	REQUIRE(!arena.isVirtual());
+	REQUIRE(arena.capacity() == 0);
+	REQUIRE(arena.numBytesCommitted() == 0);
+}
+#endif
+
+TEST_CASE("ArenaAllocator: Checkpoints", "[sfz::ArenaAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	constexpr uint64_t MEMORY_HEAP_SIZE = 256;
+	alignas(64) uint8_t memoryHeap[MEMORY_HEAP_SIZE];
+	ArenaAllocator arena;
+	arena.init(memoryHeap, MEMORY_HEAP_SIZE);
+
+	void* first = arena.allocate(sfz_dbg(""), 4, 4);
+	REQUIRE(first == &memoryHeap[0]);
+	ArenaAllocator::Checkpoint outer = arena.checkpoint();
+	REQUIRE(outer.offsetBytes == 4);
+	REQUIRE(outer.numPaddingBytes == 0);
+
+	void* second = arena.allocate(sfz_dbg(""), 4, 32);
+	REQUIRE(second == &memoryHeap[32]);
+	REQUIRE(arena.numPaddingBytes() == 28);
+	ArenaAllocator::Checkpoint inner = arena.checkpoint();
+
+	void* third = arena.allocate(sfz_dbg(""), 64, 64);
+	REQUIRE(third == &memoryHeap[64]);
+	REQUIRE(arena.numBytesAllocated() == 128);
+
+	arena.rollback(inner);
+	REQUIRE(arena.numBytesAllocated() == 36);
+	REQUIRE(arena.numPaddingBytes() == 28);
+	REQUIRE(arena.allocate(sfz_dbg(""), 64, 64) == third);
+
+	arena.rollback(outer);
+	REQUIRE(arena.numBytesAllocated() == 4);
+	REQUIRE(arena.numPaddingBytes() == 0);
+	REQUIRE(arena.allocate(sfz_dbg(""), 4, 32) == second);
+
+	// Nested scopes
+	arena.reset();
+	{
+		ArenaScope scope1(&arena);
+		REQUIRE(scope1.arena() == &arena);
+		arena.allocate(sfz_dbg(""), 16, 16);
+		REQUIRE(arena.numBytesAllocated() == 16);
+		{
+			ArenaScope scope2(&arena);
+			arena.allocate(sfz_dbg(""), 16, 16);
+			REQUIRE(arena.numBytesAllocated() == 32);
+		}
+		REQUIRE(arena.numBytesAllocated() == 16);
+	}
+	REQUIRE(arena.numBytesAllocated() == 0);
+}
+
+TEST_CASE("ArenaAllocator: Scratch arena", "[sfz::ArenaAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	ArenaAllocator* scratch = getScratchArena();
+	REQUIRE(scratch != nullptr);
+	REQUIRE(scratch == getScratchArena());
+	REQUIRE(scratch->capacity() >= getContext()->scratchArenaReserveBytes);
+
+	uint64_t numBytesBefore = scratch->numBytesAllocated();
+	{
+		ArenaScope scope(scratch);
+		DynArray<uint32_t> tmp(1024, scope.arena(), sfz_dbg("tmp"));
+		for (uint32_t i = 0; i < 1024; i++) tmp.add(i);
+		REQUIRE(scratch->numBytesAllocated() >= (numBytesBefore + 1024 * sizeof(uint32_t)));
+	}
+	REQUIRE(scratch->numBytesAllocated() == numBytesBefore);
+
+	// Each thread has its own scratch arena
+	ArenaAllocator* otherScratch = nullptr;
+	std::thread thread([&]() {
+		otherScratch = getScratchArena();
+		ArenaScope scope(otherScratch);
+		REQUIRE(otherScratch->allocate(sfz_dbg(""), 64) != nullptr);
+	});
+	thread.join();
+	REQUIRE(otherScratch != nullptr);
+	REQUIRE(otherScratch != scratch);
+}
+
+TEST_CASE("ArenaAllocator: Extend in place", "[sfz::ArenaAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	constexpr uint64_t MEMORY_HEAP_SIZE = 1024;
+	alignas(32) uint8_t memoryHeap[MEMORY_HEAP_SIZE];
+	ArenaAllocator arena;
+	arena.init(memoryHeap, MEMORY_HEAP_SIZE);
+
+	// Most recent allocation can be grown and shrunk
+	void* first = arena.allocate(sfz_dbg(""), 64, 32);
+	REQUIRE(arena.tryExtendInPlace(first, 64, 128));
+	REQUIRE(arena.numBytesAllocated() == 128);
+	REQUIRE(arena.tryExtendInPlace(first, 128, 96));
+	REQUIRE(arena.numBytesAllocated() == 96);
+	REQUIRE(!arena.tryExtendInPlace(first, 96, MEMORY_HEAP_SIZE + 1));
+	REQUIRE(arena.numBytesAllocated() == 96);
+
+	// Older allocations can't
+	void* second = arena.allocate(sfz_dbg(""), 32, 32);
+	REQUIRE(!arena.tryExtendInPlace(first, 96, 128));
+	REQUIRE(arena.numBytesAllocated() == 128);
+
+	// Reallocating older allocation copies it to the end
+	for (uint32_t i = 0; i < 96; i++) ((uint8_t*)first)[i] = uint8_t(i);
+	uint8_t* third = (uint8_t*)arena.reallocate(sfz_dbg(""), first, 96, 192, 32);
+	REQUIRE(third == memoryHeap + 128);
+	for (uint32_t i = 0; i < 96; i++) REQUIRE(third[i] == uint8_t(i));
+	REQUIRE(arena.reallocate(sfz_dbg(""), third, 192, 256, 32) == third);
+	REQUIRE(arena.numBytesAllocated() == 384);
+	(void)second;
+
+	// DynArray grows in place when it is the last allocation in the arena
+	arena.reset();
+	DynArray<uint32_t> arr(8, &arena, sfz_dbg(""));
+	const uint32_t* dataBefore = arr.data();
+	for (uint32_t i = 0; i < 200; i++) arr.add(i);
+	REQUIRE(arr.data() == dataBefore);
+	REQUIRE(arena.numBytesAllocated() == arr.capacity() * sizeof(uint32_t));
+	for (uint32_t i = 0; i < 200; i++) REQUIRE(arr[i] == i);
+	arr.destroy();
+}
+
+TEST_CASE("ArenaAllocator: Extend in place with checkpoints", "[sfz::ArenaAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	constexpr uint64_t MEMORY_HEAP_SIZE = 4096;
+	alignas(32) uint8_t memoryHeap[MEMORY_HEAP_SIZE];
+	ArenaAllocator arena;
+	arena.init(memoryHeap, MEMORY_HEAP_SIZE);
+
+	// Allocation made before a checkpoint can't be extended past it
+	void* first = arena.allocate(sfz_dbg(""), 64, 32);
+	{
+		ArenaScope scope(&arena);
+		REQUIRE(!arena.tryExtendInPlace(first, 64, 128));
+		REQUIRE(!arena.tryExtendInPlace(first, 64, 32));
+		REQUIRE(arena.numBytesAllocated() == 64);
+
+		// But allocations made inside the scope can
+		void* second = arena.allocate(sfz_dbg(""), 64, 32);
+		REQUIRE(arena.tryExtendInPlace(second, 64, 128));
+		REQUIRE(arena.numBytesAllocated() == 192);
+	}
+	REQUIRE(arena.numBytesAllocated() == 64);
+	REQUIRE(arena.tryExtendInPlace(first, 64, 128));
+	REQUIRE(arena.numBytesAllocated() == 128);
+
+	// DynArray created before a scope and grown inside it must be moved into the scope instead of
+	// being extended across the checkpoint, which the rollback would then partially free
+	arena.reset();
+	DynArray<uint32_t> outer(8, &arena, sfz_dbg(""));
+	for (uint32_t i = 0; i < 8; i++) outer.add(i);
+	const uint32_t* outerDataBefore = outer.data();
+	{
+		ArenaScope scope(&arena);
+		for (uint32_t i = 8; i < 200; i++) outer.add(i);
+		REQUIRE(outer.data() != outerDataBefore);
+		REQUIRE(arena.numBytesAllocated() > 8 * sizeof(uint32_t));
+		bool allCorrect = true;
+		for (uint32_t i = 0; i < 200; i++) allCorrect = allCorrect && outer[i] == i;
+		REQUIRE(allCorrect);
+		outer.destroy();
+	}
+	REQUIRE(arena.numBytesAllocated() == 8 * sizeof(uint32_t));
+	for (uint32_t i = 0; i < 8; i++) REQUIRE(outerDataBefore[i] == i);
+	REQUIRE(arena.allocate(sfz_dbg(""), 32, 32) == outerDataBefore + 8);
+}
@@ -0,0 +1,227 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/PushWarnings.hpp"
+#include "catch2/catch.hpp"
+#include "sfz/PopWarnings.hpp"
+
+#include <thread>
+
+#include "sfz/Context.hpp"
+#include "sfz/Logging.hpp"
+#include "sfz/containers/DynArray.hpp"
+#include "sfz/containers/HashMap.hpp"
+#include "sfz/memory/BudgetAllocator.hpp"
+#include "sfz/memory/MemoryUtils.hpp"
+
+using namespace sfz;
+
+TEST_CASE("BudgetAllocator: Budget tree", "[sfz::BudgetAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	BudgetAllocator renderer;
+	renderer.init("Renderer", 1000, getDefaultAllocator());
+	BudgetAllocator textures;
+	textures.initChild("Textures", 600, &renderer);
+	BudgetAllocator meshes;
+	meshes.initChild("Meshes", BUDGET_UNLIMITED, &renderer);
+	REQUIRE(textures.parentBudget() == &renderer);
+	REQUIRE(textures.wrappedAllocator() == getDefaultAllocator());
+
+	// Allocations are accounted to the allocator and all its ancestors
+	void* tex1 = textures.allocate(sfz_dbg(""), 400, 64);
+	REQUIRE(tex1 != nullptr);
+	REQUIRE(isAligned(tex1, 64));
+	REQUIRE(textures.currentBytes() == 400);
+	REQUIRE(renderer.currentBytes() == 400);
+	void* mesh1 = meshes.allocate(sfz_dbg(""), 300);
+	REQUIRE(mesh1 != nullptr);
+	REQUIRE(renderer.currentBytes() == 700);
+
+	// Exceeds own budget
+	SFZ_INFO("BudgetAllocator Tests", "The warnings below are expected, ignore");
+	REQUIRE(textures.allocate(sfz_dbg(""), 201) == nullptr);
+	REQUIRE(textures.numOverruns() == 1);
+	REQUIRE(textures.currentBytes() == 400);
+
+	// Exceeds parent's budget
+	REQUIRE(meshes.allocate(sfz_dbg(""), 301) == nullptr);
+	REQUIRE(renderer.numOverruns() == 1);
+	REQUIRE(meshes.numOverruns() == 0);
+	REQUIRE(meshes.currentBytes() == 300);
+	REQUIRE(renderer.currentBytes() == 700);
+
+	void* mesh2 = meshes.allocate(sfz_dbg(""), 300);
+	REQUIRE(mesh2 != nullptr);
+	REQUIRE(renderer.currentBytes() == 1000);
+	meshes.deallocate(mesh1);
+	meshes.deallocate(mesh2);
+	REQUIRE(meshes.currentBytes() == 0);
+	REQUIRE(meshes.peakBytes() == 600);
+	REQUIRE(renderer.currentBytes() == 400);
+	REQUIRE(renderer.peakBytes() == 1000);
+
+	// Report lists parents before children, in creation order
+	BudgetReportEntry entries[4];
+	REQUIRE(renderer.report(entries, 4) == 3);
+	REQUIRE(strcmp(entries[0].name, "Renderer") == 0);
+	REQUIRE(entries[0].depth == 0);
+	REQUIRE(entries[0].budgetBytes == 1000);
+	REQUIRE(entries[0].currentBytes == 400);
+	REQUIRE(entries[0].peakBytes == 1000);
+	REQUIRE(entries[0].numLiveAllocations == 0);
+	REQUIRE(entries[0].numOverruns == 1);
+	REQUIRE(strcmp(entries[1].name, "Textures") == 0);
+	REQUIRE(entries[1].depth == 1);
+	REQUIRE(entries[1].currentBytes == 400);
+	REQUIRE(entries[1].numLiveAllocations == 1);
+	REQUIRE(strcmp(entries[2].name, "Meshes") == 0);
+	REQUIRE(entries[2].depth == 1);
+	REQUIRE(entries[2].budgetBytes == BUDGET_UNLIMITED);
+	REQUIRE(textures.report(entries, 4) == 1);
+	REQUIRE(renderer.report(entries, 1) == 3);
+
+	renderer.resetPeaks();
+	REQUIRE(renderer.peakBytes() == 400);
+	REQUIRE(meshes.peakBytes() == 0);
+
+	textures.deallocate(tex1);
+	REQUIRE(renderer.currentBytes() == 0);
+
+	// Children can be destroyed and re-created
+	meshes.destroy();
+	REQUIRE(renderer.report(entries, 4) == 2);
+	meshes.initChild("Meshes2", 100, &textures);
+	REQUIRE(renderer.report(entries, 4) == 3);
+	REQUIRE(strcmp(entries[2].name, "Meshes2") == 0);
+	REQUIRE(entries[2].depth == 2);
+}
+
+struct TrimCache final {
+	BudgetAllocator* allocator = nullptr;
+	void* cached[8] = {};
+	uint32_t numCallbacks = 0;
+};
+
+static bool trimCacheCallback(BudgetAllocator* budget, uint64_t requestedBytes, void* userData)
+{
+	(void)requestedBytes;
+	TrimCache& cache = *static_cast<TrimCache*>(userData);
+	cache.numCallbacks += 1;
+	REQUIRE(budget == cache.allocator);
+
+	// Release one cached allocation, retry if something was released
+	for (void*& ptr : cache.cached) {
+		if (ptr != nullptr) {
+			cache.allocator->deallocate(ptr);
+			ptr = nullptr;
+			return true;
+		}
+	}
+	return false;
+}
+
+TEST_CASE("BudgetAllocator: Overrun callback", "[sfz::BudgetAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	BudgetAllocator budget;
+	budget.init("Cache", 1024, getDefaultAllocator());
+	TrimCache cache;
+	cache.allocator = &budget;
+	budget.setOverrunCallback(trimCacheCallback, &cache);
+	for (void*& ptr : cache.cached) ptr = budget.allocate(sfz_dbg(""), 128);
+	REQUIRE(budget.currentBytes() == 1024);
+
+	// Callback trims the cache until the allocation fits
+	void* big = budget.allocate(sfz_dbg(""), 300);
+	REQUIRE(big != nullptr);
+	REQUIRE(cache.numCallbacks == 3);
+	REQUIRE(budget.numOverruns() == 3);
+	REQUIRE(budget.currentBytes() == 1024 - 3 * 128 + 300);
+
+	// Fails once nothing more can be trimmed
+	SFZ_INFO("BudgetAllocator Tests", "The warning below is expected, ignore");
+	REQUIRE(budget.allocate(sfz_dbg(""), 2000) == nullptr);
+	for (void* ptr : cache.cached) REQUIRE(ptr == nullptr);
+
+	budget.deallocate(big);
+	REQUIRE(budget.currentBytes() == 0);
+}
+
+TEST_CASE("BudgetAllocator: Containers", "[sfz::BudgetAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	BudgetAllocator budget;
+	budget.init("Containers", 1 << 20, getDefaultAllocator());
+	{
+		DynArray<uint32_t> arr(0, &budget, sfz_dbg(""));
+		for (uint32_t i = 0; i < 1000; i++) arr.add(i);
+		REQUIRE(budget.currentBytes() == arr.capacity() * sizeof(uint32_t));
+
+		HashMap<uint32_t, uint32_t> map(0, &budget);
+		for (uint32_t i = 0; i < 1000; i++) map.put(i, i);
+		REQUIRE(budget.currentBytes() > arr.capacity() * sizeof(uint32_t));
+	}
+	REQUIRE(budget.currentBytes() == 0);
+	REQUIRE(budget.peakBytes() > 0);
+
+	// Lowering the budget below current usage makes new allocations fail
+	DynArray<uint8_t> arr(512, &budget, sfz_dbg(""));
+	budget.setBudget(256);
+	SFZ_INFO("BudgetAllocator Tests", "The warning below is expected, ignore");
+	REQUIRE(budget.allocate(sfz_dbg(""), 1) == nullptr);
+	arr.destroy();
+	void* ptr = budget.allocate(sfz_dbg(""), 256);
+	REQUIRE(ptr != nullptr);
+	budget.deallocate(ptr);
+}
+
+TEST_CASE("BudgetAllocator: Multithreaded", "[sfz::BudgetAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	constexpr uint32_t NUM_THREADS = 8;
+	constexpr uint32_t NUM_ALLOCS = 1000;
+	BudgetAllocator root;
+	root.init("Root", BUDGET_UNLIMITED, getDefaultAllocator());
+	BudgetAllocator children[NUM_THREADS];
+	for (BudgetAllocator& child : children) child.initChild("Child", BUDGET_UNLIMITED, &root);
+
+	std::thread threads[NUM_THREADS];
+	for (uint32_t t = 0; t < NUM_THREADS; t++) {
+		threads[t] = std::thread([&, t]() {
+			void* ptrs[NUM_ALLOCS] = {};
+			for (uint32_t i = 0; i < NUM_ALLOCS; i++) {
+				ptrs[i] = children[t].allocate(sfz_dbg(""), 100);
+			}
+			for (uint32_t i = 0; i < NUM_ALLOCS; i++) children[t].deallocate(ptrs[i]);
+		});
+	}
+	for (std::thread& thread : threads) thread.join();
+
+	REQUIRE(root.currentBytes() == 0);
+	REQUIRE(root.peakBytes() >= NUM_ALLOCS * 100);
+	REQUIRE(root.peakBytes() <= NUM_THREADS * NUM_ALLOCS * 100);
+	for (BudgetAllocator& child : children) {
+		REQUIRE(child.peakBytes() == NUM_ALLOCS * 100);
+		child.destroy();
+	}
+}
@@ -0,0 +1,126 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/PushWarnings.hpp"
+#include "catch2/catch.hpp"
+#include "sfz/PopWarnings.hpp"
+
+#include <thread>
+
+#include "sfz/Context.hpp"
+#include "sfz/Logging.hpp"
+#include "sfz/containers/DynArray.hpp"
+#include "sfz/memory/ConcurrentArenaAllocator.hpp"
+#include "sfz/memory/MemoryUtils.hpp"
+
+using namespace sfz;
+
+TEST_CASE("ConcurrentArenaAllocator: Single thread", "[sfz::ConcurrentArenaAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	ConcurrentArenaAllocator arena;
+	REQUIRE(arena.capacity() == 0);
+	REQUIRE(arena.numBytesAllocated() == 0);
+	REQUIRE(arena.numPaddingBytes() == 0);
+
+	constexpr uint64_t MEMORY_HEAP_SIZE = 16;
+	alignas(32) uint8_t memoryHeap[MEMORY_HEAP_SIZE];
+	arena.init(memoryHeap, MEMORY_HEAP_SIZE);
+	REQUIRE(arena.capacity() == MEMORY_HEAP_SIZE);
+
+	void* first = arena.allocate(sfz_dbg(""), 4, 4);
+	REQUIRE(first == &memoryHeap[0]);
+	REQUIRE(arena.numBytesAllocated() == 4);
+	REQUIRE(arena.numPaddingBytes() == 0);
+
+	void* second = arena.allocate(sfz_dbg(""), 4, 8);
+	REQUIRE(second == &memoryHeap[8]);
+	REQUIRE(arena.numBytesAllocated() == 12);
+	REQUIRE(arena.numPaddingBytes() == 4);
+
+	SFZ_INFO("ConcurrentArenaAllocator Tests", "The warning below is expected, ignore");
+	REQUIRE(arena.allocate(sfz_dbg(""), 8, 4) == nullptr);
+	REQUIRE(arena.numBytesAllocated() == 12);
+
+	arena.reset();
+	REQUIRE(arena.numBytesAllocated() == 0);
+	REQUIRE(arena.numPaddingBytes() == 0);
+	REQUIRE(arena.allocate(sfz_dbg(""), 16, 16) == &memoryHeap[0]);
+}
+
+TEST_CASE("ConcurrentArenaAllocator: Multithreaded stress test", "[sfz::ConcurrentArenaAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	constexpr uint32_t NUM_THREADS = 8;
+	constexpr uint32_t NUM_ALLOCS_PER_THREAD = 10000;
+	constexpr uint64_t MEMORY_SIZE = 16 * 1024 * 1024;
+	uint8_t* memoryPtr = (uint8_t*)getDefaultAllocator()->allocate(sfz_dbg(""), MEMORY_SIZE, 64);
+	REQUIRE(memoryPtr != nullptr);
+
+	ConcurrentArenaAllocator arena;
+	arena.init(memoryPtr, MEMORY_SIZE);
+
+	struct Allocation {
+		uint8_t* ptr;
+		uint32_t size;
+	};
+	DynArray<Allocation> allocations[NUM_THREADS];
+	uint64_t numBytesRequested[NUM_THREADS] = {};
+	for (uint32_t i = 0; i < NUM_THREADS; i++) {
+		allocations[i].init(NUM_ALLOCS_PER_THREAD, getDefaultAllocator(), sfz_dbg(""));
+	}
+
+	// Each thread allocates memory of varying size and alignment, then fills it with its id
+	std::thread threads[NUM_THREADS];
+	for (uint32_t i = 0; i < NUM_THREADS; i++) {
+		threads[i] = std::thread([&, i]() {
+			for (uint32_t j = 0; j < NUM_ALLOCS_PER_THREAD; j++) {
+				uint32_t size = 1 + ((j * 7 + i * 13) % 64);
+				uint64_t alignment = uint64_t(1) << ((j + i) % 7);
+				uint8_t* ptr = (uint8_t*)arena.allocate(sfz_dbg(""), size, alignment);
+				if (ptr == nullptr) continue;
+				if (!isAligned(ptr, alignment)) continue;
+				for (uint32_t k = 0; k < size; k++) ptr[k] = uint8_t(i);
+				allocations[i].add({ ptr, size });
+				numBytesRequested[i] += size;
+			}
+		});
+	}
+	for (std::thread& thread : threads) thread.join();
+
+	// Check that all allocations succeeded, were aligned and were not overwritten by other threads
+	uint64_t totalBytesRequested = 0;
+	for (uint32_t i = 0; i < NUM_THREADS; i++) {
+		REQUIRE(allocations[i].size() == NUM_ALLOCS_PER_THREAD);
+		totalBytesRequested += numBytesRequested[i];
+		bool allCorrect = true;
+		for (const Allocation& alloc : allocations[i]) {
+			for (uint32_t k = 0; k < alloc.size; k++) {
+				allCorrect = allCorrect && alloc.ptr[k] == uint8_t(i);
+			}
+		}
+		REQUIRE(allCorrect);
+	}
+	REQUIRE(arena.numBytesAllocated() == (totalBytesRequested + arena.numPaddingBytes()));
+	REQUIRE(arena.numBytesAllocated() <= MEMORY_SIZE);
+
+	arena.destroy();
+	getDefaultAllocator()->deallocate(memoryPtr);
+}
@@ -0,0 +1,168 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/PushWarnings.hpp"
+#include "catch2/catch.hpp"
+#include "sfz/PopWarnings.hpp"
+
+#include <cstring>
+#include <thread>
+
+#include "sfz/Context.hpp"
+#include "sfz/containers/DynArray.hpp"
+#include "sfz/containers/HashMap.hpp"
+#include "sfz/containers/RingBuffer.hpp"
+#include "sfz/memory/DebugAllocator.hpp"
+#include "sfz/memory/MemoryUtils.hpp"
+#include "sfz/memory/SmartPointers.hpp"
+
+using namespace sfz;
+
+TEST_CASE("DebugAllocator: Allocations and bounded history", "[sfz::DebugAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	DebugAllocator allocator("TestAllocator", 4, 8);
+	REQUIRE(allocator.numAllocations() == 0);
+	REQUIRE(allocator.numDeallocated() == 0);
+
+	void* ptrs[20] = {};
+	for (uint32_t i = 0; i < 20; i++) {
+		ptrs[i] = allocator.allocate(sfz_dbg("TestAlloc"), 16 + i, 32);
+		REQUIRE(isAligned(ptrs[i], 32));
+	}
+	REQUIRE(allocator.numAllocations() == 20);
+
+	uint32_t numInfos = 0;
+	DebugAllocationInfo* infos = allocator.allocations(&numInfos);
+	REQUIRE(numInfos == 20);
+	uint64_t totalSize = 0;
+	for (uint32_t i = 0; i < numInfos; i++) {
+		REQUIRE(std::strcmp(infos[i].name, "TestAlloc") == 0);
+		totalSize += infos[i].size;
+	}
+	REQUIRE(totalSize == 20 * 16 + (19 * 20) / 2);
+	allocator.deallocate(infos);
+
+	for (uint32_t i = 0; i < 20; i++) allocator.deallocate(ptrs[i]);
+	REQUIRE(allocator.numAllocations() == 0);
+	REQUIRE(allocator.numDeallocated() == 21);
+	REQUIRE(allocator.numTotalAllocations() == 21);
+
+	// History only contains the most recent deallocations, in order
+	DebugAllocationInfo* history = allocator.deallocatedAllocations(&numInfos);
+	REQUIRE(numInfos == 8);
+	for (uint32_t i = 0; i < 8; i++) REQUIRE(history[i].pointer == ptrs[12 + i]);
+	allocator.deallocate(history);
+}
+
+TEST_CASE("DebugAllocator: Multiple threads", "[sfz::DebugAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	DebugAllocator allocator("TestAllocator");
+
+	constexpr uint32_t NUM_THREADS = 8;
+	constexpr uint32_t NUM_ALLOCS = 2000;
+	constexpr uint32_t NUM_KEPT = 10;
+	void* kept[NUM_THREADS][NUM_KEPT] = {};
+	std::thread threads[NUM_THREADS];
+	for (uint32_t i = 0; i < NUM_THREADS; i++) {
+		threads[i] = std::thread([&, i]() {
+			void* live[32] = {};
+			for (uint32_t j = 0; j < NUM_ALLOCS; j++) {
+				allocator.deallocate(live[j % 32]);
+				live[j % 32] = allocator.allocate(sfz_dbg("ThreadAlloc"), 8 + j % 100, 16);
+				((uint8_t*)live[j % 32])[0] = uint8_t(j);
+			}
+			for (uint32_t j = 0; j < 32; j++) {
+				if (j < NUM_KEPT) kept[i][j] = live[j];
+				else allocator.deallocate(live[j]);
+			}
+		});
+	}
+	for (std::thread& thread : threads) thread.join();
+
+	REQUIRE(allocator.numAllocations() == NUM_THREADS * NUM_KEPT);
+	REQUIRE(allocator.numTotalAllocations() == NUM_THREADS * NUM_ALLOCS);
+	uint32_t numInfos = 0;
+	DebugAllocationInfo* infos = allocator.allocations(&numInfos);
+	REQUIRE(numInfos == NUM_THREADS * NUM_KEPT);
+	allocator.deallocate(infos);
+
+	// History is gathered from all shards, the most recent deallocations should all be present
+	DebugAllocationInfo* history = allocator.deallocatedAllocations(&numInfos);
+	REQUIRE(numInfos == 4096);
+	REQUIRE(history[numInfos - 1].pointer == infos);
+	bool allValid = true;
+	for (uint32_t i = 0; i < numInfos - 1; i++) {
+		allValid = allValid && history[i].pointer != nullptr;
+		allValid = allValid && std::strcmp(history[i].name, "ThreadAlloc") == 0;
+	}
+	REQUIRE(allValid);
+	allocator.deallocate(history);
+
+	for (uint32_t i = 0; i < NUM_THREADS; i++) {
+		for (uint32_t j = 0; j < NUM_KEPT; j++) allocator.deallocate(kept[i][j]);
+	}
+	REQUIRE(allocator.numAllocations() == 0);
+}
+
+struct SizedTestBase {
+	uint32_t values[3] = {};
+};
+
+struct SizedTestDerived : SizedTestBase {
+	uint8_t padding[100] = {};
+};
+
+TEST_CASE("DebugAllocator: Sized deallocation", "[sfz::DebugAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	// The debug allocator exits if the size or alignment passed to deallocateSized() is wrong, so
+	// this checks that the containers pass what they allocated with.
+	DebugAllocator allocator("TestAllocator");
+	{
+		DynArray<uint64_t> arr(0, &allocator, sfz_dbg(""));
+		for (uint64_t i = 0; i < 1000; i++) arr.add(i);
+		arr.setCapacity(10000);
+		arr.setCapacity(1000);
+
+		HashMap<uint32_t, uint32_t> map(0, &allocator);
+		for (uint32_t i = 0; i < 1000; i++) map.put(i, i);
+
+		RingBuffer<uint32_t> ring(100, &allocator);
+		ring.add(1u);
+
+		SizedTestBase* base = allocator.newObject<SizedTestBase>(sfz_dbg(""));
+		allocator.deleteObject(base);
+		REQUIRE(base == nullptr);
+
+		// Non-polymorphic subclass deleted through base pointer, must not be deallocated sized
+		UniquePtr<SizedTestBase> uniqueBase =
+			UniquePtr<SizedTestDerived>(allocator.newObject<SizedTestDerived>(sfz_dbg("")), &allocator);
+		SharedPtr<SizedTestBase> sharedBase =
+			SharedPtr<SizedTestDerived>(allocator.newObject<SizedTestDerived>(sfz_dbg("")), &allocator);
+
+		void* ptr = allocator.allocate(sfz_dbg(""), 100, 64);
+		ptr = allocator.reallocate(sfz_dbg(""), ptr, 100, 200, 64);
+		allocator.deallocateSized(ptr, 200, 64);
+	}
+	REQUIRE(allocator.numAllocations() == 0);
+}
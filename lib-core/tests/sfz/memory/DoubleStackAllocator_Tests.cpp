@@ -0,0 +1,286 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/PushWarnings.hpp"
+#include "catch2/catch.hpp"
+#include "sfz/PopWarnings.hpp"
+
+#include "sfz/Context.hpp"
+#include "sfz/Logging.hpp"
+#include "sfz/containers/DynArray.hpp"
+#include "sfz/memory/DoubleStackAllocator.hpp"
+#include "sfz/memory/MemoryUtils.hpp"
+
+using namespace sfz;
+
+TEST_CASE("DoubleStackAllocator: Both ends", "[sfz::DoubleStackAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	alignas(64) uint8_t memory[1024];
+	DoubleStackAllocator stack;
+	stack.init(memory, 1024);
+	REQUIRE(stack.capacity() == 1024);
+	REQUIRE(stack.numBytesFree() == 1024);
+
+	// Bottom grows upwards, each allocation is preceded by a 16 byte header
+	uint8_t* b1 = (uint8_t*)stack.allocateBottom(sfz_dbg(""), 32, 32);
+	REQUIRE(b1 == memory + 32);
+	REQUIRE(stack.numBytesBottom() == 64);
+	uint8_t* b2 = (uint8_t*)stack.allocate(sfz_dbg(""), 16, 16);
+	REQUIRE(b2 == memory + 80);
+	REQUIRE(stack.numBytesBottom() == 96);
+
+	// Top grows downwards
+	uint8_t* t1 = (uint8_t*)stack.allocateTop(sfz_dbg(""), 64, 64);
+	REQUIRE(t1 == memory + 1024 - 64);
+	REQUIRE(stack.numBytesTop() == 80);
+	uint8_t* t2 = (uint8_t*)stack.topAllocator()->allocate(sfz_dbg(""), 8, 8);
+	REQUIRE(t2 == memory + 1024 - 80 - 8);
+	REQUIRE(stack.numBytesTop() == 104);
+	REQUIRE(stack.numBytesFree() == 1024 - 96 - 104);
+
+	// Ends are independent, deallocation in LIFO order releases memory immediately
+	stack.deallocate(t2);
+	REQUIRE(stack.numBytesTop() == 80);
+	stack.topAllocator()->deallocate(b2);
+	REQUIRE(stack.numBytesBottom() == 64);
+	stack.deallocate(t1);
+	REQUIRE(stack.numBytesTop() == 0);
+	REQUIRE(stack.numBytesBottom() == 64);
+
+	// Out of memory when the ends meet
+	uint8_t* t3 = (uint8_t*)stack.allocateTop(sfz_dbg(""), 1024 - 64 - 16, 8);
+	REQUIRE(t3 == memory + 80);
+	REQUIRE(stack.numBytesFree() == 0);
+	SFZ_INFO("DoubleStackAllocator Tests", "The warnings below are expected, ignore");
+	REQUIRE(stack.allocateBottom(sfz_dbg(""), 1, 8) == nullptr);
+	REQUIRE(stack.allocateTop(sfz_dbg(""), 1, 8) == nullptr);
+	stack.deallocate(t3);
+	stack.deallocate(b1);
+	REQUIRE(stack.numBytesFree() == 1024);
+}
+
+TEST_CASE("DoubleStackAllocator: Out of order deallocation", "[sfz::DoubleStackAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	alignas(64) uint8_t memory[1024];
+	DoubleStackAllocator stack;
+	stack.init(memory, 1024);
+
+	void* a = stack.allocateTop(sfz_dbg(""), 32, 16);
+	void* b = stack.allocateTop(sfz_dbg(""), 32, 16);
+	void* c = stack.allocateTop(sfz_dbg(""), 32, 16);
+	REQUIRE(stack.numBytesTop() == 144);
+
+	// Not the most recent, memory is reclaimed once everything after it is gone
+	stack.deallocate(b);
+	REQUIRE(stack.numBytesTop() == 144);
+	stack.deallocate(a);
+	REQUIRE(stack.numBytesTop() == 144);
+	stack.deallocate(c);
+	REQUIRE(stack.numBytesTop() == 0);
+
+	// Same on the bottom end
+	a = stack.allocateBottom(sfz_dbg(""), 32, 16);
+	b = stack.allocateBottom(sfz_dbg(""), 32, 16);
+	c = stack.allocateBottom(sfz_dbg(""), 32, 16);
+	REQUIRE(stack.numBytesBottom() == 144);
+	stack.deallocate(b);
+	stack.deallocate(c);
+	REQUIRE(stack.numBytesBottom() == 48);
+	stack.deallocate(a);
+	REQUIRE(stack.numBytesBottom() == 0);
+}
+
+TEST_CASE("DoubleStackAllocator: Markers", "[sfz::DoubleStackAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	alignas(64) uint8_t memory[4096];
+	DoubleStackAllocator stack;
+	stack.init(memory, 4096);
+
+	// Persistent data on bottom, transient buffers on top
+	void* level = stack.allocateBottom(sfz_dbg(""), 100);
+	REQUIRE(level != nullptr);
+	DoubleStackAllocator::Marker bottomMarker = stack.bottomMarker();
+	const uint64_t bottomBytes = stack.numBytesBottom();
+
+	for (uint32_t i = 0; i < 10; i++) {
+		DoubleStackAllocator::Marker topMarker = stack.topMarker();
+		void* decodeBuffer = stack.allocateTop(sfz_dbg(""), 1000);
+		REQUIRE(decodeBuffer != nullptr);
+		void* asset = stack.allocateBottom(sfz_dbg(""), 100);
+		REQUIRE(asset != nullptr);
+		stack.allocateTop(sfz_dbg(""), 500);
+		stack.rollbackTop(topMarker);
+		REQUIRE(stack.numBytesTop() == 0);
+	}
+	REQUIRE(stack.numBytesBottom() > bottomBytes);
+
+	stack.rollbackBottom(bottomMarker);
+	REQUIRE(stack.numBytesBottom() == bottomBytes);
+	stack.deallocate(level);
+	REQUIRE(stack.numBytesBottom() == 0);
+
+	stack.allocateTop(sfz_dbg(""), 100);
+	stack.allocateBottom(sfz_dbg(""), 100);
+	stack.reset();
+	REQUIRE(stack.numBytesFree() == 4096);
+}
+
+TEST_CASE("DoubleStackAllocator: Extend in place with markers", "[sfz::DoubleStackAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	alignas(64) uint8_t memory[4096];
+	DoubleStackAllocator stack;
+	stack.init(memory, 4096);
+
+	// Allocation made before a marker can't be resized past it
+	void* first = stack.allocateBottom(sfz_dbg(""), 64);
+	const uint64_t bytesBefore = stack.numBytesBottom();
+	DoubleStackAllocator::Marker marker = stack.bottomMarker();
+	REQUIRE(!stack.tryExtendInPlace(first, 64, 128));
+	REQUIRE(!stack.tryExtendInPlace(first, 64, 32));
+	REQUIRE(stack.numBytesBottom() == bytesBefore);
+
+	// But allocations made after the marker can
+	void* second = stack.allocateBottom(sfz_dbg(""), 64);
+	REQUIRE(stack.tryExtendInPlace(second, 64, 128));
+	stack.rollbackBottom(marker);
+	REQUIRE(stack.numBytesBottom() == bytesBefore);
+
+	// The floor is lifted when rolled back to
+	REQUIRE(stack.tryExtendInPlace(first, 64, 128));
+	REQUIRE(stack.numBytesBottom() == bytesBefore + 64);
+	stack.deallocate(first);
+	REQUIRE(stack.numBytesBottom() == 0);
+
+	// DynArray created before a marker and grown after it is moved instead of extended
+	DynArray<uint32_t> outer(16, &stack, sfz_dbg(""));
+	for (uint32_t i = 0; i < 16; i++) outer.add(i);
+	const uint32_t* outerDataBefore = outer.data();
+	stack.bottomMarker();
+	for (uint32_t i = 16; i < 64; i++) outer.add(i);
+	REQUIRE(outer.data() != outerDataBefore);
+	bool allCorrect = true;
+	for (uint32_t i = 0; i < 64; i++) allCorrect = allCorrect && outer[i] == i;
+	REQUIRE(allCorrect);
+	outer.destroy();
+	stack.reset();
+	REQUIRE(stack.numBytesFree() == 4096);
+}
+
+TEST_CASE("DoubleStackAllocator: Deallocation below marker", "[sfz::DoubleStackAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	alignas(64) uint8_t memory[4096];
+	DoubleStackAllocator stack;
+	stack.init(memory, 4096);
+
+	// Bottom, allocation made before the marker is deallocated while it is live
+	void* a = stack.allocateBottom(sfz_dbg(""), 64);
+	const uint64_t bottomBytes = stack.numBytesBottom();
+	DoubleStackAllocator::Marker bottomMarker = stack.bottomMarker();
+	stack.deallocate(a);
+	REQUIRE(stack.numBytesBottom() == bottomBytes);
+	void* b = stack.allocateBottom(sfz_dbg(""), 256);
+	REQUIRE((uint8_t*)b > (uint8_t*)a);
+	stack.deallocate(b);
+	REQUIRE(stack.numBytesBottom() == bottomBytes);
+	stack.allocateBottom(sfz_dbg(""), 16);
+	stack.rollbackBottom(bottomMarker);
+	REQUIRE(stack.numBytesBottom() == 0);
+	void* c = stack.allocateBottom(sfz_dbg(""), 32);
+	stack.deallocate(c);
+	REQUIRE(stack.numBytesBottom() == 0);
+
+	// Same for top
+	void* d = stack.allocateTop(sfz_dbg(""), 64);
+	const uint64_t topBytes = stack.numBytesTop();
+	DoubleStackAllocator::Marker topMarker = stack.topMarker();
+	stack.deallocate(d);
+	REQUIRE(stack.numBytesTop() == topBytes);
+	void* e = stack.allocateTop(sfz_dbg(""), 256);
+	REQUIRE((uint8_t*)e < (uint8_t*)d);
+	stack.deallocate(e);
+	REQUIRE(stack.numBytesTop() == topBytes);
+	stack.allocateTop(sfz_dbg(""), 16);
+	stack.rollbackTop(topMarker);
+	REQUIRE(stack.numBytesTop() == 0);
+	void* f = stack.allocateTop(sfz_dbg(""), 32);
+	stack.deallocate(f);
+	REQUIRE(stack.numBytesTop() == 0);
+
+	// Allocation made before the marker is not reclaimed while allocations made after it are live
+	a = stack.allocateBottom(sfz_dbg(""), 64);
+	bottomMarker = stack.bottomMarker();
+	b = stack.allocateBottom(sfz_dbg(""), 64);
+	stack.deallocate(a);
+	stack.deallocate(b);
+	REQUIRE(stack.numBytesBottom() == bottomBytes);
+	stack.rollbackBottom(bottomMarker);
+	REQUIRE(stack.numBytesBottom() == 0);
+
+	// Growing or destroying a DynArray created before the marker inside the marker scope
+	{
+		DynArray<uint32_t> outer(16, &stack, sfz_dbg(""));
+		for (uint32_t i = 0; i < 16; i++) outer.add(i);
+		bottomMarker = stack.bottomMarker();
+		for (uint32_t i = 16; i < 128; i++) outer.add(i);
+		bool allCorrect = true;
+		for (uint32_t i = 0; i < 128; i++) allCorrect = allCorrect && outer[i] == i;
+		REQUIRE(allCorrect);
+		outer.destroy();
+		stack.rollbackBottom(bottomMarker);
+		REQUIRE(stack.numBytesBottom() == 0);
+	}
+	REQUIRE(stack.numBytesFree() == 4096);
+}
+
+TEST_CASE("DoubleStackAllocator: Containers", "[sfz::DoubleStackAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	alignas(64) uint8_t memory[4096];
+	DoubleStackAllocator stack;
+	stack.init(memory, 4096);
+
+	// Most recent bottom allocation grows in place
+	DynArray<uint32_t> persistent(16, &stack, sfz_dbg(""));
+	uint32_t* dataBefore = persistent.data();
+	for (uint32_t i = 0; i < 64; i++) persistent.add(i);
+	REQUIRE(persistent.data() == dataBefore);
+
+	// Top allocations cannot grow in place, but are still freed when the array is destroyed
+	{
+		DynArray<uint32_t> transient(16, stack.topAllocator(), sfz_dbg(""));
+		for (uint32_t i = 0; i < 64; i++) transient.add(i);
+		REQUIRE(stack.numBytesTop() > 0);
+	}
+	REQUIRE(stack.numBytesTop() == 0);
+
+	for (uint32_t i = 0; i < 64; i++) REQUIRE(persistent[i] == i);
+	REQUIRE(stack.tryExtendInPlace(persistent.data(), persistent.capacity() * sizeof(uint32_t), 4096) == false);
+	persistent.destroy();
+	REQUIRE(stack.numBytesBottom() == 0);
+}
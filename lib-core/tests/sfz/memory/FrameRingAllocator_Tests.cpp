@@ -0,0 +1,182 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/PushWarnings.hpp"
+#include "catch2/catch.hpp"
+#include "sfz/PopWarnings.hpp"
+
+#include <atomic>
+#include <thread>
+
+#include "sfz/Context.hpp"
+#include "sfz/Logging.hpp"
+#include "sfz/containers/DynArray.hpp"
+#include "sfz/memory/FrameRingAllocator.hpp"
+#include "sfz/memory/MemoryUtils.hpp"
+
+using namespace sfz;
+
+TEST_CASE("FrameRingAllocator: Frames", "[sfz::FrameRingAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	alignas(64) uint8_t memory[1024];
+	FrameRingAllocator ring;
+	ring.init(memory, 1024);
+	REQUIRE(ring.capacity() == 1024);
+	REQUIRE(ring.currentFrame() == 0);
+	REQUIRE(ring.numFramesInFlight() == 1);
+
+	// Frame 0
+	uint8_t* a = (uint8_t*)ring.allocate(sfz_dbg(""), 100, 32);
+	REQUIRE(a == memory);
+	uint8_t* b = (uint8_t*)ring.allocate(sfz_dbg(""), 200, 32);
+	REQUIRE(b == memory + 128);
+	REQUIRE(ring.numBytesInUse() == 328);
+
+	// Frame 1
+	REQUIRE(ring.beginFrame() == 1);
+	uint8_t* c = (uint8_t*)ring.allocate(sfz_dbg(""), 400, 32);
+	REQUIRE(c == memory + 352);
+	REQUIRE(ring.numFramesInFlight() == 2);
+	REQUIRE(ring.numBytesInUse() == 752);
+
+	// Frame 2, does not fit before the end of the ring so wraps around to the start, which is
+	// still in use until frame 0 is retired
+	REQUIRE(ring.beginFrame() == 2);
+	SFZ_INFO("FrameRingAllocator Tests", "The warning below is expected, ignore");
+	REQUIRE(ring.allocate(sfz_dbg(""), 300, 32) == nullptr);
+	ring.retireFrame(0);
+	REQUIRE(ring.oldestUnretiredFrame() == 1);
+	REQUIRE(ring.numBytesInUse() == 752 - 328);
+	uint8_t* d = (uint8_t*)ring.allocate(sfz_dbg(""), 300, 32);
+	REQUIRE(d == memory);
+	REQUIRE(ring.numBytesInUse() == 1024 + 300 - 328);
+
+	// Frames can be retired out of order, but memory is reclaimed in frame order
+	REQUIRE(ring.beginFrame() == 3);
+	ring.retireFrame(2);
+	REQUIRE(ring.oldestUnretiredFrame() == 1);
+	REQUIRE(ring.numBytesInUse() == 1024 + 300 - 328);
+	ring.retireFrame(1);
+	REQUIRE(ring.oldestUnretiredFrame() == 3);
+	REQUIRE(ring.numFramesInFlight() == 1);
+	REQUIRE(ring.numBytesInUse() == 0);
+
+	uint8_t* e = (uint8_t*)ring.allocate(sfz_dbg(""), 600, 32);
+	REQUIRE(e == memory + 320);
+	ring.reset();
+	REQUIRE(ring.currentFrame() == 0);
+	REQUIRE(ring.numBytesInUse() == 0);
+}
+
+TEST_CASE("FrameRingAllocator: DynArray scratch buffers", "[sfz::FrameRingAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	alignas(64) uint8_t memory[4096];
+	FrameRingAllocator ring;
+	ring.init(memory, 4096);
+
+	for (uint32_t frame = 0; frame < 20; frame++) {
+		if (frame > 0) {
+			REQUIRE(ring.beginFrame() == frame);
+		}
+
+		// Most recent allocation grows in place unless it reaches the end of the ring
+		DynArray<uint32_t> scratch(8, &ring, sfz_dbg(""));
+		uint32_t* dataBefore = scratch.data();
+		for (uint32_t i = 0; i < 200; i++) scratch.add(i * frame);
+		if (frame == 0) REQUIRE(scratch.data() == dataBefore);
+		for (uint32_t i = 0; i < 200; i++) REQUIRE(scratch[i] == i * frame);
+
+		// Keep two frames in flight
+		if (frame >= 2) ring.retireFrame(frame - 2);
+		REQUIRE(ring.numFramesInFlight() <= 3);
+	}
+}
+
+TEST_CASE("FrameRingAllocator: Concurrent producers and consumer", "[sfz::FrameRingAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	constexpr uint32_t NUM_PRODUCERS = 4;
+	constexpr uint32_t NUM_FRAMES = 200;
+	constexpr uint32_t NUM_ALLOCS_PER_THREAD = 32;
+	constexpr uint64_t ALLOC_SIZE = 64;
+	constexpr uint64_t MEMORY_SIZE = (NUM_PRODUCERS * NUM_ALLOCS_PER_THREAD * ALLOC_SIZE) * 4;
+	uint8_t* memory = (uint8_t*)getDefaultAllocator()->allocate(sfz_dbg(""), MEMORY_SIZE, 64);
+	FrameRingAllocator ring;
+	ring.init(memory, MEMORY_SIZE);
+
+	// Allocations of each frame are filled with the frame index, the consumer verifies them
+	static uint8_t* allocs[NUM_FRAMES][NUM_PRODUCERS][NUM_ALLOCS_PER_THREAD] = {};
+	std::atomic<uint64_t> numFramesProduced{0};
+	std::atomic<bool> allValid{true};
+	std::thread consumer([&]() {
+		for (uint64_t frame = 0; frame < NUM_FRAMES; frame++) {
+			while (numFramesProduced.load(std::memory_order_acquire) <= frame) {
+				std::this_thread::yield();
+			}
+			for (uint32_t t = 0; t < NUM_PRODUCERS; t++) {
+				for (uint32_t i = 0; i < NUM_ALLOCS_PER_THREAD; i++) {
+					uint8_t* ptr = allocs[frame][t][i];
+					if (ptr == nullptr) {
+						allValid.store(false);
+						continue;
+					}
+					for (uint64_t j = 0; j < ALLOC_SIZE; j++) {
+						if (ptr[j] != uint8_t(frame)) allValid.store(false);
+					}
+				}
+			}
+			// Only frames that are no longer current can be retired, so the last one is not
+			if (frame + 1 == NUM_FRAMES) break;
+			while (ring.currentFrame() <= frame) std::this_thread::yield();
+			ring.retireFrame(frame);
+		}
+	});
+
+	for (uint64_t frame = 0; frame < NUM_FRAMES; frame++) {
+		if (frame > 0) {
+			// Wait for the consumer, keep at most 3 frames in flight
+			while (ring.numFramesInFlight() >= 3) std::this_thread::yield();
+			ring.beginFrame();
+		}
+
+		std::thread producers[NUM_PRODUCERS];
+		for (uint32_t t = 0; t < NUM_PRODUCERS; t++) {
+			producers[t] = std::thread([&, t]() {
+				for (uint32_t i = 0; i < NUM_ALLOCS_PER_THREAD; i++) {
+					uint8_t* ptr = (uint8_t*)ring.allocate(sfz_dbg(""), ALLOC_SIZE, 32);
+					if (ptr == nullptr) continue;
+					memset(ptr, int(uint8_t(frame)), ALLOC_SIZE);
+					allocs[frame][t][i] = ptr;
+				}
+			});
+		}
+		for (std::thread& producer : producers) producer.join();
+		numFramesProduced.store(frame + 1, std::memory_order_release);
+	}
+
+	consumer.join();
+	REQUIRE(allValid.load());
+	REQUIRE(ring.oldestUnretiredFrame() == NUM_FRAMES - 1);
+	ring.destroy();
+	getDefaultAllocator()->deallocate(memory);
+}
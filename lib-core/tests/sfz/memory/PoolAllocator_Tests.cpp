@@ -0,0 +1,151 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/PushWarnings.hpp"
+#include "catch2/catch.hpp"
+#include "sfz/PopWarnings.hpp"
+
+#include "sfz/Context.hpp"
+#include "sfz/Logging.hpp"
+#include "sfz/containers/DynArray.hpp"
+#include "sfz/memory/DebugAllocator.hpp"
+#include "sfz/memory/MemoryUtils.hpp"
+#include "sfz/memory/PoolAllocator.hpp"
+#include "sfz/memory/SmartPointers.hpp"
+
+using namespace sfz;
+
+TEST_CASE("PoolAllocator: Stack based memory", "[sfz::PoolAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	// Create default-constructed pool without memory
+	PoolAllocator pool;
+	REQUIRE(pool.capacity() == 0);
+	REQUIRE(pool.numSlots() == 0);
+	REQUIRE(pool.numSlotsInUse() == 0);
+	REQUIRE(pool.numSlotsHighWaterMark() == 0);
+
+	// Initialize pool with memory
+	constexpr uint64_t SLOT_SIZE = 12;
+	constexpr uint32_t NUM_SLOTS = 4;
+	REQUIRE(PoolAllocator::memoryRequirementBytes(SLOT_SIZE, NUM_SLOTS, 16) == 64);
+	alignas(32) uint8_t memoryHeap[64];
+	pool.init(SLOT_SIZE, NUM_SLOTS, 16, memoryHeap, sizeof(memoryHeap));
+	REQUIRE(pool.capacity() == 64);
+	REQUIRE(pool.slotSize() == 16);
+	REQUIRE(pool.slotAlignment() == 16);
+	REQUIRE(pool.numSlots() == NUM_SLOTS);
+	REQUIRE(pool.numSlotsInUse() == 0);
+	REQUIRE(pool.numSlotsHighWaterMark() == 0);
+
+	// Do some allocations
+	void* first = pool.allocate(sfz_dbg(""), 12, 4);
+	REQUIRE(first == &memoryHeap[0]);
+	void* second = pool.allocate(sfz_dbg(""), 16, 16);
+	REQUIRE(second == &memoryHeap[16]);
+	void* third = pool.allocate(sfz_dbg(""), 1, 1);
+	REQUIRE(third == &memoryHeap[32]);
+	REQUIRE(pool.numSlotsInUse() == 3);
+	REQUIRE(pool.numSlotsHighWaterMark() == 3);
+	REQUIRE(pool.owns(second));
+	REQUIRE(!pool.owns(&memoryHeap[64]));
+
+	// Too large allocations should fail
+	SFZ_INFO("PoolAllocator Tests", "The warnings below are expected, ignore");
+	REQUIRE(pool.allocate(sfz_dbg(""), 17, 16) == nullptr);
+	REQUIRE(pool.allocate(sfz_dbg(""), 4, 32) == nullptr);
+	REQUIRE(pool.numSlotsInUse() == 3);
+
+	// Deallocated slots should be reused (LIFO)
+	pool.deallocate(second);
+	pool.deallocate(first);
+	REQUIRE(pool.numSlotsInUse() == 1);
+	REQUIRE(pool.numSlotsHighWaterMark() == 3);
+	REQUIRE(pool.allocate(sfz_dbg(""), 4, 4) == first);
+	REQUIRE(pool.allocate(sfz_dbg(""), 4, 4) == second);
+	REQUIRE(pool.numSlotsHighWaterMark() == 3);
+
+	// Use last untouched slot, then run out of memory
+	void* fourth = pool.allocate(sfz_dbg(""), 4, 4);
+	REQUIRE(fourth == &memoryHeap[48]);
+	REQUIRE(pool.numSlotsInUse() == 4);
+	REQUIRE(pool.numSlotsHighWaterMark() == 4);
+	REQUIRE(pool.allocate(sfz_dbg(""), 4, 4) == nullptr);
+
+	// Deallocating nullptr is a no-op
+	pool.deallocate(nullptr);
+	REQUIRE(pool.numSlotsInUse() == 4);
+
+	// Reset the pool
+	pool.reset();
+	REQUIRE(pool.numSlotsInUse() == 0);
+	REQUIRE(pool.numSlotsHighWaterMark() == 0);
+	REQUIRE(pool.allocate(sfz_dbg(""), 4, 4) == &memoryHeap[0]);
+}
+
+TEST_CASE("PoolAllocator: Owned memory", "[sfz::PoolAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	DebugAllocator debugAllocator("debug");
+	{
+		PoolAllocator pool;
+		pool.init(sizeof(uint64_t), 128, 32, &debugAllocator, sfz_dbg("pool"));
+		REQUIRE(debugAllocator.numAllocations() == 1);
+		REQUIRE(pool.slotSize() == 32);
+		REQUIRE(pool.numSlots() == 128);
+
+		for (uint32_t i = 0; i < 128; i++) {
+			void* ptr = pool.allocate(sfz_dbg(""), sizeof(uint64_t));
+			REQUIRE(ptr != nullptr);
+			REQUIRE(isAligned(ptr, 32));
+		}
+		REQUIRE(pool.numSlotsInUse() == 128);
+	}
+	REQUIRE(debugAllocator.numAllocations() == 0);
+}
+
+TEST_CASE("PoolAllocator: Used by containers and smart pointers", "[sfz::PoolAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	PoolAllocator pool;
+	pool.init(256, 16, 32, getDefaultAllocator(), sfz_dbg("pool"));
+
+	SECTION("DynArray") {
+		DynArray<uint32_t> arr(8, &pool, sfz_dbg(""));
+		REQUIRE(pool.numSlotsInUse() == 1);
+		for (uint32_t i = 0; i < 40; i++) arr.add(i);
+		REQUIRE(arr.size() == 40);
+		REQUIRE(pool.numSlotsInUse() == 1);
+		for (uint32_t i = 0; i < 40; i++) REQUIRE(arr[i] == i);
+		arr.destroy();
+		REQUIRE(pool.numSlotsInUse() == 0);
+	}
+	SECTION("SharedPtr & UniquePtr") {
+		{
+			SharedPtr<uint64_t> shared = makeShared<uint64_t>(&pool, 42u);
+			UniquePtr<uint64_t> unique = makeUnique<uint64_t>(&pool, 43u);
+			REQUIRE(*shared == 42);
+			REQUIRE(*unique == 43);
+			REQUIRE(pool.numSlotsInUse() == 2); // SharedPtr stores its state next to the object
+		}
+		REQUIRE(pool.numSlotsInUse() == 0);
+	}
+}
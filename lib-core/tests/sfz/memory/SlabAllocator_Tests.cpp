@@ -0,0 +1,182 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/PushWarnings.hpp"
+#include "catch2/catch.hpp"
+#include "sfz/PopWarnings.hpp"
+
+#include "sfz/Context.hpp"
+#include "sfz/Logging.hpp"
+#include "sfz/containers/DynArray.hpp"
+#include "sfz/memory/MemoryUtils.hpp"
+#include "sfz/memory/SlabAllocator.hpp"
+
+using namespace sfz;
+
+TEST_CASE("SlabAllocator: Size classes", "[sfz::SlabAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	SlabAllocator slab;
+	slab.init(getDefaultAllocator(), 1024 * 1024);
+	REQUIRE(slab.parentAllocator() == getDefaultAllocator());
+	REQUIRE(slab.slabMemoryCapacity() == 1024 * 1024);
+
+	// Class is chosen from both size and alignment
+	REQUIRE(slab.sizeClassBlockSize(1, 1) == 8);
+	REQUIRE(slab.sizeClassBlockSize(8, 8) == 8);
+	REQUIRE(slab.sizeClassBlockSize(9, 8) == 16);
+	REQUIRE(slab.sizeClassBlockSize(20, 4) == 24);
+	REQUIRE(slab.sizeClassBlockSize(20, 16) == 32);
+	REQUIRE(slab.sizeClassBlockSize(8, 32) == 32);
+	REQUIRE(slab.sizeClassBlockSize(33, 16) == 48);
+	REQUIRE(slab.sizeClassBlockSize(33, 32) == 64);
+	REQUIRE(slab.sizeClassBlockSize(200, 64) == 256);
+	REQUIRE(slab.sizeClassBlockSize(300, 8) == 320);
+	REQUIRE(slab.sizeClassBlockSize(512, 512) == 512);
+	REQUIRE(slab.sizeClassBlockSize(513, 8) == 0);
+	REQUIRE(slab.sizeClassBlockSize(8, 1024) == 0);
+
+	// Small allocations are packed tightly
+	uint8_t* a = (uint8_t*)slab.allocate(sfz_dbg(""), 8, 8);
+	uint8_t* b = (uint8_t*)slab.allocate(sfz_dbg(""), 8, 8);
+	REQUIRE(b == a + 8);
+	REQUIRE(slab.numSmallAllocations() == 2);
+	REQUIRE(slab.numSmallBytesAllocated() == 16);
+	REQUIRE(slab.numSlabsInUse() == 1);
+	REQUIRE(slab.ownsSlabMemory(a));
+
+	// Freed block is reused
+	slab.deallocate(a);
+	REQUIRE(slab.allocate(sfz_dbg(""), 5, 4) == a);
+
+	// Large allocations go to parent
+	void* large = slab.allocate(sfz_dbg(""), 4096, 32);
+	REQUIRE(large != nullptr);
+	REQUIRE(!slab.ownsSlabMemory(large));
+	REQUIRE(slab.numSmallAllocations() == 2);
+	slab.deallocate(large);
+
+	// Extend in place within size class
+	uint8_t* c = (uint8_t*)slab.allocate(sfz_dbg(""), 40, 16);
+	REQUIRE(slab.tryExtendInPlace(c, 40, 48));
+	REQUIRE(!slab.tryExtendInPlace(c, 48, 49));
+
+	slab.deallocate(a);
+	slab.deallocate(b);
+	slab.deallocate(c);
+	REQUIRE(slab.numSmallAllocations() == 0);
+	REQUIRE(slab.numSlabsInUse() == 0);
+	slab.destroy();
+}
+
+TEST_CASE("SlabAllocator: Many allocations", "[sfz::SlabAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	SlabAllocator slab;
+	slab.init(getDefaultAllocator(), 4 * 1024 * 1024);
+
+	constexpr uint32_t NUM_LIVE = 4096;
+	DynArray<uint8_t*> live(NUM_LIVE, getDefaultAllocator(), sfz_dbg(""));
+	DynArray<uint32_t> sizes(NUM_LIVE, getDefaultAllocator(), sfz_dbg(""));
+	live.add((uint8_t*)nullptr, NUM_LIVE);
+	sizes.add(uint32_t(0), NUM_LIVE);
+
+	uint32_t rng = 1337;
+	bool allCorrect = true;
+	for (uint32_t i = 0; i < 100000; i++) {
+		rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+		uint32_t idx = rng % NUM_LIVE;
+		if (live[idx] != nullptr) {
+			for (uint32_t j = 0; j < sizes[idx]; j++) allCorrect = allCorrect && live[idx][j] == uint8_t(idx);
+			slab.deallocate(live[idx]);
+		}
+		uint32_t size = 1 + (rng >> 8) % 600;
+		uint64_t alignment = uint64_t(1) << ((rng >> 20) % 7);
+		live[idx] = (uint8_t*)slab.allocate(sfz_dbg(""), size, alignment);
+		sizes[idx] = size;
+		allCorrect = allCorrect && live[idx] != nullptr && isAligned(live[idx], alignment);
+		for (uint32_t j = 0; j < size; j++) live[idx][j] = uint8_t(idx);
+	}
+	REQUIRE(allCorrect);
+
+	for (uint8_t* ptr : live) slab.deallocate(ptr);
+	REQUIRE(slab.numSmallAllocations() == 0);
+	REQUIRE(slab.numSmallBytesAllocated() == 0);
+	REQUIRE(slab.numSlabsInUse() == 0);
+}
+
+TEST_CASE("SlabAllocator: Sized deallocation", "[sfz::SlabAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	SlabAllocator slab;
+	slab.init(getDefaultAllocator(), 1024 * 1024);
+
+	void* small = slab.allocate(sfz_dbg(""), 20, 4);
+	void* large = slab.allocate(sfz_dbg(""), 2000, 32);
+	REQUIRE(slab.ownsSlabMemory(small));
+	REQUIRE(!slab.ownsSlabMemory(large));
+	REQUIRE(slab.numSmallAllocations() == 1);
+
+	// Grows within the size class, but never shrinks since the class is derived from the size
+	REQUIRE(slab.tryExtendInPlace(small, 20, 24));
+	REQUIRE(!slab.tryExtendInPlace(small, 24, 25));
+	REQUIRE(!slab.tryExtendInPlace(small, 24, 8));
+
+	slab.deallocateSized(small, 24, 4);
+	slab.deallocateSized(large, 2000, 32);
+	REQUIRE(slab.numSmallAllocations() == 0);
+	REQUIRE(slab.numSlabsInUse() == 0);
+
+	// Containers deallocate sized
+	{
+		DynArray<uint32_t> arr(0, &slab, sfz_dbg(""));
+		for (uint32_t i = 0; i < 100; i++) arr.add(i);
+		REQUIRE(slab.numSmallAllocations() == 1);
+	}
+	REQUIRE(slab.numSmallAllocations() == 0);
+}
+
+TEST_CASE("SlabAllocator: Out of slabs", "[sfz::SlabAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	SlabAllocator slab;
+	slab.init(getDefaultAllocator(), 64 * 1024); // 16 slabs
+
+	// Fill all slabs with 512 byte blocks, 8 per slab
+	void* ptrs[128] = {};
+	for (uint32_t i = 0; i < 128; i++) {
+		ptrs[i] = slab.allocate(sfz_dbg(""), 512, 8);
+		REQUIRE(ptrs[i] != nullptr);
+	}
+	REQUIRE(slab.numSlabsInUse() == 16);
+	SFZ_INFO("SlabAllocator Tests", "The warning below is expected, ignore");
+	REQUIRE(slab.allocate(sfz_dbg(""), 8, 8) == nullptr);
+
+	// Emptied slab can be reused by another size class
+	for (uint32_t i = 0; i < 8; i++) slab.deallocate(ptrs[i]);
+	REQUIRE(slab.numSlabsInUse() == 15);
+	void* small = slab.allocate(sfz_dbg(""), 8, 8);
+	REQUIRE(small != nullptr);
+	slab.deallocate(small);
+	for (uint32_t i = 8; i < 128; i++) slab.deallocate(ptrs[i]);
+	REQUIRE(slab.numSlabsInUse() == 0);
+}
@@ -20,6 +20,8 @@
 #include "catch2/catch.hpp"
 #include "sfz/PopWarnings.hpp"
 
+#include "sfz/memory/DebugAllocator.hpp"
+#include "sfz/memory/MemoryUtils.hpp"
 #include "sfz/memory/SmartPointers.hpp"
 
 using namespace sfz;
@@ -244,3 +246,151 @@ TEST_CASE("Cast constructors", "[sfz::SmartPointers]")
 	REQUIRE(ptr3.allocator() == getDefaultAllocator());
 	REQUIRE(ptr3.refCount() == 1);
 }
+
+TEST_CASE("makeShared() single allocation", "[sfz::SmartPointers]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	DebugAllocator allocator("debug");
+	{
+		struct alignas(64) Aligned { int val; Aligned(int v) : val(v) {} };
+		SharedPtr<Aligned> ptr = makeShared<Aligned>(&allocator, 7);
+		REQUIRE(allocator.numAllocations() == 1);
+		REQUIRE(isAligned(ptr.get(), 64));
+		REQUIRE(ptr->val == 7);
+		REQUIRE(ptr.allocator() == &allocator);
+
+		SharedPtr<Aligned> copy = ptr;
+		REQUIRE(allocator.numAllocations() == 1);
+		REQUIRE(copy.refCount() == 2);
+
+		// Adopting an existing object requires a separate state
+		SharedPtr<Derived> adopted(allocator.newObject<Derived>(sfz_dbg(""), 3), &allocator);
+		REQUIRE(allocator.numAllocations() == 3);
+
+		// Last reference is a cast, still destroys the object created by makeShared()
+		SharedPtr<Base> base = makeShared<Derived>(&allocator, 4);
+		REQUIRE(allocator.numAllocations() == 4);
+		REQUIRE(base->val == 4);
+	}
+	REQUIRE(allocator.numAllocations() == 0);
+}
+
+TEST_CASE("LocalSharedPtr", "[sfz::SmartPointers]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	DebugAllocator allocator("debug");
+	{
+		LocalSharedPtr<Derived> derived = makeLocalShared<Derived>(&allocator, 5);
+		REQUIRE(allocator.numAllocations() == 1);
+		REQUIRE(derived->val == 5);
+		REQUIRE(derived.refCount() == 1);
+		{
+			LocalSharedPtr<Base> base = derived;
+			REQUIRE(derived.refCount() == 2);
+			REQUIRE(base.get() == derived.get());
+		}
+		REQUIRE(derived.refCount() == 1);
+
+		LocalSharedPtr<Base> fromUnique = makeUnique<Derived>(&allocator, 6);
+		REQUIRE(fromUnique->val == 6);
+		REQUIRE(fromUnique.refCount() == 1);
+		REQUIRE(allocator.numAllocations() == 3);
+	}
+	REQUIRE(allocator.numAllocations() == 0);
+}
+
+// IntrusivePtr tests
+// ------------------------------------------------------------------------------------------------
+
+class IntrusiveBase : public RefCounted<> {
+public:
+	int val = 0;
+	int* destroyedFlag = nullptr;
+	IntrusiveBase(int valIn, int* flag) : val(valIn), destroyedFlag(flag) {}
+	~IntrusiveBase() { *destroyedFlag += 1; }
+
+	IntrusivePtr<IntrusiveBase> self() { return IntrusivePtr<IntrusiveBase>(this); }
+};
+
+class IntrusiveDerived final : public IntrusiveBase {
+public:
+	uint64_t extra[4] = {};
+	IntrusiveDerived(int valIn, int* flag) : IntrusiveBase(valIn, flag) {}
+};
+
+class IntrusiveLocal final : public RefCounted<NonAtomicRefCount> {
+public:
+	int val = 0;
+	IntrusiveLocal(int valIn) : val(valIn) {}
+};
+
+TEST_CASE("Basic IntrusivePtr tests", "[sfz::IntrusivePtr]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	REQUIRE(sizeof(IntrusivePtr<IntrusiveBase>) == sizeof(void*));
+
+	DebugAllocator allocator("debug");
+	int flag = 0;
+	{
+		IntrusivePtr<IntrusiveBase> empty;
+		REQUIRE(empty == nullptr);
+		REQUIRE(empty.refCount() == 0);
+
+		IntrusivePtr<IntrusiveBase> ptr = makeIntrusive<IntrusiveBase>(&allocator, 3, &flag);
+		REQUIRE(ptr != nullptr);
+		REQUIRE(ptr->val == 3);
+		REQUIRE(ptr.refCount() == 1);
+		REQUIRE(ptr->refCountedAllocator() == &allocator);
+		REQUIRE(allocator.numAllocations() == 1);
+		{
+			IntrusivePtr<IntrusiveBase> copy = ptr;
+			REQUIRE(copy == ptr);
+			REQUIRE(ptr.refCount() == 2);
+
+			// New references can be created from a raw pointer to the object
+			IntrusivePtr<IntrusiveBase> fromThis = ptr->self();
+			REQUIRE(fromThis == ptr);
+			REQUIRE(ptr.refCount() == 3);
+		}
+		REQUIRE(ptr.refCount() == 1);
+
+		IntrusivePtr<IntrusiveBase> moved = std::move(ptr);
+		REQUIRE(ptr == nullptr);
+		REQUIRE(moved.refCount() == 1);
+		REQUIRE(flag == 0);
+	}
+	REQUIRE(flag == 1);
+	REQUIRE(allocator.numAllocations() == 0);
+}
+
+TEST_CASE("IntrusivePtr cast and policies", "[sfz::IntrusivePtr]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	DebugAllocator allocator("debug");
+	int flag = 0;
+	{
+		IntrusivePtr<IntrusiveDerived> derived =
+			makeIntrusive<IntrusiveDerived>(&allocator, 4, &flag);
+		IntrusivePtr<IntrusiveBase> base = derived;
+		REQUIRE(base.get() == derived.get());
+		REQUIRE(base.refCount() == 2);
+		derived.destroy();
+		REQUIRE(base.refCount() == 1);
+		REQUIRE(base->val == 4);
+		REQUIRE(flag == 0);
+
+		// Last reference is to base class, object is still destroyed as the derived type
+		base = nullptr;
+		REQUIRE(flag == 1);
+
+		IntrusivePtr<IntrusiveLocal> local = makeIntrusive<IntrusiveLocal>(&allocator, 5);
+		IntrusivePtr<IntrusiveLocal> localCopy = local;
+		REQUIRE(local.refCount() == 2);
+		REQUIRE(localCopy->val == 5);
+	}
+	REQUIRE(allocator.numAllocations() == 0);
+}
@@ -0,0 +1,174 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/PushWarnings.hpp"
+#include "catch2/catch.hpp"
+#include "sfz/PopWarnings.hpp"
+
+#include <chrono>
+#include <thread>
+
+#include "sfz/Context.hpp"
+#include "sfz/Logging.hpp"
+#include "sfz/containers/DynArray.hpp"
+#include "sfz/containers/HashMap.hpp"
+#include "sfz/memory/MemoryUtils.hpp"
+#include "sfz/memory/StandardAllocator.hpp"
+#include "sfz/memory/ThreadCachingAllocator.hpp"
+
+using namespace sfz;
+
+TEST_CASE("ThreadCachingAllocator: Sizes and alignments", "[sfz::ThreadCachingAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+	Allocator* allocator = getThreadCachingAllocator();
+	REQUIRE(allocator == getThreadCachingAllocator());
+
+	allocator->deallocate(nullptr);
+
+	const uint64_t sizes[] = { 0, 1, 15, 16, 17, 100, 128, 129, 1000, 4096, 20000, 32768, 32769, 100000 };
+	const uint64_t alignments[] = { 1, 8, 16, 32, 64, 256, 4096, 65536 };
+	for (uint64_t size : sizes) {
+		for (uint64_t alignment : alignments) {
+			uint8_t* ptrs[8] = {};
+			for (uint32_t i = 0; i < 8; i++) {
+				ptrs[i] = (uint8_t*)allocator->allocate(sfz_dbg(""), size, alignment);
+				REQUIRE(ptrs[i] != nullptr);
+				REQUIRE(isAligned(ptrs[i], alignment));
+				for (uint64_t j = 0; j < size; j++) ptrs[i][j] = uint8_t(i);
+			}
+			for (uint32_t i = 0; i < 8; i++) {
+				bool correct = true;
+				for (uint64_t j = 0; j < size; j++) correct = correct && ptrs[i][j] == uint8_t(i);
+				REQUIRE(correct);
+				allocator->deallocate(ptrs[i]);
+			}
+		}
+	}
+
+	// Freed blocks should be reused
+	void* first = allocator->allocate(sfz_dbg(""), 64, 32);
+	allocator->deallocate(first);
+	void* second = allocator->allocate(sfz_dbg(""), 64, 32);
+	REQUIRE(first == second);
+	allocator->deallocate(second);
+}
+
+TEST_CASE("ThreadCachingAllocator: Containers", "[sfz::ThreadCachingAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+	Allocator* allocator = getThreadCachingAllocator();
+
+	DynArray<uint32_t> arr(0, allocator, sfz_dbg(""));
+	for (uint32_t i = 0; i < 100000; i++) arr.add(i);
+	for (uint32_t i = 0; i < 100000; i++) REQUIRE(arr[i] == i);
+	arr.destroy();
+
+	HashMap<uint32_t, uint32_t> map(0, allocator);
+	for (uint32_t i = 0; i < 10000; i++) map.put(i, i * 3);
+	for (uint32_t i = 0; i < 10000; i++) REQUIRE(map[i] == i * 3);
+}
+
+TEST_CASE("ThreadCachingAllocator: Multiple threads", "[sfz::ThreadCachingAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+	Allocator* allocator = getThreadCachingAllocator();
+
+	constexpr uint32_t NUM_THREADS = 8;
+	constexpr uint32_t NUM_ALLOCS = 20000;
+
+	// Each thread allocates blocks and fills them with its id, half of them are freed directly and
+	// the other half are handed over to the main thread.
+	DynArray<uint8_t*> handedOver[NUM_THREADS];
+	bool allCorrect[NUM_THREADS] = {};
+	for (uint32_t i = 0; i < NUM_THREADS; i++) {
+		handedOver[i].init(NUM_ALLOCS / 2, getDefaultAllocator(), sfz_dbg(""));
+	}
+
+	std::thread threads[NUM_THREADS];
+	for (uint32_t i = 0; i < NUM_THREADS; i++) {
+		threads[i] = std::thread([&, i]() {
+			bool correct = true;
+			uint8_t* live[64] = {};
+			uint32_t liveSizes[64] = {};
+			for (uint32_t j = 0; j < NUM_ALLOCS; j++) {
+				uint32_t slot = (j * 31 + i) % 64;
+				if (live[slot] != nullptr) {
+					for (uint32_t k = 0; k < liveSizes[slot]; k++) {
+						correct = correct && live[slot][k] == uint8_t(i + 1);
+					}
+					if ((j & 1) == 0) allocator->deallocate(live[slot]);
+					else handedOver[i].add(live[slot]);
+				}
+				uint32_t size = 1 + ((j * 97 + i * 13) % 2048);
+				live[slot] = (uint8_t*)allocator->allocate(sfz_dbg(""), size, 16);
+				liveSizes[slot] = size;
+				correct = correct && live[slot] != nullptr;
+				if (live[slot] != nullptr) {
+					for (uint32_t k = 0; k < size; k++) live[slot][k] = uint8_t(i + 1);
+				}
+			}
+			for (uint8_t* ptr : live) allocator->deallocate(ptr);
+			allCorrect[i] = correct;
+		});
+	}
+	for (std::thread& thread : threads) thread.join();
+
+	for (uint32_t i = 0; i < NUM_THREADS; i++) {
+		REQUIRE(allCorrect[i]);
+		for (uint8_t* ptr : handedOver[i]) allocator->deallocate(ptr);
+	}
+}
+
+TEST_CASE("ThreadCachingAllocator: Benchmark", "[sfz::ThreadCachingAllocator][.benchmark]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	constexpr uint32_t NUM_ITERATIONS = 2000000;
+	constexpr uint32_t NUM_LIVE = 256;
+
+	auto runBenchmark = [](Allocator* allocator, uint32_t numThreads) -> double {
+		DynArray<std::thread> threads(numThreads, getDefaultAllocator(), sfz_dbg(""));
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < numThreads; i++) {
+			threads.add(std::thread([allocator, i]() {
+				void* live[NUM_LIVE] = {};
+				uint32_t rng = 0x9E3779B9u * (i + 1);
+				for (uint32_t j = 0; j < NUM_ITERATIONS; j++) {
+					rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+					uint32_t slot = rng % NUM_LIVE;
+					allocator->deallocate(live[slot]);
+					live[slot] = allocator->allocate(sfz_dbg(""), 16 + (rng >> 8) % 1024, 32);
+				}
+				for (void* ptr : live) allocator->deallocate(ptr);
+			}));
+		}
+		for (std::thread& thread : threads) thread.join();
+		auto after = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration<double, std::milli>(after - before).count();
+	};
+
+	const uint32_t numThreadsList[] = { 1, 2, 4, 8, 16 };
+	for (uint32_t numThreads : numThreadsList) {
+		double standardMs = runBenchmark(getStandardAllocator(), numThreads);
+		double cachingMs = runBenchmark(getThreadCachingAllocator(), numThreads);
+		SFZ_INFO("ThreadCachingAllocator Benchmark",
+			"%u threads, %u alloc/free pairs per thread: standard %.2f ms, thread-caching %.2f ms",
+			numThreads, NUM_ITERATIONS, standardMs, cachingMs);
+	}
+}
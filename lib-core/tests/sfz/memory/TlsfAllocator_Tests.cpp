@@ -0,0 +1,190 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/PushWarnings.hpp"
+#include "catch2/catch.hpp"
+#include "sfz/PopWarnings.hpp"
+
+#include "sfz/Context.hpp"
+#include "sfz/Logging.hpp"
+#include "sfz/containers/DynArray.hpp"
+#include "sfz/memory/MemoryUtils.hpp"
+#include "sfz/memory/TlsfAllocator.hpp"
+
+using namespace sfz;
+
+TEST_CASE("TlsfAllocator: Basic allocation and coalescing", "[sfz::TlsfAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	TlsfAllocator tlsf;
+	REQUIRE(tlsf.capacity() == 0);
+	REQUIRE(tlsf.allocate(sfz_dbg(""), 16) == nullptr);
+
+	constexpr uint64_t MEMORY_SIZE = 64 * 1024;
+	tlsf.init(MEMORY_SIZE, getDefaultAllocator(), sfz_dbg(""));
+	REQUIRE(tlsf.capacity() == MEMORY_SIZE);
+	REQUIRE(tlsf.numAllocations() == 0);
+	REQUIRE(tlsf.numBytesAllocated() == 0);
+	const uint64_t initialFree = tlsf.numBytesFree();
+	REQUIRE(initialFree == MEMORY_SIZE - 32);
+	REQUIRE(tlsf.largestFreeBlockBytes() == initialFree);
+	REQUIRE(tlsf.fragmentation() == 0.0f);
+
+	void* a = tlsf.allocate(sfz_dbg(""), 100, 16);
+	void* b = tlsf.allocate(sfz_dbg(""), 1, 16);
+	void* c = tlsf.allocate(sfz_dbg(""), 1000, 16);
+	REQUIRE(a != nullptr);
+	REQUIRE(b != nullptr);
+	REQUIRE(c != nullptr);
+	REQUIRE(tlsf.owns(a));
+	REQUIRE(tlsf.owns(b));
+	REQUIRE(tlsf.owns(c));
+	REQUIRE(tlsf.numAllocations() == 3);
+	REQUIRE(tlsf.numBytesAllocated() == 112 + 16 + 1008);
+
+	// Freeing middle block creates a hole, i.e. fragmentation
+	tlsf.deallocate(b);
+	REQUIRE(tlsf.numAllocations() == 2);
+	REQUIRE(tlsf.fragmentation() > 0.0f);
+	REQUIRE(tlsf.largestFreeBlockBytes() < tlsf.numBytesFree());
+
+	// Hole should be reused by allocation of same size
+	void* b2 = tlsf.allocate(sfz_dbg(""), 16, 16);
+	REQUIRE(b2 == b);
+	tlsf.deallocate(b2);
+
+	// Freeing everything should coalesce back into one block
+	tlsf.deallocate(a);
+	tlsf.deallocate(c);
+	REQUIRE(tlsf.numAllocations() == 0);
+	REQUIRE(tlsf.numBytesAllocated() == 0);
+	REQUIRE(tlsf.numBytesFree() == initialFree);
+	REQUIRE(tlsf.largestFreeBlockBytes() == initialFree);
+	REQUIRE(tlsf.fragmentation() == 0.0f);
+
+	// Allocations larger than the free memory fail
+	void* half = tlsf.allocate(sfz_dbg(""), initialFree / 2, 16);
+	REQUIRE(half != nullptr);
+	SFZ_INFO("TlsfAllocator Tests", "The warning below is expected, ignore");
+	REQUIRE(tlsf.allocate(sfz_dbg(""), initialFree / 2 + 16, 16) == nullptr);
+	tlsf.deallocate(half);
+
+	tlsf.allocate(sfz_dbg(""), 128, 16);
+	tlsf.reset();
+	REQUIRE(tlsf.numAllocations() == 0);
+	REQUIRE(tlsf.numBytesFree() == initialFree);
+
+	tlsf.destroy();
+	REQUIRE(tlsf.capacity() == 0);
+}
+
+TEST_CASE("TlsfAllocator: Alignment", "[sfz::TlsfAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	TlsfAllocator tlsf;
+	tlsf.init(256 * 1024, getDefaultAllocator(), sfz_dbg(""));
+	const uint64_t initialFree = tlsf.numBytesFree();
+
+	DynArray<void*> ptrs(0, getDefaultAllocator(), sfz_dbg(""));
+	const uint64_t alignments[] = { 1, 8, 16, 32, 64, 128, 256, 4096 };
+	for (uint32_t i = 0; i < 64; i++) {
+		uint64_t alignment = alignments[i % 8];
+		void* ptr = tlsf.allocate(sfz_dbg(""), 8 + i * 24, alignment);
+		REQUIRE(ptr != nullptr);
+		REQUIRE(isAligned(ptr, alignment));
+		ptrs.add(ptr);
+	}
+	for (void* ptr : ptrs) tlsf.deallocate(ptr);
+	REQUIRE(tlsf.numAllocations() == 0);
+	REQUIRE(tlsf.numBytesFree() == initialFree);
+	REQUIRE(tlsf.largestFreeBlockBytes() == initialFree);
+}
+
+TEST_CASE("TlsfAllocator: Extend in place", "[sfz::TlsfAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	TlsfAllocator tlsf;
+	tlsf.init(64 * 1024, getDefaultAllocator(), sfz_dbg(""));
+	const uint64_t initialFree = tlsf.numBytesFree();
+
+	void* a = tlsf.allocate(sfz_dbg(""), 256, 16);
+	void* b = tlsf.allocate(sfz_dbg(""), 256, 16);
+
+	// Last block can grow into the free memory after it
+	REQUIRE(tlsf.tryExtendInPlace(b, 256, 4096));
+	REQUIRE(tlsf.numBytesAllocated() == 256 + 4096);
+
+	// First block is followed by an allocated block, so it can only shrink
+	REQUIRE(!tlsf.tryExtendInPlace(a, 256, 512));
+	REQUIRE(tlsf.tryExtendInPlace(a, 256, 64));
+	REQUIRE(tlsf.numBytesAllocated() == 64 + 4096);
+	REQUIRE(tlsf.tryExtendInPlace(a, 64, 256));
+
+	// Reallocate moves block if it can't be extended
+	void* a2 = tlsf.reallocate(sfz_dbg(""), a, 256, 1024, 16);
+	REQUIRE(a2 != nullptr);
+	REQUIRE(a2 != a);
+
+	tlsf.deallocate(a2);
+	tlsf.deallocate(b);
+	REQUIRE(tlsf.numAllocations() == 0);
+	REQUIRE(tlsf.numBytesAllocated() == 0);
+	REQUIRE(tlsf.numBytesFree() == initialFree);
+	REQUIRE(tlsf.largestFreeBlockBytes() == initialFree);
+}
+
+TEST_CASE("TlsfAllocator: Random allocations", "[sfz::TlsfAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	TlsfAllocator tlsf;
+	tlsf.init(4 * 1024 * 1024, getDefaultAllocator(), sfz_dbg(""));
+	const uint64_t initialFree = tlsf.numBytesFree();
+
+	constexpr uint32_t NUM_LIVE = 512;
+	uint8_t* live[NUM_LIVE] = {};
+	uint32_t liveSizes[NUM_LIVE] = {};
+	uint32_t rng = 12345;
+	bool allCorrect = true;
+	for (uint32_t i = 0; i < 50000; i++) {
+		rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+		uint32_t slot = rng % NUM_LIVE;
+		if (live[slot] != nullptr) {
+			for (uint32_t j = 0; j < liveSizes[slot]; j++) {
+				allCorrect = allCorrect && live[slot][j] == uint8_t(slot);
+			}
+			tlsf.deallocate(live[slot]);
+		}
+		uint32_t size = 1 + (rng >> 12) % 4000;
+		uint64_t alignment = uint64_t(1) << ((rng >> 4) % 8);
+		live[slot] = (uint8_t*)tlsf.allocate(sfz_dbg(""), size, alignment);
+		liveSizes[slot] = size;
+		allCorrect = allCorrect && live[slot] != nullptr && isAligned(live[slot], alignment);
+		for (uint32_t j = 0; j < size; j++) live[slot][j] = uint8_t(slot);
+	}
+	REQUIRE(allCorrect);
+
+	for (uint8_t* ptr : live) tlsf.deallocate(ptr);
+	REQUIRE(tlsf.numAllocations() == 0);
+	REQUIRE(tlsf.numBytesAllocated() == 0);
+	REQUIRE(tlsf.numBytesFree() == initialFree);
+	REQUIRE(tlsf.largestFreeBlockBytes() == initialFree);
+}
@@ -0,0 +1,164 @@
+// Copyright (c) 2019 Peter Hillerström (skipifzero.com, peter@hstroem.se)
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+
+#include "sfz/PushWarnings.hpp"
+#include "catch2/catch.hpp"
+#include "sfz/PopWarnings.hpp"
+
+#include <thread>
+
+#include "sfz/Context.hpp"
+#include "sfz/containers/DynArray.hpp"
+#include "sfz/memory/ArenaAllocator.hpp"
+#include "sfz/memory/MemoryUtils.hpp"
+#include "sfz/memory/TrackingAllocator.hpp"
+
+using namespace sfz;
+
+TEST_CASE("TrackingAllocator: Per tag statistics", "[sfz::TrackingAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	TrackingAllocator tracker;
+	tracker.init(getDefaultAllocator(), 16);
+	REQUIRE(tracker.wrappedAllocator() == getDefaultAllocator());
+	REQUIRE(tracker.numTags() == 0);
+
+	const char* TAG_A = "TagA";
+	const char* TAG_B = "TagB";
+
+	void* a1 = tracker.allocate(DbgInfo(TAG_A, __FILE__, __LINE__), 100, 64);
+	void* a2 = tracker.allocate(DbgInfo(TAG_A, __FILE__, __LINE__), 1000, 8);
+	void* b1 = tracker.allocate(DbgInfo(TAG_B, __FILE__, __LINE__), 0, 32);
+	REQUIRE(isAligned(a1, 64));
+	REQUIRE(isAligned(a2, 8));
+	REQUIRE(tracker.numTags() == 2);
+
+	TrackingTagStats stats;
+	REQUIRE(tracker.tagStats(TAG_A, stats));
+	REQUIRE(stats.tag == TAG_A);
+	REQUIRE(stats.numAllocations == 2);
+	REQUIRE(stats.numLiveAllocations == 2);
+	REQUIRE(stats.liveBytes == 1100);
+	REQUIRE(stats.peakLiveBytes == 1100);
+	REQUIRE(stats.sizeHistogram[6] == 1); // 100 in [64, 128)
+	REQUIRE(stats.sizeHistogram[9] == 1); // 1000 in [512, 1024)
+
+	tracker.deallocate(a2);
+	REQUIRE(tracker.tagStats(TAG_A, stats));
+	REQUIRE(stats.numAllocations == 2);
+	REQUIRE(stats.numLiveAllocations == 1);
+	REQUIRE(stats.liveBytes == 100);
+	REQUIRE(stats.peakLiveBytes == 1100);
+	tracker.resetPeaks();
+	REQUIRE(tracker.tagStats(TAG_A, stats));
+	REQUIRE(stats.peakLiveBytes == 100);
+
+	REQUIRE(tracker.tagStats(TAG_B, stats));
+	REQUIRE(stats.numAllocations == 1);
+	REQUIRE(stats.liveBytes == 0);
+	REQUIRE(stats.sizeHistogram[0] == 1);
+	REQUIRE(!tracker.tagStats("NotUsed", stats));
+
+	TrackingTagStats snapshot[8];
+	REQUIRE(tracker.snapshot(snapshot, 8) == 2);
+	REQUIRE(tracker.snapshot(snapshot, 1) == 1);
+
+	tracker.deallocate(a1);
+	tracker.deallocate(b1);
+	tracker.deallocate(nullptr);
+
+	// Tags beyond the capacity of the table end up in the overflow tag
+	static const char TAGS[32] = {};
+	void* ptrs[32] = {};
+	for (uint32_t i = 0; i < 32; i++) ptrs[i] = tracker.allocate(DbgInfo(&TAGS[i], "", 0), 16, 32);
+	REQUIRE(tracker.numTags() == 17);
+	uint64_t totalAllocs = 0;
+	TrackingTagStats many[32];
+	uint32_t numStats = tracker.snapshot(many, 32);
+	REQUIRE(numStats == 17);
+	for (uint32_t i = 0; i < numStats; i++) totalAllocs += many[i].numAllocations;
+	REQUIRE(totalAllocs == 35);
+	for (void* ptr : ptrs) tracker.deallocate(ptr);
+
+	tracker.destroy();
+}
+
+TEST_CASE("TrackingAllocator: Extend in place", "[sfz::TrackingAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	constexpr uint64_t MEMORY_HEAP_SIZE = 64 * 1024;
+	alignas(32) static uint8_t memoryHeap[MEMORY_HEAP_SIZE];
+	ArenaAllocator arena;
+	arena.init(memoryHeap, MEMORY_HEAP_SIZE);
+
+	// Tag table is allocated from the arena, so array will be the last allocation in it
+	TrackingAllocator arenaTracker;
+	arenaTracker.init(&arena, 16);
+
+	DynArray<uint32_t> arr(8, &arenaTracker, sfz_dbg("TrackedArray"));
+	const uint32_t* dataBefore = arr.data();
+	for (uint32_t i = 0; i < 1000; i++) arr.add(i);
+	REQUIRE(arr.data() == dataBefore);
+
+	TrackingTagStats stats;
+	uint32_t numStats = arenaTracker.snapshot(&stats, 1);
+	REQUIRE(numStats == 1);
+	REQUIRE(stats.numAllocations == 1);
+	REQUIRE(stats.liveBytes == arr.capacity() * sizeof(uint32_t));
+	arr.destroy();
+	REQUIRE(arenaTracker.snapshot(&stats, 1) == 1);
+	REQUIRE(stats.liveBytes == 0);
+	REQUIRE(stats.numLiveAllocations == 0);
+}
+
+TEST_CASE("TrackingAllocator: Multiple threads", "[sfz::TrackingAllocator]")
+{
+	sfz::setContext(sfz::getStandardContext());
+
+	TrackingAllocator tracker;
+	tracker.init(getDefaultAllocator());
+
+	static const char TAGS[4] = {};
+	constexpr uint32_t NUM_THREADS = 8;
+	constexpr uint32_t NUM_ALLOCS = 10000;
+	std::thread threads[NUM_THREADS];
+	for (uint32_t i = 0; i < NUM_THREADS; i++) {
+		threads[i] = std::thread([&tracker, i]() {
+			void* live[16] = {};
+			for (uint32_t j = 0; j < NUM_ALLOCS; j++) {
+				tracker.deallocate(live[j % 16]);
+				live[j % 16] = tracker.allocate(DbgInfo(&TAGS[(i + j) % 4], "", 0), 64, 32);
+			}
+			for (void* ptr : live) tracker.deallocate(ptr);
+		});
+	}
+	for (std::thread& thread : threads) thread.join();
+
+	TrackingTagStats stats[4];
+	REQUIRE(tracker.snapshot(stats, 4) == 4);
+	uint64_t totalAllocs = 0;
+	for (const TrackingTagStats& s : stats) {
+		totalAllocs += s.numAllocations;
+		REQUIRE(s.numLiveAllocations == 0);
+		REQUIRE(s.liveBytes == 0);
+		REQUIRE(s.sizeHistogram[6] == s.numAllocations);
+	}
+	REQUIRE(totalAllocs == NUM_THREADS * NUM_ALLOCS);
+}